@@ -1048,6 +1048,14 @@ gtk_file_folder_base_init (gpointer g_class)
 		    g_cclosure_marshal_VOID__POINTER,
 		    G_TYPE_NONE, 1,
 		    G_TYPE_POINTER);
+      g_signal_new (I_("files-renamed"),
+		    iface_type,
+		    G_SIGNAL_RUN_LAST,
+		    G_STRUCT_OFFSET (GtkFolderIface, files_renamed),
+		    NULL, NULL,
+		    g_cclosure_marshal_VOID__POINTER,
+		    G_TYPE_NONE, 1,
+		    G_TYPE_POINTER);
       g_signal_new (I_("finished-loading"),
 		    iface_type,
 		    G_SIGNAL_RUN_LAST,
@@ -359,6 +359,10 @@ struct _GtkFolderIface
 			 GSList        *paths);
   void (*files_removed) (GtkFolder *monitor,
 			 GSList        *paths);
+  /* PATHS holds the old and the new file of each renamed file, one
+     after the other */
+  void (*files_renamed) (GtkFolder *monitor,
+			 GSList        *paths);
 
   /* Method / signal */
   gboolean (*is_finished_loading) (GtkFolder *folder);
@@ -88,6 +88,8 @@ struct GtkFolderGioClass
 			    GList     *paths);
   void (*files_changed)    (GtkFolderGio *folder,
 			    GList     *paths);
+  void (*files_renamed)    (GtkFolderGio *folder,
+			    GList     *paths);
   void (*finished_loading) (GtkFolderGio *folder);
   void (*deleted)          (GtkFolderGio *folder);
 };
@@ -1617,6 +1619,70 @@ query_created_file_info_callback (GObject      *source_object,
   gdk_threads_leave ();
 }
 
+typedef struct
+{
+  GtkFolder *folder;
+  GFile *old_file;
+} RenamedFileData;
+
+static void
+query_renamed_file_info_callback (GObject      *source_object,
+				  GAsyncResult *result,
+				  gpointer      user_data)
+{
+  RenamedFileData *data = user_data;
+  GFile *file = G_FILE (source_object);
+  GError *error = NULL;
+  GFileInfo *info;
+  GtkFolderGioPrivate *priv;
+  GSList *files;
+
+  info = g_file_query_info_finish (file, result, &error);
+
+  /* A cancelled query means that the folder is gone */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      g_object_unref (data->old_file);
+      g_slice_free (RenamedFileData, data);
+      return;
+    }
+
+  gdk_threads_enter ();
+
+  priv = GTK_FOLDER_GIO_GET_PRIVATE (data->folder);
+  g_hash_table_remove (priv->children, data->old_file);
+
+  if (error)
+    {
+      /* The new name is not there anymore, but the old one is gone
+	 too */
+      files = g_slist_prepend (NULL, data->old_file);
+      g_signal_emit_by_name (data->folder, "files-removed", files);
+      g_slist_free (files);
+
+      gdk_threads_leave ();
+
+      g_error_free (error);
+      g_object_unref (data->old_file);
+      g_slice_free (RenamedFileData, data);
+      return;
+    }
+
+  gtk_folder_gio_add_file (data->folder, file, info);
+
+  files = g_slist_prepend (NULL, file);
+  files = g_slist_prepend (files, data->old_file);
+  g_signal_emit_by_name (data->folder, "files-renamed", files);
+  g_slist_free (files);
+
+  g_object_unref (info);
+  gdk_threads_leave ();
+
+  g_object_unref (data->old_file);
+  g_slice_free (RenamedFileData, data);
+}
+
 static void
 directory_monitor_changed (GFileMonitor      *monitor,
 			   GFile             *file,
@@ -1636,6 +1702,25 @@ directory_monitor_changed (GFileMonitor      *monitor,
 
   switch (event)
     {
+#if GLIB_CHECK_VERSION (2, 46, 0)
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      {
+	/* Keep the row of the file, only its name changes */
+	RenamedFileData *renamed = g_slice_new (RenamedFileData);
+
+	renamed->folder = GTK_FOLDER (folder);
+	renamed->old_file = g_object_ref (file);
+	g_file_query_info_async (other_file,
+				 priv->attributes,
+				 G_FILE_QUERY_INFO_NONE,
+				 G_PRIORITY_DEFAULT,
+				 priv->cancellable,
+				 query_renamed_file_info_callback,
+				 renamed);
+      }
+      break;
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+#endif
     case G_FILE_MONITOR_EVENT_CREATED:
       g_file_query_info_async (file,
 			       priv->attributes,
@@ -1645,6 +1730,9 @@ directory_monitor_changed (GFileMonitor      *monitor,
 			       query_created_file_info_callback,
 			       folder);
       break;
+#if GLIB_CHECK_VERSION (2, 46, 0)
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+#endif
     case G_FILE_MONITOR_EVENT_DELETED:
       if (g_file_equal (file, priv->folder_file))
 	g_signal_emit_by_name (folder, "deleted");
@@ -1732,7 +1820,13 @@ gtk_folder_gio_constructed (GObject *object)
   GError *error = NULL;
 
   priv = GTK_FOLDER_GIO_GET_PRIVATE (object);
+#if GLIB_CHECK_VERSION (2, 46, 0)
+  /* Renames within the folder come as one event instead of a
+     deletion and a creation */
+  priv->directory_monitor = g_file_monitor_directory (priv->folder_file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+#else
   priv->directory_monitor = g_file_monitor_directory (priv->folder_file, G_FILE_MONITOR_NONE, NULL, &error);
+#endif
 
   if (error)
     {
@@ -128,6 +128,8 @@ struct _HildonFileChooserDialogPrivate {
     GtkWidget *folder_button;
     HildonFileSelection *filetree;
     HildonFileSystemModel *model;
+    /* Set if the model was given to us and may have other users */
+    gboolean shared_model;
     GtkSizeGroup *caption_size_group;
     GtkSizeGroup *value_size_group;
 
@@ -1316,6 +1318,19 @@ static void build_ui(HildonFileChooserDialog * self)
     default:
         g_assert_not_reached();
     };
+
+    /* The content pane of a hidden file tree is never looked at, so
+       there is no point in keeping the models of folders it went
+       through */
+    _hildon_file_selection_set_view_cache_size(priv->filetree,
+        GTK_WIDGET_VISIBLE(priv->filetree) ? VIEW_CACHE_SIZE_DEFAULT : 0);
+
+    /* Huge folders only get rows as far as the content pane is
+       scrolled.  Other users of a model given to us would miss the
+       rest. */
+    _hildon_file_selection_set_windowed(priv->filetree,
+        GTK_WIDGET_VISIBLE(priv->filetree) && !priv->shared_model);
+
     /* according the spec of Fremantle File management, 
        this function is changed */
     update_folder_button_visibility(priv);
@@ -1946,7 +1961,10 @@ static void hildon_file_chooser_dialog_set_property(GObject * object,
         g_assert(priv->model == NULL || g_value_get_object(value) == NULL);
         if (!priv->model) {
             if ((priv->model = g_value_get_object(value)) != NULL)
+            {
                 g_object_ref(priv->model);
+                priv->shared_model = TRUE;
+            }
         }
         break;
     case PROP_FOLDER_BUTTON:
@@ -46,6 +46,9 @@ G_BEGIN_DECLS
 /* If environment doesn't define, use this */
 #define MAX_FILENAME_LENGTH_DEFAULT 255
 
+/* How many recently visited folders keep their content pane models */
+#define VIEW_CACHE_SIZE_DEFAULT 4
+
 /* Default weights for sorting operation. Negative weight informs
    that only single sorting criteria (=name) is used. */
 #define SORT_WEIGHT_FILE   10
@@ -60,12 +63,109 @@ G_BEGIN_DECLS
 #define SORT_WEIGHT_SMB           -14
 #define SORT_WEIGHT_UPNP          -13
 
+/* Packed row state, see HildonFileSystemModelRow.
+   The low byte holds booleans, the second byte the
+   HildonFileSystemModelItemType and the upper half the sort weight. */
+#define ROW_FLAG_VALID          (1 << 0)
+#define ROW_FLAG_IS_FOLDER      (1 << 1)
+#define ROW_FLAG_HAS_LOCAL_PATH (1 << 2)
+#define ROW_FLAG_IS_AVAILABLE   (1 << 3)
+#define ROW_FLAG_IS_HIDDEN      (1 << 4)
+#define ROW_FLAG_IS_READONLY    (1 << 5)
+#define ROW_FLAG_IS_UPNP        (1 << 6) /* Below $UPNP_ROOT */
+
+#define ROW_FLAGS_TYPE_SHIFT        8
+#define ROW_FLAGS_SORT_WEIGHT_SHIFT 16
+
+#define ROW_FLAGS_TYPE(flags) \
+  ((HildonFileSystemModelItemType) (((flags) >> ROW_FLAGS_TYPE_SHIFT) & 0xff))
+#define ROW_FLAGS_SORT_WEIGHT(flags) \
+  ((gint) (gint16) ((flags) >> ROW_FLAGS_SORT_WEIGHT_SHIFT))
+
 enum HildonFileSystemModelPrivateColumns {
 	PRIV_COLUMN_DISPLAY_TEXT = HILDON_FILE_SYSTEM_MODEL_NUM_COLUMNS,
 	PRIV_COLUMN_DISPLAY_ATTRS,
+	PRIV_COLUMN_SEARCH_NAME,
 	NUM_COLUMNS,
 };
 
+/* In hildon-file-system-model.c
+ */
+
+/* Cached fields of a model row.  The GFile and the strings belong to
+   the model and are only valid until the row changes. */
+typedef struct {
+  guint32 flags;
+  GFile *file;
+  const gchar *file_name;
+  const gchar *sort_key;
+  const gchar *mime_type;
+  gint64 size;
+  gint64 mtime;
+} HildonFileSystemModelRow;
+
+void _hildon_file_system_model_peek_row (HildonFileSystemModel *model,
+                                         GtkTreeIter *iter,
+                                         HildonFileSystemModelRow *row);
+guint32 _hildon_file_system_model_peek_row_flags (HildonFileSystemModel *model,
+                                                  GtkTreeIter *iter,
+                                                  GFile **file);
+void _hildon_file_system_model_peek_search_names (HildonFileSystemModel *model,
+                                                  GtkTreeIter *iter,
+                                                  const gchar **name,
+                                                  const gchar **display_text);
+gboolean
+_hildon_file_system_model_get_filter_result (HildonFileSystemModel *model,
+                                             GtkTreeIter *iter,
+                                             guint generation,
+                                             gboolean *result);
+void
+_hildon_file_system_model_set_filter_result (HildonFileSystemModel *model,
+                                             GtkTreeIter *iter,
+                                             guint generation,
+                                             gboolean result);
+gint _hildon_file_system_model_get_n_folders (HildonFileSystemModel *model,
+                                             GtkTreeIter *parent);
+gboolean
+_hildon_file_system_model_iter_nth_folder (HildonFileSystemModel *model,
+                                           GtkTreeIter *iter,
+                                           GtkTreeIter *parent,
+                                           gint n);
+gint
+_hildon_file_system_model_get_folder_position (HildonFileSystemModel *model,
+                                               GtkTreeIter *iter);
+void
+_hildon_file_system_model_get_change_counts (HildonFileSystemModel *model,
+                                             guint *queued,
+                                             guint *emitted,
+                                             guint *flushes);
+gint _hildon_file_system_model_compare_rows (const HildonFileSystemModelRow *a,
+                                             const HildonFileSystemModelRow *b,
+                                             HildonFileSelectionSortKey key,
+                                             GtkSortType order);
+void _hildon_file_system_model_set_sort (HildonFileSystemModel *model,
+                                         HildonFileSelectionSortKey key,
+                                         GtkSortType order);
+void _hildon_file_system_model_unset_sort (HildonFileSystemModel *model);
+void
+_hildon_file_system_model_window_children (HildonFileSystemModel *model,
+                                           GtkTreeIter *parent,
+                                           guint size);
+void
+_hildon_file_system_model_unwindow_children (HildonFileSystemModel *model,
+                                             GtkTreeIter *parent);
+gboolean
+_hildon_file_system_model_grow_children (HildonFileSystemModel *model,
+                                         GtkTreeIter *parent,
+                                         guint n);
+void
+_hildon_file_system_model_add_record_files (HildonFileSystemModel *model,
+                                            GtkTreeIter *parent,
+                                            GPtrArray *files);
+void
+_hildon_file_system_model_set_max_device_loads (HildonFileSystemModel *model,
+                                                guint n);
+
 /* In hildon-file-selection.c
  */
 
@@ -83,7 +183,21 @@ GFile *_hildon_file_selection_get_current_folder_path(HildonFileSelection *self)
 
 GSList *_hildon_file_selection_get_selected_files (HildonFileSelection
 						   *self);
+GPtrArray *
+_hildon_file_selection_get_selected_file_array (HildonFileSelection *self);
+gboolean _hildon_file_selection_select_range (HildonFileSelection *self,
+                                              GtkTreeIter *first,
+                                              GtkTreeIter *last);
+void _hildon_file_selection_invert_selection (HildonFileSelection *self);
 void _hildon_file_selection_realize_help (HildonFileSelection *self);
+void _hildon_file_selection_set_view_cache_size (HildonFileSelection *self,
+                                                 guint size);
+gboolean _hildon_file_selection_view_cache_has_folder (HildonFileSelection *self,
+                                                       GtkTreeIter *folder);
+void _hildon_file_selection_set_windowed (HildonFileSelection *self,
+                                          gboolean windowed);
+void _hildon_file_selection_set_grid (HildonFileSelection *self,
+                                      gboolean grid);
 
 
 G_END_DECLS
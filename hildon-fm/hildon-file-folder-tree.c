@@ -0,0 +1,1020 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileFolderTree
+ *
+ * The tree is made of levels, one for every folder whose children
+ * have been asked for.  A level holds an iter of the model for every
+ * visible folder among those children, in model order, and is found
+ * from the row of its parent through LEVELS.  A level only exists
+ * while its parent is listed, so the parent of every level but the
+ * top one can be found in the level above.  Iters of the tree carry
+ * the level and an index into it and are invalidated by every
+ * structural change.
+ *
+ * Rows of the model are told apart by their user_data, which is
+ * unique since the iters of the model persist.
+ */
+
+#include "config.h"
+
+#include "hildon-file-folder-tree.h"
+#include "hildon-file-common-private.h"
+
+typedef struct _FolderLevel FolderLevel;
+
+struct _FolderLevel
+{
+  GtkTreeIter parent;         /* in the model, unused for the top level */
+  FolderLevel *parent_level;  /* NULL for the top level */
+  GArray *folders;            /* GtkTreeIter of the model, in model order */
+};
+
+struct _HildonFileFolderTreePrivate
+{
+  GtkTreeModel *model;
+  gint stamp;
+
+  FolderLevel *root;          /* NULL until first asked for */
+  GHashTable *levels;         /* row of the model -> FolderLevel */
+  GHashTable *listed;         /* row of the model -> FolderLevel that
+                                 lists it */
+
+  GtkTreeModelFilterVisibleFunc visible_func;
+  gpointer visible_data;
+  GDestroyNotify visible_destroy;
+};
+
+static void hildon_file_folder_tree_iface_init(GtkTreeModelIface *iface);
+static void hildon_file_folder_tree_drag_source_init(GtkTreeDragSourceIface
+                                                     *iface);
+
+/* Note! G_IMPLEMENT_INTERFACE macros together form the 5th parameter for
+   G_DEFINE_TYPE_EXTENDED */
+G_DEFINE_TYPE_EXTENDED(HildonFileFolderTree, hildon_file_folder_tree,
+                       G_TYPE_OBJECT, 0,
+                       G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+                                             hildon_file_folder_tree_iface_init)
+                       G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_DRAG_SOURCE,
+                                             hildon_file_folder_tree_drag_source_init))
+
+#define FOLDER(level, k) (&g_array_index ((level)->folders, GtkTreeIter, (k)))
+#define ROW_KEY(iter) ((iter)->user_data)
+
+/* Levels */
+
+static gint
+find_folder (FolderLevel *level, GtkTreeIter *iter)
+{
+  guint k;
+
+  for (k = 0; k < level->folders->len; k++)
+    if (ROW_KEY (FOLDER (level, k)) == ROW_KEY (iter))
+      return k;
+
+  return -1;
+}
+
+static FolderLevel *
+lookup_level (HildonFileFolderTreePrivate *priv, GtkTreeIter *parent)
+{
+  if (parent == NULL)
+    return priv->root;
+
+  return g_hash_table_lookup (priv->levels, ROW_KEY (parent));
+}
+
+static gboolean
+folder_is_visible (HildonFileFolderTreePrivate *priv, GtkTreeIter *iter)
+{
+  if (priv->visible_func == NULL)
+    return TRUE;
+
+  return priv->visible_func (priv->model, iter, priv->visible_data);
+}
+
+/* Sets POSITION to the index of ITER among the folders of its parent
+   in the model.  Files are turned away here, by a flag test. */
+static gboolean
+row_is_visible (HildonFileFolderTreePrivate *priv, GtkTreeIter *iter,
+                gint *position)
+{
+  *position = _hildon_file_system_model_get_folder_position
+    (HILDON_FILE_SYSTEM_MODEL (priv->model), iter);
+
+  return *position >= 0 && folder_is_visible (priv, iter);
+}
+
+static FolderLevel *
+level_new (HildonFileFolderTree *self, FolderLevel *parent_level,
+           GtkTreeIter *parent)
+{
+  HildonFileFolderTreePrivate *priv = self->priv;
+  HildonFileSystemModel *model = HILDON_FILE_SYSTEM_MODEL (priv->model);
+  FolderLevel *level;
+  GtkTreeIter iter;
+  gint i, n;
+
+  level = g_new0 (FolderLevel, 1);
+  level->parent_level = parent_level;
+  level->folders = g_array_new (FALSE, FALSE, sizeof (GtkTreeIter));
+
+  n = _hildon_file_system_model_get_n_folders (model, parent);
+  for (i = 0; i < n; i++)
+    if (_hildon_file_system_model_iter_nth_folder (model, &iter, parent, i)
+        && folder_is_visible (priv, &iter))
+      {
+        g_array_append_val (level->folders, iter);
+        g_hash_table_insert (priv->listed, ROW_KEY (&iter), level);
+      }
+
+  if (parent)
+    {
+      level->parent = *parent;
+      g_hash_table_insert (priv->levels, ROW_KEY (parent), level);
+    }
+  else
+    priv->root = level;
+
+  return level;
+}
+
+static void
+level_free (HildonFileFolderTreePrivate *priv, FolderLevel *level)
+{
+  FolderLevel *child;
+  guint k;
+
+  for (k = 0; k < level->folders->len; k++)
+    {
+      if ((child = lookup_level (priv, FOLDER (level, k))) != NULL)
+        level_free (priv, child);
+      g_hash_table_remove (priv->listed, ROW_KEY (FOLDER (level, k)));
+    }
+
+  if (level->parent_level)
+    g_hash_table_remove (priv->levels, ROW_KEY (&level->parent));
+  else
+    priv->root = NULL;
+
+  g_array_free (level->folders, TRUE);
+  g_free (level);
+}
+
+static FolderLevel *
+get_root_level (HildonFileFolderTree *self)
+{
+  if (self->priv->root == NULL)
+    return level_new (self, NULL, NULL);
+
+  return self->priv->root;
+}
+
+static FolderLevel *
+get_child_level (HildonFileFolderTree *self, FolderLevel *level, gint k)
+{
+  FolderLevel *child = lookup_level (self->priv, FOLDER (level, k));
+
+  if (child == NULL)
+    child = level_new (self, level, FOLDER (level, k));
+
+  return child;
+}
+
+static GtkTreePath *
+level_get_path (FolderLevel *level, gint k)
+{
+  GtkTreePath *path = gtk_tree_path_new ();
+
+  gtk_tree_path_prepend_index (path, k);
+  for (; level->parent_level; level = level->parent_level)
+    gtk_tree_path_prepend_index (path, find_folder (level->parent_level,
+                                                    &level->parent));
+
+  return path;
+}
+
+/* Signals */
+
+static void
+emit_row_inserted (HildonFileFolderTree *self, FolderLevel *level, gint k)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  iter.stamp = self->priv->stamp;
+  iter.user_data = level;
+  iter.user_data2 = GINT_TO_POINTER (k);
+  path = level_get_path (level, k);
+  gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+static void
+emit_row_changed (HildonFileFolderTree *self, FolderLevel *level, gint k)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  iter.stamp = self->priv->stamp;
+  iter.user_data = level;
+  iter.user_data2 = GINT_TO_POINTER (k);
+  path = level_get_path (level, k);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (self), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+static void
+emit_row_has_child_toggled (HildonFileFolderTree *self, FolderLevel *level,
+                            gint k)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  iter.stamp = self->priv->stamp;
+  iter.user_data = level;
+  iter.user_data2 = GINT_TO_POINTER (k);
+  path = level_get_path (level, k);
+  gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (self), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+/* For the row that LEVEL holds the children of. */
+static void
+emit_parent_has_child_toggled (HildonFileFolderTree *self, FolderLevel *level)
+{
+  if (level->parent_level)
+    emit_row_has_child_toggled (self, level->parent_level,
+                                find_folder (level->parent_level,
+                                             &level->parent));
+}
+
+/* Maintaining the levels */
+
+/* Index in LEVEL where the folder at POSITION among the folders of
+   the model belongs. */
+static guint
+find_insert_position (HildonFileFolderTreePrivate *priv, FolderLevel *level,
+                      gint position)
+{
+  HildonFileSystemModel *model = HILDON_FILE_SYSTEM_MODEL (priv->model);
+  guint lo = 0, hi = level->folders->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (_hildon_file_system_model_get_folder_position
+            (model, FOLDER (level, mid)) < position)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+insert_folder (HildonFileFolderTree *self, FolderLevel *level,
+               GtkTreeIter *iter, gint position)
+{
+  HildonFileFolderTreePrivate *priv = self->priv;
+  guint k;
+
+  k = find_insert_position (priv, level, position);
+  g_array_insert_val (level->folders, k, *iter);
+  g_hash_table_insert (priv->listed, ROW_KEY (iter), level);
+  priv->stamp++;
+
+  emit_row_inserted (self, level, k);
+  if (level->folders->len == 1)
+    emit_parent_has_child_toggled (self, level);
+
+  /* A folder that has been hidden can have subfolders already */
+  if (_hildon_file_system_model_get_n_folders
+        (HILDON_FILE_SYSTEM_MODEL (priv->model), iter) > 0)
+    emit_row_has_child_toggled (self, level, k);
+}
+
+static void
+remove_folder (HildonFileFolderTree *self, FolderLevel *level, gint k)
+{
+  HildonFileFolderTreePrivate *priv = self->priv;
+  FolderLevel *child;
+  GtkTreePath *path;
+
+  path = level_get_path (level, k);
+
+  if ((child = lookup_level (priv, FOLDER (level, k))) != NULL)
+    level_free (priv, child);
+  g_hash_table_remove (priv->listed, ROW_KEY (FOLDER (level, k)));
+  g_array_remove_index (level->folders, k);
+  priv->stamp++;
+
+  gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+  gtk_tree_path_free (path);
+
+  if (level->folders->len == 0)
+    emit_parent_has_child_toggled (self, level);
+}
+
+/* Brings the row at ITER up to date, whether it has just been added
+   or has changed. */
+static void
+update_row (HildonFileFolderTree *self, GtkTreeIter *iter)
+{
+  HildonFileFolderTreePrivate *priv = self->priv;
+  GtkTreeIter parent;
+  FolderLevel *level;
+  gboolean has_parent, visible;
+  gint position, k;
+
+  /* Most rows are files, which are neither folders of the model nor
+     listed here, and need no more than these two lookups */
+  position = _hildon_file_system_model_get_folder_position
+    (HILDON_FILE_SYSTEM_MODEL (priv->model), iter);
+  if (position < 0 && !g_hash_table_lookup (priv->listed, ROW_KEY (iter)))
+    return;
+
+  has_parent = gtk_tree_model_iter_parent (priv->model, &parent, iter);
+  level = lookup_level (priv, has_parent ? &parent : NULL);
+
+  if (level == NULL)
+    {
+      /* Nobody has asked for the children of the parent yet.  If it is
+         listed, the view has to be told that it may have some now. */
+      GtkTreeIter grandparent;
+      gboolean has_grandparent;
+
+      if (!has_parent)
+        return;
+
+      has_grandparent = gtk_tree_model_iter_parent (priv->model,
+                                                    &grandparent, &parent);
+      level = lookup_level (priv, has_grandparent ? &grandparent : NULL);
+      if (level && (k = find_folder (level, &parent)) >= 0
+          && position >= 0 && folder_is_visible (priv, iter))
+        emit_row_has_child_toggled (self, level, k);
+      return;
+    }
+
+  visible = position >= 0 && folder_is_visible (priv, iter);
+
+  /* Also a listed row that has stopped being a folder is dropped */
+  k = g_hash_table_lookup (priv->listed, ROW_KEY (iter)) == level
+    ? find_folder (level, iter) : -1;
+  if (k >= 0 && visible)
+    emit_row_changed (self, level, k);
+  else if (k >= 0)
+    remove_folder (self, level, k);
+  else if (visible)
+    insert_folder (self, level, iter, position);
+}
+
+static void
+refilter_level (HildonFileFolderTree *self, FolderLevel *level)
+{
+  HildonFileFolderTreePrivate *priv = self->priv;
+  HildonFileSystemModel *model = HILDON_FILE_SYSTEM_MODEL (priv->model);
+  GtkTreeIter *parent, iter;
+  FolderLevel *child;
+  gint i, k, n, position;
+
+  parent = level->parent_level ? &level->parent : NULL;
+
+  for (k = level->folders->len - 1; k >= 0; k--)
+    if (!row_is_visible (priv, FOLDER (level, k), &position))
+      remove_folder (self, level, k);
+
+  /* The listed folders are in the same order as those of the model,
+     so one pass over both finds the ones to add. */
+  n = _hildon_file_system_model_get_n_folders (model, parent);
+  for (i = 0, k = 0; i < n; i++)
+    {
+      if (!_hildon_file_system_model_iter_nth_folder (model, &iter, parent, i))
+        break;
+
+      if ((guint) k < level->folders->len
+          && ROW_KEY (FOLDER (level, k)) == ROW_KEY (&iter))
+        k++;
+      else if (folder_is_visible (priv, &iter))
+        {
+          insert_folder (self, level, &iter, i);
+          k++;
+        }
+    }
+
+  for (k = 0; (guint) k < level->folders->len; k++)
+    if ((child = lookup_level (priv, FOLDER (level, k))) != NULL)
+      refilter_level (self, child);
+}
+
+/* Tracking the model */
+
+static void
+model_row_inserted (GtkTreeModel *model, GtkTreePath *path,
+                    GtkTreeIter *iter, gpointer data)
+{
+  update_row (HILDON_FILE_FOLDER_TREE (data), iter);
+}
+
+static void
+model_row_changed (GtkTreeModel *model, GtkTreePath *path,
+                   GtkTreeIter *iter, gpointer data)
+{
+  update_row (HILDON_FILE_FOLDER_TREE (data), iter);
+}
+
+static void
+model_row_deleted (GtkTreeModel *model, GtkTreePath *path, gpointer data)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (data);
+  GtkTreeIter iter;
+  FolderLevel *level;
+  gint k;
+
+  /* HildonFileSystemModel emits ::row-deleted before it takes the row
+     out, so PATH still leads to it. */
+  if (!gtk_tree_model_get_iter (model, &iter, path))
+    return;
+
+  level = g_hash_table_lookup (self->priv->listed, ROW_KEY (&iter));
+  if (level && (k = find_folder (level, &iter)) >= 0)
+    remove_folder (self, level, k);
+}
+
+static void
+model_rows_reordered (GtkTreeModel *model, GtkTreePath *path,
+                      GtkTreeIter *iter, gint *new_order, gpointer data)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (data);
+  HildonFileFolderTreePrivate *priv = self->priv;
+  HildonFileSystemModel *fs_model = HILDON_FILE_SYSTEM_MODEL (model);
+  GtkTreeIter *parent, folder;
+  FolderLevel *level;
+  GHashTable *old_index;
+  GArray *folders;
+  gint *level_order;
+  gboolean moved = FALSE;
+  gint i, n;
+  guint k;
+
+  parent = gtk_tree_path_get_depth (path) > 0 ? iter : NULL;
+  level = lookup_level (priv, parent);
+  if (level == NULL)
+    return;
+
+  /* A row that has stopped being a folder is moved before the change
+     is announced, and is no longer among the folders of the model. */
+  for (i = level->folders->len - 1; i >= 0; i--)
+    if (_hildon_file_system_model_get_folder_position
+          (fs_model, FOLDER (level, i)) < 0)
+      remove_folder (self, level, i);
+
+  if (level->folders->len < 2)
+    return;
+
+  /* Mostly it is files that move, and the folders stay in order */
+  n = _hildon_file_system_model_get_n_folders (fs_model, parent);
+  for (i = 0, k = 0; i < n && k < level->folders->len; i++)
+    if (_hildon_file_system_model_iter_nth_folder (fs_model, &folder,
+                                                   parent, i)
+        && ROW_KEY (&folder) == ROW_KEY (FOLDER (level, k)))
+      k++;
+  if (k == level->folders->len)
+    return;
+
+  old_index = g_hash_table_new (NULL, NULL);
+  for (k = 0; k < level->folders->len; k++)
+    g_hash_table_insert (old_index, ROW_KEY (FOLDER (level, k)),
+                         GUINT_TO_POINTER (k + 1));
+
+  /* The model has already put its folders in the new order */
+  folders = g_array_sized_new (FALSE, FALSE, sizeof (GtkTreeIter),
+                               level->folders->len);
+  level_order = g_new (gint, level->folders->len);
+  for (i = 0; i < n; i++)
+    {
+      gpointer old;
+
+      if (!_hildon_file_system_model_iter_nth_folder (fs_model, &folder,
+                                                      parent, i))
+        break;
+
+      old = g_hash_table_lookup (old_index, ROW_KEY (&folder));
+      if (old == NULL)
+        continue;
+
+      level_order[folders->len] = GPOINTER_TO_UINT (old) - 1;
+      moved |= (level_order[folders->len] != (gint) folders->len);
+      g_array_append_val (folders, *FOLDER (level, GPOINTER_TO_UINT (old) - 1));
+    }
+
+  g_hash_table_destroy (old_index);
+  g_assert (folders->len == level->folders->len);
+
+  g_array_free (level->folders, TRUE);
+  level->folders = folders;
+
+  if (moved)
+    {
+      GtkTreePath *level_path;
+      GtkTreeIter level_iter;
+
+      priv->stamp++;
+
+      if (level->parent_level)
+        {
+          level_iter.stamp = priv->stamp;
+          level_iter.user_data = level->parent_level;
+          level_iter.user_data2 =
+            GINT_TO_POINTER (find_folder (level->parent_level,
+                                          &level->parent));
+          level_path = gtk_tree_model_get_path (GTK_TREE_MODEL (self),
+                                                &level_iter);
+          gtk_tree_model_rows_reordered (GTK_TREE_MODEL (self), level_path,
+                                         &level_iter, level_order);
+        }
+      else
+        {
+          level_path = gtk_tree_path_new ();
+          gtk_tree_model_rows_reordered (GTK_TREE_MODEL (self), level_path,
+                                         NULL, level_order);
+        }
+
+      gtk_tree_path_free (level_path);
+    }
+
+  g_free (level_order);
+}
+
+/* GtkTreeModel */
+
+static GtkTreeModelFlags
+hildon_file_folder_tree_get_flags (GtkTreeModel *model)
+{
+  return 0;
+}
+
+static gint
+hildon_file_folder_tree_get_n_columns (GtkTreeModel *model)
+{
+  return gtk_tree_model_get_n_columns
+    (HILDON_FILE_FOLDER_TREE (model)->priv->model);
+}
+
+static GType
+hildon_file_folder_tree_get_column_type (GtkTreeModel *model, gint index)
+{
+  return gtk_tree_model_get_column_type
+    (HILDON_FILE_FOLDER_TREE (model)->priv->model, index);
+}
+
+static gboolean
+hildon_file_folder_tree_get_iter (GtkTreeModel *model, GtkTreeIter *iter,
+                                  GtkTreePath *path)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (model);
+  FolderLevel *level;
+  gint depth, *indices, i;
+
+  depth = gtk_tree_path_get_depth (path);
+  indices = gtk_tree_path_get_indices (path);
+  if (depth == 0)
+    return FALSE;
+
+  level = get_root_level (self);
+  for (i = 0; i < depth; i++)
+    {
+      if (indices[i] < 0 || (guint) indices[i] >= level->folders->len)
+        return FALSE;
+      if (i < depth - 1)
+        level = get_child_level (self, level, indices[i]);
+    }
+
+  iter->stamp = self->priv->stamp;
+  iter->user_data = level;
+  iter->user_data2 = GINT_TO_POINTER (indices[depth - 1]);
+  return TRUE;
+}
+
+static GtkTreePath *
+hildon_file_folder_tree_get_path (GtkTreeModel *model, GtkTreeIter *iter)
+{
+  g_return_val_if_fail
+    (iter->stamp == HILDON_FILE_FOLDER_TREE (model)->priv->stamp, NULL);
+
+  return level_get_path (iter->user_data, GPOINTER_TO_INT (iter->user_data2));
+}
+
+static void
+hildon_file_folder_tree_get_value (GtkTreeModel *model, GtkTreeIter *iter,
+                                   gint column, GValue *value)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (model);
+  GtkTreeIter child_iter;
+
+  _hildon_file_folder_tree_convert_iter_to_child_iter (self, &child_iter,
+                                                       iter);
+  gtk_tree_model_get_value (self->priv->model, &child_iter, column, value);
+}
+
+static gboolean
+hildon_file_folder_tree_iter_next (GtkTreeModel *model, GtkTreeIter *iter)
+{
+  FolderLevel *level;
+  guint next;
+
+  g_return_val_if_fail
+    (iter->stamp == HILDON_FILE_FOLDER_TREE (model)->priv->stamp, FALSE);
+
+  level = iter->user_data;
+  next = GPOINTER_TO_UINT (iter->user_data2) + 1;
+  if (next >= level->folders->len)
+    return FALSE;
+
+  iter->user_data2 = GUINT_TO_POINTER (next);
+  return TRUE;
+}
+
+static gboolean
+hildon_file_folder_tree_iter_nth_child (GtkTreeModel *model,
+                                        GtkTreeIter *iter,
+                                        GtkTreeIter *parent, gint n)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (model);
+  FolderLevel *level;
+
+  if (parent)
+    {
+      g_return_val_if_fail (parent->stamp == self->priv->stamp, FALSE);
+      level = get_child_level (self, parent->user_data,
+                               GPOINTER_TO_INT (parent->user_data2));
+    }
+  else
+    level = get_root_level (self);
+
+  if (n < 0 || (guint) n >= level->folders->len)
+    return FALSE;
+
+  iter->stamp = self->priv->stamp;
+  iter->user_data = level;
+  iter->user_data2 = GINT_TO_POINTER (n);
+  return TRUE;
+}
+
+static gboolean
+hildon_file_folder_tree_iter_children (GtkTreeModel *model,
+                                       GtkTreeIter *iter,
+                                       GtkTreeIter *parent)
+{
+  return hildon_file_folder_tree_iter_nth_child (model, iter, parent, 0);
+}
+
+static gint
+hildon_file_folder_tree_iter_n_children (GtkTreeModel *model,
+                                         GtkTreeIter *iter)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (model);
+
+  if (iter == NULL)
+    return get_root_level (self)->folders->len;
+
+  g_return_val_if_fail (iter->stamp == self->priv->stamp, 0);
+
+  return get_child_level (self, iter->user_data,
+                          GPOINTER_TO_INT (iter->user_data2))->folders->len;
+}
+
+static gboolean
+hildon_file_folder_tree_iter_has_child (GtkTreeModel *model,
+                                        GtkTreeIter *iter)
+{
+  return hildon_file_folder_tree_iter_n_children (model, iter) > 0;
+}
+
+static gboolean
+hildon_file_folder_tree_iter_parent (GtkTreeModel *model,
+                                     GtkTreeIter *iter,
+                                     GtkTreeIter *child)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (model);
+  FolderLevel *level;
+
+  g_return_val_if_fail (child->stamp == self->priv->stamp, FALSE);
+
+  level = child->user_data;
+  if (level->parent_level == NULL)
+    return FALSE;
+
+  iter->stamp = self->priv->stamp;
+  iter->user_data = level->parent_level;
+  iter->user_data2 = GINT_TO_POINTER (find_folder (level->parent_level,
+                                                   &level->parent));
+  return TRUE;
+}
+
+static void
+hildon_file_folder_tree_iface_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = hildon_file_folder_tree_get_flags;
+  iface->get_n_columns = hildon_file_folder_tree_get_n_columns;
+  iface->get_column_type = hildon_file_folder_tree_get_column_type;
+  iface->get_iter = hildon_file_folder_tree_get_iter;
+  iface->get_path = hildon_file_folder_tree_get_path;
+  iface->get_value = hildon_file_folder_tree_get_value;
+  iface->iter_next = hildon_file_folder_tree_iter_next;
+  iface->iter_children = hildon_file_folder_tree_iter_children;
+  iface->iter_has_child = hildon_file_folder_tree_iter_has_child;
+  iface->iter_n_children = hildon_file_folder_tree_iter_n_children;
+  iface->iter_nth_child = hildon_file_folder_tree_iter_nth_child;
+  iface->iter_parent = hildon_file_folder_tree_iter_parent;
+}
+
+/* GtkTreeDragSource, forwarded to the model */
+
+static gboolean
+convert_path_to_child_path (HildonFileFolderTree *self, GtkTreePath *path,
+                            GtkTreePath **child_path)
+{
+  GtkTreeIter iter, child_iter;
+
+  if (!gtk_tree_model_get_iter (GTK_TREE_MODEL (self), &iter, path))
+    return FALSE;
+
+  _hildon_file_folder_tree_convert_iter_to_child_iter (self, &child_iter,
+                                                       &iter);
+  *child_path = gtk_tree_model_get_path (self->priv->model, &child_iter);
+  return *child_path != NULL;
+}
+
+static gboolean
+hildon_file_folder_tree_row_draggable (GtkTreeDragSource *source,
+                                       GtkTreePath *path)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (source);
+  GtkTreePath *child_path;
+  gboolean result;
+
+  if (!GTK_IS_TREE_DRAG_SOURCE (self->priv->model)
+      || !convert_path_to_child_path (self, path, &child_path))
+    return FALSE;
+
+  result = gtk_tree_drag_source_row_draggable
+    (GTK_TREE_DRAG_SOURCE (self->priv->model), child_path);
+  gtk_tree_path_free (child_path);
+
+  return result;
+}
+
+static gboolean
+hildon_file_folder_tree_drag_data_get (GtkTreeDragSource *source,
+                                       GtkTreePath *path,
+                                       GtkSelectionData *selection_data)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (source);
+  GtkTreePath *child_path;
+  gboolean result;
+
+  if (!GTK_IS_TREE_DRAG_SOURCE (self->priv->model)
+      || !convert_path_to_child_path (self, path, &child_path))
+    return FALSE;
+
+  result = gtk_tree_drag_source_drag_data_get
+    (GTK_TREE_DRAG_SOURCE (self->priv->model), child_path, selection_data);
+  gtk_tree_path_free (child_path);
+
+  return result;
+}
+
+static gboolean
+hildon_file_folder_tree_drag_data_delete (GtkTreeDragSource *source,
+                                          GtkTreePath *path)
+{
+  HildonFileFolderTree *self = HILDON_FILE_FOLDER_TREE (source);
+  GtkTreePath *child_path;
+  gboolean result;
+
+  if (!GTK_IS_TREE_DRAG_SOURCE (self->priv->model)
+      || !convert_path_to_child_path (self, path, &child_path))
+    return FALSE;
+
+  result = gtk_tree_drag_source_drag_data_delete
+    (GTK_TREE_DRAG_SOURCE (self->priv->model), child_path);
+  gtk_tree_path_free (child_path);
+
+  return result;
+}
+
+static void
+hildon_file_folder_tree_drag_source_init (GtkTreeDragSourceIface *iface)
+{
+  iface->row_draggable = hildon_file_folder_tree_row_draggable;
+  iface->drag_data_get = hildon_file_folder_tree_drag_data_get;
+  iface->drag_data_delete = hildon_file_folder_tree_drag_data_delete;
+}
+
+/* GObject */
+
+static void
+hildon_file_folder_tree_init (HildonFileFolderTree *self)
+{
+  HildonFileFolderTreePrivate *priv;
+
+  priv = self->priv = G_TYPE_INSTANCE_GET_PRIVATE
+    (self, HILDON_TYPE_FILE_FOLDER_TREE, HildonFileFolderTreePrivate);
+
+  priv->stamp = g_random_int ();
+  priv->levels = g_hash_table_new (NULL, NULL);
+  priv->listed = g_hash_table_new (NULL, NULL);
+}
+
+static void
+hildon_file_folder_tree_dispose (GObject *obj)
+{
+  HildonFileFolderTreePrivate *priv = HILDON_FILE_FOLDER_TREE (obj)->priv;
+
+  if (priv->root)
+    level_free (priv, priv->root);
+
+  if (priv->model)
+    {
+      g_signal_handlers_disconnect_matched (priv->model, G_SIGNAL_MATCH_DATA,
+                                            0, 0, NULL, NULL, obj);
+      g_object_unref (priv->model);
+      priv->model = NULL;
+    }
+
+  G_OBJECT_CLASS (hildon_file_folder_tree_parent_class)->dispose (obj);
+}
+
+static void
+hildon_file_folder_tree_finalize (GObject *obj)
+{
+  HildonFileFolderTreePrivate *priv = HILDON_FILE_FOLDER_TREE (obj)->priv;
+
+  if (priv->visible_destroy)
+    priv->visible_destroy (priv->visible_data);
+
+  g_hash_table_destroy (priv->levels);
+  g_hash_table_destroy (priv->listed);
+
+  G_OBJECT_CLASS (hildon_file_folder_tree_parent_class)->finalize (obj);
+}
+
+static void
+hildon_file_folder_tree_class_init (HildonFileFolderTreeClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (HildonFileFolderTreePrivate));
+
+  object_class->dispose = hildon_file_folder_tree_dispose;
+  object_class->finalize = hildon_file_folder_tree_finalize;
+}
+
+/* Internal API */
+
+HildonFileFolderTree *
+_hildon_file_folder_tree_new (HildonFileSystemModel *model)
+{
+  HildonFileFolderTree *self;
+  HildonFileFolderTreePrivate *priv;
+
+  g_return_val_if_fail (HILDON_IS_FILE_SYSTEM_MODEL (model), NULL);
+
+  self = g_object_new (HILDON_TYPE_FILE_FOLDER_TREE, NULL);
+  priv = self->priv;
+
+  /* The folders are stored as iters of the model. */
+  g_assert (gtk_tree_model_get_flags (GTK_TREE_MODEL (model))
+            & GTK_TREE_MODEL_ITERS_PERSIST);
+
+  priv->model = g_object_ref (model);
+
+  g_signal_connect (model, "row-inserted",
+                    G_CALLBACK (model_row_inserted), self);
+  g_signal_connect (model, "row-changed",
+                    G_CALLBACK (model_row_changed), self);
+  g_signal_connect (model, "row-deleted",
+                    G_CALLBACK (model_row_deleted), self);
+  g_signal_connect (model, "rows-reordered",
+                    G_CALLBACK (model_rows_reordered), self);
+
+  return self;
+}
+
+/* Like gtk_tree_model_filter_set_visible_func, this does not refilter
+   the rows that are already there.
+*/
+void
+_hildon_file_folder_tree_set_visible_func (HildonFileFolderTree *self,
+                                           GtkTreeModelFilterVisibleFunc func,
+                                           gpointer data,
+                                           GDestroyNotify destroy)
+{
+  HildonFileFolderTreePrivate *priv;
+
+  g_return_if_fail (HILDON_IS_FILE_FOLDER_TREE (self));
+  priv = self->priv;
+
+  if (priv->visible_destroy)
+    priv->visible_destroy (priv->visible_data);
+
+  priv->visible_func = func;
+  priv->visible_data = data;
+  priv->visible_destroy = destroy;
+}
+
+void
+_hildon_file_folder_tree_refilter (HildonFileFolderTree *self)
+{
+  g_return_if_fail (HILDON_IS_FILE_FOLDER_TREE (self));
+
+  if (self->priv->root)
+    refilter_level (self, self->priv->root);
+}
+
+void
+_hildon_file_folder_tree_convert_iter_to_child_iter (HildonFileFolderTree *self,
+                                                     GtkTreeIter *child_iter,
+                                                     GtkTreeIter *iter)
+{
+  FolderLevel *level;
+  guint k;
+
+  g_return_if_fail (HILDON_IS_FILE_FOLDER_TREE (self));
+  g_return_if_fail (iter->stamp == self->priv->stamp);
+
+  level = iter->user_data;
+  k = GPOINTER_TO_UINT (iter->user_data2);
+  g_return_if_fail (k < level->folders->len);
+
+  *child_iter = *FOLDER (level, k);
+}
+
+/* Builds the levels down to CHILD_ITER as needed.  Returns FALSE if
+   it or one of its parents is not listed. */
+gboolean
+_hildon_file_folder_tree_convert_child_iter_to_iter (HildonFileFolderTree *self,
+                                                     GtkTreeIter *iter,
+                                                     GtkTreeIter *child_iter)
+{
+  HildonFileFolderTreePrivate *priv;
+  GArray *ancestors;
+  GtkTreeIter parent;
+  FolderLevel *level;
+  gint i, k = -1;
+
+  g_return_val_if_fail (HILDON_IS_FILE_FOLDER_TREE (self), FALSE);
+  priv = self->priv;
+
+  /* CHILD_ITER first, the top level row last */
+  ancestors = g_array_new (FALSE, FALSE, sizeof (GtkTreeIter));
+  g_array_append_val (ancestors, *child_iter);
+  while (gtk_tree_model_iter_parent (priv->model, &parent,
+                                     &g_array_index (ancestors, GtkTreeIter,
+                                                     ancestors->len - 1)))
+    g_array_append_val (ancestors, parent);
+
+  level = get_root_level (self);
+  for (i = ancestors->len - 1; i >= 0; i--)
+    {
+      k = find_folder (level, &g_array_index (ancestors, GtkTreeIter, i));
+      if (k < 0)
+        break;
+      if (i > 0)
+        level = get_child_level (self, level, k);
+    }
+
+  g_array_free (ancestors, TRUE);
+
+  if (k < 0)
+    return FALSE;
+
+  iter->stamp = priv->stamp;
+  iter->user_data = level;
+  iter->user_data2 = GINT_TO_POINTER (k);
+  return TRUE;
+}
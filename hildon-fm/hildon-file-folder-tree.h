@@ -0,0 +1,98 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileFolderTree
+ *
+ * The folders of a HildonFileSystemModel, as a tree for the
+ * navigation pane.  This replaces the GtkTreeModelFilter that used to
+ * sit between the model and the navigation pane and had to look at
+ * every file of every loaded folder only to hide it: here only the
+ * folder children that the model keeps track of are ever walked, and
+ * files are dropped with one flag test when they are added.
+ *
+ * INTERNAL TO FILE SELECTION STUFF, NOT FOR APPLICATION DEVELOPERS TO USE.
+ *
+ */
+
+#ifndef __HILDON_FILE_FOLDER_TREE_H__
+#define __HILDON_FILE_FOLDER_TREE_H__
+
+#include <gtk/gtk.h>
+#include "hildon-file-system-model.h"
+
+G_BEGIN_DECLS
+
+#define HILDON_TYPE_FILE_FOLDER_TREE (hildon_file_folder_tree_get_type())
+#define HILDON_FILE_FOLDER_TREE(object) \
+  (G_TYPE_CHECK_INSTANCE_CAST((object), HILDON_TYPE_FILE_FOLDER_TREE, \
+  HildonFileFolderTree))
+#define HILDON_FILE_FOLDER_TREE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), HILDON_TYPE_FILE_FOLDER_TREE, \
+  HildonFileFolderTreeClass))
+#define HILDON_IS_FILE_FOLDER_TREE(object) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((object), HILDON_TYPE_FILE_FOLDER_TREE))
+#define HILDON_IS_FILE_FOLDER_TREE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), HILDON_TYPE_FILE_FOLDER_TREE))
+
+typedef struct _HildonFileFolderTree HildonFileFolderTree;
+typedef struct _HildonFileFolderTreeClass HildonFileFolderTreeClass;
+typedef struct _HildonFileFolderTreePrivate HildonFileFolderTreePrivate;
+
+struct _HildonFileFolderTree
+{
+  GObject parent;
+  HildonFileFolderTreePrivate *priv;
+};
+
+struct _HildonFileFolderTreeClass
+{
+  GObjectClass parent_class;
+};
+
+GType hildon_file_folder_tree_get_type(void);
+
+/* The tree starts out with every folder of MODEL visible, in the order
+   of the model. */
+HildonFileFolderTree *_hildon_file_folder_tree_new(HildonFileSystemModel *model);
+
+/* FUNC is called with iters of the underlying model, and only for
+   folders. */
+void _hildon_file_folder_tree_set_visible_func(HildonFileFolderTree *self,
+                                  GtkTreeModelFilterVisibleFunc func,
+                                  gpointer data,
+                                  GDestroyNotify destroy);
+void _hildon_file_folder_tree_refilter(HildonFileFolderTree *self);
+
+void
+_hildon_file_folder_tree_convert_iter_to_child_iter(HildonFileFolderTree *self,
+                                                    GtkTreeIter *child_iter,
+                                                    GtkTreeIter *iter);
+gboolean
+_hildon_file_folder_tree_convert_child_iter_to_iter(HildonFileFolderTree *self,
+                                                    GtkTreeIter *iter,
+                                                    GtkTreeIter *child_iter);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,1210 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileFolderView
+ *
+ * The view keeps two sequences of the same FolderChild records.
+ * CHILDREN holds every child of the folder in model order, so the last
+ * index of a model path is a position in it.  ORDER holds the visible
+ * children in sorted order; the position of a row in the view is its
+ * position in ORDER.  Each child knows where it is in both, so finding
+ * a row, inserting it and removing it take logarithmic time, also for
+ * folders with tens of thousands of files.  Iters of the view carry
+ * the GSequenceIter of the row in ORDER and are invalidated by every
+ * structural change.
+ *
+ * The children are collected lazily, on first access, so that the
+ * visible function and the sorting can be set up first without
+ * paying for them twice.
+ */
+
+#include "config.h"
+
+#include "hildon-file-folder-view.h"
+
+typedef struct {
+  GtkTreeIter iter;           /* in the model */
+  GSequenceIter *child_pos;   /* in CHILDREN */
+  GSequenceIter *order_pos;   /* in ORDER, NULL while hidden */
+  gint old_position;          /* scratch space of resort() */
+} FolderChild;
+
+typedef struct {
+  gint sort_column_id;
+  GtkTreeIterCompareFunc func;
+  gpointer data;
+  GDestroyNotify destroy;
+} SortHeader;
+
+struct _HildonFileFolderViewPrivate
+{
+  GtkTreeModel *model;
+  GtkTreePath *folder_path;   /* NULL when the folder is gone */
+  gint stamp;
+
+  gboolean built;
+  GSequence *children;        /* FolderChild, in model order, owned */
+  GSequence *order;           /* FolderChild, visible ones sorted */
+
+  GtkTreeModelFilterVisibleFunc visible_func;
+  gpointer visible_data;
+  GDestroyNotify visible_destroy;
+
+  HildonFileFolderViewHideFunc hide_func;
+  gpointer hide_data;
+
+  GArray *sort_headers;       /* SortHeader */
+  GtkTreeIterCompareFunc default_sort_func;
+  gpointer default_sort_data;
+  GDestroyNotify default_sort_destroy;
+  gint sort_column_id;
+  GtkSortType sort_order;
+};
+
+static void hildon_file_folder_view_iface_init(GtkTreeModelIface *iface);
+static void hildon_file_folder_view_sortable_init(GtkTreeSortableIface *iface);
+static void hildon_file_folder_view_drag_source_init(GtkTreeDragSourceIface
+                                                     *iface);
+
+/* Note! G_IMPLEMENT_INTERFACE macros together form the 5th parameter for
+   G_DEFINE_TYPE_EXTENDED */
+G_DEFINE_TYPE_EXTENDED(HildonFileFolderView, hildon_file_folder_view,
+                       G_TYPE_OBJECT, 0,
+                       G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+                                             hildon_file_folder_view_iface_init)
+                       G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_SORTABLE,
+                                             hildon_file_folder_view_sortable_init)
+                       G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_DRAG_SOURCE,
+                                             hildon_file_folder_view_drag_source_init))
+
+#define CHILD_AT(priv, k) \
+  ((FolderChild *) g_sequence_get \
+     (g_sequence_get_iter_at_pos ((priv)->children, (k))))
+
+static void
+folder_child_free (FolderChild *child)
+{
+  g_slice_free (FolderChild, child);
+}
+
+/* Sorting */
+
+static SortHeader *
+find_sort_header (HildonFileFolderViewPrivate *priv, gint sort_column_id)
+{
+  guint i;
+
+  for (i = 0; i < priv->sort_headers->len; i++)
+    {
+      SortHeader *header = &g_array_index (priv->sort_headers, SortHeader, i);
+
+      if (header->sort_column_id == sort_column_id)
+        return header;
+    }
+
+  return NULL;
+}
+
+static GtkTreeIterCompareFunc
+get_compare_func (HildonFileFolderViewPrivate *priv, gpointer *data)
+{
+  if (priv->sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    {
+      *data = priv->default_sort_data;
+      return priv->default_sort_func;
+    }
+  else if (priv->sort_column_id != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID)
+    {
+      SortHeader *header = find_sort_header (priv, priv->sort_column_id);
+
+      if (header)
+        {
+          *data = header->data;
+          return header->func;
+        }
+    }
+
+  *data = NULL;
+  return NULL;
+}
+
+/* Total order on the children: the sort function first and the model
+   order for ties, like GtkTreeModelSort does.
+*/
+static gint
+compare_children (gconstpointer a, gconstpointer b, gpointer data)
+{
+  HildonFileFolderViewPrivate *priv = data;
+  const FolderChild *child_a = a, *child_b = b;
+  GtkTreeIterCompareFunc func;
+  gpointer func_data;
+  gint result = 0;
+
+  if (child_a == child_b)
+    return 0;
+
+  func = get_compare_func (priv, &func_data);
+  if (func)
+    {
+      result = func (priv->model, (GtkTreeIter *) &child_a->iter,
+                     (GtkTreeIter *) &child_b->iter, func_data);
+      if (priv->sort_order == GTK_SORT_DESCENDING)
+        result = (result > 0) ? -1 : (result < 0) ? 1 : 0;
+    }
+
+  if (result == 0)
+    result = (g_sequence_iter_get_position (child_a->child_pos)
+              < g_sequence_iter_get_position (child_b->child_pos)) ? -1 : 1;
+
+  return result;
+}
+
+/* Signals */
+
+static void
+emit_row_inserted (HildonFileFolderView *self, FolderChild *child)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  iter.stamp = self->priv->stamp;
+  iter.user_data = child->order_pos;
+  path = gtk_tree_path_new_from_indices
+    (g_sequence_iter_get_position (child->order_pos), -1);
+  gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+static void
+emit_row_changed (HildonFileFolderView *self, FolderChild *child)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  iter.stamp = self->priv->stamp;
+  iter.user_data = child->order_pos;
+  path = gtk_tree_path_new_from_indices
+    (g_sequence_iter_get_position (child->order_pos), -1);
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (self), path, &iter);
+  gtk_tree_path_free (path);
+}
+
+static void
+emit_row_deleted (HildonFileFolderView *self, guint position)
+{
+  GtkTreePath *path;
+
+  path = gtk_tree_path_new_from_indices (position, -1);
+  gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+  gtk_tree_path_free (path);
+}
+
+static void
+emit_rows_reordered (HildonFileFolderView *self, gint *new_order)
+{
+  GtkTreePath *path;
+
+  path = gtk_tree_path_new ();
+  gtk_tree_model_rows_reordered (GTK_TREE_MODEL (self), path, NULL,
+                                 new_order);
+  gtk_tree_path_free (path);
+}
+
+/* Maintaining ORDER */
+
+static gboolean
+child_is_visible (HildonFileFolderViewPrivate *priv, FolderChild *child)
+{
+  if (priv->visible_func == NULL)
+    return TRUE;
+
+  return priv->visible_func (priv->model, &child->iter, priv->visible_data);
+}
+
+static void
+show_child (HildonFileFolderView *self, FolderChild *child)
+{
+  HildonFileFolderViewPrivate *priv = self->priv;
+
+  child->order_pos = g_sequence_insert_sorted (priv->order, child,
+                                               compare_children, priv);
+  priv->stamp++;
+
+  emit_row_inserted (self, child);
+}
+
+static void
+hide_child (HildonFileFolderView *self, FolderChild *child)
+{
+  HildonFileFolderViewPrivate *priv = self->priv;
+  guint position;
+
+  if (priv->hide_func)
+    priv->hide_func (self, &child->iter, priv->hide_data);
+
+  position = g_sequence_iter_get_position (child->order_pos);
+  g_sequence_remove (child->order_pos);
+  child->order_pos = NULL;
+  priv->stamp++;
+
+  emit_row_deleted (self, position);
+}
+
+/* Moves the row of CHILD to where it belongs now that its sort keys
+   have changed.
+*/
+static void
+reposition_child (HildonFileFolderView *self, FolderChild *child)
+{
+  HildonFileFolderViewPrivate *priv = self->priv;
+  GSequenceIter *prev, *next;
+  guint position, new_position, i, n;
+  gint *new_order;
+
+  /* Most changes don't move the row at all. */
+  prev = g_sequence_iter_is_begin (child->order_pos)
+    ? NULL : g_sequence_iter_prev (child->order_pos);
+  next = g_sequence_iter_next (child->order_pos);
+  if ((prev == NULL
+       || compare_children (g_sequence_get (prev), child, priv) < 0)
+      && (g_sequence_iter_is_end (next)
+          || compare_children (child, g_sequence_get (next), priv) < 0))
+    return;
+
+  position = g_sequence_iter_get_position (child->order_pos);
+  g_sequence_sort_changed (child->order_pos, compare_children, priv);
+  new_position = g_sequence_iter_get_position (child->order_pos);
+  priv->stamp++;
+
+  if (position == new_position)
+    return;
+
+  n = g_sequence_get_length (priv->order);
+  new_order = g_new (gint, n);
+  for (i = 0; i < n; i++)
+    new_order[i] = i;
+  if (position < new_position)
+    for (i = position; i < new_position; i++)
+      new_order[i] = i + 1;
+  else
+    for (i = new_position + 1; i <= position; i++)
+      new_order[i] = i - 1;
+  new_order[new_position] = position;
+
+  emit_rows_reordered (self, new_order);
+  g_free (new_order);
+}
+
+static void
+resort (HildonFileFolderView *self)
+{
+  HildonFileFolderViewPrivate *priv = self->priv;
+  GSequenceIter *pos;
+  gint n, p;
+  gint *new_order;
+  gboolean moved = FALSE;
+
+  if (!priv->built || g_sequence_get_length (priv->order) < 2)
+    return;
+
+  n = g_sequence_get_length (priv->order);
+  for (pos = g_sequence_get_begin_iter (priv->order), p = 0;
+       !g_sequence_iter_is_end (pos); pos = g_sequence_iter_next (pos), p++)
+    ((FolderChild *) g_sequence_get (pos))->old_position = p;
+
+  g_sequence_sort (priv->order, compare_children, priv);
+
+  new_order = g_new (gint, n);
+  for (pos = g_sequence_get_begin_iter (priv->order), p = 0;
+       !g_sequence_iter_is_end (pos); pos = g_sequence_iter_next (pos), p++)
+    {
+      new_order[p] = ((FolderChild *) g_sequence_get (pos))->old_position;
+      if (new_order[p] != p)
+        moved = TRUE;
+    }
+
+  if (moved)
+    {
+      priv->stamp++;
+      emit_rows_reordered (self, new_order);
+    }
+
+  g_free (new_order);
+}
+
+static void
+ensure_built (HildonFileFolderView *self)
+{
+  HildonFileFolderViewPrivate *priv = self->priv;
+  GtkTreeIter folder, iter;
+  GSequenceIter *pos;
+
+  if (priv->built)
+    return;
+
+  priv->built = TRUE;
+
+  if (priv->folder_path == NULL
+      || !gtk_tree_model_get_iter (priv->model, &folder, priv->folder_path)
+      || !gtk_tree_model_iter_children (priv->model, &iter, &folder))
+    return;
+
+  do
+    {
+      FolderChild *child = g_slice_new0 (FolderChild);
+
+      child->iter = iter;
+      child->child_pos = g_sequence_append (priv->children, child);
+    }
+  while (gtk_tree_model_iter_next (priv->model, &iter));
+
+  for (pos = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (pos); pos = g_sequence_iter_next (pos))
+    {
+      FolderChild *child = g_sequence_get (pos);
+
+      if (child_is_visible (priv, child))
+        child->order_pos = g_sequence_append (priv->order, child);
+    }
+
+  g_sequence_sort (priv->order, compare_children, priv);
+}
+
+static void
+clear_children (HildonFileFolderView *self)
+{
+  HildonFileFolderViewPrivate *priv = self->priv;
+
+  while (g_sequence_get_length (priv->order) > 0)
+    hide_child (self, g_sequence_get
+                (g_sequence_iter_prev (g_sequence_get_end_iter (priv->order))));
+
+  g_sequence_remove_range (g_sequence_get_begin_iter (priv->children),
+                           g_sequence_get_end_iter (priv->children));
+}
+
+/* Tracking the folder in the model */
+
+/* Whether PATH is a sibling of the folder or of one of its ancestors.
+ */
+static gboolean
+is_sibling_of_ancestor (GtkTreePath *path, GtkTreePath *folder_path)
+{
+  gint depth = gtk_tree_path_get_depth (path);
+  gint *a, *b, i;
+
+  if (depth == 0 || depth > gtk_tree_path_get_depth (folder_path))
+    return FALSE;
+
+  a = gtk_tree_path_get_indices (path);
+  b = gtk_tree_path_get_indices (folder_path);
+  for (i = 0; i < depth - 1; i++)
+    if (a[i] != b[i])
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Returns the index of PATH among the folder's children, or -1 if it
+   is not a child of the folder.
+*/
+static gint
+child_index (GtkTreePath *path, GtkTreePath *folder_path)
+{
+  gint depth = gtk_tree_path_get_depth (folder_path);
+  gint *a, *b, i;
+
+  if (gtk_tree_path_get_depth (path) != depth + 1)
+    return -1;
+
+  a = gtk_tree_path_get_indices (path);
+  b = gtk_tree_path_get_indices (folder_path);
+  for (i = 0; i < depth; i++)
+    if (a[i] != b[i])
+      return -1;
+
+  return a[depth];
+}
+
+static void
+model_row_inserted (GtkTreeModel *model, GtkTreePath *path,
+                    GtkTreeIter *iter, gpointer data)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (data);
+  HildonFileFolderViewPrivate *priv = self->priv;
+  FolderChild *child;
+  gint k;
+
+  if (priv->folder_path == NULL)
+    return;
+
+  if (is_sibling_of_ancestor (path, priv->folder_path))
+    {
+      gint depth = gtk_tree_path_get_depth (path);
+      gint *indices = gtk_tree_path_get_indices (priv->folder_path);
+
+      if (gtk_tree_path_get_indices (path)[depth - 1] <= indices[depth - 1])
+        indices[depth - 1]++;
+      return;
+    }
+
+  if (!priv->built)
+    return;
+
+  k = child_index (path, priv->folder_path);
+  if (k < 0)
+    return;
+
+  child = g_slice_new0 (FolderChild);
+  child->iter = *iter;
+  child->child_pos = g_sequence_insert_before
+    (g_sequence_get_iter_at_pos (priv->children, k), child);
+
+  if (child_is_visible (priv, child))
+    show_child (self, child);
+}
+
+static void
+model_row_changed (GtkTreeModel *model, GtkTreePath *path,
+                   GtkTreeIter *iter, gpointer data)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (data);
+  HildonFileFolderViewPrivate *priv = self->priv;
+  FolderChild *child;
+  gboolean visible;
+  gint k;
+
+  if (priv->folder_path == NULL || !priv->built)
+    return;
+
+  k = child_index (path, priv->folder_path);
+  if (k < 0 || k >= g_sequence_get_length (priv->children))
+    return;
+
+  child = CHILD_AT (priv, k);
+  visible = child_is_visible (priv, child);
+  if (child->order_pos == NULL)
+    {
+      if (visible)
+        show_child (self, child);
+      return;
+    }
+
+  if (!visible)
+    hide_child (self, child);
+  else
+    {
+      reposition_child (self, child);
+      emit_row_changed (self, child);
+    }
+}
+
+static void
+model_row_deleted (GtkTreeModel *model, GtkTreePath *path, gpointer data)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (data);
+  HildonFileFolderViewPrivate *priv = self->priv;
+  FolderChild *child;
+  gint k;
+
+  if (priv->folder_path == NULL)
+    return;
+
+  if (is_sibling_of_ancestor (path, priv->folder_path))
+    {
+      gint depth = gtk_tree_path_get_depth (path);
+      gint index = gtk_tree_path_get_indices (path)[depth - 1];
+      gint *indices = gtk_tree_path_get_indices (priv->folder_path);
+
+      if (index == indices[depth - 1])
+        {
+          /* The folder itself or one of its ancestors is gone. */
+          gtk_tree_path_free (priv->folder_path);
+          priv->folder_path = NULL;
+          if (priv->built)
+            clear_children (self);
+        }
+      else if (index < indices[depth - 1])
+        indices[depth - 1]--;
+      return;
+    }
+
+  if (!priv->built)
+    return;
+
+  k = child_index (path, priv->folder_path);
+  if (k < 0 || k >= g_sequence_get_length (priv->children))
+    return;
+
+  child = CHILD_AT (priv, k);
+  if (child->order_pos)
+    hide_child (self, child);
+
+  g_sequence_remove (child->child_pos);
+}
+
+static void
+model_rows_reordered (GtkTreeModel *model, GtkTreePath *path,
+                      GtkTreeIter *iter, gint *new_order, gpointer data)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (data);
+  HildonFileFolderViewPrivate *priv = self->priv;
+  gint depth, folder_depth, i, n;
+  gint *path_indices, *folder_indices;
+
+  if (priv->folder_path == NULL)
+    return;
+
+  depth = gtk_tree_path_get_depth (path);
+  folder_depth = gtk_tree_path_get_depth (priv->folder_path);
+  path_indices = gtk_tree_path_get_indices (path);
+  folder_indices = gtk_tree_path_get_indices (priv->folder_path);
+
+  for (i = 0; i < MIN (depth, folder_depth); i++)
+    if (path_indices[i] != folder_indices[i])
+      return;
+
+  if (depth < folder_depth)
+    {
+      /* The folder or one of its ancestors moved. */
+      n = gtk_tree_model_iter_n_children (model, iter);
+      for (i = 0; i < n; i++)
+        if (new_order[i] == folder_indices[depth])
+          {
+            folder_indices[depth] = i;
+            break;
+          }
+    }
+  else if (depth == folder_depth && priv->built)
+    {
+      FolderChild **old_children;
+      GSequenceIter *pos;
+
+      n = g_sequence_get_length (priv->children);
+      old_children = g_new (FolderChild *, n);
+      for (pos = g_sequence_get_begin_iter (priv->children), i = 0;
+           !g_sequence_iter_is_end (pos); pos = g_sequence_iter_next (pos))
+        old_children[i++] = g_sequence_get (pos);
+
+      /* Moving every child to the end in the new order leaves them in
+         that order, and their GSequenceIters stay valid */
+      for (i = 0; i < n; i++)
+        g_sequence_move (old_children[new_order[i]]->child_pos,
+                         g_sequence_get_end_iter (priv->children));
+      g_free (old_children);
+
+      /* Only the ties, or everything when unsorted, can move. */
+      resort (self);
+    }
+}
+
+/* GtkTreeModel */
+
+static GtkTreeModelFlags
+hildon_file_folder_view_get_flags (GtkTreeModel *model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+hildon_file_folder_view_get_n_columns (GtkTreeModel *model)
+{
+  return gtk_tree_model_get_n_columns
+    (HILDON_FILE_FOLDER_VIEW (model)->priv->model);
+}
+
+static GType
+hildon_file_folder_view_get_column_type (GtkTreeModel *model, gint index)
+{
+  return gtk_tree_model_get_column_type
+    (HILDON_FILE_FOLDER_VIEW (model)->priv->model, index);
+}
+
+static gboolean
+hildon_file_folder_view_iter_nth_child (GtkTreeModel *model,
+                                        GtkTreeIter *iter,
+                                        GtkTreeIter *parent, gint n)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (model);
+
+  ensure_built (self);
+
+  if (parent || n < 0 || n >= g_sequence_get_length (self->priv->order))
+    return FALSE;
+
+  iter->stamp = self->priv->stamp;
+  iter->user_data = g_sequence_get_iter_at_pos (self->priv->order, n);
+  return TRUE;
+}
+
+static gboolean
+hildon_file_folder_view_get_iter (GtkTreeModel *model, GtkTreeIter *iter,
+                                  GtkTreePath *path)
+{
+  if (gtk_tree_path_get_depth (path) != 1)
+    return FALSE;
+
+  return hildon_file_folder_view_iter_nth_child
+    (model, iter, NULL, gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+hildon_file_folder_view_get_path (GtkTreeModel *model, GtkTreeIter *iter)
+{
+  g_return_val_if_fail
+    (iter->stamp == HILDON_FILE_FOLDER_VIEW (model)->priv->stamp, NULL);
+
+  return gtk_tree_path_new_from_indices
+    (g_sequence_iter_get_position (iter->user_data), -1);
+}
+
+static void
+hildon_file_folder_view_get_value (GtkTreeModel *model, GtkTreeIter *iter,
+                                   gint column, GValue *value)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (model);
+  FolderChild *child;
+
+  /* The caller reads VALUE even when the iter is stale */
+  if (iter->stamp != self->priv->stamp
+      || g_sequence_iter_is_end (iter->user_data))
+    {
+      g_value_init (value, gtk_tree_model_get_column_type (self->priv->model,
+                                                           column));
+      g_return_if_reached ();
+    }
+
+  child = g_sequence_get (iter->user_data);
+  gtk_tree_model_get_value (self->priv->model, &child->iter, column, value);
+}
+
+static gboolean
+hildon_file_folder_view_iter_next (GtkTreeModel *model, GtkTreeIter *iter)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (model);
+  GSequenceIter *next;
+
+  g_return_val_if_fail (iter->stamp == self->priv->stamp, FALSE);
+
+  next = g_sequence_iter_next (iter->user_data);
+  if (g_sequence_iter_is_end (next))
+    return FALSE;
+
+  iter->user_data = next;
+  return TRUE;
+}
+
+static gboolean
+hildon_file_folder_view_iter_children (GtkTreeModel *model,
+                                       GtkTreeIter *iter,
+                                       GtkTreeIter *parent)
+{
+  return hildon_file_folder_view_iter_nth_child (model, iter, parent, 0);
+}
+
+static gboolean
+hildon_file_folder_view_iter_has_child (GtkTreeModel *model,
+                                        GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+static gint
+hildon_file_folder_view_iter_n_children (GtkTreeModel *model,
+                                         GtkTreeIter *iter)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (model);
+
+  if (iter)
+    return 0;
+
+  ensure_built (self);
+  return g_sequence_get_length (self->priv->order);
+}
+
+static gboolean
+hildon_file_folder_view_iter_parent (GtkTreeModel *model,
+                                     GtkTreeIter *iter,
+                                     GtkTreeIter *child)
+{
+  return FALSE;
+}
+
+static void
+hildon_file_folder_view_iface_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = hildon_file_folder_view_get_flags;
+  iface->get_n_columns = hildon_file_folder_view_get_n_columns;
+  iface->get_column_type = hildon_file_folder_view_get_column_type;
+  iface->get_iter = hildon_file_folder_view_get_iter;
+  iface->get_path = hildon_file_folder_view_get_path;
+  iface->get_value = hildon_file_folder_view_get_value;
+  iface->iter_next = hildon_file_folder_view_iter_next;
+  iface->iter_children = hildon_file_folder_view_iter_children;
+  iface->iter_has_child = hildon_file_folder_view_iter_has_child;
+  iface->iter_n_children = hildon_file_folder_view_iter_n_children;
+  iface->iter_nth_child = hildon_file_folder_view_iter_nth_child;
+  iface->iter_parent = hildon_file_folder_view_iter_parent;
+}
+
+/* GtkTreeSortable */
+
+static gboolean
+hildon_file_folder_view_get_sort_column_id (GtkTreeSortable *sortable,
+                                            gint *sort_column_id,
+                                            GtkSortType *order)
+{
+  HildonFileFolderViewPrivate *priv = HILDON_FILE_FOLDER_VIEW (sortable)->priv;
+
+  if (sort_column_id)
+    *sort_column_id = priv->sort_column_id;
+  if (order)
+    *order = priv->sort_order;
+
+  return priv->sort_column_id != GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID
+    && priv->sort_column_id != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+}
+
+static void
+hildon_file_folder_view_set_sort_column_id (GtkTreeSortable *sortable,
+                                            gint sort_column_id,
+                                            GtkSortType order)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (sortable);
+  HildonFileFolderViewPrivate *priv = self->priv;
+
+  if (sort_column_id >= 0)
+    g_return_if_fail (find_sort_header (priv, sort_column_id) != NULL);
+  else if (sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    g_return_if_fail (priv->default_sort_func != NULL);
+
+  if (priv->sort_column_id == sort_column_id && priv->sort_order == order)
+    return;
+
+  priv->sort_column_id = sort_column_id;
+  priv->sort_order = order;
+
+  gtk_tree_sortable_sort_column_changed (sortable);
+  resort (self);
+}
+
+static void
+hildon_file_folder_view_set_sort_func (GtkTreeSortable *sortable,
+                                       gint sort_column_id,
+                                       GtkTreeIterCompareFunc func,
+                                       gpointer data,
+                                       GDestroyNotify destroy)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (sortable);
+  HildonFileFolderViewPrivate *priv = self->priv;
+  SortHeader *header;
+
+  header = find_sort_header (priv, sort_column_id);
+  if (header)
+    {
+      if (header->destroy)
+        header->destroy (header->data);
+    }
+  else
+    {
+      SortHeader new_header = { sort_column_id, NULL, NULL, NULL };
+
+      g_array_append_val (priv->sort_headers, new_header);
+      header = &g_array_index (priv->sort_headers, SortHeader,
+                               priv->sort_headers->len - 1);
+    }
+
+  header->func = func;
+  header->data = data;
+  header->destroy = destroy;
+
+  if (priv->sort_column_id == sort_column_id)
+    resort (self);
+}
+
+static void
+hildon_file_folder_view_set_default_sort_func (GtkTreeSortable *sortable,
+                                               GtkTreeIterCompareFunc func,
+                                               gpointer data,
+                                               GDestroyNotify destroy)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (sortable);
+  HildonFileFolderViewPrivate *priv = self->priv;
+
+  if (priv->default_sort_destroy)
+    priv->default_sort_destroy (priv->default_sort_data);
+
+  priv->default_sort_func = func;
+  priv->default_sort_data = data;
+  priv->default_sort_destroy = destroy;
+
+  if (priv->sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+    resort (self);
+}
+
+static gboolean
+hildon_file_folder_view_has_default_sort_func (GtkTreeSortable *sortable)
+{
+  return HILDON_FILE_FOLDER_VIEW (sortable)->priv->default_sort_func != NULL;
+}
+
+static void
+hildon_file_folder_view_sortable_init (GtkTreeSortableIface *iface)
+{
+  iface->get_sort_column_id = hildon_file_folder_view_get_sort_column_id;
+  iface->set_sort_column_id = hildon_file_folder_view_set_sort_column_id;
+  iface->set_sort_func = hildon_file_folder_view_set_sort_func;
+  iface->set_default_sort_func = hildon_file_folder_view_set_default_sort_func;
+  iface->has_default_sort_func = hildon_file_folder_view_has_default_sort_func;
+}
+
+/* GtkTreeDragSource, forwarded to the model */
+
+static gboolean
+convert_path_to_child_path (HildonFileFolderView *self, GtkTreePath *path,
+                            GtkTreePath **child_path)
+{
+  GtkTreeIter iter, child_iter;
+
+  if (!gtk_tree_model_get_iter (GTK_TREE_MODEL (self), &iter, path))
+    return FALSE;
+
+  _hildon_file_folder_view_convert_iter_to_child_iter (self, &child_iter,
+                                                       &iter);
+  *child_path = gtk_tree_model_get_path (self->priv->model, &child_iter);
+  return *child_path != NULL;
+}
+
+static gboolean
+hildon_file_folder_view_row_draggable (GtkTreeDragSource *source,
+                                       GtkTreePath *path)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (source);
+  GtkTreePath *child_path;
+  gboolean result;
+
+  if (!GTK_IS_TREE_DRAG_SOURCE (self->priv->model)
+      || !convert_path_to_child_path (self, path, &child_path))
+    return FALSE;
+
+  result = gtk_tree_drag_source_row_draggable
+    (GTK_TREE_DRAG_SOURCE (self->priv->model), child_path);
+  gtk_tree_path_free (child_path);
+
+  return result;
+}
+
+static gboolean
+hildon_file_folder_view_drag_data_get (GtkTreeDragSource *source,
+                                       GtkTreePath *path,
+                                       GtkSelectionData *selection_data)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (source);
+  GtkTreePath *child_path;
+  gboolean result;
+
+  if (!GTK_IS_TREE_DRAG_SOURCE (self->priv->model)
+      || !convert_path_to_child_path (self, path, &child_path))
+    return FALSE;
+
+  result = gtk_tree_drag_source_drag_data_get
+    (GTK_TREE_DRAG_SOURCE (self->priv->model), child_path, selection_data);
+  gtk_tree_path_free (child_path);
+
+  return result;
+}
+
+static gboolean
+hildon_file_folder_view_drag_data_delete (GtkTreeDragSource *source,
+                                          GtkTreePath *path)
+{
+  HildonFileFolderView *self = HILDON_FILE_FOLDER_VIEW (source);
+  GtkTreePath *child_path;
+  gboolean result;
+
+  if (!GTK_IS_TREE_DRAG_SOURCE (self->priv->model)
+      || !convert_path_to_child_path (self, path, &child_path))
+    return FALSE;
+
+  result = gtk_tree_drag_source_drag_data_delete
+    (GTK_TREE_DRAG_SOURCE (self->priv->model), child_path);
+  gtk_tree_path_free (child_path);
+
+  return result;
+}
+
+static void
+hildon_file_folder_view_drag_source_init (GtkTreeDragSourceIface *iface)
+{
+  iface->row_draggable = hildon_file_folder_view_row_draggable;
+  iface->drag_data_get = hildon_file_folder_view_drag_data_get;
+  iface->drag_data_delete = hildon_file_folder_view_drag_data_delete;
+}
+
+/* GObject */
+
+static void
+hildon_file_folder_view_init (HildonFileFolderView *self)
+{
+  HildonFileFolderViewPrivate *priv;
+
+  priv = self->priv = G_TYPE_INSTANCE_GET_PRIVATE
+    (self, HILDON_TYPE_FILE_FOLDER_VIEW, HildonFileFolderViewPrivate);
+
+  priv->stamp = g_random_int ();
+  priv->children = g_sequence_new ((GDestroyNotify) folder_child_free);
+  priv->order = g_sequence_new (NULL);
+  priv->sort_headers = g_array_new (FALSE, FALSE, sizeof (SortHeader));
+  priv->sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  priv->sort_order = GTK_SORT_ASCENDING;
+}
+
+static void
+hildon_file_folder_view_dispose (GObject *obj)
+{
+  HildonFileFolderViewPrivate *priv = HILDON_FILE_FOLDER_VIEW (obj)->priv;
+
+  if (priv->model)
+    {
+      g_signal_handlers_disconnect_matched (priv->model, G_SIGNAL_MATCH_DATA,
+                                            0, 0, NULL, NULL, obj);
+      g_object_unref (priv->model);
+      priv->model = NULL;
+    }
+
+  G_OBJECT_CLASS (hildon_file_folder_view_parent_class)->dispose (obj);
+}
+
+static void
+hildon_file_folder_view_finalize (GObject *obj)
+{
+  HildonFileFolderViewPrivate *priv = HILDON_FILE_FOLDER_VIEW (obj)->priv;
+  guint i;
+
+  for (i = 0; i < priv->sort_headers->len; i++)
+    {
+      SortHeader *header = &g_array_index (priv->sort_headers, SortHeader, i);
+
+      if (header->destroy)
+        header->destroy (header->data);
+    }
+  g_array_free (priv->sort_headers, TRUE);
+
+  if (priv->default_sort_destroy)
+    priv->default_sort_destroy (priv->default_sort_data);
+  if (priv->visible_destroy)
+    priv->visible_destroy (priv->visible_data);
+
+  g_sequence_free (priv->order);
+  g_sequence_free (priv->children);
+  if (priv->folder_path)
+    gtk_tree_path_free (priv->folder_path);
+
+  G_OBJECT_CLASS (hildon_file_folder_view_parent_class)->finalize (obj);
+}
+
+static void
+hildon_file_folder_view_class_init (HildonFileFolderViewClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (HildonFileFolderViewPrivate));
+
+  object_class->dispose = hildon_file_folder_view_dispose;
+  object_class->finalize = hildon_file_folder_view_finalize;
+}
+
+/* Internal API */
+
+HildonFileFolderView *
+_hildon_file_folder_view_new (HildonFileSystemModel *model,
+                              GtkTreeIter *folder)
+{
+  HildonFileFolderView *self;
+  HildonFileFolderViewPrivate *priv;
+
+  g_return_val_if_fail (HILDON_IS_FILE_SYSTEM_MODEL (model), NULL);
+
+  self = g_object_new (HILDON_TYPE_FILE_FOLDER_VIEW, NULL);
+  priv = self->priv;
+
+  /* The children are stored as iters of the model. */
+  g_assert (gtk_tree_model_get_flags (GTK_TREE_MODEL (model))
+            & GTK_TREE_MODEL_ITERS_PERSIST);
+
+  priv->model = g_object_ref (model);
+  if (folder)
+    priv->folder_path = gtk_tree_model_get_path (priv->model, folder);
+
+  g_signal_connect (model, "row-inserted",
+                    G_CALLBACK (model_row_inserted), self);
+  g_signal_connect (model, "row-changed",
+                    G_CALLBACK (model_row_changed), self);
+  g_signal_connect (model, "row-deleted",
+                    G_CALLBACK (model_row_deleted), self);
+  g_signal_connect (model, "rows-reordered",
+                    G_CALLBACK (model_rows_reordered), self);
+
+  return self;
+}
+
+GtkTreeModel *
+_hildon_file_folder_view_get_model (HildonFileFolderView *self)
+{
+  g_return_val_if_fail (HILDON_IS_FILE_FOLDER_VIEW (self), NULL);
+
+  return self->priv->model;
+}
+
+gboolean
+_hildon_file_folder_view_get_folder (HildonFileFolderView *self,
+                                     GtkTreeIter *folder)
+{
+  g_return_val_if_fail (HILDON_IS_FILE_FOLDER_VIEW (self), FALSE);
+
+  return self->priv->folder_path != NULL
+    && gtk_tree_model_get_iter (self->priv->model, folder,
+                                self->priv->folder_path);
+}
+
+/* Like gtk_tree_model_filter_set_visible_func, this does not refilter
+   the rows that are already there.
+*/
+void
+_hildon_file_folder_view_set_visible_func (HildonFileFolderView *self,
+                                           GtkTreeModelFilterVisibleFunc func,
+                                           gpointer data,
+                                           GDestroyNotify destroy)
+{
+  HildonFileFolderViewPrivate *priv;
+
+  g_return_if_fail (HILDON_IS_FILE_FOLDER_VIEW (self));
+  priv = self->priv;
+
+  if (priv->visible_destroy)
+    priv->visible_destroy (priv->visible_data);
+
+  priv->visible_func = func;
+  priv->visible_data = data;
+  priv->visible_destroy = destroy;
+}
+
+void
+_hildon_file_folder_view_set_hide_func (HildonFileFolderView *self,
+                                        HildonFileFolderViewHideFunc func,
+                                        gpointer data)
+{
+  g_return_if_fail (HILDON_IS_FILE_FOLDER_VIEW (self));
+
+  self->priv->hide_func = func;
+  self->priv->hide_data = data;
+}
+
+void
+_hildon_file_folder_view_refilter (HildonFileFolderView *self)
+{
+  HildonFileFolderViewPrivate *priv;
+  GSequenceIter *pos;
+
+  g_return_if_fail (HILDON_IS_FILE_FOLDER_VIEW (self));
+  priv = self->priv;
+
+  if (!priv->built)
+    return;
+
+  /* Every child is looked at exactly once: the visible ones while
+     hiding, the others while showing.  Rows are hidden from the end,
+     so the row-deleted paths of the rows before stay valid. */
+  pos = g_sequence_get_end_iter (priv->order);
+  while (!g_sequence_iter_is_begin (pos))
+    {
+      FolderChild *child;
+
+      pos = g_sequence_iter_prev (pos);
+      child = g_sequence_get (pos);
+      if (!child_is_visible (priv, child))
+        {
+          pos = g_sequence_iter_next (pos);
+          hide_child (self, child);
+        }
+    }
+
+  for (pos = g_sequence_get_begin_iter (priv->children);
+       !g_sequence_iter_is_end (pos); pos = g_sequence_iter_next (pos))
+    {
+      FolderChild *child = g_sequence_get (pos);
+
+      if (child->order_pos == NULL && child_is_visible (priv, child))
+        show_child (self, child);
+    }
+}
+
+void
+_hildon_file_folder_view_convert_iter_to_child_iter (HildonFileFolderView *self,
+                                                     GtkTreeIter *child_iter,
+                                                     GtkTreeIter *iter)
+{
+  HildonFileFolderViewPrivate *priv;
+
+  g_return_if_fail (HILDON_IS_FILE_FOLDER_VIEW (self));
+  priv = self->priv;
+  g_return_if_fail (iter->stamp == priv->stamp);
+  g_return_if_fail (!g_sequence_iter_is_end (iter->user_data));
+
+  *child_iter = ((FolderChild *) g_sequence_get (iter->user_data))->iter;
+}
+
+gboolean
+_hildon_file_folder_view_convert_child_iter_to_iter (HildonFileFolderView *self,
+                                                     GtkTreeIter *iter,
+                                                     GtkTreeIter *child_iter)
+{
+  HildonFileFolderViewPrivate *priv;
+  FolderChild *child;
+  GtkTreePath *path;
+  gint k;
+
+  g_return_val_if_fail (HILDON_IS_FILE_FOLDER_VIEW (self), FALSE);
+  priv = self->priv;
+
+  ensure_built (self);
+  if (priv->folder_path == NULL)
+    return FALSE;
+
+  path = gtk_tree_model_get_path (priv->model, child_iter);
+  k = path ? child_index (path, priv->folder_path) : -1;
+  if (path)
+    gtk_tree_path_free (path);
+
+  if (k < 0 || k >= g_sequence_get_length (priv->children))
+    return FALSE;
+
+  child = CHILD_AT (priv, k);
+  if (child->order_pos == NULL)
+    return FALSE;
+
+  iter->stamp = priv->stamp;
+  iter->user_data = child->order_pos;
+  return TRUE;
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileFolderView
+ *
+ * Flat, sortable list of the visible children of a single folder of
+ * a HildonFileSystemModel.  This replaces the GtkTreeModelFilter
+ * (with a virtual root) plus GtkTreeModelSort pair that used to sit
+ * between the model and the content pane: only the direct children
+ * of the folder are ever looked at, the visible rows are kept in
+ * sorted order in one array and changes are applied with a binary
+ * search instead of a full resort.
+ *
+ * INTERNAL TO FILE SELECTION STUFF, NOT FOR APPLICATION DEVELOPERS TO USE.
+ *
+ */
+
+#ifndef __HILDON_FILE_FOLDER_VIEW_H__
+#define __HILDON_FILE_FOLDER_VIEW_H__
+
+#include <gtk/gtk.h>
+#include "hildon-file-system-model.h"
+
+G_BEGIN_DECLS
+
+#define HILDON_TYPE_FILE_FOLDER_VIEW (hildon_file_folder_view_get_type())
+#define HILDON_FILE_FOLDER_VIEW(object) \
+  (G_TYPE_CHECK_INSTANCE_CAST((object), HILDON_TYPE_FILE_FOLDER_VIEW, \
+  HildonFileFolderView))
+#define HILDON_FILE_FOLDER_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), HILDON_TYPE_FILE_FOLDER_VIEW, \
+  HildonFileFolderViewClass))
+#define HILDON_IS_FILE_FOLDER_VIEW(object) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((object), HILDON_TYPE_FILE_FOLDER_VIEW))
+#define HILDON_IS_FILE_FOLDER_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), HILDON_TYPE_FILE_FOLDER_VIEW))
+
+typedef struct _HildonFileFolderView HildonFileFolderView;
+typedef struct _HildonFileFolderViewClass HildonFileFolderViewClass;
+typedef struct _HildonFileFolderViewPrivate HildonFileFolderViewPrivate;
+
+struct _HildonFileFolderView
+{
+  GObject parent;
+  HildonFileFolderViewPrivate *priv;
+};
+
+struct _HildonFileFolderViewClass
+{
+  GObjectClass parent_class;
+};
+
+GType hildon_file_folder_view_get_type(void);
+
+/* FOLDER is an iter of MODEL, or NULL for an always empty view.  The
+   view starts out unsorted and with every child visible. */
+HildonFileFolderView *
+_hildon_file_folder_view_new(HildonFileSystemModel *model,
+                             GtkTreeIter *folder);
+
+GtkTreeModel *_hildon_file_folder_view_get_model(HildonFileFolderView *self);
+
+/* Returns FALSE when the folder has been removed from the model. */
+gboolean _hildon_file_folder_view_get_folder(HildonFileFolderView *self,
+                                             GtkTreeIter *folder);
+
+/* FUNC is called with iters of the underlying model. */
+void _hildon_file_folder_view_set_visible_func(HildonFileFolderView *self,
+                                  GtkTreeModelFilterVisibleFunc func,
+                                  gpointer data,
+                                  GDestroyNotify destroy);
+void _hildon_file_folder_view_refilter(HildonFileFolderView *self);
+
+/* FUNC is called with the iter in MODEL of every row that is about to
+   leave the view, because it is filtered out, deleted or gone with the
+   folder.  The node of the row has not been freed yet at that
+   point. */
+typedef void (*HildonFileFolderViewHideFunc) (HildonFileFolderView *self,
+                                              GtkTreeIter *child_iter,
+                                              gpointer data);
+void _hildon_file_folder_view_set_hide_func(HildonFileFolderView *self,
+                                            HildonFileFolderViewHideFunc func,
+                                            gpointer data);
+
+void
+_hildon_file_folder_view_convert_iter_to_child_iter(HildonFileFolderView *self,
+                                                    GtkTreeIter *child_iter,
+                                                    GtkTreeIter *iter);
+gboolean
+_hildon_file_folder_view_convert_child_iter_to_iter(HildonFileFolderView *self,
+                                                    GtkTreeIter *iter,
+                                                    GtkTreeIter *child_iter);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,1055 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileGridView
+ *
+ * Row K of the model goes to column K % N_COLUMNS of line
+ * K / N_COLUMNS, and every line is CELL_HEIGHT pixels high.  The view
+ * only remembers how many rows the model has, kept up to date from its
+ * signals, and the position of the cursor.  Drawing walks the model
+ * from the first row of the exposed area to the last one, so a frame
+ * looks at the rows of about one screen, whatever the size of the
+ * model.  Scrolling moves what is on the window already and only the
+ * lines uncovered are drawn.
+ */
+
+#include "config.h"
+
+#include <gdk/gdkkeysyms.h>
+
+#include "hildon-file-grid-view.h"
+
+/* Space around the thumbnail and the text of a cell */
+#define CELL_PADDING 4
+
+enum {
+  ITEM_ACTIVATED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+struct _HildonFileGridViewPrivate
+{
+  GtkTreeModel *model;
+  gint n_items;
+  gint pixbuf_column, text_column, sensitive_column;
+
+  GtkCellRenderer *pixbuf_renderer;
+  GtkCellRenderer *text_renderer;
+  HildonFileGridViewDataFunc data_func;
+  gpointer data_func_data;
+  HildonFileGridViewSelectedFunc selected_func;
+  gpointer selected_func_data;
+
+  GtkAdjustment *hadjustment;
+  GtkAdjustment *vadjustment;
+  gint yoffset;               /* the value of VADJUSTMENT drawn */
+
+  /* Geometry: the cell size asked for, and the one used for the
+     current allocation */
+  gint pixbuf_width, pixbuf_height;
+  gint text_height;
+  gint n_columns;
+  gint column_width;
+  gint cell_height;
+
+  gint cursor;                /* -1 when not set */
+  gint pressed;               /* cell of the button press, or -1 */
+
+  /* Scrolling asked for before the view had a size */
+  gint scroll_to;             /* -1 when nothing is pending */
+  gboolean scroll_use_align;
+  gfloat scroll_align;
+};
+
+G_DEFINE_TYPE(HildonFileGridView, hildon_file_grid_view, GTK_TYPE_WIDGET)
+
+/* Geometry */
+
+static gint
+n_lines (HildonFileGridViewPrivate *priv)
+{
+  return (priv->n_items + priv->n_columns - 1) / priv->n_columns;
+}
+
+static void
+get_cell_area (HildonFileGridView *self, gint index, GdkRectangle *area)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+
+  area->x = (index % priv->n_columns) * priv->column_width;
+  area->y = (index / priv->n_columns) * priv->cell_height - priv->yoffset;
+  area->width = priv->column_width;
+  area->height = priv->cell_height;
+}
+
+/* The cell under the window coordinates X, Y, or -1 */
+static gint
+get_index_at_pos (HildonFileGridView *self, gint x, gint y)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint column, line, index;
+
+  if (x < 0 || y < 0)
+    return -1;
+
+  column = x / priv->column_width;
+  line = (y + priv->yoffset) / priv->cell_height;
+  index = line * priv->n_columns + column;
+
+  if (column >= priv->n_columns || index >= priv->n_items)
+    return -1;
+
+  return index;
+}
+
+static void
+invalidate_cell (HildonFileGridView *self, gint index)
+{
+  GdkRectangle area;
+
+  if (index < 0 || !GTK_WIDGET_REALIZED (self))
+    return;
+
+  get_cell_area (self, index, &area);
+  gdk_window_invalidate_rect (GTK_WIDGET (self)->window, &area, FALSE);
+}
+
+static void
+update_text_height (HildonFileGridView *self)
+{
+  GtkWidget *widget = GTK_WIDGET (self);
+  HildonFileGridViewPrivate *priv = self->priv;
+  PangoContext *context;
+  PangoFontMetrics *metrics;
+  gint ypad;
+
+  context = gtk_widget_get_pango_context (widget);
+  metrics = pango_context_get_metrics (context, widget->style->font_desc,
+                                       pango_context_get_language (context));
+  g_object_get (priv->text_renderer, "ypad", &ypad, NULL);
+
+  priv->text_height =
+    PANGO_PIXELS (pango_font_metrics_get_ascent (metrics)
+                  + pango_font_metrics_get_descent (metrics)) + 2 * ypad;
+  priv->cell_height = 2 * CELL_PADDING + priv->pixbuf_height
+                      + priv->text_height;
+
+  pango_font_metrics_unref (metrics);
+}
+
+/* Scrolling */
+
+static void
+update_adjustments (HildonFileGridView *self)
+{
+  GtkWidget *widget = GTK_WIDGET (self);
+  HildonFileGridViewPrivate *priv = self->priv;
+  GtkAdjustment *vadj = priv->vadjustment;
+  gdouble value;
+
+  if (priv->hadjustment)
+    {
+      priv->hadjustment->lower = 0;
+      priv->hadjustment->upper = widget->allocation.width;
+      priv->hadjustment->page_size = widget->allocation.width;
+      priv->hadjustment->step_increment = priv->column_width;
+      priv->hadjustment->page_increment = widget->allocation.width;
+      priv->hadjustment->value = 0;
+      gtk_adjustment_changed (priv->hadjustment);
+    }
+
+  if (!vadj)
+    return;
+
+  vadj->lower = 0;
+  vadj->upper = MAX (n_lines (priv) * priv->cell_height,
+                     widget->allocation.height);
+  vadj->page_size = widget->allocation.height;
+  vadj->step_increment = priv->cell_height;
+  vadj->page_increment = widget->allocation.height * 0.9;
+
+  value = CLAMP (vadj->value, 0, vadj->upper - vadj->page_size);
+  gtk_adjustment_changed (vadj);
+  if (value != vadj->value)
+    gtk_adjustment_set_value (vadj, value);
+}
+
+static void
+vadjustment_value_changed (GtkAdjustment *adjustment,
+                           HildonFileGridView *self)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint yoffset = (gint) adjustment->value;
+
+  if (yoffset == priv->yoffset)
+    return;
+
+  /* What stays on screen is moved, the rest gets an expose */
+  if (GTK_WIDGET_REALIZED (self))
+    gdk_window_scroll (GTK_WIDGET (self)->window, 0,
+                       priv->yoffset - yoffset);
+  priv->yoffset = yoffset;
+}
+
+static void
+set_adjustment (HildonFileGridView *self, GtkAdjustment **slot,
+                GtkAdjustment *adjustment, gboolean vertical)
+{
+  if (*slot == adjustment)
+    return;
+
+  if (*slot)
+    {
+      g_signal_handlers_disconnect_by_func (*slot,
+                                            vadjustment_value_changed, self);
+      g_object_unref (*slot);
+    }
+
+  *slot = g_object_ref_sink (adjustment);
+  if (vertical)
+    g_signal_connect (adjustment, "value-changed",
+                      G_CALLBACK (vadjustment_value_changed), self);
+}
+
+static void
+hildon_file_grid_view_set_scroll_adjustments (HildonFileGridView *self,
+                                              GtkAdjustment *hadjustment,
+                                              GtkAdjustment *vadjustment)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+
+  if (!hadjustment)
+    hadjustment = GTK_ADJUSTMENT (gtk_adjustment_new (0, 0, 0, 0, 0, 0));
+  if (!vadjustment)
+    vadjustment = GTK_ADJUSTMENT (gtk_adjustment_new (0, 0, 0, 0, 0, 0));
+
+  set_adjustment (self, &priv->hadjustment, hadjustment, FALSE);
+  set_adjustment (self, &priv->vadjustment, vadjustment, TRUE);
+
+  priv->yoffset = (gint) vadjustment->value;
+  update_adjustments (self);
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+static void
+scroll_to_index (HildonFileGridView *self, gint index,
+                 gboolean use_align, gfloat row_align)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+  GtkAdjustment *vadj = priv->vadjustment;
+  gdouble y, value;
+
+  if (index < 0 || index >= priv->n_items)
+    return;
+
+  /* Without a size there is no telling where the cell is yet */
+  if (!vadj || !GTK_WIDGET_REALIZED (self) || vadj->page_size <= 0)
+    {
+      priv->scroll_to = index;
+      priv->scroll_use_align = use_align;
+      priv->scroll_align = row_align;
+      return;
+    }
+
+  y = (index / priv->n_columns) * priv->cell_height;
+
+  if (use_align)
+    value = y - row_align * (vadj->page_size - priv->cell_height);
+  else if (y < vadj->value)
+    value = y;
+  else if (y + priv->cell_height > vadj->value + vadj->page_size)
+    value = y + priv->cell_height - vadj->page_size;
+  else
+    return;
+
+  gtk_adjustment_set_value (vadj, CLAMP (value, vadj->lower,
+                                         vadj->upper - vadj->page_size));
+}
+
+static void
+set_cursor_index (HildonFileGridView *self, gint index)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+
+  if (index == priv->cursor)
+    return;
+
+  invalidate_cell (self, priv->cursor);
+  priv->cursor = index;
+  invalidate_cell (self, priv->cursor);
+}
+
+/* Model */
+
+static gboolean
+index_is_shown (HildonFileGridView *self, gint index)
+{
+  GtkWidget *widget = GTK_WIDGET (self);
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint line = index / priv->n_columns;
+
+  return GTK_WIDGET_REALIZED (self)
+    && (line + 1) * priv->cell_height > priv->yoffset
+    && line * priv->cell_height < priv->yoffset + widget->allocation.height;
+}
+
+static void
+model_row_inserted (GtkTreeModel *model, GtkTreePath *path,
+                    GtkTreeIter *iter, HildonFileGridView *self)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint index;
+
+  if (gtk_tree_path_get_depth (path) != 1)
+    return;
+
+  index = gtk_tree_path_get_indices (path)[0];
+  priv->n_items++;
+  if (priv->cursor >= index)
+    priv->cursor++;
+
+  update_adjustments (self);
+
+  /* The cells from INDEX on moved one forward */
+  if (index_is_shown (self, index)
+      || index / priv->n_columns < priv->yoffset / priv->cell_height)
+    gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+static void
+model_row_deleted (GtkTreeModel *model, GtkTreePath *path,
+                   HildonFileGridView *self)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint index;
+
+  if (gtk_tree_path_get_depth (path) != 1)
+    return;
+
+  index = gtk_tree_path_get_indices (path)[0];
+  priv->n_items--;
+
+  /* A deleted cursor goes to the row that takes its place */
+  if (priv->cursor > index)
+    priv->cursor--;
+  else if (priv->cursor == index && priv->cursor >= priv->n_items)
+    priv->cursor = priv->n_items - 1;
+
+  if (priv->pressed >= index)
+    priv->pressed = -1;
+
+  update_adjustments (self);
+
+  if (index_is_shown (self, index)
+      || index / priv->n_columns < priv->yoffset / priv->cell_height)
+    gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+static void
+model_row_changed (GtkTreeModel *model, GtkTreePath *path,
+                   GtkTreeIter *iter, HildonFileGridView *self)
+{
+  if (gtk_tree_path_get_depth (path) == 1
+      && index_is_shown (self, gtk_tree_path_get_indices (path)[0]))
+    invalidate_cell (self, gtk_tree_path_get_indices (path)[0]);
+}
+
+static void
+model_rows_reordered (GtkTreeModel *model, GtkTreePath *path,
+                      GtkTreeIter *iter, gint *new_order,
+                      HildonFileGridView *self)
+{
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint i;
+
+  if (gtk_tree_path_get_depth (path) != 0)
+    return;
+
+  /* The cursor stays with its row */
+  if (priv->cursor >= 0)
+    for (i = 0; i < priv->n_items; i++)
+      if (new_order[i] == priv->cursor)
+        {
+          priv->cursor = i;
+          break;
+        }
+
+  priv->pressed = -1;
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+/* Drawing */
+
+static void
+draw_cell (HildonFileGridView *self, GtkTreeIter *iter, gint index,
+           GdkRectangle *expose_area)
+{
+  GtkWidget *widget = GTK_WIDGET (self);
+  HildonFileGridViewPrivate *priv = self->priv;
+  GdkRectangle cell, pixbuf_area, text_area;
+  GtkCellRendererState flags = 0;
+  GdkPixbuf *pixbuf = NULL;
+  gchar *text = NULL;
+  gboolean sensitive = TRUE;
+
+  get_cell_area (self, index, &cell);
+
+  gtk_tree_model_get (priv->model, iter,
+                      priv->pixbuf_column, &pixbuf,
+                      priv->text_column, &text,
+                      -1);
+  if (priv->sensitive_column >= 0)
+    gtk_tree_model_get (priv->model, iter,
+                        priv->sensitive_column, &sensitive, -1);
+
+  g_object_set (priv->pixbuf_renderer,
+                "pixbuf", pixbuf, "sensitive", sensitive, NULL);
+  g_object_set (priv->text_renderer,
+                "text", text, "sensitive", sensitive, NULL);
+  if (priv->data_func)
+    priv->data_func (self, priv->text_renderer, priv->model, iter,
+                     priv->data_func_data);
+
+  if (priv->selected_func
+      && priv->selected_func (self, priv->model, iter,
+                              priv->selected_func_data))
+    {
+      flags |= GTK_CELL_RENDERER_SELECTED;
+      gtk_paint_flat_box (widget->style, widget->window,
+                          GTK_STATE_SELECTED, GTK_SHADOW_NONE,
+                          expose_area, widget, "cell_even",
+                          cell.x, cell.y, cell.width, cell.height);
+    }
+
+  if (index == priv->cursor && GTK_WIDGET_HAS_FOCUS (widget))
+    flags |= GTK_CELL_RENDERER_FOCUSED;
+
+  pixbuf_area.x = cell.x;
+  pixbuf_area.y = cell.y + CELL_PADDING;
+  pixbuf_area.width = cell.width;
+  pixbuf_area.height = priv->pixbuf_height;
+
+  text_area.x = cell.x;
+  text_area.y = pixbuf_area.y + pixbuf_area.height;
+  text_area.width = cell.width;
+  text_area.height = priv->text_height;
+
+  gtk_cell_renderer_render (priv->pixbuf_renderer, widget->window, widget,
+                            &pixbuf_area, &pixbuf_area, expose_area, flags);
+  gtk_cell_renderer_render (priv->text_renderer, widget->window, widget,
+                            &text_area, &text_area, expose_area, flags);
+
+  if (flags & GTK_CELL_RENDERER_FOCUSED)
+    gtk_paint_focus (widget->style, widget->window,
+                     GTK_WIDGET_STATE (widget), expose_area, widget,
+                     "treeview", cell.x, cell.y, cell.width, cell.height);
+
+  if (pixbuf)
+    g_object_unref (pixbuf);
+  g_free (text);
+}
+
+static gboolean
+hildon_file_grid_view_expose (GtkWidget *widget, GdkEventExpose *event)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (widget);
+  HildonFileGridViewPrivate *priv = self->priv;
+  GtkTreeIter iter;
+  gint first_line, last_line, first, last, i;
+
+  if (event->window != widget->window || !priv->model || !priv->n_items)
+    return FALSE;
+
+  first_line = (event->area.y + priv->yoffset) / priv->cell_height;
+  last_line = (event->area.y + event->area.height - 1 + priv->yoffset)
+              / priv->cell_height;
+  first = first_line * priv->n_columns;
+  last = MIN (priv->n_items - 1, (last_line + 1) * priv->n_columns - 1);
+
+  if (first > last
+      || !gtk_tree_model_iter_nth_child (priv->model, &iter, NULL, first))
+    return FALSE;
+
+  for (i = first; i <= last; i++)
+    {
+      GdkRectangle cell, area;
+
+      get_cell_area (self, i, &cell);
+      if (gdk_rectangle_intersect (&cell, &event->area, &area))
+        draw_cell (self, &iter, i, &event->area);
+
+      if (!gtk_tree_model_iter_next (priv->model, &iter))
+        break;
+    }
+
+  return FALSE;
+}
+
+/* Events */
+
+static void
+activate_index (HildonFileGridView *self, gint index)
+{
+  GtkTreePath *path = gtk_tree_path_new_from_indices (index, -1);
+
+  g_signal_emit (self, signals[ITEM_ACTIVATED], 0, path);
+  gtk_tree_path_free (path);
+}
+
+static gboolean
+hildon_file_grid_view_button_press (GtkWidget *widget, GdkEventButton *event)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (widget);
+
+  if (event->button != 1 || event->type != GDK_BUTTON_PRESS)
+    return FALSE;
+
+  if (!GTK_WIDGET_HAS_FOCUS (widget))
+    gtk_widget_grab_focus (widget);
+
+  self->priv->pressed = get_index_at_pos (self, event->x, event->y);
+
+  return TRUE;
+}
+
+/* A tap is a press and a release in the same cell.  A pannable area
+   lets the release go elsewhere when the press started a pan. */
+static gboolean
+hildon_file_grid_view_button_release (GtkWidget *widget,
+                                      GdkEventButton *event)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (widget);
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint pressed = priv->pressed;
+
+  if (event->button != 1)
+    return FALSE;
+
+  priv->pressed = -1;
+  if (pressed < 0 || get_index_at_pos (self, event->x, event->y) != pressed)
+    return TRUE;
+
+  set_cursor_index (self, pressed);
+  activate_index (self, pressed);
+
+  return TRUE;
+}
+
+/* Arrows move the cursor inside the grid.  At its edges they are left
+   to the handlers after the view. */
+static gboolean
+hildon_file_grid_view_key_press (GtkWidget *widget, GdkEventKey *event)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (widget);
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint cursor = priv->cursor, target, page;
+
+  if (!priv->n_items)
+    return FALSE;
+
+  page = MAX (1, widget->allocation.height / priv->cell_height)
+         * priv->n_columns;
+
+  switch (event->keyval)
+    {
+    case GDK_KP_Enter:
+    case GDK_ISO_Enter:
+    case GDK_Return:
+    case GDK_space:
+      if (cursor < 0)
+        return FALSE;
+      activate_index (self, cursor);
+      return TRUE;
+    case GDK_KP_Up:
+    case GDK_Up:
+      target = cursor - priv->n_columns;
+      break;
+    case GDK_KP_Down:
+    case GDK_Down:
+      target = cursor + priv->n_columns;
+      /* From the line above the last one, to the last cell */
+      if (target >= priv->n_items
+          && cursor / priv->n_columns < n_lines (priv) - 1)
+        target = priv->n_items - 1;
+      break;
+    case GDK_KP_Left:
+    case GDK_Left:
+      target = cursor % priv->n_columns ? cursor - 1 : -1;
+      break;
+    case GDK_KP_Right:
+    case GDK_Right:
+      target = cursor % priv->n_columns < priv->n_columns - 1
+               ? cursor + 1 : priv->n_items;
+      break;
+    case GDK_KP_Page_Up:
+    case GDK_Page_Up:
+      target = MAX (cursor - page, cursor % priv->n_columns);
+      break;
+    case GDK_KP_Page_Down:
+    case GDK_Page_Down:
+      target = MIN (cursor + page, priv->n_items - 1);
+      break;
+    case GDK_KP_Home:
+    case GDK_Home:
+      target = 0;
+      break;
+    case GDK_KP_End:
+    case GDK_End:
+      target = priv->n_items - 1;
+      break;
+    default:
+      return FALSE;
+    }
+
+  /* Without a cursor, any move starts from the first cell */
+  if (cursor < 0)
+    target = 0;
+  else if (target < 0 || target >= priv->n_items)
+    return FALSE;
+
+  set_cursor_index (self, target);
+  scroll_to_index (self, target, FALSE, 0.0);
+
+  return TRUE;
+}
+
+static gboolean
+hildon_file_grid_view_focus_change (GtkWidget *widget, GdkEventFocus *event)
+{
+  invalidate_cell (HILDON_FILE_GRID_VIEW (widget),
+                   HILDON_FILE_GRID_VIEW (widget)->priv->cursor);
+
+  return FALSE;
+}
+
+/* GtkWidget */
+
+static void
+hildon_file_grid_view_realize (GtkWidget *widget)
+{
+  GdkWindowAttr attributes;
+
+  GTK_WIDGET_SET_FLAGS (widget, GTK_REALIZED);
+
+  attributes.window_type = GDK_WINDOW_CHILD;
+  attributes.x = widget->allocation.x;
+  attributes.y = widget->allocation.y;
+  attributes.width = widget->allocation.width;
+  attributes.height = widget->allocation.height;
+  attributes.wclass = GDK_INPUT_OUTPUT;
+  attributes.visual = gtk_widget_get_visual (widget);
+  attributes.colormap = gtk_widget_get_colormap (widget);
+  attributes.event_mask = gtk_widget_get_events (widget)
+                          | GDK_EXPOSURE_MASK
+                          | GDK_BUTTON_PRESS_MASK
+                          | GDK_BUTTON_RELEASE_MASK
+                          | GDK_KEY_PRESS_MASK;
+
+  widget->window = gdk_window_new (gtk_widget_get_parent_window (widget),
+                                   &attributes,
+                                   GDK_WA_X | GDK_WA_Y | GDK_WA_VISUAL
+                                   | GDK_WA_COLORMAP);
+  gdk_window_set_user_data (widget->window, widget);
+
+  widget->style = gtk_style_attach (widget->style, widget->window);
+  gdk_window_set_background (widget->window,
+                             &widget->style->base[GTK_WIDGET_STATE (widget)]);
+}
+
+static void
+hildon_file_grid_view_style_set (GtkWidget *widget, GtkStyle *previous)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (widget);
+
+  if (GTK_WIDGET_REALIZED (widget))
+    gdk_window_set_background (widget->window,
+                               &widget->style->base[GTK_WIDGET_STATE (widget)]);
+
+  update_text_height (self);
+  gtk_widget_queue_resize (widget);
+}
+
+static void
+hildon_file_grid_view_size_request (GtkWidget *widget,
+                                    GtkRequisition *requisition)
+{
+  HildonFileGridViewPrivate *priv = HILDON_FILE_GRID_VIEW (widget)->priv;
+
+  /* Scrolled, so one cell is enough */
+  requisition->width = priv->pixbuf_width;
+  requisition->height = priv->cell_height;
+}
+
+static void
+hildon_file_grid_view_size_allocate (GtkWidget *widget,
+                                     GtkAllocation *allocation)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (widget);
+  HildonFileGridViewPrivate *priv = self->priv;
+  gint n_columns;
+
+  widget->allocation = *allocation;
+
+  if (GTK_WIDGET_REALIZED (widget))
+    gdk_window_move_resize (widget->window,
+                            allocation->x, allocation->y,
+                            allocation->width, allocation->height);
+
+  n_columns = MAX (1, allocation->width / priv->pixbuf_width);
+  if (n_columns != priv->n_columns)
+    gtk_widget_queue_draw (widget);
+
+  priv->n_columns = n_columns;
+  priv->column_width = MAX (priv->pixbuf_width,
+                            allocation->width / n_columns);
+
+  update_adjustments (self);
+
+  if (priv->scroll_to >= 0 && GTK_WIDGET_REALIZED (widget))
+    {
+      gint index = priv->scroll_to;
+
+      priv->scroll_to = -1;
+      scroll_to_index (self, index, priv->scroll_use_align,
+                       priv->scroll_align);
+    }
+}
+
+static void
+hildon_file_grid_view_map (GtkWidget *widget)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (widget);
+
+  GTK_WIDGET_CLASS (hildon_file_grid_view_parent_class)->map (widget);
+
+  if (self->priv->scroll_to >= 0)
+    gtk_widget_queue_resize (widget);
+}
+
+/* GObject */
+
+static void
+hildon_file_grid_view_init (HildonFileGridView *self)
+{
+  HildonFileGridViewPrivate *priv;
+
+  priv = self->priv = G_TYPE_INSTANCE_GET_PRIVATE
+    (self, HILDON_TYPE_FILE_GRID_VIEW, HildonFileGridViewPrivate);
+
+  GTK_WIDGET_SET_FLAGS (self, GTK_CAN_FOCUS);
+
+  priv->pixbuf_renderer = g_object_ref_sink (gtk_cell_renderer_pixbuf_new ());
+  priv->text_renderer = g_object_ref_sink (gtk_cell_renderer_text_new ());
+  g_object_set (priv->text_renderer,
+                "xalign", 0.5, "xpad", CELL_PADDING, "ypad", 0,
+                "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+
+  priv->pixbuf_column = priv->text_column = 0;
+  priv->sensitive_column = -1;
+  priv->n_columns = 1;
+  priv->column_width = priv->pixbuf_width = 1;
+  priv->cell_height = priv->pixbuf_height = 1;
+  priv->cursor = priv->pressed = priv->scroll_to = -1;
+
+  hildon_file_grid_view_set_scroll_adjustments (self, NULL, NULL);
+}
+
+static void
+hildon_file_grid_view_dispose (GObject *obj)
+{
+  HildonFileGridView *self = HILDON_FILE_GRID_VIEW (obj);
+  HildonFileGridViewPrivate *priv = self->priv;
+
+  _hildon_file_grid_view_set_model (self, NULL);
+
+  if (priv->hadjustment)
+    {
+      g_object_unref (priv->hadjustment);
+      priv->hadjustment = NULL;
+    }
+  if (priv->vadjustment)
+    {
+      g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                            vadjustment_value_changed, self);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
+    }
+  if (priv->pixbuf_renderer)
+    {
+      g_object_unref (priv->pixbuf_renderer);
+      priv->pixbuf_renderer = NULL;
+    }
+  if (priv->text_renderer)
+    {
+      g_object_unref (priv->text_renderer);
+      priv->text_renderer = NULL;
+    }
+
+  G_OBJECT_CLASS (hildon_file_grid_view_parent_class)->dispose (obj);
+}
+
+static void
+hildon_file_grid_view_class_init (HildonFileGridViewClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (HildonFileGridViewPrivate));
+
+  object_class->dispose = hildon_file_grid_view_dispose;
+
+  widget_class->realize = hildon_file_grid_view_realize;
+  widget_class->map = hildon_file_grid_view_map;
+  widget_class->style_set = hildon_file_grid_view_style_set;
+  widget_class->size_request = hildon_file_grid_view_size_request;
+  widget_class->size_allocate = hildon_file_grid_view_size_allocate;
+  widget_class->expose_event = hildon_file_grid_view_expose;
+  widget_class->button_press_event = hildon_file_grid_view_button_press;
+  widget_class->button_release_event = hildon_file_grid_view_button_release;
+  widget_class->key_press_event = hildon_file_grid_view_key_press;
+  widget_class->focus_in_event = hildon_file_grid_view_focus_change;
+  widget_class->focus_out_event = hildon_file_grid_view_focus_change;
+
+  klass->set_scroll_adjustments = hildon_file_grid_view_set_scroll_adjustments;
+
+  widget_class->set_scroll_adjustments_signal =
+    g_signal_new ("set-scroll-adjustments",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                  G_STRUCT_OFFSET (HildonFileGridViewClass,
+                                   set_scroll_adjustments),
+                  NULL, NULL,
+                  gtk_marshal_VOID__OBJECT_OBJECT, G_TYPE_NONE, 2,
+                  GTK_TYPE_ADJUSTMENT, GTK_TYPE_ADJUSTMENT);
+
+  signals[ITEM_ACTIVATED] =
+    g_signal_new ("item-activated",
+                  G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (HildonFileGridViewClass, item_activated),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__BOXED, G_TYPE_NONE, 1,
+                  GTK_TYPE_TREE_PATH);
+}
+
+/* Internal API */
+
+GtkWidget *
+_hildon_file_grid_view_new (gint pixbuf_width, gint pixbuf_height)
+{
+  HildonFileGridView *self;
+
+  g_return_val_if_fail (pixbuf_width > 0 && pixbuf_height > 0, NULL);
+
+  self = g_object_new (HILDON_TYPE_FILE_GRID_VIEW, NULL);
+  self->priv->pixbuf_width = self->priv->column_width = pixbuf_width;
+  self->priv->pixbuf_height = pixbuf_height;
+  gtk_cell_renderer_set_fixed_size (self->priv->pixbuf_renderer,
+                                    pixbuf_width, pixbuf_height);
+  update_text_height (self);
+
+  return GTK_WIDGET (self);
+}
+
+void
+_hildon_file_grid_view_set_model (HildonFileGridView *self,
+                                  GtkTreeModel *model)
+{
+  HildonFileGridViewPrivate *priv;
+
+  g_return_if_fail (HILDON_IS_FILE_GRID_VIEW (self));
+  g_return_if_fail (model == NULL || GTK_IS_TREE_MODEL (model));
+  priv = self->priv;
+
+  if (model == priv->model)
+    return;
+
+  if (priv->model)
+    g_signal_handlers_disconnect_matched (priv->model, G_SIGNAL_MATCH_DATA,
+                                          0, 0, NULL, NULL, self);
+
+  priv->model = model;
+  priv->n_items = 0;
+  priv->cursor = priv->pressed = priv->scroll_to = -1;
+
+  if (model)
+    {
+      priv->n_items = gtk_tree_model_iter_n_children (model, NULL);
+
+      g_signal_connect (model, "row-inserted",
+                        G_CALLBACK (model_row_inserted), self);
+      g_signal_connect (model, "row-deleted",
+                        G_CALLBACK (model_row_deleted), self);
+      g_signal_connect (model, "row-changed",
+                        G_CALLBACK (model_row_changed), self);
+      g_signal_connect (model, "rows-reordered",
+                        G_CALLBACK (model_rows_reordered), self);
+    }
+
+  if (priv->vadjustment)
+    gtk_adjustment_set_value (priv->vadjustment, 0);
+  update_adjustments (self);
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+GtkTreeModel *
+_hildon_file_grid_view_get_model (HildonFileGridView *self)
+{
+  g_return_val_if_fail (HILDON_IS_FILE_GRID_VIEW (self), NULL);
+
+  return self->priv->model;
+}
+
+void
+_hildon_file_grid_view_set_columns (HildonFileGridView *self,
+                                    gint pixbuf_column,
+                                    gint text_column,
+                                    gint sensitive_column)
+{
+  g_return_if_fail (HILDON_IS_FILE_GRID_VIEW (self));
+
+  self->priv->pixbuf_column = pixbuf_column;
+  self->priv->text_column = text_column;
+  self->priv->sensitive_column = sensitive_column;
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+void
+_hildon_file_grid_view_set_data_func (HildonFileGridView *self,
+                                      HildonFileGridViewDataFunc func,
+                                      gpointer data)
+{
+  g_return_if_fail (HILDON_IS_FILE_GRID_VIEW (self));
+
+  self->priv->data_func = func;
+  self->priv->data_func_data = data;
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+void
+_hildon_file_grid_view_set_selected_func (HildonFileGridView *self,
+                                          HildonFileGridViewSelectedFunc func,
+                                          gpointer data)
+{
+  g_return_if_fail (HILDON_IS_FILE_GRID_VIEW (self));
+
+  self->priv->selected_func = func;
+  self->priv->selected_func_data = data;
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+GtkTreePath *
+_hildon_file_grid_view_get_cursor (HildonFileGridView *self)
+{
+  g_return_val_if_fail (HILDON_IS_FILE_GRID_VIEW (self), NULL);
+
+  if (self->priv->cursor < 0)
+    return NULL;
+
+  return gtk_tree_path_new_from_indices (self->priv->cursor, -1);
+}
+
+void
+_hildon_file_grid_view_set_cursor (HildonFileGridView *self,
+                                   GtkTreePath *path)
+{
+  gint index = -1;
+
+  g_return_if_fail (HILDON_IS_FILE_GRID_VIEW (self));
+
+  if (path && gtk_tree_path_get_depth (path) == 1)
+    index = gtk_tree_path_get_indices (path)[0];
+  if (index >= self->priv->n_items)
+    index = -1;
+
+  set_cursor_index (self, index);
+  scroll_to_index (self, index, FALSE, 0.0);
+}
+
+GtkTreePath *
+_hildon_file_grid_view_get_path_at_pos (HildonFileGridView *self,
+                                        gint x, gint y)
+{
+  gint index;
+
+  g_return_val_if_fail (HILDON_IS_FILE_GRID_VIEW (self), NULL);
+
+  index = get_index_at_pos (self, x, y);
+  if (index < 0)
+    return NULL;
+
+  return gtk_tree_path_new_from_indices (index, -1);
+}
+
+gboolean
+_hildon_file_grid_view_get_visible_range (HildonFileGridView *self,
+                                          GtkTreePath **start_path,
+                                          GtkTreePath **end_path)
+{
+  HildonFileGridViewPrivate *priv;
+  gint first, last;
+
+  g_return_val_if_fail (HILDON_IS_FILE_GRID_VIEW (self), FALSE);
+  priv = self->priv;
+
+  if (!GTK_WIDGET_REALIZED (self) || !priv->n_items)
+    return FALSE;
+
+  first = priv->yoffset / priv->cell_height * priv->n_columns;
+  last = ((priv->yoffset + GTK_WIDGET (self)->allocation.height - 1)
+          / priv->cell_height + 1) * priv->n_columns - 1;
+  last = MIN (last, priv->n_items - 1);
+  if (first > last)
+    return FALSE;
+
+  if (start_path)
+    *start_path = gtk_tree_path_new_from_indices (first, -1);
+  if (end_path)
+    *end_path = gtk_tree_path_new_from_indices (last, -1);
+
+  return TRUE;
+}
+
+gint
+_hildon_file_grid_view_get_n_columns (HildonFileGridView *self)
+{
+  g_return_val_if_fail (HILDON_IS_FILE_GRID_VIEW (self), 1);
+
+  return self->priv->n_columns;
+}
+
+void
+_hildon_file_grid_view_scroll_to_path (HildonFileGridView *self,
+                                       GtkTreePath *path,
+                                       gboolean use_align,
+                                       gfloat row_align)
+{
+  g_return_if_fail (HILDON_IS_FILE_GRID_VIEW (self));
+  g_return_if_fail (path != NULL);
+
+  if (gtk_tree_path_get_depth (path) == 1)
+    scroll_to_index (self, gtk_tree_path_get_indices (path)[0],
+                     use_align, row_align);
+}
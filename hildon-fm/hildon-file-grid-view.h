@@ -0,0 +1,141 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileGridView
+ *
+ * Grid of thumbnails with their names below them, for the rows of a
+ * flat GtkTreeModel.  Every cell has the same size, so where a row is
+ * drawn is computed from its position and nothing is measured.  Only
+ * the rows of the cells being drawn are looked at, through one pixbuf
+ * and one text renderer that all cells share, so drawing and memory
+ * do not depend on the number of rows.  The view scrolls vertically
+ * with the adjustments given to it by a GtkScrolledWindow or a
+ * HildonPannableArea.
+ *
+ * INTERNAL TO FILE SELECTION STUFF, NOT FOR APPLICATION DEVELOPERS TO USE.
+ *
+ */
+
+#ifndef __HILDON_FILE_GRID_VIEW_H__
+#define __HILDON_FILE_GRID_VIEW_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define HILDON_TYPE_FILE_GRID_VIEW (hildon_file_grid_view_get_type())
+#define HILDON_FILE_GRID_VIEW(object) \
+  (G_TYPE_CHECK_INSTANCE_CAST((object), HILDON_TYPE_FILE_GRID_VIEW, \
+  HildonFileGridView))
+#define HILDON_FILE_GRID_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), HILDON_TYPE_FILE_GRID_VIEW, \
+  HildonFileGridViewClass))
+#define HILDON_IS_FILE_GRID_VIEW(object) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((object), HILDON_TYPE_FILE_GRID_VIEW))
+#define HILDON_IS_FILE_GRID_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), HILDON_TYPE_FILE_GRID_VIEW))
+
+typedef struct _HildonFileGridView HildonFileGridView;
+typedef struct _HildonFileGridViewClass HildonFileGridViewClass;
+typedef struct _HildonFileGridViewPrivate HildonFileGridViewPrivate;
+
+struct _HildonFileGridView
+{
+  GtkWidget parent;
+  HildonFileGridViewPrivate *priv;
+};
+
+struct _HildonFileGridViewClass
+{
+  GtkWidgetClass parent_class;
+
+  void (*set_scroll_adjustments) (HildonFileGridView *self,
+                                  GtkAdjustment *hadjustment,
+                                  GtkAdjustment *vadjustment);
+  void (*item_activated) (HildonFileGridView *self, GtkTreePath *path);
+};
+
+GType hildon_file_grid_view_get_type(void);
+
+/* Thumbnails are centered in a PIXBUF_WIDTH x PIXBUF_HEIGHT area, and
+   a line of text goes below.  Cells get wider to share the width of
+   the view between the columns. */
+GtkWidget *_hildon_file_grid_view_new(gint pixbuf_width, gint pixbuf_height);
+
+/* The rows of MODEL are shown in order, its children are not.  The
+   view does not own the model. */
+void _hildon_file_grid_view_set_model(HildonFileGridView *self,
+                                      GtkTreeModel *model);
+GtkTreeModel *_hildon_file_grid_view_get_model(HildonFileGridView *self);
+
+/* Columns of the model for the thumbnail, the text and whether the
+   cell is sensitive.  SENSITIVE_COLUMN can be -1. */
+void _hildon_file_grid_view_set_columns(HildonFileGridView *self,
+                                        gint pixbuf_column,
+                                        gint text_column,
+                                        gint sensitive_column);
+
+/* FUNC is called for every cell drawn, after the text renderer has
+   been set up from the columns. */
+typedef void (*HildonFileGridViewDataFunc) (HildonFileGridView *self,
+                                            GtkCellRenderer *text_renderer,
+                                            GtkTreeModel *model,
+                                            GtkTreeIter *iter,
+                                            gpointer data);
+void _hildon_file_grid_view_set_data_func(HildonFileGridView *self,
+                                          HildonFileGridViewDataFunc func,
+                                          gpointer data);
+
+/* The view keeps no selection.  FUNC tells whether a cell is drawn
+   as selected.  When what it answers changes, the view has to be
+   redrawn. */
+typedef gboolean (*HildonFileGridViewSelectedFunc) (HildonFileGridView *self,
+                                                    GtkTreeModel *model,
+                                                    GtkTreeIter *iter,
+                                                    gpointer data);
+void _hildon_file_grid_view_set_selected_func(HildonFileGridView *self,
+                                              HildonFileGridViewSelectedFunc func,
+                                              gpointer data);
+
+/* Paths are of the model.  The cursor is NULL when it is not set. */
+GtkTreePath *_hildon_file_grid_view_get_cursor(HildonFileGridView *self);
+void _hildon_file_grid_view_set_cursor(HildonFileGridView *self,
+                                       GtkTreePath *path);
+GtkTreePath *_hildon_file_grid_view_get_path_at_pos(HildonFileGridView *self,
+                                                    gint x, gint y);
+gboolean _hildon_file_grid_view_get_visible_range(HildonFileGridView *self,
+                                                  GtkTreePath **start_path,
+                                                  GtkTreePath **end_path);
+gint _hildon_file_grid_view_get_n_columns(HildonFileGridView *self);
+
+/* Scrolls so that the row of PATH is shown.  With USE_ALIGN, its cell
+   goes ROW_ALIGN of the way down the view, 0.0 being the top. */
+void _hildon_file_grid_view_scroll_to_path(HildonFileGridView *self,
+                                           GtkTreePath *path,
+                                           gboolean use_align,
+                                           gfloat row_align);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,1084 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileNameIndex
+ *
+ * The index is a table of folders, keyed by URI.  Every folder holds
+ * the modification time it had when it was enumerated and one entry
+ * per child.  An entry is a single block "<type><name>\0<search>\0",
+ * where type is 'd' for folders and 'f' for everything else, name is
+ * the file name as found on disk and search is the display name
+ * normalized like the live search does it.  The file on disk is the
+ * same blocks, preceded for every folder by its URI, modification
+ * time and number of entries, all NUL terminated.
+ *
+ * Only one folder is looked at at a time, with asynchronous GIO calls
+ * at low priority.  A folder whose modification time is unchanged is
+ * not enumerated again.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <glib/gstdio.h>
+#include <hildon/hildon-helper.h>
+
+#include "hildon-file-name-index.h"
+
+#define INDEX_MAGIC "hildon-fm-name-index 1\n"
+#define CRAWL_BATCH 64
+#define SAVE_DELAY_SECONDS 5
+
+#define ENTRY_TYPE(entry) ((entry)[0])
+#define ENTRY_NAME(entry) ((entry) + 1)
+#define ENTRY_SEARCH_NAME(entry) ((entry) + strlen(entry) + 1)
+#define ENTRY_SIZE(entry) \
+  (strlen(entry) + strlen(ENTRY_SEARCH_NAME(entry)) + 2)
+
+typedef struct {
+  gchar *uri;
+  guint64 mtime;        /* 0 forces the folder to be enumerated again */
+  GPtrArray *entries;
+} IndexFolder;
+
+struct _HildonFileNameIndex {
+  gchar *cache_file;
+  HildonFileNameIndexFunc func;
+  gpointer data;
+
+  GHashTable *folders;       /* URI -> IndexFolder */
+  GSList *roots;             /* GFile */
+
+  GQueue *queue;             /* GFile */
+  GHashTable *queued;        /* URI -> TRUE for everything in QUEUE */
+
+  /* The folder being crawled, NULL when idle */
+  GFile *current;
+  IndexFolder *scanning;
+  GCancellable *cancellable;
+
+  gboolean ready;
+  /* Set while the saved index is read in a thread.  The crawl waits
+     for it, so that it can skip the folders that have not changed. */
+  gboolean loading;
+  /* Set when the entries differ from the saved ones.  A save is then
+     scheduled from save_id, so that a crawl is not held up by it. */
+  gboolean dirty;
+  guint save_id;
+  /* Set by _hildon_file_name_index_free() while a crawl or the load
+     is pending.  The callback of the pending call frees the index. */
+  gboolean disposed;
+};
+
+static void crawl_next(HildonFileNameIndex *index);
+
+static gchar *
+index_entry_new(gchar type, const gchar *name)
+{
+  gchar *display_name, *search_name, *entry;
+  gsize name_len, search_len;
+
+  display_name = g_filename_display_name(name);
+  search_name = hildon_helper_normalize_string(display_name);
+  name_len = strlen(name);
+  search_len = strlen(search_name);
+
+  entry = g_malloc(name_len + search_len + 3);
+  entry[0] = type;
+  memcpy(entry + 1, name, name_len + 1);
+  memcpy(entry + name_len + 2, search_name, search_len + 1);
+
+  g_free(display_name);
+  g_free(search_name);
+
+  return entry;
+}
+
+static IndexFolder *
+index_folder_new(const gchar *uri, guint64 mtime)
+{
+  IndexFolder *folder = g_slice_new(IndexFolder);
+
+  folder->uri = g_strdup(uri);
+  folder->mtime = mtime;
+  folder->entries = g_ptr_array_new_with_free_func(g_free);
+
+  return folder;
+}
+
+static void
+index_folder_free(IndexFolder *folder)
+{
+  g_free(folder->uri);
+  g_ptr_array_free(folder->entries, TRUE);
+  g_slice_free(IndexFolder, folder);
+}
+
+static gint
+compare_entries(gconstpointer a, gconstpointer b)
+{
+  return strcmp(*(const gchar **) a, *(const gchar **) b);
+}
+
+static gboolean
+index_folder_same_entries(IndexFolder *a, IndexFolder *b)
+{
+  guint i;
+
+  if (a->entries->len != b->entries->len)
+    return FALSE;
+
+  for (i = 0; i < a->entries->len; i++)
+    if (strcmp(g_ptr_array_index(a->entries, i),
+               g_ptr_array_index(b->entries, i)) != 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Looks for the entry of NAME with TYPE in the sorted entries of
+   FOLDER.  Returns TRUE if it is there, and sets *POSITION to where it
+   is or would be. */
+static gboolean
+index_folder_find(IndexFolder *folder, gchar type, const gchar *name,
+                  guint *position)
+{
+  guint low = 0, high = folder->entries->len;
+
+  while (low < high)
+  {
+    guint middle = low + (high - low) / 2;
+    const gchar *entry = g_ptr_array_index(folder->entries, middle);
+    gint result = ENTRY_TYPE(entry) - type;
+
+    if (result == 0)
+      result = strcmp(ENTRY_NAME(entry), name);
+
+    if (result == 0)
+    {
+      *position = middle;
+      return TRUE;
+    }
+
+    if (result < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  *position = low;
+  return FALSE;
+}
+
+/* The folder that FILE is in, if it is in the index */
+static IndexFolder *
+index_lookup_parent(HildonFileNameIndex *index, GFile *file)
+{
+  IndexFolder *folder = NULL;
+  GFile *parent;
+  gchar *uri;
+
+  parent = g_file_get_parent(file);
+  if (!parent)
+    return NULL;
+
+  uri = g_file_get_uri(parent);
+  folder = g_hash_table_lookup(index->folders, uri);
+  g_free(uri);
+  g_object_unref(parent);
+
+  return folder;
+}
+
+static gboolean
+uri_is_below(gpointer key, gpointer value, gpointer data)
+{
+  return g_str_has_prefix(key, data);
+}
+
+/* Puts FOLDER into the index, or only its mtime if the folder is
+   there with the same entries already, and frees FOLDER then.  Returns
+   the folder that is in the index. */
+static IndexFolder *
+index_store_folder(HildonFileNameIndex *index, IndexFolder *folder)
+{
+  IndexFolder *old;
+
+  /* Sorted so that the entries can be compared in one pass, as the
+     model and the crawl may list a folder in different orders */
+  g_ptr_array_sort(folder->entries, compare_entries);
+
+  old = g_hash_table_lookup(index->folders, folder->uri);
+  if (old && index_folder_same_entries(old, folder))
+  {
+    /* A changed mtime alone is not worth a save.  At worst the folder
+       is enumerated once more after a restart. */
+    old->mtime = folder->mtime;
+    index_folder_free(folder);
+    return old;
+  }
+
+  g_hash_table_replace(index->folders, folder->uri, folder);
+  index->dirty = TRUE;
+
+  return folder;
+}
+
+static gboolean
+index_has_root_for(HildonFileNameIndex *index, GFile *file)
+{
+  GSList *l;
+
+  for (l = index->roots; l; l = l->next)
+    if (g_file_equal(l->data, file) || g_file_has_prefix(file, l->data))
+      return TRUE;
+
+  return FALSE;
+}
+
+static gboolean
+index_has_root_for_uri(HildonFileNameIndex *index, const gchar *uri)
+{
+  GFile *file = g_file_new_for_uri(uri);
+  gboolean result = index_has_root_for(index, file);
+
+  g_object_unref(file);
+
+  return result;
+}
+
+static void
+index_queue(HildonFileNameIndex *index, GFile *file)
+{
+  gchar *uri;
+
+  uri = g_file_get_uri(file);
+  if (g_hash_table_lookup(index->queued, uri))
+  {
+    g_free(uri);
+    return;
+  }
+
+  g_queue_push_tail(index->queue, g_object_ref(file));
+  g_hash_table_insert(index->queued, uri, GINT_TO_POINTER(TRUE));
+}
+
+/* ONLY_NEW is used for folders that the model has loaded: their
+   subfolders that are in the index already are up to date as far
+   as we know. */
+static void
+index_queue_subfolders(HildonFileNameIndex *index, IndexFolder *folder,
+                       GFile *file, gboolean only_new)
+{
+  guint i;
+
+  for (i = 0; i < folder->entries->len; i++)
+  {
+    const gchar *entry = g_ptr_array_index(folder->entries, i);
+    GFile *child;
+    gchar *uri;
+
+    if (ENTRY_TYPE(entry) != 'd')
+      continue;
+
+    child = g_file_get_child(file, ENTRY_NAME(entry));
+    if (!only_new)
+      index_queue(index, child);
+    else
+    {
+      uri = g_file_get_uri(child);
+      if (!g_hash_table_lookup(index->folders, uri))
+        index_queue(index, child);
+      g_free(uri);
+    }
+    g_object_unref(child);
+  }
+}
+
+static gboolean
+remove_outside_roots(gpointer key, gpointer value, gpointer data)
+{
+  HildonFileNameIndex *index = data;
+  gboolean outside = !index_has_root_for_uri(index, key);
+
+  if (outside)
+    index->dirty = TRUE;
+
+  return outside;
+}
+
+static GString *
+index_serialize(HildonFileNameIndex *index)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GString *data;
+  gchar *dir;
+
+  data = g_string_new(INDEX_MAGIC);
+  g_hash_table_iter_init(&iter, index->folders);
+  while (g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    IndexFolder *folder = value;
+    guint i;
+
+    g_string_append_len(data, folder->uri, strlen(folder->uri) + 1);
+    g_string_append_printf(data, "%" G_GUINT64_FORMAT, folder->mtime);
+    g_string_append_c(data, '\0');
+    g_string_append_printf(data, "%u", folder->entries->len);
+    g_string_append_c(data, '\0');
+
+    for (i = 0; i < folder->entries->len; i++)
+    {
+      const gchar *entry = g_ptr_array_index(folder->entries, i);
+      g_string_append_len(data, entry, ENTRY_SIZE(entry));
+    }
+  }
+
+  dir = g_path_get_dirname(index->cache_file);
+  g_mkdir_with_parents(dir, 0700);
+  g_free(dir);
+
+  index->dirty = FALSE;
+
+  return data;
+}
+
+/* Only used when the index is freed, the last changes must not wait
+   for a main loop that may not run again */
+static void
+index_save(HildonFileNameIndex *index)
+{
+  GString *data;
+
+  if (!index->cache_file)
+    return;
+
+  data = index_serialize(index);
+
+  if (!g_file_set_contents(index->cache_file, data->str, data->len, NULL))
+    g_warning("Could not save the file name index to %s", index->cache_file);
+
+  g_string_free(data, TRUE);
+}
+
+/* Does not touch the index, which may have been freed meanwhile */
+static void
+index_save_cb(GObject *source, GAsyncResult *result, gpointer data)
+{
+  GError *error = NULL;
+
+  if (!g_file_replace_contents_finish(G_FILE(source), result, NULL, &error))
+  {
+    g_warning("Could not save the file name index: %s", error->message);
+    g_error_free(error);
+  }
+
+  g_free(data);
+}
+
+static gboolean
+index_save_timeout(gpointer data)
+{
+  HildonFileNameIndex *index = data;
+  GString *contents;
+  GFile *file;
+  gchar *str;
+  gsize len;
+
+  index->save_id = 0;
+
+  contents = index_serialize(index);
+  len = contents->len;
+  str = g_string_free(contents, FALSE);
+
+  /* STR is freed by index_save_cb() */
+  file = g_file_new_for_path(index->cache_file);
+  g_file_replace_contents_async(file, str, len, NULL, FALSE,
+                                G_FILE_CREATE_PRIVATE, NULL,
+                                index_save_cb, str);
+  g_object_unref(file);
+
+  return FALSE;
+}
+
+/* Saves the index a while after the last change, without blocking */
+static void
+index_schedule_save(HildonFileNameIndex *index)
+{
+  if (index->cache_file && !index->save_id)
+    index->save_id = g_timeout_add_seconds(SAVE_DELAY_SECONDS,
+                                           index_save_timeout, index);
+}
+
+/* Returns the NUL terminated string at *P and moves *P past it */
+static const gchar *
+next_string(const gchar **p, const gchar *end)
+{
+  const gchar *s = *p;
+  const gchar *nul = memchr(s, '\0', end - s);
+
+  if (!nul)
+    return NULL;
+
+  *p = nul + 1;
+  return s;
+}
+
+/* Reads the saved index into FOLDERS.  Returns FALSE if it is
+   missing or corrupt. */
+static gboolean
+index_parse(const gchar *cache_file, GHashTable *folders)
+{
+  const gchar *p, *end;
+  gchar *contents;
+  gsize length;
+  gboolean ok = TRUE;
+
+  if (!g_file_get_contents(cache_file, &contents, &length, NULL))
+    return FALSE;
+
+  if (length < strlen(INDEX_MAGIC) ||
+      strncmp(contents, INDEX_MAGIC, strlen(INDEX_MAGIC)) != 0)
+  {
+    g_free(contents);
+    return FALSE;
+  }
+
+  p = contents + strlen(INDEX_MAGIC);
+  end = contents + length;
+
+  while (ok && p < end)
+  {
+    const gchar *uri, *mtime, *count;
+    IndexFolder *folder;
+    guint i, n;
+
+    uri = next_string(&p, end);
+    mtime = uri ? next_string(&p, end) : NULL;
+    count = mtime ? next_string(&p, end) : NULL;
+    if (!count)
+    {
+      ok = FALSE;
+      break;
+    }
+
+    folder = index_folder_new(uri, g_ascii_strtoull(mtime, NULL, 10));
+    n = strtoul(count, NULL, 10);
+
+    for (i = 0; i < n; i++)
+    {
+      const gchar *entry = next_string(&p, end);
+
+      if (!entry || (entry[0] != 'd' && entry[0] != 'f') ||
+          !next_string(&p, end))
+      {
+        ok = FALSE;
+        break;
+      }
+
+      g_ptr_array_add(folder->entries, g_memdup(entry, p - entry));
+    }
+
+    g_hash_table_replace(folders, folder->uri, folder);
+  }
+
+  g_free(contents);
+
+  if (!ok)
+    g_warning("The file name index %s is corrupt", cache_file);
+
+  return ok;
+}
+
+/* Runs in a thread, the index itself is not touched */
+static void
+index_load_thread(GTask *task, gpointer source, gpointer data,
+                  GCancellable *cancellable)
+{
+  GHashTable *folders;
+
+  folders = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                  (GDestroyNotify) index_folder_free);
+
+  if (index_parse(data, folders))
+    g_task_return_pointer(task, folders,
+                          (GDestroyNotify) g_hash_table_unref);
+  else
+  {
+    g_hash_table_unref(folders);
+    g_task_return_pointer(task, NULL, NULL);
+  }
+}
+
+static gboolean crawl_step_done(HildonFileNameIndex *index);
+
+static void
+index_load_cb(GObject *source, GAsyncResult *result, gpointer data)
+{
+  HildonFileNameIndex *index = data;
+  GHashTable *folders;
+  GHashTableIter iter;
+  gpointer value;
+
+  folders = g_task_propagate_pointer(G_TASK(result), NULL);
+
+  if (!crawl_step_done(index))
+  {
+    if (folders)
+      g_hash_table_unref(folders);
+    return;
+  }
+
+  index->loading = FALSE;
+
+  if (folders)
+  {
+    /* Folders that the model has handed over meanwhile are newer */
+    g_hash_table_iter_init(&iter, folders);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+      IndexFolder *folder = value;
+
+      g_hash_table_iter_steal(&iter);
+      if (g_hash_table_lookup(index->folders, folder->uri) ||
+          !index_has_root_for_uri(index, folder->uri))
+        index_folder_free(folder);
+      else
+        g_hash_table_insert(index->folders, folder->uri, folder);
+    }
+    g_hash_table_unref(folders);
+
+    /* A saved index answers searches right away.  It is brought up
+       to date by the crawl. */
+    if (!index->ready)
+    {
+      index->ready = TRUE;
+      if (index->func)
+        index->func(index, index->data);
+    }
+  }
+
+  crawl_next(index);
+}
+
+/* Reads the saved index without blocking the main loop */
+static void
+index_load(HildonFileNameIndex *index)
+{
+  GTask *task;
+
+  if (!index->cache_file)
+    return;
+
+  if (!index->cancellable)
+    index->cancellable = g_cancellable_new();
+
+  index->loading = TRUE;
+  task = g_task_new(NULL, index->cancellable, index_load_cb, index);
+  g_task_set_task_data(task, g_strdup(index->cache_file), g_free);
+  g_task_run_in_thread(task, index_load_thread);
+  g_object_unref(task);
+}
+
+static void
+index_destroy(HildonFileNameIndex *index)
+{
+  if (index->scanning)
+    index_folder_free(index->scanning);
+  if (index->current)
+    g_object_unref(index->current);
+  if (index->cancellable)
+    g_object_unref(index->cancellable);
+
+  g_queue_foreach(index->queue, (GFunc) g_object_unref, NULL);
+  g_queue_free(index->queue);
+  g_hash_table_destroy(index->queued);
+  g_hash_table_destroy(index->folders);
+  g_slist_foreach(index->roots, (GFunc) g_object_unref, NULL);
+  g_slist_free(index->roots);
+  g_free(index->cache_file);
+  g_free(index);
+}
+
+/* Called at the end of every asynchronous step.  Returns FALSE when
+   the index has been freed meanwhile. */
+static gboolean
+crawl_step_done(HildonFileNameIndex *index)
+{
+  if (index->disposed)
+  {
+    index_destroy(index);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+crawl_folder_done(HildonFileNameIndex *index, gboolean success)
+{
+  IndexFolder *folder = index->scanning;
+  GFile *current = index->current;
+
+  index->scanning = NULL;
+  index->current = NULL;
+
+  /* The roots may have changed meanwhile */
+  if (success && index_has_root_for(index, current))
+  {
+    folder = index_store_folder(index, folder);
+    index_queue_subfolders(index, folder, current, FALSE);
+  }
+  else
+  {
+    if (!success && g_hash_table_remove(index->folders, folder->uri))
+      index->dirty = TRUE;
+    index_folder_free(folder);
+  }
+
+  g_object_unref(current);
+  crawl_next(index);
+}
+
+static void
+crawl_next_files_cb(GObject *source, GAsyncResult *result, gpointer data)
+{
+  HildonFileNameIndex *index = data;
+  GFileEnumerator *enumerator = G_FILE_ENUMERATOR(source);
+  GError *error = NULL;
+  GList *infos, *l;
+
+  infos = g_file_enumerator_next_files_finish(enumerator, result, &error);
+
+  if (!crawl_step_done(index))
+  {
+    g_list_foreach(infos, (GFunc) g_object_unref, NULL);
+    g_list_free(infos);
+    g_clear_error(&error);
+    g_object_unref(enumerator);
+    return;
+  }
+
+  if (infos == NULL)
+  {
+    g_object_unref(enumerator);
+    crawl_folder_done(index, error == NULL);
+    g_clear_error(&error);
+    return;
+  }
+
+  for (l = infos; l; l = l->next)
+  {
+    GFileInfo *info = l->data;
+    const gchar *name = g_file_info_get_name(info);
+
+    /* Hidden files are not shown by default, so they are not
+       searched either */
+    if (name && name[0] != '.')
+      g_ptr_array_add(index->scanning->entries,
+                      index_entry_new(g_file_info_get_file_type(info) ==
+                                      G_FILE_TYPE_DIRECTORY ? 'd' : 'f',
+                                      name));
+    g_object_unref(info);
+  }
+  g_list_free(infos);
+
+  g_file_enumerator_next_files_async(enumerator, CRAWL_BATCH,
+                                     G_PRIORITY_LOW, index->cancellable,
+                                     crawl_next_files_cb, index);
+}
+
+static void
+crawl_enumerate_cb(GObject *source, GAsyncResult *result, gpointer data)
+{
+  HildonFileNameIndex *index = data;
+  GFileEnumerator *enumerator;
+
+  enumerator = g_file_enumerate_children_finish(G_FILE(source), result, NULL);
+
+  if (!crawl_step_done(index))
+  {
+    if (enumerator)
+      g_object_unref(enumerator);
+    return;
+  }
+
+  if (!enumerator)
+  {
+    crawl_folder_done(index, FALSE);
+    return;
+  }
+
+  g_file_enumerator_next_files_async(enumerator, CRAWL_BATCH,
+                                     G_PRIORITY_LOW, index->cancellable,
+                                     crawl_next_files_cb, index);
+}
+
+static void
+crawl_query_cb(GObject *source, GAsyncResult *result, gpointer data)
+{
+  HildonFileNameIndex *index = data;
+  GFile *current;
+  IndexFolder *folder;
+  GFileInfo *info;
+  guint64 mtime;
+  gchar *uri;
+
+  info = g_file_query_info_finish(G_FILE(source), result, NULL);
+
+  if (!crawl_step_done(index))
+  {
+    if (info)
+      g_object_unref(info);
+    return;
+  }
+
+  current = index->current;
+  uri = g_file_get_uri(current);
+
+  if (!info || g_file_info_get_file_type(info) != G_FILE_TYPE_DIRECTORY)
+  {
+    if (g_hash_table_remove(index->folders, uri))
+      index->dirty = TRUE;
+    if (info)
+      g_object_unref(info);
+    g_free(uri);
+    index->current = NULL;
+    g_object_unref(current);
+    crawl_next(index);
+    return;
+  }
+
+  mtime = g_file_info_get_attribute_uint64(info,
+                                           G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  g_object_unref(info);
+
+  folder = g_hash_table_lookup(index->folders, uri);
+  if (folder && folder->mtime == mtime && mtime != 0)
+  {
+    /* Unchanged, the subfolders may still have changed */
+    index_queue_subfolders(index, folder, current, FALSE);
+    g_free(uri);
+    index->current = NULL;
+    g_object_unref(current);
+    crawl_next(index);
+    return;
+  }
+
+  index->scanning = index_folder_new(uri, mtime);
+  g_free(uri);
+
+  g_file_enumerate_children_async(current,
+                                  G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                  G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  G_PRIORITY_LOW, index->cancellable,
+                                  crawl_enumerate_cb, index);
+}
+
+static void
+crawl_next(HildonFileNameIndex *index)
+{
+  gchar *uri;
+
+  if (index->current || index->loading)
+    return;
+
+  index->current = g_queue_pop_head(index->queue);
+
+  if (!index->current)
+  {
+    if (index->dirty)
+      index_schedule_save(index);
+
+    if (!index->ready)
+    {
+      index->ready = TRUE;
+      if (index->func)
+        index->func(index, index->data);
+    }
+    return;
+  }
+
+  uri = g_file_get_uri(index->current);
+  g_hash_table_remove(index->queued, uri);
+  g_free(uri);
+
+  if (!index->cancellable)
+    index->cancellable = g_cancellable_new();
+
+  g_file_query_info_async(index->current,
+                          G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                          G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                          G_PRIORITY_LOW, index->cancellable,
+                          crawl_query_cb, index);
+}
+
+HildonFileNameIndex *
+_hildon_file_name_index_new(const gchar *cache_file,
+                            HildonFileNameIndexFunc func,
+                            gpointer data)
+{
+  HildonFileNameIndex *index = g_new0(HildonFileNameIndex, 1);
+
+  index->cache_file = g_strdup(cache_file);
+  index->func = func;
+  index->data = data;
+  index->folders =
+    g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                          (GDestroyNotify) index_folder_free);
+  index->queue = g_queue_new();
+  index->queued = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        g_free, NULL);
+
+  index_load(index);
+
+  return index;
+}
+
+void
+_hildon_file_name_index_free(HildonFileNameIndex *index)
+{
+  if (index->save_id)
+    g_source_remove(index->save_id);
+  index->save_id = 0;
+
+  if (index->dirty && index->ready)
+    index_save(index);
+
+  if (index->current || index->loading)
+  {
+    index->disposed = TRUE;
+    g_cancellable_cancel(index->cancellable);
+  }
+  else
+    index_destroy(index);
+}
+
+void
+_hildon_file_name_index_set_roots(HildonFileNameIndex *index, GSList *roots)
+{
+  GSList *old_roots, *l;
+
+  old_roots = index->roots;
+  index->roots = NULL;
+
+  for (l = roots; l; l = l->next)
+  {
+    /* Roots inside other roots are crawled as part of them */
+    if (index_has_root_for(index, l->data))
+      continue;
+
+    index->roots = g_slist_prepend(index->roots, g_object_ref(l->data));
+  }
+
+  g_hash_table_foreach_remove(index->folders, remove_outside_roots, index);
+
+  for (l = index->roots; l; l = l->next)
+  {
+    GSList *old;
+
+    for (old = old_roots; old; old = old->next)
+      if (g_file_equal(old->data, l->data))
+        break;
+
+    if (!old)
+      index_queue(index, l->data);
+  }
+
+  g_slist_foreach(old_roots, (GFunc) g_object_unref, NULL);
+  g_slist_free(old_roots);
+
+  crawl_next(index);
+}
+
+void
+_hildon_file_name_index_set_folder(HildonFileNameIndex *index,
+                                   GFile *folder,
+                                   guint64 mtime,
+                                   GSList *infos)
+{
+  IndexFolder *indexed;
+  gchar *uri;
+
+  if (!index_has_root_for(index, folder))
+    return;
+
+  uri = g_file_get_uri(folder);
+  indexed = index_folder_new(uri, mtime);
+  g_free(uri);
+
+  for (; infos; infos = infos->next)
+  {
+    const gchar *name = g_file_info_get_name(infos->data);
+
+    if (name && name[0] != '.')
+      g_ptr_array_add(indexed->entries,
+                      index_entry_new(g_file_info_get_file_type(infos->data)
+                                      == G_FILE_TYPE_DIRECTORY ? 'd' : 'f',
+                                      name));
+  }
+
+  indexed = index_store_folder(index, indexed);
+
+  index_queue_subfolders(index, indexed, folder, TRUE);
+  crawl_next(index);
+}
+
+void
+_hildon_file_name_index_remove_file(HildonFileNameIndex *index, GFile *file)
+{
+  IndexFolder *folder;
+  gchar *name, *uri, *prefix;
+  guint position;
+
+  folder = index_lookup_parent(index, file);
+  if (!folder)
+    return;
+
+  name = g_file_get_basename(file);
+
+  if (index_folder_find(folder, 'f', name, &position))
+    g_ptr_array_remove_index(folder->entries, position);
+  else if (index_folder_find(folder, 'd', name, &position))
+  {
+    g_ptr_array_remove_index(folder->entries, position);
+
+    /* The folder takes everything below it along */
+    uri = g_file_get_uri(file);
+    prefix = g_strconcat(uri, "/", NULL);
+    g_hash_table_remove(index->folders, uri);
+    g_hash_table_foreach_remove(index->folders, uri_is_below, prefix);
+    g_free(prefix);
+    g_free(uri);
+  }
+  else
+  {
+    g_free(name);
+    return;
+  }
+
+  g_free(name);
+  index->dirty = TRUE;
+
+  /* A crawl saves the index when it is done */
+  if (!index->current && !index->loading)
+    index_schedule_save(index);
+}
+
+void
+_hildon_file_name_index_add_file(HildonFileNameIndex *index, GFile *file,
+                                 GFileInfo *info)
+{
+  IndexFolder *folder;
+  const gchar *name;
+  gchar type;
+  guint position;
+
+  name = g_file_info_get_name(info);
+  if (!name || name[0] == '.')
+    return;
+
+  folder = index_lookup_parent(index, file);
+  if (!folder)
+    return;
+
+  type = g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY ? 'd' : 'f';
+  if (index_folder_find(folder, type, name, &position))
+    return;
+
+  /* Kept sorted, see index_store_folder() */
+  g_ptr_array_add(folder->entries, NULL);
+  memmove(folder->entries->pdata + position + 1,
+          folder->entries->pdata + position,
+          (folder->entries->len - position - 1) * sizeof(gpointer));
+  folder->entries->pdata[position] = index_entry_new(type, name);
+
+  index->dirty = TRUE;
+
+  /* A crawl saves the index when it is done */
+  if (type == 'd')
+  {
+    index_queue(index, file);
+    crawl_next(index);
+  }
+  else if (!index->current && !index->loading)
+    index_schedule_save(index);
+}
+
+gboolean
+_hildon_file_name_index_is_ready(HildonFileNameIndex *index)
+{
+  return index->ready;
+}
+
+gchar **
+_hildon_file_name_index_search(HildonFileNameIndex *index, const gchar *text)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GPtrArray *uris;
+  gchar *needle;
+
+  uris = g_ptr_array_new();
+  needle = hildon_helper_normalize_string(text);
+
+  if (needle[0] != '\0')
+  {
+    g_hash_table_iter_init(&iter, index->folders);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+      IndexFolder *folder = value;
+      GFile *file = NULL;
+      guint i;
+
+      for (i = 0; i < folder->entries->len; i++)
+      {
+        const gchar *entry = g_ptr_array_index(folder->entries, i);
+        GFile *child;
+
+        if (!hildon_helper_smart_match(ENTRY_SEARCH_NAME(entry), needle))
+          continue;
+
+        if (!file)
+          file = g_file_new_for_uri(folder->uri);
+
+        child = g_file_get_child(file, ENTRY_NAME(entry));
+        g_ptr_array_add(uris, g_file_get_uri(child));
+        g_object_unref(child);
+      }
+
+      if (file)
+        g_object_unref(file);
+    }
+  }
+
+  g_free(needle);
+  g_ptr_array_add(uris, NULL);
+
+  return (gchar **) g_ptr_array_free(uris, FALSE);
+}
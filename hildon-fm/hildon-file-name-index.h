@@ -0,0 +1,94 @@
+/*
+ * This file is part of hildon-fm package
+ *
+ * Copyright (C) 2005 Nokia Corporation.  All rights reserved.
+ *
+ * Contact: Marius Vollmer <marius.vollmer@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * HildonFileNameIndex
+ *
+ * Names of all files below a set of local folders (the local device
+ * and the mounted memory cards), so that files can be found by name
+ * without loading every folder into the model.  The index is filled
+ * by crawling the folders at low priority and takes over the children
+ * of every folder that the model loads or gets monitor events for.  It
+ * is saved to disk, so that the next process only needs to look at the
+ * folders whose modification time has changed.
+ *
+ * INTERNAL TO FILE SELECTION STUFF, NOT FOR APPLICATION DEVELOPERS TO USE.
+ *
+ */
+
+#ifndef __HILDON_FILE_NAME_INDEX_H__
+#define __HILDON_FILE_NAME_INDEX_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _HildonFileNameIndex HildonFileNameIndex;
+
+typedef void (*HildonFileNameIndexFunc) (HildonFileNameIndex *index,
+                                         gpointer data);
+
+/* CACHE_FILE is where the index is kept between runs, or NULL.  It
+   is read in a thread.  FUNC is called once, when it has been read
+   or, if there is none, when the first crawl of the roots has
+   finished. */
+HildonFileNameIndex *
+_hildon_file_name_index_new(const gchar *cache_file,
+                            HildonFileNameIndexFunc func,
+                            gpointer data);
+void _hildon_file_name_index_free(HildonFileNameIndex *index);
+
+/* ROOTS is a list of GFiles.  Folders that are not below one of them
+   are dropped from the index. */
+void _hildon_file_name_index_set_roots(HildonFileNameIndex *index,
+                                       GSList *roots);
+
+/* Replaces the children of FOLDER with INFOS, a list of GFileInfos
+   that the model has enumerated.  MTIME is the modification time of
+   FOLDER, or 0 if unknown. */
+void _hildon_file_name_index_set_folder(HildonFileNameIndex *index,
+                                        GFile *folder,
+                                        guint64 mtime,
+                                        GSList *infos);
+
+/* Apply a single change that the model got a monitor event for to
+   the folder of FILE, if that folder is in the index.  INFO is the
+   GFileInfo of the new FILE. */
+void _hildon_file_name_index_remove_file(HildonFileNameIndex *index,
+                                         GFile *file);
+void _hildon_file_name_index_add_file(HildonFileNameIndex *index,
+                                      GFile *file,
+                                      GFileInfo *info);
+
+/* Returns TRUE once the index has been loaded from disk or the roots
+   have been crawled at least once. */
+gboolean _hildon_file_name_index_is_ready(HildonFileNameIndex *index);
+
+/* Returns the URIs of the files whose names match TEXT the same way
+   the live search of HildonFileSelection matches. */
+gchar **_hildon_file_name_index_search(HildonFileNameIndex *index,
+                                       const gchar *text);
+
+G_END_DECLS
+
+#endif
@@ -61,12 +61,23 @@
 #include "hildon-file-selection.h"
 
 #include "hildon-file-common-private.h"
+#include "hildon-file-folder-view.h"
+#include "hildon-file-folder-tree.h"
+#include "hildon-file-grid-view.h"
 
 /* I wonder where does that additional +2 come from.
     Anyway I have to add it to make cell 60 + two
     margin pixels high. Now height is pixel perfect. */
 #define THUMBNAIL_CELL_HEIGHT (60 + HILDON_MARGIN_DEFAULT * 2 + 2)
 #define THUMBNAIL_CELL_WIDTH (80 + 16)
+/* Rows above and below the visible ones whose thumbnails are loaded
+   ahead of scrolling, lines of cells in the grid */
+#define THUMBNAIL_PREFETCH_ROWS 8
+/* Rows made for a folder before the rest of its files wait for the
+   content pane to be scrolled near the end, and how many more are
+   made then */
+#define CONTENT_PANE_WINDOW_ROWS 200
+#define CONTENT_PANE_GROW_ROWS 100
 
 /* Row height should be 30 and 4 is a mysterious constant.
     I just wonder why the constant is now 4 instead of 2
@@ -89,8 +100,12 @@ hildon_file_selection_check_close_load_banner(GtkTreeModel *model,
 static void hildon_file_selection_close_load_banner(HildonFileSelection *
                                                     self);
 static void hildon_file_selection_modified(gpointer object, GtkTreePath *path);
-static gboolean view_path_to_main_iter(GtkTreeModel *model,
+static gboolean view_path_to_main_iter(HildonFileSelectionPrivate *priv,
   GtkTreeIter *iter, GtkTreePath *path);
+static GtkTreePath *main_iter_to_view_path(HildonFileSelectionPrivate *priv,
+  GtkTreeIter *main_iter);
+static void view_iter_to_main_iter(HildonFileSelectionPrivate *priv,
+  GtkTreeIter *main_iter, GtkTreeIter *filter_iter);
 static void hildon_file_selection_real_row_insensitive(HildonFileSelection *self,
   GtkTreeIter *location);
 static void
@@ -104,10 +119,9 @@ static void
 hildon_file_selection_disable_cursor_magic (HildonFileSelection *self,
                                             GtkTreeModel *model);
 
-static GtkTreeModel *
-hildon_file_selection_create_sort_model(HildonFileSelection *self,
-                                        GtkTreeIterCompareFunc sort_function,
-                                        GtkTreeModel *parent_model);
+static void
+hildon_file_selection_setup_sortable(GtkTreeSortable *sortable,
+                                     GtkTreeIterCompareFunc sort_function);
 
 static gboolean
 hildon_file_selection_select_iter (HildonFileSelection *self,
@@ -157,6 +171,72 @@ enum {
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* The configuration that filter_func checks, compiled so that
+   evaluating a row does not allocate.  Invalidated whenever any of
+   it changes and compiled again on the next use. */
+typedef struct {
+    gboolean valid;
+    gboolean local_only;
+    gboolean show_hidden;
+    gboolean show_files;
+    gboolean show_folders;
+    gboolean show_readonly;
+    gboolean show_upnp;         /* Rows below $UPNP_ROOT */
+
+    GFile *mydocs;              /* This and everything below is hidden */
+
+    GtkFileFilter *filter;      /* Owned by the selection */
+    GtkFileFilterFlags needed;
+    GHashTable *mime_results;   /* MIME quark -> filter result + 1 */
+    guint generation;           /* Of the filter results in the model */
+} FilterPredicate;
+
+/* Every GtkFileFilter gets its own generation when it is first set,
+   kept in its qdata, so that the results stored in a model shared by
+   several selections are never mixed up, and going back to a filter
+   finds its results again.  0 is not used. */
+static guint filter_generation = 0;
+static GQuark filter_generation_quark = 0;
+
+/* The rules of a filter are not expected to change once it has been
+   set, as with GtkFileChooser. */
+static guint get_filter_generation(GtkFileFilter *filter)
+{
+    guint generation;
+
+    if (!filter_generation_quark)
+        filter_generation_quark =
+            g_quark_from_static_string("hildon-file-selection-filter-generation");
+
+    generation = GPOINTER_TO_UINT(g_object_get_qdata(G_OBJECT(filter),
+                                                     filter_generation_quark));
+    if (generation == 0) {
+        if (++filter_generation == 0)
+            ++filter_generation;
+        generation = filter_generation;
+        g_object_set_qdata(G_OBJECT(filter), filter_generation_quark,
+                           GUINT_TO_POINTER(generation));
+    }
+
+    return generation;
+}
+
+/* The content pane models of a folder that is not shown at the
+   moment.  They stay connected to the model, so that going back to
+   the folder only needs to put them back in place. */
+typedef struct {
+    HildonFileFolderView *folder_view;
+    GtkTreeModel *view_filter;
+    GtkTreeRowReference *current_row;   /* In view_filter */
+    GtkTreeRowReference *top_row;       /* First visible row */
+} ViewCacheEntry;
+
+static void filter_predicate_clear(FilterPredicate *p);
+static void view_cache_clear(HildonFileSelectionPrivate *priv);
+static void unwindow_folders(HildonFileSelectionPrivate *priv);
+static gboolean search_grow_idle(gpointer data);
+static void filter_predicate_compile(HildonFileSelectionPrivate *priv);
+
 struct _HildonFileSelectionPrivate {
     GtkWidget *scroll_dir;
     GtkWidget *scroll_list;
@@ -164,20 +244,53 @@ struct _HildonFileSelectionPrivate {
     GtkWidget *dir_tree;
     GtkWidget *view[4]; /* List, thumbnail, empty, repair */
     int cur_view;
+    /* The thumbnail grid that is shown instead of view[1] while
+       grid_mode is set, and the area it scrolls in */
+    GtkWidget *grid;
+    GtkWidget *scroll_grid;
+    gboolean grid_mode;
     GtkWidget *hpaned;
 
-    GtkTreeModel *main_model;
-    GtkTreeModel *sort_model;   /* HildonFileSystemModel doesn't implement */
-    GtkTreeModel *dir_sort;     /* GtkTreeSortable */
+    GtkTreeModel *main_model;   /* Sorted by the model itself for the
+                                   navigation pane */
+    GtkTreeModel *dir_filter;   /* HildonFileFolderTree */
 
-    GtkTreeModel *dir_filter;
+    /* Content pane: the visible children of the current folder, and
+       the live search on top of them that the views show. */
+    HildonFileFolderView *folder_view;
     GtkTreeModel *view_filter;
 
     HildonLiveSearch *live_search;
+    /* The needle of the last live search pass, normalized, and the
+       rows of the model (GNodes) it has rejected.  A longer needle
+       cannot match them either. */
+    gchar *search_needle;
+    gchar *search_needle_stripped;
+    GHashTable *search_rejected;
+
+    /* ViewCacheEntries of recently visited folders, the most recent
+       first */
+    GQueue *view_cache;
+    guint view_cache_size;
+
+    /* The selection of the content pane in edit mode: the rows of
+       the model (GNodes) in marks, or every row of view_filter but
+       those if marks_inverted is set, together with the files of a
+       windowed folder that have no row yet.  Rows leave marks when
+       they leave folder_view.  The view selects only the rows it
+       draws to match, marks_syncing is set meanwhile, and its own
+       changes come back one row at a time.  marks_growing is set
+       while rows are made for files the folder already had. */
+    GHashTable *marks;
+    gboolean marks_inverted;
+    gboolean marks_syncing;
+    gboolean marks_growing;
 
     GtkTreeRowReference *current_folder;
     GtkWidget *view_selector;
     GtkFileFilter *filter;
+    FilterPredicate predicate;
+    guint filter_generation;
 
     HildonFileSelectionMode mode;       /* User requested mode. Actual
                                            mode is either this or an empty
@@ -224,7 +337,7 @@ struct _HildonFileSelectionPrivate {
     gboolean show_files;
     gboolean edit_mode;
     gboolean hide_navi;
-    GtkTreeRowReference *current_row; // a row in sort_model of content pane
+    GtkTreeRowReference *current_row; // a row in view_filter of content pane
     gboolean show_folders;
     gboolean show_readonly;
 
@@ -236,6 +349,18 @@ struct _HildonFileSelectionPrivate {
 
     guint cursor_idle_id;
     gpointer cursor_idle_data;
+
+    guint content_scroll_id;
+    /* What the last prefetch pass saw: the visible rows of the
+       thumbnail view and how many rows there were */
+    gint prefetch_start, prefetch_end, prefetch_rows;
+
+    /* Whether huge folders only get rows as far as the content pane
+       is scrolled, and the folders windowed so far: GNodes of the
+       main model to GtkTreeRowReferences */
+    gboolean windowed;
+    GHashTable *windowed_folders;
+    guint search_grow_id;
 };
 
 #if 0
@@ -286,15 +411,69 @@ hildon_file_selection_cancel_delayed_select(HildonFileSelectionPrivate *priv)
   }
 }
 
-static void scroll_to_cursor(GtkTreeView *tree)
+/* The views that show rows are tree views, and the thumbnail grid.
+   These do what the tree view functions do for both. */
+static gboolean is_row_view(GtkWidget *view)
+{
+  return GTK_IS_TREE_VIEW(view) || HILDON_IS_FILE_GRID_VIEW(view);
+}
+
+static GtkTreeModel *row_view_get_model(GtkWidget *view)
+{
+  if (HILDON_IS_FILE_GRID_VIEW(view))
+    return _hildon_file_grid_view_get_model(HILDON_FILE_GRID_VIEW(view));
+
+  return gtk_tree_view_get_model(GTK_TREE_VIEW(view));
+}
+
+static GtkTreePath *row_view_get_cursor(GtkWidget *view)
 {
   GtkTreePath *path;
 
-  gtk_tree_view_get_cursor(tree, &path, NULL);
+  if (HILDON_IS_FILE_GRID_VIEW(view))
+    return _hildon_file_grid_view_get_cursor(HILDON_FILE_GRID_VIEW(view));
+
+  gtk_tree_view_get_cursor(GTK_TREE_VIEW(view), &path, NULL);
+  return path;
+}
+
+static void row_view_set_cursor(GtkWidget *view, GtkTreePath *path)
+{
+  if (HILDON_IS_FILE_GRID_VIEW(view))
+    _hildon_file_grid_view_set_cursor(HILDON_FILE_GRID_VIEW(view), path);
+  else
+    gtk_tree_view_set_cursor(GTK_TREE_VIEW(view), path, NULL, FALSE);
+}
+
+static void row_view_scroll_to_path(GtkWidget *view, GtkTreePath *path,
+                                    gboolean use_align, gfloat row_align)
+{
+  if (HILDON_IS_FILE_GRID_VIEW(view))
+    _hildon_file_grid_view_scroll_to_path(HILDON_FILE_GRID_VIEW(view), path,
+                                          use_align, row_align);
+  else
+    gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(view), path, NULL,
+                                 use_align, row_align, 0.0f);
+}
+
+static gboolean row_view_get_visible_range(GtkWidget *view,
+                                           GtkTreePath **start,
+                                           GtkTreePath **end)
+{
+  if (HILDON_IS_FILE_GRID_VIEW(view))
+    return _hildon_file_grid_view_get_visible_range
+      (HILDON_FILE_GRID_VIEW(view), start, end);
+
+  return gtk_tree_view_get_visible_range(GTK_TREE_VIEW(view), start, end);
+}
+
+static void scroll_to_cursor(GtkWidget *view)
+{
+  GtkTreePath *path = row_view_get_cursor(view);
 
   if (path)
   {
-    gtk_tree_view_scroll_to_cell(tree, path, NULL, FALSE, 0.0f, 0.0f);
+    row_view_scroll_to_path(view, path, FALSE, 0.0f);
     gtk_tree_path_free(path);
   }
 }
@@ -305,12 +484,12 @@ static void scroll_to_cursor(GtkTreeView *tree)
     fall back to first item */
 static void activate_view(GtkWidget *view)
 {
-  if (GTK_IS_TREE_VIEW(view))
+  if (is_row_view(view))
   {
     if (!GTK_WIDGET_HAS_FOCUS(view))
       gtk_widget_grab_focus(view);
 
-    scroll_to_cursor(GTK_TREE_VIEW(view));
+    scroll_to_cursor(view);
   }
 }
 
@@ -324,7 +503,13 @@ hildon_file_selection_content_pane_visible(HildonFileSelectionPrivate *
 static GtkWidget *get_current_view(HildonFileSelectionPrivate * priv)
 {
     if (hildon_file_selection_content_pane_visible(priv))
-      return priv->view[priv->cur_view];
+      {
+        if (priv->cur_view == HILDON_FILE_SELECTION_MODE_THUMBNAILS
+            && priv->grid_mode)
+          return priv->grid;
+
+        return priv->view[priv->cur_view];
+      }
 
     return NULL;
 }
@@ -333,8 +518,7 @@ static GtkWidget *get_current_view(HildonFileSelectionPrivate * priv)
     information view. Otherwise we show currently asked view */
 static gint get_view_to_be_displayed(HildonFileSelectionPrivate *priv)
 {
-  GtkTreeModel *model, *child_model;
-  GtkTreePath *path;
+  GtkTreeModel *model;
   GtkTreeIter iter;
   gint result;
 
@@ -352,15 +536,12 @@ static gint get_view_to_be_displayed(HildonFileSelectionPrivate *priv)
   /* We have currently nothing, check if we are loading or if we
      should offer the repair button. */
 
-  g_object_get(model, "child-model", &child_model,
-	       "virtual-root", &path, NULL);
-
-  if (gtk_tree_model_get_iter(child_model, &iter, path))
+  if (_hildon_file_folder_view_get_folder(priv->folder_view, &iter))
     {
       gboolean ready, is_drive;
       char *uri = NULL;
 
-      gtk_tree_model_get (child_model, &iter,
+      gtk_tree_model_get (priv->main_model, &iter,
 			  HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &ready,
 			  HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_DRIVE, &is_drive,
 			  HILDON_FILE_SYSTEM_MODEL_COLUMN_URI, &uri,
@@ -379,12 +560,10 @@ static gint get_view_to_be_displayed(HildonFileSelectionPrivate *priv)
 	result = 2;
       g_free(uri);
     }
-  else /* Virtual root is almost certainly found, EXCEPT when
-          that node is destroyed and row_reference is invalidated... */
+  else /* Folder is almost certainly found, EXCEPT when
+          that node is destroyed... */
     result = 2;
 
-  gtk_tree_path_free(path);
-  g_object_unref(child_model);
   return result;
 }
 
@@ -392,16 +571,26 @@ static void rebind_models(HildonFileSelectionPrivate *priv)
 {
   GtkWidget *current_view = get_current_view(priv);
 
-  if (priv->view[1] == current_view || priv->view[0] == current_view)
+  /* The same visible range of other rows needs a new prefetch */
+  priv->prefetch_start = priv->prefetch_end = -1;
+
+  /* Only the thumbnail view shown, the tree or the grid, has the
+     model */
+  if (priv->view[1] == current_view || priv->view[0] == current_view
+      || priv->grid == current_view)
   {
      gtk_tree_view_set_model(GTK_TREE_VIEW(priv->view[0]), NULL);
      gtk_tree_view_set_model(GTK_TREE_VIEW(priv->view[1]),
-        priv->sort_model);
+        priv->grid_mode ? NULL : priv->view_filter);
+     _hildon_file_grid_view_set_model(HILDON_FILE_GRID_VIEW(priv->grid),
+        priv->grid_mode ? priv->view_filter : NULL);
   }
   else
   {
      gtk_tree_view_set_model(GTK_TREE_VIEW(priv->view[0]), NULL);
      gtk_tree_view_set_model(GTK_TREE_VIEW(priv->view[1]), NULL);
+     _hildon_file_grid_view_set_model(HILDON_FILE_GRID_VIEW(priv->grid),
+                                      NULL);
   }
 }
 
@@ -409,7 +598,8 @@ static void rebind_models(HildonFileSelectionPrivate *priv)
 static void hildon_file_selection_sync_selections(HildonFileSelectionPrivate *priv,
                                                   GtkWidget * source, GtkWidget * target)
 {
-
+  /* Both views show the same marks.  The one switched to selects its
+     rows to match as it draws them, see marks_apply_to_visible_rows(). */
 }
 
 static gboolean expand_cursor_row(GtkTreeView *tree)
@@ -435,7 +625,7 @@ view_widget (HildonFileSelectionPrivate *priv, int view)
   if (view == 0)
     return priv->scroll_list;
   else if (view == 1)
-    return priv->scroll_thumb;
+    return priv->grid_mode ? priv->scroll_grid : priv->scroll_thumb;
   else
     return priv->view[view];
 }
@@ -453,6 +643,10 @@ _hildon_file_selection_get_scroll_thumb (HildonFileSelection *self)
 {
     g_return_val_if_fail (HILDON_IS_FILE_SELECTION (self), NULL);
 
+    /* Thumbnails are shown in the grid when it is on */
+    if (self->priv->grid_mode)
+        return self->priv->scroll_grid;
+
     return self->priv->scroll_thumb;
 }
 
@@ -630,13 +824,17 @@ static void hildon_file_selection_finalize(GObject * obj)
         (gpointer) hildon_file_selection_modified,
         self);
 
-    hildon_file_selection_disable_cursor_magic (self, priv->sort_model);
+    hildon_file_selection_disable_cursor_magic (self, priv->view_filter);
     hildon_file_selection_disable_cursor_magic (self, priv->dir_filter);
 
     g_free (priv->cursor_goal_uri);
     priv->cursor_goal_uri = NULL;
 
     hildon_file_selection_cancel_delayed_select(priv);
+    if (priv->content_scroll_id)
+      g_source_remove(priv->content_scroll_id);
+    if (priv->search_grow_id)
+      g_source_remove(priv->search_grow_id);
     g_source_remove_by_user_data(self); /* Banner checking timeout */
     /* This gives warnings to console about unref_tree_helpers */
     /* This have homething to do with content pane filter model */
@@ -647,11 +845,12 @@ static void hildon_file_selection_finalize(GObject * obj)
     gtk_tree_row_reference_free(priv->current_row);
     g_strfreev(priv->drag_data_uris);
 
+    /* The model may be shared, give it back its own order */
+    _hildon_file_system_model_unset_sort(HILDON_FILE_SYSTEM_MODEL
+                                         (priv->main_model));
     g_object_unref(priv->dir_filter);
 
-    g_object_unref(priv->dir_sort);
-
-    g_object_unref(priv->sort_model);
+    view_cache_clear(priv);
 
     if (priv->view_filter)
     {
@@ -659,10 +858,27 @@ static void hildon_file_selection_finalize(GObject * obj)
       priv->view_filter = NULL;
     }
 
+    if (priv->folder_view)
+    {
+      g_object_unref(priv->folder_view);
+      priv->folder_view = NULL;
+    }
+
+    /* And every row, now that our own models no longer see them */
+    unwindow_folders(priv);
+    g_hash_table_destroy(priv->windowed_folders);
+
     /* Setting filter don't cause refiltering any more,
-        because view_filter is already set to NULL. Failing this setting caused
+        because folder_view is already set to NULL. Failing this setting caused
         segfaults earlier. */
     hildon_file_selection_set_filter(self, NULL);
+    filter_predicate_clear(&priv->predicate);
+    g_queue_free(priv->view_cache);
+    g_hash_table_destroy(priv->marks);
+
+    g_free(priv->search_needle);
+    g_free(priv->search_needle_stripped);
+    g_hash_table_destroy(priv->search_rejected);
 
     if (priv->monitor)
     {
@@ -676,58 +892,93 @@ static void hildon_file_selection_finalize(GObject * obj)
 /* Previously the folder status was enough to decide whether or not
    to show an item. Now we have also properties for hidden folders
    and non-local folders, so we have to use this filter function
-   instead of simple boolean column. */
+   instead of simple boolean column.  Only called for folders, with
+   the settings compiled into the same predicate as filter_func. */
 static gboolean navigation_pane_filter_func(GtkTreeModel *model,
     GtkTreeIter *iter, gpointer data)
 {
-  gboolean folder, hidden, local, upnp = FALSE;
-  char *uri = NULL;
-  const char *upnp_root;
-  const char *mydocsdir;
   HildonFileSelectionPrivate *priv = data;
+  FilterPredicate *p = &priv->predicate;
+  GFile *file;
+  guint32 flags;
 
-  gtk_tree_model_get(model, iter,
-    HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER, &folder,
-    HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH, &local,
-    HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_HIDDEN, &hidden,
-    HILDON_FILE_SYSTEM_MODEL_COLUMN_URI, &uri,
-    -1);
+  if (!p->valid)
+      filter_predicate_compile(priv);
 
-  if (uri != NULL)
-  {
-      mydocsdir = g_getenv ("MYDOCSDIR");
-      upnp_root = g_getenv ("UPNP_ROOT");
-      upnp = upnp_root && g_str_has_prefix (uri, upnp_root);
-      //Fremantle hack: never filter out root of roots with weird uri
-      if (g_str_has_prefix (uri, "files:///"))
-          local = TRUE;
-      if (mydocsdir && g_str_has_prefix (uri, "file:///") &&
-          !priv->show_localdevice && g_str_has_prefix (&uri[7], mydocsdir))
-      {
-          g_free (uri);
-	  return FALSE;
-      }
-      g_free (uri);
-  }
+  flags = _hildon_file_system_model_peek_row_flags(
+      HILDON_FILE_SYSTEM_MODEL(model), iter, &file);
+
+  //Fremantle hack: never filter out root of roots with weird uri
+  if (p->local_only && !(flags & ROW_FLAG_HAS_LOCAL_PATH) &&
+      !(file && g_file_has_uri_scheme(file, "files")))
+      return FALSE;
+
+  if (p->mydocs && file &&
+      (g_file_equal(file, p->mydocs) ||
+       g_file_has_prefix(file, p->mydocs)))
+      return FALSE;
+
+  if (!p->show_upnp && (flags & ROW_FLAG_IS_UPNP))
+      return FALSE;
+
+  if (!p->show_hidden && (flags & ROW_FLAG_IS_HIDDEN))
+      return FALSE;
+
+  return TRUE;
+}
+
+static void live_search_reset (HildonFileSelectionPrivate *priv)
+{
+    g_free (priv->search_needle);
+    g_free (priv->search_needle_stripped);
+    priv->search_needle = NULL;
+    priv->search_needle_stripped = NULL;
+    g_hash_table_remove_all (priv->search_rejected);
+}
+
+/* Called for every row of a pass, but only does work when the text
+   has changed since the previous row. */
+static const gchar *live_search_update_needle (HildonFileSelectionPrivate *priv,
+                                               const gchar *needle)
+{
+    gchar *stripped;
+
+    if (priv->search_needle && strcmp (priv->search_needle, needle) == 0)
+        return priv->search_needle_stripped;
+
+    stripped = hildon_helper_normalize_string (needle);
+
+    /* Matches are only looked for at the start of words, so a row
+       that did not match a prefix of the needle will not match the
+       needle either.  Anything else starts from scratch. */
+    if (!priv->search_needle_stripped ||
+        !g_str_has_prefix (stripped, priv->search_needle_stripped))
+        g_hash_table_remove_all (priv->search_rejected);
+
+    g_free (priv->search_needle);
+    g_free (priv->search_needle_stripped);
+    priv->search_needle = g_strdup (needle);
+    priv->search_needle_stripped = stripped;
+
+    /* Files of a windowed folder without a row could match too */
+    if (priv->search_grow_id == 0)
+        priv->search_grow_id = g_idle_add (search_grow_idle, priv);
 
-  return (folder &&
-         (!priv->local_only || local) &&
-         (priv->show_hidden || !hidden) &&
-         (priv->show_upnp || !upnp));
+    return stripped;
 }
 
 static gboolean visible_for_live_search (GtkTreeModel *model,
     GtkTreeIter * iter,
     HildonFileSelectionPrivate *priv)
 {
-    const gchar *needle;
-    gchar *needle_stripped;
-    gchar *filename = NULL, *display_text = NULL;
-    gchar *filename_stripped = NULL, *display_text_stripped = NULL;
-    gboolean visible = TRUE;
+    const gchar *needle, *needle_stripped;
+    const gchar *filename_stripped, *display_text_stripped;
+    GtkTreeIter main_iter;
+    gboolean visible;
 
-    /* No live search yet */
-    if (!priv->live_search)
+    /* No live search yet.  The models of cached folders are not
+       searched either, the needle belongs to the current one. */
+    if (!priv->live_search || model != GTK_TREE_MODEL (priv->folder_view))
         return TRUE;
 
     needle = hildon_live_search_get_text (priv->live_search);
@@ -735,16 +986,18 @@ static gboolean visible_for_live_search (GtkTreeModel *model,
     if (needle == NULL || needle[0] == '\0')
       return TRUE;
 
-    gtk_tree_model_get (model, iter,
-        HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME, &filename,
-        PRIV_COLUMN_DISPLAY_TEXT, &display_text,
-        -1);
+    needle_stripped = live_search_update_needle (priv, needle);
 
-    needle_stripped = hildon_helper_normalize_string (needle);
-    if (filename)
-      filename_stripped = hildon_helper_normalize_string (filename);
-    if (display_text)
-      display_text_stripped = hildon_helper_normalize_string (display_text);
+    _hildon_file_folder_view_convert_iter_to_child_iter
+      (HILDON_FILE_FOLDER_VIEW (model), &main_iter, iter);
+
+    if (g_hash_table_lookup (priv->search_rejected, main_iter.user_data))
+      return FALSE;
+
+    /* Both names are normalized once and cached by the model */
+    _hildon_file_system_model_peek_search_names
+      (HILDON_FILE_SYSTEM_MODEL (priv->main_model), &main_iter,
+       &filename_stripped, &display_text_stripped);
 
     visible = (filename_stripped != NULL &&
         hildon_helper_smart_match (filename_stripped,
@@ -753,260 +1006,367 @@ static gboolean visible_for_live_search (GtkTreeModel *model,
         hildon_helper_smart_match (display_text_stripped,
           needle_stripped) != NULL);
 
-    g_free (filename);
-    g_free (display_text);
-    g_free (filename_stripped);
-    g_free (display_text_stripped);
-    g_free (needle_stripped);
+    if (!visible)
+      g_hash_table_insert (priv->search_rejected, main_iter.user_data,
+                           GINT_TO_POINTER (TRUE));
 
     return visible;
 }
 
-static gboolean filter_func(GtkTreeModel * model, GtkTreeIter * iter,
-                            gpointer data)
+/* A changed row has to be tested again.  This is connected before the
+   live search filter is created, so that it runs first. */
+static void live_search_row_changed (GtkTreeModel *model, GtkTreePath *path,
+                                     GtkTreeIter *iter,
+                                     HildonFileSelectionPrivate *priv)
 {
-    HildonFileSelectionPrivate *priv = data;
-    gboolean is_folder, result, has_local_path, is_hidden;
-    GtkFileFilterInfo info;
-    char *uri = NULL;
-    const char *prefix;
-    GtkTreePath *root_path;
-    GtkTreePath *tree_path;
-
-    /* Avoid expensive computation for files which are not in the current
-     * directory */
-    tree_path = gtk_tree_model_get_path (model, iter);
-    g_object_get (priv->view_filter, "virtual-root", &root_path, NULL);
-    if (!gtk_tree_path_is_descendant (tree_path, root_path)) {
-        gtk_tree_path_free (tree_path);
-        gtk_tree_path_free (root_path);
-        return FALSE;
-    }
-    if (gtk_tree_path_get_depth (tree_path)
-        - gtk_tree_path_get_depth (root_path) != 1) {
-        gtk_tree_path_free (tree_path);
-        gtk_tree_path_free (root_path);
-        return FALSE;
-    }
-    gtk_tree_path_free (tree_path);
-    gtk_tree_path_free (root_path);
+    GtkTreeIter main_iter;
 
+    _hildon_file_folder_view_convert_iter_to_child_iter
+      (HILDON_FILE_FOLDER_VIEW (model), &main_iter, iter);
+    g_hash_table_remove (priv->search_rejected, main_iter.user_data);
+}
 
-    if (visible_for_live_search (model, iter, priv) == FALSE)
-      return FALSE;
+/* The node of a deleted row can be reused by a new one */
+static void live_search_row_deleted (GtkTreeModel *model, GtkTreePath *path,
+                                     HildonFileSelectionPrivate *priv)
+{
+    g_hash_table_remove_all (priv->search_rejected);
+}
 
+static void live_search_connect (HildonFileSelectionPrivate *priv)
+{
+    g_signal_connect (priv->folder_view, "row-changed",
+                      G_CALLBACK (live_search_row_changed), priv);
+    g_signal_connect (priv->folder_view, "row-deleted",
+                      G_CALLBACK (live_search_row_deleted), priv);
+}
 
-    if (priv->local_only) {
-        gtk_tree_model_get(model, iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH,
-                           &has_local_path, -1);
-        if (!has_local_path)
-            return FALSE;
-    }
+static void live_search_disconnect (HildonFileSelectionPrivate *priv)
+{
+    g_signal_handlers_disconnect_by_func
+      (priv->folder_view, (gpointer) live_search_row_changed, priv);
+    g_signal_handlers_disconnect_by_func
+      (priv->folder_view, (gpointer) live_search_row_deleted, priv);
+}
 
-    if (!priv->show_hidden) {
-        gtk_tree_model_get(model, iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_HIDDEN, 
-			   &is_hidden, -1);
-        if (is_hidden)
-            return FALSE;
-    }
-    gtk_tree_model_get(model, iter,
-		       HILDON_FILE_SYSTEM_MODEL_COLUMN_URI, &uri, -1);
+static void view_cache_entry_free (ViewCacheEntry *entry)
+{
+    gtk_tree_row_reference_free (entry->current_row);
+    gtk_tree_row_reference_free (entry->top_row);
+    g_object_unref (entry->view_filter);
+    g_object_unref (entry->folder_view);
+    g_slice_free (ViewCacheEntry, entry);
+}
 
-    prefix = g_getenv ("UPNP_ROOT");
-    if (uri && prefix && g_str_has_prefix (uri, prefix) && !priv->show_upnp) {
-       g_free (uri);
-       return FALSE;
-    }
+static void view_cache_trim (HildonFileSelectionPrivate *priv, guint size)
+{
+    while (g_queue_get_length (priv->view_cache) > size)
+      view_cache_entry_free (g_queue_pop_tail (priv->view_cache));
+}
 
-    prefix = g_getenv("MYDOCSDIR");
-    if (uri && prefix && g_str_has_prefix(uri, "file:///") &&
-        g_str_has_prefix(&uri[7], prefix) &&
-        (priv->show_localdevice == FALSE)) {
-      return FALSE;
-    }
-    if (uri) {
-       g_free (uri);
-       uri = NULL;
-    }
+/* For when the filter settings change: the cached rows were filtered
+   with the old ones */
+static void view_cache_clear (HildonFileSelectionPrivate *priv)
+{
+    view_cache_trim (priv, 0);
+}
 
-    gtk_tree_model_get(model, iter,
-		       HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER,
-		       &is_folder, -1);
-    if(!priv->show_files) {
-       if (!is_folder) {
-	/* Files are NOT displayed in for example, 
-	   folder chooser dialog..., maybe more etc */
-           return FALSE;
-       }
-    }
-    if (is_folder && !priv->show_folders) {
-        return FALSE;
-    }
+/* Takes the content pane models away from the selection and keeps
+   them for the next visit of their folder.  Rows filtered by a live
+   search are not worth keeping. */
+static void view_cache_store (HildonFileSelection *self)
+{
+    HildonFileSelectionPrivate *priv = self->priv;
+    ViewCacheEntry *entry;
+    const gchar *needle;
+    GtkWidget *view;
+    GtkTreePath *top_path = NULL;
 
-    if (!priv->show_readonly)
-    {
-        gboolean is_readonly;
-        gtk_tree_model_get(model, iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_READONLY,
-                           &is_readonly, -1);
-        if (is_readonly)
-            return FALSE;
-    }
-    /* All files are shown if no filter is present */
-    if (!priv->filter) {
-        return TRUE;
+    hildon_file_selection_disable_cursor_magic (self, priv->view_filter);
+    g_signal_handlers_disconnect_by_func
+      (priv->view_filter, (gpointer) hildon_file_selection_inspect_view, priv);
+    live_search_disconnect (priv);
+
+    needle = priv->live_search ?
+      hildon_live_search_get_text (priv->live_search) : NULL;
+    if (priv->view_cache_size == 0 || (needle && needle[0] != '\0'))
+      {
+        gtk_tree_row_reference_free (priv->current_row);
+        g_object_unref (priv->view_filter);
+        g_object_unref (priv->folder_view);
+        priv->current_row = NULL;
+        priv->view_filter = NULL;
+        priv->folder_view = NULL;
+        return;
+      }
+
+    entry = g_slice_new0 (ViewCacheEntry);
+    entry->folder_view = priv->folder_view;
+    entry->view_filter = priv->view_filter;
+    entry->current_row = priv->current_row;
+
+    view = get_current_view (priv);
+    if (is_row_view (view)
+        && row_view_get_model (view) == priv->view_filter
+        && row_view_get_visible_range (view, &top_path, NULL))
+      {
+        entry->top_row = gtk_tree_row_reference_new (priv->view_filter,
+                                                     top_path);
+        gtk_tree_path_free (top_path);
+      }
+
+    priv->current_row = NULL;
+    priv->view_filter = NULL;
+    priv->folder_view = NULL;
+
+    g_queue_push_head (priv->view_cache, entry);
+    view_cache_trim (priv, priv->view_cache_size);
+}
+
+/* Puts the cursor and the scroll position of the content pane back
+   where they were when its models were cached, and keeps the loading
+   code from moving them. */
+static void view_cache_restore_position (HildonFileSelectionPrivate *priv,
+                                         GtkTreeRowReference *top_row)
+{
+    GtkWidget *view = get_current_view (priv);
+    GtkTreePath *path;
+
+    if (!is_row_view (view)
+        || row_view_get_model (view) != priv->view_filter)
+      return;
+
+    if (gtk_tree_row_reference_valid (priv->current_row) && !priv->edit_mode)
+      {
+        path = gtk_tree_row_reference_get_path (priv->current_row);
+        row_view_set_cursor (view, path);
+        gtk_tree_path_free (path);
+        priv->user_touched = TRUE;
+      }
+
+    if (gtk_tree_row_reference_valid (top_row))
+      {
+        path = gtk_tree_row_reference_get_path (top_row);
+        row_view_scroll_to_path (view, path, TRUE, 0.0);
+        gtk_tree_path_free (path);
+        priv->user_scrolled = TRUE;
+      }
+}
+
+/* Removes the entry of the folder at MAIN_ITER from the cache and
+   returns it, or NULL.  Entries of removed folders are dropped on the
+   way. */
+static ViewCacheEntry *view_cache_take (HildonFileSelectionPrivate *priv,
+                                        GtkTreeIter *main_iter)
+{
+    GList *link, *next;
+
+    for (link = priv->view_cache->head; link; link = next)
+      {
+        ViewCacheEntry *entry = link->data;
+        GtkTreeIter folder;
+
+        next = link->next;
+
+        if (!_hildon_file_folder_view_get_folder (entry->folder_view,
+                                                  &folder))
+          {
+            g_queue_delete_link (priv->view_cache, link);
+            view_cache_entry_free (entry);
+          }
+        else if (folder.user_data == main_iter->user_data)
+          {
+            g_queue_delete_link (priv->view_cache, link);
+            return entry;
+          }
+      }
+
+    return NULL;
+}
+
+static void filter_predicate_clear(FilterPredicate *p)
+{
+    if (p->mydocs)
+        g_object_unref(p->mydocs);
+    if (p->mime_results)
+        g_hash_table_destroy(p->mime_results);
+
+    memset(p, 0, sizeof(FilterPredicate));
+}
+
+/* Everything that only depends on the configuration is looked up
+   here, once, instead of for every row. */
+static void filter_predicate_compile(HildonFileSelectionPrivate *priv)
+{
+    FilterPredicate *p = &priv->predicate;
+    const gchar *prefix;
+
+    filter_predicate_clear(p);
+
+    p->valid = TRUE;
+    p->local_only = priv->local_only;
+    p->show_hidden = priv->show_hidden;
+    p->show_files = priv->show_files;
+    p->show_folders = priv->show_folders;
+    p->show_readonly = priv->show_readonly;
+    p->show_upnp = priv->show_upnp;
+
+    prefix = g_getenv("MYDOCSDIR");
+    if (prefix && !priv->show_localdevice)
+        p->mydocs = g_file_new_for_path(prefix);
+
+    if (priv->filter) {
+        p->filter = priv->filter;
+        p->needed = gtk_file_filter_get_needed(priv->filter);
+        p->generation = priv->filter_generation;
+
+        /* Filters that only look at the MIME type give the same answer
+           for every file of that type */
+        if (p->needed == GTK_FILE_FILTER_MIME_TYPE)
+            p->mime_results = g_hash_table_new(NULL, NULL);
     }
+}
 
-    if (is_folder)      /* Folders are always displayed */
-        return TRUE;
+static gboolean filter_predicate_run_filter(FilterPredicate *p,
+                                            HildonFileSystemModelRow *row)
+{
+    GtkFileFilterInfo info;
+    gchar *filename = NULL, *uri = NULL;
+    gboolean result;
 
     memset(&info, 0, sizeof(GtkFileFilterInfo));
-    info.contains = gtk_file_filter_get_needed(priv->filter);
+    info.contains = p->needed;
 
+    if (p->mime_results) {
+        GQuark mime_quark;
+        gpointer cached;
+
+        mime_quark = g_quark_from_string(row->mime_type);
+        cached = g_hash_table_lookup(p->mime_results,
+                                     GUINT_TO_POINTER(mime_quark));
+        if (cached)
+            return GPOINTER_TO_INT(cached) - 1;
+
+        info.mime_type = g_quark_to_string(mime_quark);
+        result = gtk_file_filter_filter(p->filter, &info);
+        g_hash_table_insert(p->mime_results, GUINT_TO_POINTER(mime_quark),
+                            GINT_TO_POINTER(result + 1));
+
+        return result;
+    }
+
+    /* Only the path and the URI have to be built */
     if (info.contains & GTK_FILE_FILTER_FILENAME)
-        gtk_tree_model_get(model, iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_LOCAL_PATH,
-                           &info.filename, -1);
+        info.filename = filename = g_file_get_path(row->file);
     if (info.contains & GTK_FILE_FILTER_URI)
-        gtk_tree_model_get(model, iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_URI, &info.uri,
-                           -1);
-    if (info.contains & GTK_FILE_FILTER_DISPLAY_NAME)
-        gtk_tree_model_get(model, iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME,
-                           &info.display_name, -1);
-    if (info.contains & GTK_FILE_FILTER_MIME_TYPE)
-        gtk_tree_model_get(model, iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE,
-                           &info.mime_type, -1);
-
-/*  g_print("%d\t%s\t%s\t%s\t%s\n",
-    info.contains, info.filename, info.uri,
-    info.display_name, info.mime_type);*/
-
-    result = gtk_file_filter_filter(priv->filter, &info);
-
-    g_free((char *) info.filename);     /* Casting away const is safe in
-                                           this case */
-    g_free((char *) info.uri);
-    g_free((char *) info.display_name);
-    g_free((char *) info.mime_type);
+        info.uri = uri = g_file_get_uri(row->file);
+    info.display_name = row->file_name;
+    info.mime_type = row->mime_type;
+
+    result = gtk_file_filter_filter(p->filter, &info);
+
+    g_free(filename);
+    g_free(uri);
 
     return result;
 }
 
-static gint
-sort_function (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b,
-               HildonFileSelectionSortKey key, GtkSortType order)
+/* The result for a row only changes with the filter or the row, so
+   it is kept in the model until either changes.  Refiltering for the
+   other settings, or after going back to a folder, does not run the
+   filter rules again.  The full row, with its display name, is only
+   peeked at when the rules have to run. */
+static gboolean filter_predicate_match_filter(FilterPredicate *p,
+                                              GtkTreeModel *model,
+                                              GtkTreeIter *iter)
 {
-    gint value, weight_a, weight_b, diff;
-    char *mime_a, *mime_b;
+    HildonFileSystemModel *fs_model = HILDON_FILE_SYSTEM_MODEL(model);
+    HildonFileSystemModelRow row;
+    gboolean result;
 
-    gtk_tree_model_get(model, a, HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT,
-                       &weight_a, -1);
-    gtk_tree_model_get(model, b, HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT,
-                       &weight_b, -1);
+    if (_hildon_file_system_model_get_filter_result(fs_model, iter,
+                                                    p->generation, &result))
+        return result;
 
-    /* If the items are in different sorting groups, we can determine
-       the order directly by checking the weights. */
-    if ((diff = weight_a - weight_b) != 0)
-    {
-        /* If either of the weights is negative, we need to preserve the
-           order independenty of ascending/descending mode */
-        if ((weight_a < 0 || weight_b < 0) && order == GTK_SORT_DESCENDING)
-          return -diff;
+    _hildon_file_system_model_peek_row(fs_model, iter, &row);
+    result = filter_predicate_run_filter(p, &row);
+    _hildon_file_system_model_set_filter_result(fs_model, iter,
+                                                p->generation, result);
 
-        return diff;
-    }
+    return result;
+}
 
-    /* In case of fodlers sort only by name */
-    if (weight_a < 0) key = HILDON_FILE_SELECTION_SORT_NAME;
+static gboolean filter_func(GtkTreeModel * model, GtkTreeIter * iter,
+                            gpointer data)
+{
+    HildonFileSelectionPrivate *priv = data;
+    FilterPredicate *p = &priv->predicate;
+    GFile *file;
+    guint32 flags;
+    gboolean is_folder;
 
-    if (key == HILDON_FILE_SELECTION_SORT_MODIFIED) {
-        GtkFileTime time_a, time_b;
-		gint retval;
+    /* Only called for the children of the current folder, and the live
+       search is applied on top of this by view_filter. */
 
-        gtk_tree_model_get(model, a,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_TIME,
-                           &time_a, -1);
-        gtk_tree_model_get(model, b,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_TIME,
-                           &time_b, -1);
+    if (!p->valid)
+        filter_predicate_compile(priv);
 
-        retval = time_a > time_b ? 1 : (time_a == time_b ? 0 : -1);
-        if (weight_a < 0 && order == GTK_SORT_ASCENDING) {
-	  retval = -retval;
-	}
-	if (retval != 0) return retval;
-	else key = HILDON_FILE_SELECTION_SORT_NAME;
-    }
+    flags = _hildon_file_system_model_peek_row_flags(
+        HILDON_FILE_SYSTEM_MODEL(model), iter, &file);
 
-    if (key == HILDON_FILE_SELECTION_SORT_SIZE) {
-        gint64 size_a, size_b;
-		gint retval;
+    if (p->local_only && !(flags & ROW_FLAG_HAS_LOCAL_PATH))
+        return FALSE;
 
-        gtk_tree_model_get(model, a,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_SIZE,
-                           &size_a, -1);
-        gtk_tree_model_get(model, b,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_SIZE,
-                           &size_b, -1);
+    if (!p->show_hidden && (flags & ROW_FLAG_IS_HIDDEN))
+        return FALSE;
+
+    if (!p->show_upnp && (flags & ROW_FLAG_IS_UPNP))
+        return FALSE;
 
-        retval = size_a > size_b ? 1 : (size_a == size_b ? 0 : -1);
-        if (weight_a < 0 && order == GTK_SORT_ASCENDING)
-	  retval = -retval;
+    if (p->mydocs && (g_file_equal(file, p->mydocs) ||
+                      g_file_has_prefix(file, p->mydocs)))
+        return FALSE;
 
-	if (retval != 0) return retval;
-	else key = HILDON_FILE_SELECTION_SORT_NAME;
+    is_folder = (flags & ROW_FLAG_IS_FOLDER) != 0;
+    if(!p->show_files) {
+       if (!is_folder) {
+	/* Files are NOT displayed in for example, 
+	   folder chooser dialog..., maybe more etc */
+           return FALSE;
+       }
+    }
+    if (is_folder && !p->show_folders) {
+        return FALSE;
     }
 
-    /* Sort by name. This allways applies for directories and also for
-       files when name sorting is selected */
-    if (key == HILDON_FILE_SELECTION_SORT_NAME) {
-        gchar *title_a, *title_b;
-        gint value;
-
-        gtk_tree_model_get(model, a,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY,
-                           &title_a, -1);
-        gtk_tree_model_get(model, b,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY,
-                           &title_b, -1);
-
-        value = strcmp(title_a, title_b);
-
-        /* Directories are always sorted alphabetically, so we
-            have to reverse order in descending mode. Actually
-            we should do a separate sort model for navigation pane,
-            but that would be a much bigger change. Temporarily we'll
-            do this hack. */
-        if (weight_a < 0 && order == GTK_SORT_DESCENDING)
-          value = -value;
-
-        g_free(title_a);
-        g_free(title_b);
-        return value;
+    if (!p->show_readonly && (flags & ROW_FLAG_IS_READONLY))
+        return FALSE;
+    /* All files are shown if no filter is present */
+    if (!p->filter) {
+        return TRUE;
     }
 
-    /* Note! Actually we should sort by extension, not by MIME type.
-       Getting extension is also related to other problem */
-    gtk_tree_model_get(model, a, HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE,
-                       &mime_a, -1);
-    gtk_tree_model_get(model, b, HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE,
-                       &mime_b, -1);
+    if (is_folder)      /* Folders are always displayed */
+        return TRUE;
 
-    value = strcmp(mime_a, mime_b);
+    return filter_predicate_match_filter(p, model, iter);
+}
 
-    g_free(mime_a);
-    g_free(mime_b);
-    
-    if (value != 0)
-      return value;
-    else 
-      return sort_function (model, a, b, 
-			    HILDON_FILE_SELECTION_SORT_NAME, order);
+/* The rows are peeked at instead of fetched with gtk_tree_model_get(),
+   so that no GValues are filled and no strings are copied for each
+   of the many comparisons of a sort. */
+static gint
+sort_function (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b,
+               HildonFileSelectionSortKey key, GtkSortType order)
+{
+    HildonFileSystemModelRow row_a, row_b;
+
+    _hildon_file_system_model_peek_row(HILDON_FILE_SYSTEM_MODEL(model),
+                                       a, &row_a);
+    _hildon_file_system_model_peek_row(HILDON_FILE_SYSTEM_MODEL(model),
+                                       b, &row_b);
+
+    return _hildon_file_system_model_compare_rows(&row_a, &row_b, key, order);
 }
 
 static gint
@@ -1031,17 +1391,6 @@ content_pane_sort_function (GtkTreeModel *model,
     return sort_function (model, a, b, key, order);
 }
 
-static gint
-navigation_pane_sort_function (GtkTreeModel *model,
-                               GtkTreeIter *a, GtkTreeIter *b,
-                               gpointer data)
-{
-
-  return sort_function (model, a, b,
-                        HILDON_FILE_SELECTION_SORT_NAME,
-                        GTK_SORT_ASCENDING);
-}
-
 static void
 thumbnail_cell_data_func(GtkTreeViewColumn *col,
 			 GtkCellRenderer *renderer,
@@ -1049,17 +1398,23 @@ thumbnail_cell_data_func(GtkTreeViewColumn *col,
 			 GtkTreeIter *iter,
 			 HildonFileSelection *selection)
 {
-  gboolean sensitive;
+  HildonFileSelectionPrivate *priv = selection->priv;
+  GtkTreeIter main_iter;
+  guint32 flags;
 
   /* As the sapwood engine doesn't support insensitive cells which have Pango
-     attributes, we set the attributes only here.  This is not even a bit more
-     expensive than having it set via gtk_tree_view_column_add_attribute(). */
-  g_object_get(renderer, "sensitive", &sensitive, NULL);
-  if (sensitive)
+     attributes, we set the attributes only here.  The row is looked up in
+     the main model directly, this runs for every visible cell on every
+     frame while scrolling. */
+  view_iter_to_main_iter(priv, &main_iter, iter);
+  flags = _hildon_file_system_model_peek_row_flags(HILDON_FILE_SYSTEM_MODEL
+                                                   (priv->main_model),
+                                                   &main_iter, NULL);
+  if (flags & ROW_FLAG_IS_AVAILABLE)
     {
       PangoAttrList *display_attrs;
 
-      gtk_tree_model_get(model, iter,
+      gtk_tree_model_get(priv->main_model, &main_iter,
 			 PRIV_COLUMN_DISPLAY_ATTRS, &display_attrs,
 			 -1);
       g_object_set(renderer, "attributes", display_attrs, NULL);
@@ -1072,6 +1427,188 @@ thumbnail_cell_data_func(GtkTreeViewColumn *col,
 }
 
 
+/* Keeps the rows of the folder at MAIN_ITER to the part that has been
+   scrolled to, if huge folders are windowed.  The model may be shared,
+   so each folder is windowed once and given back by
+   unwindow_folders(). */
+static void window_folder(HildonFileSelectionPrivate *priv,
+                          GtkTreeIter *main_iter)
+{
+  GtkTreePath *path;
+
+  if (!priv->windowed ||
+      gtk_tree_row_reference_valid(g_hash_table_lookup(priv->windowed_folders,
+                                                       main_iter->user_data)))
+    return;
+
+  path = gtk_tree_model_get_path(priv->main_model, main_iter);
+  g_hash_table_insert(priv->windowed_folders, main_iter->user_data,
+                      gtk_tree_row_reference_new(priv->main_model, path));
+  gtk_tree_path_free(path);
+
+  _hildon_file_system_model_window_children
+    (HILDON_FILE_SYSTEM_MODEL(priv->main_model), main_iter,
+     CONTENT_PANE_WINDOW_ROWS);
+}
+
+static void unwindow_folder(gpointer key, gpointer value, gpointer data)
+{
+  HildonFileSelectionPrivate *priv = data;
+  GtkTreePath *path = gtk_tree_row_reference_get_path(value);
+  GtkTreeIter iter;
+
+  /* Removed folders took their window with them */
+  if (path == NULL)
+    return;
+
+  if (gtk_tree_model_get_iter(priv->main_model, &iter, path))
+    _hildon_file_system_model_unwindow_children
+      (HILDON_FILE_SYSTEM_MODEL(priv->main_model), &iter);
+  gtk_tree_path_free(path);
+}
+
+/* Gives every file of the windowed folders a row */
+static void unwindow_folders(HildonFileSelectionPrivate *priv)
+{
+  priv->marks_growing = TRUE;
+  g_hash_table_foreach(priv->windowed_folders, unwindow_folder, priv);
+  g_hash_table_remove_all(priv->windowed_folders);
+  priv->marks_growing = FALSE;
+}
+
+/* Makes rows for up to N more files of the current folder, if it is
+   windowed.  Returns TRUE if some files are still left without one. */
+static gboolean content_pane_grow(HildonFileSelectionPrivate *priv, guint n)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  gboolean result = FALSE;
+
+  if (priv->current_folder &&
+      (path = gtk_tree_row_reference_get_path(priv->current_folder)))
+    {
+      priv->marks_growing = TRUE;
+      if (gtk_tree_model_get_iter(priv->main_model, &iter, path))
+        result = _hildon_file_system_model_grow_children
+          (HILDON_FILE_SYSTEM_MODEL(priv->main_model), &iter, n);
+      priv->marks_growing = FALSE;
+      gtk_tree_path_free(path);
+    }
+
+  return result;
+}
+
+/* Live search has to see every file of the folder, not only the ones
+   scrolled to.  The rows are made from an idle, the filter function
+   must not change the model it filters. */
+static gboolean search_grow_idle(gpointer data)
+{
+  HildonFileSelectionPrivate *priv = data;
+
+  GDK_THREADS_ENTER();
+
+  priv->search_grow_id = 0;
+  content_pane_grow(priv, G_MAXUINT);
+
+  GDK_THREADS_LEAVE();
+
+  return FALSE;
+}
+
+/* Runs after the content pane is drawn, in list, thumbnail or grid
+   mode.
+   Near the end of the rows of a windowed folder, more rows are made.
+   The thumbnail view also asks for the thumbnails of the rows around
+   the visible ones, so that they are ready when scrolled to.  Only
+   this window of rows is ever looked at, whatever the size of the
+   folder.  Expose events come far more often than scrolling, so
+   nothing is asked again while the visible rows and the row count
+   stay the same. */
+static gboolean content_scroll_idle(gpointer data)
+{
+  HildonFileSelectionPrivate *priv;
+  GtkWidget *view;
+  GtkTreePath *start, *end;
+  GtkTreeIter iter;
+  gint i, first, last = -1, visible_start, visible_end, n_rows, margin;
+
+  GDK_THREADS_ENTER();
+
+  priv = HILDON_FILE_SELECTION(data)->priv;
+  priv->content_scroll_id = 0;
+  view = get_current_view(priv);
+
+  if (!is_row_view(view) ||
+      row_view_get_model(view) != priv->view_filter)
+    {
+      GDK_THREADS_LEAVE();
+      return FALSE;
+    }
+
+  n_rows = gtk_tree_model_iter_n_children(priv->view_filter, NULL);
+  margin = THUMBNAIL_PREFETCH_ROWS;
+  if (view == priv->grid)
+    margin *= _hildon_file_grid_view_get_n_columns
+      (HILDON_FILE_GRID_VIEW(view));
+
+  if (row_view_get_visible_range(view, &start, &end))
+    {
+      visible_start = gtk_tree_path_get_indices(start)[0];
+      visible_end = gtk_tree_path_get_indices(end)[0];
+      gtk_tree_path_free(start);
+      gtk_tree_path_free(end);
+      last = visible_end + margin;
+
+      if ((view == priv->view[1] || view == priv->grid)
+          && (visible_start != priv->prefetch_start
+              || visible_end != priv->prefetch_end
+              || n_rows != priv->prefetch_rows))
+        {
+          priv->prefetch_start = visible_start;
+          priv->prefetch_end = visible_end;
+          priv->prefetch_rows = n_rows;
+
+          first = MAX(0, visible_start - margin);
+          start = gtk_tree_path_new_from_indices(first, -1);
+          if (gtk_tree_model_get_iter(priv->view_filter, &iter, start))
+            for (i = first; i <= last; i++)
+              {
+                GdkPixbuf *thumbnail = NULL;
+
+                gtk_tree_model_get(priv->view_filter, &iter,
+                                   HILDON_FILE_SYSTEM_MODEL_COLUMN_THUMBNAIL,
+                                   &thumbnail, -1);
+                if (thumbnail)
+                  g_object_unref(thumbnail);
+
+                if (!gtk_tree_model_iter_next(priv->view_filter, &iter))
+                  break;
+              }
+          gtk_tree_path_free(start);
+        }
+    }
+
+  /* The rows made may all be filtered out, so keep going until the
+     view is filled or the folder has no files left */
+  if (last + CONTENT_PANE_GROW_ROWS / 2 >= n_rows
+      && content_pane_grow(priv, CONTENT_PANE_GROW_ROWS))
+    priv->content_scroll_id = g_idle_add(content_scroll_idle, data);
+
+  GDK_THREADS_LEAVE();
+
+  return FALSE;
+}
+
+static gboolean content_view_expose(GtkWidget *widget,
+                                    GdkEventExpose *event,
+                                    HildonFileSelection *self)
+{
+  if (self->priv->content_scroll_id == 0)
+    self->priv->content_scroll_id = g_idle_add(content_scroll_idle, self);
+
+  return FALSE;
+}
+
 static void hildon_file_selection_set_property(GObject * object,
                                                guint property_id,
                                                const GValue * value,
@@ -1079,6 +1616,9 @@ static void hildon_file_selection_set_property(GObject * object,
 {
     HildonFileSelectionPrivate *priv = HILDON_FILE_SELECTION(object)->priv;
 
+    /* Most of the properties affect the content pane filter */
+    priv->predicate.valid = FALSE;
+
     switch (property_id) {
     case PROP_MODEL:
         g_assert(priv->main_model == NULL);     /* We come here exactly
@@ -1094,11 +1634,11 @@ static void hildon_file_selection_set_property(GObject * object,
 
         if (new_state != priv->local_only) {
             priv->local_only = new_state;
-            gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-                                               (priv->dir_filter));
-            if (priv->view_filter) {
-                gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-                                               (priv->view_filter));
+            _hildon_file_folder_tree_refilter(HILDON_FILE_FOLDER_TREE
+                                              (priv->dir_filter));
+            view_cache_clear(priv);
+            if (priv->folder_view) {
+                _hildon_file_folder_view_refilter(priv->folder_view);
                 hildon_file_selection_inspect_view(priv);
             }
         }
@@ -1110,11 +1650,11 @@ static void hildon_file_selection_set_property(GObject * object,
 
         if (new_state != priv->show_hidden) {
             priv->show_hidden = new_state;
-            gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-                                               (priv->dir_filter));
-            if (priv->view_filter) {
-                gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-                                               (priv->view_filter));
+            _hildon_file_folder_tree_refilter(HILDON_FILE_FOLDER_TREE
+                                              (priv->dir_filter));
+            view_cache_clear(priv);
+            if (priv->folder_view) {
+                _hildon_file_folder_view_refilter(priv->folder_view);
                 hildon_file_selection_inspect_view(priv);
             }
         }
@@ -1142,8 +1682,8 @@ static void hildon_file_selection_set_property(GObject * object,
         if (new_state != priv->show_upnp) {
             priv->show_upnp = new_state;
             if (priv->dir_filter) {
-                    gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-                                               (priv->dir_filter));
+                    _hildon_file_folder_tree_refilter(HILDON_FILE_FOLDER_TREE
+                                                      (priv->dir_filter));
             }
         }
         break;
@@ -1161,11 +1701,11 @@ static void hildon_file_selection_set_property(GObject * object,
 
 	if (new_state  != priv->show_files) {
 		priv->show_files = new_state;
-		gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
+		_hildon_file_folder_tree_refilter(HILDON_FILE_FOLDER_TREE
 						  (priv->dir_filter));
-		if (priv->view_filter) {
-			gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-							(priv->view_filter));
+		view_cache_clear(priv);
+		if (priv->folder_view) {
+			_hildon_file_folder_view_refilter(priv->folder_view);
 			hildon_file_selection_inspect_view(priv);
 		}
 	}
@@ -1179,9 +1719,11 @@ static void hildon_file_selection_set_property(GObject * object,
       break;
     case PROP_SHOW_FOLDERS:
       priv->show_folders = g_value_get_boolean(value);
+      view_cache_clear(priv);
       break;
     case PROP_SHOW_READONLY:
       priv->show_readonly = g_value_get_boolean(value);
+      view_cache_clear(priv);
       break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -1520,6 +2062,199 @@ static void hildon_file_selection_class_init(HildonFileSelectionClass *
 
 }
 
+/* Edit mode selection */
+
+static void view_iter_to_main_iter(HildonFileSelectionPrivate *priv,
+                                   GtkTreeIter *main_iter,
+                                   GtkTreeIter *filter_iter)
+{
+    GtkTreeIter folder_iter;
+
+    gtk_tree_model_filter_convert_iter_to_child_iter
+      (GTK_TREE_MODEL_FILTER(priv->view_filter), &folder_iter, filter_iter);
+    _hildon_file_folder_view_convert_iter_to_child_iter(priv->folder_view,
+                                                        main_iter,
+                                                        &folder_iter);
+}
+
+static gboolean marks_contains(HildonFileSelectionPrivate *priv,
+                               gpointer node)
+{
+    return (g_hash_table_lookup(priv->marks, node) != NULL)
+      != priv->marks_inverted;
+}
+
+static void marks_set(HildonFileSelectionPrivate *priv, gpointer node,
+                      gboolean selected)
+{
+    if (selected != priv->marks_inverted)
+      g_hash_table_insert(priv->marks, node, GINT_TO_POINTER(TRUE));
+    else
+      g_hash_table_remove(priv->marks, node);
+}
+
+/* Selects every row when ALL is set, none otherwise */
+static void marks_reset(HildonFileSelectionPrivate *priv, gboolean all)
+{
+    if (g_hash_table_size(priv->marks) > 0)
+      g_hash_table_remove_all(priv->marks);
+    priv->marks_inverted = all;
+}
+
+static gboolean live_search_active(HildonFileSelectionPrivate *priv)
+{
+    const gchar *needle = priv->live_search ?
+      hildon_live_search_get_text(priv->live_search) : NULL;
+
+    return needle != NULL && needle[0] != '\0';
+}
+
+typedef void (*MarksForeachFunc) (HildonFileSelectionPrivate *priv,
+                                  GtkTreeIter *main_iter,
+                                  gpointer data);
+
+/* Calls FUNC for the selected rows.  Unless all rows are selected
+   or a live search hides some, only the marked rows are looked at,
+   in no particular order.  Otherwise the rows come in the order of
+   the view.  FUNC must not change the marks. */
+static void marks_foreach(HildonFileSelectionPrivate *priv,
+                          MarksForeachFunc func, gpointer data)
+{
+    GtkTreeIter iter, main_iter;
+    gboolean valid;
+
+    if (!priv->marks_inverted && g_hash_table_size(priv->marks) == 0)
+      return;
+
+    if (!priv->marks_inverted && !live_search_active(priv))
+      {
+        GHashTableIter marks_iter;
+        gpointer node;
+
+        /* The rows share the stamp of their folder */
+        if (!_hildon_file_folder_view_get_folder(priv->folder_view,
+                                                 &main_iter))
+          return;
+
+        g_hash_table_iter_init(&marks_iter, priv->marks);
+        while (g_hash_table_iter_next(&marks_iter, &node, NULL))
+          {
+            main_iter.user_data = node;
+            func(priv, &main_iter, data);
+          }
+        return;
+      }
+
+    for (valid = gtk_tree_model_get_iter_first(priv->view_filter, &iter);
+         valid; valid = gtk_tree_model_iter_next(priv->view_filter, &iter))
+      {
+        view_iter_to_main_iter(priv, &main_iter, &iter);
+        if (marks_contains(priv, main_iter.user_data))
+          func(priv, &main_iter, data);
+      }
+}
+
+/* Takes a change that the view makes to its own selection, like a
+   tap that toggles a row or a range, over into the marks.  GtkTreeView
+   asks this for every row it selects or unselects, so nothing has to
+   be compared afterwards. */
+static gboolean marks_select_func(GtkTreeSelection *sel, GtkTreeModel *model,
+                                  GtkTreePath *path, gboolean selected,
+                                  gpointer data)
+{
+    HildonFileSelectionPrivate *priv = data;
+    GtkTreeIter main_iter;
+
+    if (priv->edit_mode && !priv->marks_syncing
+        && model == priv->view_filter
+        && view_path_to_main_iter(priv, &main_iter, path))
+      marks_set(priv, main_iter.user_data, !selected);
+
+    return TRUE;
+}
+
+/* Makes the selection of the rows of TREE on screen equal to the
+   marks.  This runs before they are drawn, so that select all, unselect
+   all and invert never have to touch the rows of the whole folder. */
+static void marks_apply_to_visible_rows(HildonFileSelectionPrivate *priv,
+                                        GtkTreeView *tree)
+{
+    GtkTreeSelection *sel;
+    GtkTreePath *start, *end;
+    GtkTreeIter iter, main_iter;
+    gint i, n;
+
+    if (gtk_tree_view_get_model(tree) != priv->view_filter
+        || !gtk_tree_view_get_visible_range(tree, &start, &end))
+      return;
+
+    n = gtk_tree_path_get_indices(end)[0]
+      - gtk_tree_path_get_indices(start)[0];
+    sel = gtk_tree_view_get_selection(tree);
+    priv->marks_syncing = TRUE;
+
+    if (gtk_tree_model_get_iter(priv->view_filter, &iter, start))
+      for (i = 0; i <= n; i++)
+        {
+          gboolean selected;
+
+          view_iter_to_main_iter(priv, &main_iter, &iter);
+          selected = marks_contains(priv, main_iter.user_data);
+          if (selected != gtk_tree_selection_iter_is_selected(sel, &iter))
+            {
+              if (selected)
+                gtk_tree_selection_select_iter(sel, &iter);
+              else
+                gtk_tree_selection_unselect_iter(sel, &iter);
+            }
+
+          if (!gtk_tree_model_iter_next(priv->view_filter, &iter))
+            break;
+        }
+
+    priv->marks_syncing = FALSE;
+    gtk_tree_path_free(start);
+    gtk_tree_path_free(end);
+}
+
+static gboolean content_view_expose_marks(GtkWidget *widget,
+                                          GdkEventExpose *event,
+                                          HildonFileSelection *self)
+{
+    if (self->priv->edit_mode)
+      marks_apply_to_visible_rows(self->priv, GTK_TREE_VIEW(widget));
+
+    return FALSE;
+}
+
+/* A new row is not selected, even if all rows were.  Rows made for
+   files that the folder already had keep the selection of the rest. */
+static void marks_row_inserted(GtkTreeModel *model, GtkTreePath *path,
+                               GtkTreeIter *iter,
+                               HildonFileSelectionPrivate *priv)
+{
+    GtkTreeIter main_iter;
+
+    if (model != GTK_TREE_MODEL(priv->folder_view) || priv->marks_growing
+        || (!priv->marks_inverted && g_hash_table_size(priv->marks) == 0))
+      return;
+
+    _hildon_file_folder_view_convert_iter_to_child_iter
+      (HILDON_FILE_FOLDER_VIEW(model), &main_iter, iter);
+    marks_set(priv, main_iter.user_data, FALSE);
+}
+
+/* A row that leaves the content pane leaves the selection too, so
+   the marks never point to a node that the model has freed */
+static void marks_row_hidden(HildonFileFolderView *view,
+                             GtkTreeIter *child_iter, gpointer data)
+{
+    HildonFileSelectionPrivate *priv = data;
+
+    if (view == priv->folder_view)
+      g_hash_table_remove(priv->marks, child_iter->user_data);
+}
+
 static gboolean
 content_pane_selection_changed_idle(gpointer data)
 {
@@ -1537,11 +2272,9 @@ content_pane_selection_changed_idle(gpointer data)
 /* We have to send this signal in idle, because caches contain only
    invalid iterators if this signal is received when we are deleting
    something. */
-static void
-hildon_file_selection_content_pane_selection_changed (GtkTreeSelection *sel,
-                                                      gpointer data)
+static void content_pane_changed(HildonFileSelection *self)
 {
-    HildonFileSelectionPrivate *priv = HILDON_FILE_SELECTION(data)->priv;
+    HildonFileSelectionPrivate *priv = self->priv;
 
     gtk_tree_row_reference_free(priv->current_row);
     priv->current_row = NULL;
@@ -1549,26 +2282,49 @@ hildon_file_selection_content_pane_selection_changed (GtkTreeSelection *sel,
     if (priv->content_pane_changed_id == 0)
     {
       priv->content_pane_changed_id =
-        g_idle_add(content_pane_selection_changed_idle, data);
+        g_idle_add(content_pane_selection_changed_idle, self);
     }
 }
 
+static void
+hildon_file_selection_content_pane_selection_changed (GtkTreeSelection *sel,
+                                                      gpointer data)
+{
+    /* The view only caught up with the marks while drawing */
+    if (HILDON_FILE_SELECTION(data)->priv->marks_syncing)
+      return;
+
+    content_pane_changed(HILDON_FILE_SELECTION(data));
+}
+
+/* The marks changed without the view: it picks them up for the rows it
+   draws next, and the selection is reported changed as usual */
+static void marks_changed(HildonFileSelection *self)
+{
+    GtkWidget *view = get_current_view(self->priv);
+
+    if (is_row_view(view))
+      gtk_widget_queue_draw(view);
+
+    content_pane_changed(self);
+}
+
 /* Checks whether the given path matches current content pane path.
-   We have to use view_filter rather than current_folder, since these
+   We have to use folder_view rather than current_folder, since these
    not not neccesarily in sync when this is called */
 static gboolean
 hildon_file_selection_matches_current_view(HildonFileSelectionPrivate *
                                            priv, GtkTreePath * path)
 {
-    if (GTK_IS_TREE_MODEL_FILTER(priv->view_filter)) {
+    GtkTreeIter iter;
+
+    if (priv->folder_view &&
+        _hildon_file_folder_view_get_folder(priv->folder_view, &iter)) {
         GtkTreePath *current_path;
         gint result = 1;
 
-        g_object_get(priv->view_filter, "virtual-root", &current_path,
-                     NULL);
+        current_path = gtk_tree_model_get_path(priv->main_model, &iter);
 
-        g_assert(current_path); /* Content pane should always have root
-                                   (no local device level allowed) */
         if (!gtk_tree_path_compare(path, current_path) && gtk_tree_row_reference_valid(priv->current_folder)) 
                 /* after deleting a folder the new and current (deleted) paths are same 
                    but current_folder is invalid for the current (deleted) row */
@@ -1685,23 +2441,21 @@ static void hildon_file_selection_close_load_banner(HildonFileSelection *
 
     view = get_current_view(priv);
 
-    if (view && GTK_IS_TREE_VIEW (view) && !priv->edit_mode)
+    if (view && is_row_view (view) && !priv->edit_mode)
       {
-        GtkTreePath *cursor_path = NULL;
+        GtkTreePath *cursor_path = row_view_get_cursor (view);
 
-        gtk_tree_view_get_cursor (GTK_TREE_VIEW (view), &cursor_path, NULL);
         if (cursor_path == NULL || priv->user_touched == FALSE)
           {
-            GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (view));
-            if (gtk_tree_model_iter_n_children (model, NULL) > 0)
+            GtkTreeModel *model = row_view_get_model (view);
+            if (model && gtk_tree_model_iter_n_children (model, NULL) > 0)
               {
                 GtkTreePath *path = gtk_tree_path_new_first ();
-                gtk_tree_view_set_cursor (GTK_TREE_VIEW (view), path,
-                                          NULL, FALSE);
+                row_view_set_cursor (view, path);
                 gtk_tree_path_free (path);
               }
           }
-        else
+        else if (GTK_IS_TREE_VIEW (view))
           {
             /* XXX - when the selection mode is MULTIPLE, it can
                      happen that we have a cursor, but the selection
@@ -1755,7 +2509,7 @@ static gboolean delayed_select_idle(gpointer data)
 {
   HildonFileSelection *self;
   HildonFileSelectionPrivate *priv;
-  GtkTreeIter main_iter, sort_iter;
+  GtkTreeIter main_iter;
   GtkTreePath *sort_path = NULL;
   gboolean found = FALSE;
 
@@ -1769,11 +2523,8 @@ static gboolean delayed_select_idle(gpointer data)
 
   if (sort_path)
   {
-    /* We have to use sort_path --- not main_path, because there is not
-       neccesarily corresponding main node present. */
-
     /* First try this location */
-    if (gtk_tree_model_get_iter(priv->dir_sort, &sort_iter, sort_path))
+    if (gtk_tree_model_get_iter(priv->main_model, &main_iter, sort_path))
       found = TRUE;
     else
     {
@@ -1781,7 +2532,7 @@ static gboolean delayed_select_idle(gpointer data)
       gtk_tree_path_up(sort_path);
 
       if (gtk_tree_path_get_depth(sort_path) >= 1 &&
-          gtk_tree_model_get_iter(priv->dir_sort, &sort_iter, sort_path))
+          gtk_tree_model_get_iter(priv->main_model, &main_iter, sort_path))
         found = TRUE;
     }
 
@@ -1790,8 +2541,6 @@ static gboolean delayed_select_idle(gpointer data)
 
   if (found)
   {
-    gtk_tree_model_sort_convert_iter_to_child_iter(
-      GTK_TREE_MODEL_SORT(priv->dir_sort), &main_iter, &sort_iter);
     /* It's possible that we are trying to select dimmed location.
        This happens, for example, if root folder of mmc was selected
        in a save dialog and mmc is removed. */
@@ -1843,15 +2592,26 @@ hildon_file_selection_delayed_select_path(HildonFileSelection *self,
   GtkTreePath *sort_model_path)
 {
   hildon_file_selection_delayed_select_reference(self,
-    gtk_tree_row_reference_new(self->priv->dir_sort, sort_model_path));
+    gtk_tree_row_reference_new(self->priv->main_model, sort_model_path));
 }
 
 static void hildon_file_selection_row_insensitive(GtkTreeView *tree,
   GtkTreePath *path, gpointer data)
 {
-  GtkTreeIter iter;
+  HildonFileSelectionPrivate *priv = HILDON_FILE_SELECTION(data)->priv;
+  GtkTreeIter iter, filter_iter;
+
+  if (GTK_WIDGET(tree) == priv->dir_tree)
+  {
+    if (!gtk_tree_model_get_iter(priv->dir_filter, &filter_iter, path))
+      return;
 
-  if (view_path_to_main_iter(gtk_tree_view_get_model(tree), &iter, path))
+    _hildon_file_folder_tree_convert_iter_to_child_iter(HILDON_FILE_FOLDER_TREE
+                                                        (priv->dir_filter),
+                                                        &iter, &filter_iter);
+    g_signal_emit(data, signals[LOCATION_INSENSITIVE], 0, &iter);
+  }
+  else if (view_path_to_main_iter(priv, &iter, path))
     g_signal_emit(data, signals[LOCATION_INSENSITIVE], 0, &iter);
 }
 
@@ -1892,30 +2652,24 @@ static void hildon_file_selection_selection_changed(GtkTreeSelection *
 
     if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
 
-        GtkTreeIter sort_iter, main_iter;
-        GtkTreePath *sort_path, *dir_sort_path;
+        GtkTreeIter main_iter;
+        GtkTreePath *sort_path;
 
         g_assert(model == priv->dir_filter
-          && GTK_IS_TREE_MODEL_FILTER(model));
+          && HILDON_IS_FILE_FOLDER_TREE(model));
 
         g_free (priv->cursor_goal_uri);
         priv->cursor_goal_uri = NULL;
 
-        gtk_tree_model_filter_convert_iter_to_child_iter
-            (GTK_TREE_MODEL_FILTER(priv->dir_filter), &sort_iter, &iter);
-        gtk_tree_model_sort_convert_iter_to_child_iter(GTK_TREE_MODEL_SORT
-                                                       (priv->dir_sort),
-                                                       &main_iter,
-                                                       &sort_iter);
+        _hildon_file_folder_tree_convert_iter_to_child_iter
+            (HILDON_FILE_FOLDER_TREE(priv->dir_filter), &main_iter, &iter);
             sort_path =
                 gtk_tree_model_get_path(priv->main_model, &main_iter);
-            dir_sort_path = gtk_tree_model_get_path(priv->dir_sort, &sort_iter);
 
             /* Check that we have actually changed the folder */
             if (hildon_file_selection_matches_current_view(priv, sort_path))
             {
                 gtk_tree_path_free(sort_path);
-                gtk_tree_path_free(dir_sort_path);
                 g_debug("Current folder re-selected => Asked to reload (if on gateway)");
                 _hildon_file_system_model_queue_reload(
                     HILDON_FILE_SYSTEM_MODEL(priv->main_model),
@@ -1934,60 +2688,94 @@ static void hildon_file_selection_selection_changed(GtkTreeSelection *
             }
 
             gtk_tree_row_reference_free (priv->current_folder);
-            priv->current_folder = gtk_tree_row_reference_new(priv->dir_sort, dir_sort_path);
-            gtk_tree_path_free(dir_sort_path);
+            priv->current_folder = gtk_tree_row_reference_new(priv->main_model, sort_path);
 
         if (hildon_file_selection_content_pane_visible(priv)) {
 	    gint sort_column = GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID;
 	    GtkSortType sort_order = GTK_SORT_ASCENDING;
+            ViewCacheEntry *cached;
 
-            if (priv->sort_model)
+            if (priv->folder_view)
               {
 		gtk_tree_sortable_get_sort_column_id
-		  (GTK_TREE_SORTABLE (priv->sort_model),
+		  (GTK_TREE_SORTABLE (priv->folder_view),
 		   &sort_column,
 		   &sort_order);
-                hildon_file_selection_disable_cursor_magic (self,
-                                                            priv->sort_model);
-                gtk_tree_row_reference_free(priv->current_row);
-                priv->current_row = NULL;
-                g_object_unref(priv->sort_model);
+                view_cache_store (self);
               }
-            if (priv->view_filter)
-                g_object_unref(priv->view_filter);
 
-            priv->view_filter =
-                gtk_tree_model_filter_new(priv->main_model, sort_path);
+            /* Before the files of a new folder arrive */
+            window_folder (priv, &main_iter);
 
-            priv->sort_model = hildon_file_selection_create_sort_model
-              (self, content_pane_sort_function, priv->view_filter);
+            /* A folder visited recently still has its models, kept up
+               to date while it was away. */
+            cached = view_cache_take (priv, &main_iter);
+            if (cached)
+              {
+                priv->folder_view = cached->folder_view;
+                priv->view_filter = cached->view_filter;
+                priv->current_row = cached->current_row;
+              }
+            else
+              {
+                /* Only the children of the folder are looked at, so
+                   this does not depend on the size of the whole
+                   model. */
+                priv->folder_view = _hildon_file_folder_view_new
+                  (HILDON_FILE_SYSTEM_MODEL (priv->main_model), &main_iter);
+                _hildon_file_folder_view_set_visible_func (priv->folder_view,
+                                                           filter_func, priv,
+                                                           NULL);
+                _hildon_file_folder_view_set_hide_func (priv->folder_view,
+                                                        marks_row_hidden,
+                                                        priv);
+                g_signal_connect (priv->folder_view, "row-inserted",
+                                  G_CALLBACK (marks_row_inserted), priv);
+                hildon_file_selection_setup_sortable
+                  (GTK_TREE_SORTABLE (priv->folder_view),
+                   content_pane_sort_function);
+                priv->view_filter = gtk_tree_model_filter_new
+                  (GTK_TREE_MODEL (priv->folder_view), NULL);
+                gtk_tree_model_filter_set_visible_func
+                  (GTK_TREE_MODEL_FILTER (priv->view_filter),
+                   (GtkTreeModelFilterVisibleFunc) visible_for_live_search,
+                   priv, NULL);
+              }
+
+            /* The view starts out with nothing selected */
+            marks_reset (priv, FALSE);
+
+            /* Does nothing if the cached models are already sorted
+               this way */
 	    gtk_tree_sortable_set_sort_column_id 
-	      (GTK_TREE_SORTABLE (priv->sort_model),
+	      (GTK_TREE_SORTABLE (priv->folder_view),
 	       sort_column,
 	       sort_order);
+            live_search_reset (priv);
+            live_search_connect (priv);
 
             if (!priv->edit_mode)
-              hildon_file_selection_enable_cursor_magic (self, priv->sort_model);
-
-            g_assert(priv->view_filter != NULL);
+              hildon_file_selection_enable_cursor_magic (self, priv->view_filter);
 
             /* Live search */
             g_assert (priv->live_search);
             hildon_live_search_set_filter (priv->live_search,
                 GTK_TREE_MODEL_FILTER (priv->view_filter));
             hildon_live_search_set_text (priv->live_search, "");
-            gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER
-                                                   (priv->view_filter),
-                                                   filter_func, priv,
-                                                   NULL);
-            gtk_tree_model_filter_refilter (
-                GTK_TREE_MODEL_FILTER (priv->view_filter));
             rebind_models(priv);
             g_signal_connect_data(priv->view_filter, "row-has-child-toggled",
                 G_CALLBACK
                 (hildon_file_selection_inspect_view), priv, NULL,
                 G_CONNECT_SWAPPED | G_CONNECT_AFTER);
             hildon_file_selection_inspect_view(priv);
+
+            if (cached)
+              {
+                view_cache_restore_position (priv, cached->top_row);
+                gtk_tree_row_reference_free (cached->top_row);
+                g_slice_free (ViewCacheEntry, cached);
+              }
+
 	    g_signal_emit(self, signals[FOLDER_ACTIVATED], 0);
 
             /* These DON'T affect colums that have AUTOSIZE as sizing type
@@ -2058,22 +2846,15 @@ static void hildon_file_selection_selection_changed(GtkTreeSelection *
     }
 }
 
-static void hildon_file_selection_row_activated(GtkTreeView * view,
-                                                GtkTreePath * path,
-                                                GtkTreeViewColumn * col,
-                                                gpointer data)
+/* Opens the row at PATH of the content pane filter MODEL, from the
+   tree views and the grid */
+static void content_row_activated(GtkTreeModel *model, GtkTreePath *path,
+                                  gpointer data)
 {
-	
-    GtkTreeIter iter;
-    GtkTreeModel *model;
-    GtkTreePath *filter_path = NULL, *base_path = NULL, *dir_path = NULL;
+    GtkTreeIter iter, main_iter;
+    GtkTreePath *dir_path = NULL;
     gboolean is_folder, is_available;
 
-    if (HILDON_FILE_SELECTION(data)->priv->edit_mode)
-        return;
-
-    model = gtk_tree_view_get_model(view); /* Content pane filter model */
-
     gtk_tree_row_reference_free(HILDON_FILE_SELECTION(data)->priv->current_row);
     HILDON_FILE_SELECTION(data)->priv->current_row = gtk_tree_row_reference_new(model, path);
 
@@ -2086,24 +2867,10 @@ static void hildon_file_selection_row_activated(GtkTreeView * view,
 
         if (is_available) {
           if (is_folder) {
-            filter_path = gtk_tree_model_sort_convert_path_to_child_path(
-              GTK_TREE_MODEL_SORT(model), path);
-
-            if (filter_path) {
-              base_path = gtk_tree_model_filter_convert_path_to_child_path(
-                GTK_TREE_MODEL_FILTER(
-                  HILDON_FILE_SELECTION(data)->priv->view_filter),
-                filter_path);
-              gtk_tree_path_free(filter_path);
-            }
-
-            if (base_path) {
-              dir_path = gtk_tree_model_sort_convert_child_path_to_path(
-                GTK_TREE_MODEL_SORT(
-                  HILDON_FILE_SELECTION(data)->priv->dir_sort),
-                base_path);
-              gtk_tree_path_free(base_path);
-            }
+            if (view_path_to_main_iter(HILDON_FILE_SELECTION(data)->priv,
+                                       &main_iter, path))
+              dir_path = gtk_tree_model_get_path(
+                HILDON_FILE_SELECTION(data)->priv->main_model, &main_iter);
 
             if (dir_path) {
               hildon_file_selection_delayed_select_path(
@@ -2128,6 +2895,17 @@ static void hildon_file_selection_row_activated(GtkTreeView * view,
     }
 }
 
+static void hildon_file_selection_row_activated(GtkTreeView * view,
+                                                GtkTreePath * path,
+                                                GtkTreeViewColumn * col,
+                                                gpointer data)
+{
+    if (HILDON_FILE_SELECTION(data)->priv->edit_mode)
+        return;
+
+    content_row_activated(gtk_tree_view_get_model(view), path, data);
+}
+
 static gboolean hildon_file_selection_user_moved(gpointer object)
 {
     HildonFileSelection *self;
@@ -2161,8 +2939,8 @@ static void hildon_file_selection_keep_cursor_visible(HildonFileSelection *self)
     GtkWidget *view;
 
     view = get_current_view(self->priv);
-    if (GTK_IS_TREE_VIEW(view) && !self->priv->user_scrolled)
-      scroll_to_cursor(GTK_TREE_VIEW(view));
+    if (is_row_view(view) && !self->priv->user_scrolled)
+      scroll_to_cursor(view);
 }
 
 static void hildon_file_selection_modified(gpointer object, GtkTreePath *path)
@@ -2326,7 +3104,7 @@ navigation_pane_focus(GObject *object, GParamSpec *pspec, gpointer data)
     {
       hildon_file_selection_clear_multi_selection( HILDON_FILE_SELECTION(data) );
       priv->content_pane_last_used = FALSE;
-      scroll_to_cursor(GTK_TREE_VIEW(object));
+      scroll_to_cursor(GTK_WIDGET(object));
       g_object_notify(data, "active-pane");
     }
   }
@@ -2343,7 +3121,7 @@ content_pane_focus(GObject *object, GParamSpec *pspec, gpointer data)
     {
       priv->content_pane_last_used = TRUE;
       if (!priv->user_scrolled)
-        scroll_to_cursor(GTK_TREE_VIEW(object));
+        scroll_to_cursor(GTK_WIDGET(object));
       g_object_notify(data, "active-pane");
     }
   }
@@ -2380,15 +3158,19 @@ navigation_pane_tap_and_hold_query (GtkWidget *widget,
 static gboolean button_press_event_callback(GtkWidget *widget, GdkEventButton *event, gpointer data) {
 
     HildonFileSelectionPrivate *priv = HILDON_FILE_SELECTION(data)->priv;
-    GtkTreePath *path;
+    GtkTreePath *path = NULL;
     gint cell_x, cell_y;
 
-    if (gtk_tree_view_get_path_at_pos(GTK_TREE_VIEW(widget), event->x, event->y, &path, NULL, &cell_x, &cell_y)) {
-        if (path) {
-            gtk_tree_row_reference_free(priv->current_row);
-            priv->current_row = gtk_tree_row_reference_new(priv->sort_model, path);
-            gtk_tree_path_free(path);
-        }
+    if (HILDON_IS_FILE_GRID_VIEW(widget))
+        path = _hildon_file_grid_view_get_path_at_pos
+          (HILDON_FILE_GRID_VIEW(widget), event->x, event->y);
+    else if (!gtk_tree_view_get_path_at_pos(GTK_TREE_VIEW(widget), event->x, event->y, &path, NULL, &cell_x, &cell_y))
+        path = NULL;
+
+    if (path) {
+        gtk_tree_row_reference_free(priv->current_row);
+        priv->current_row = gtk_tree_row_reference_new(priv->view_filter, path);
+        gtk_tree_path_free(path);
     }
     return FALSE; //continue propagating the event
 }
@@ -2455,6 +3237,9 @@ static void hildon_file_selection_create_thumbnail_view(HildonFileSelection
         (selection, "changed",
          G_CALLBACK(hildon_file_selection_content_pane_selection_changed),
          self, 0);
+    if (self->priv->edit_mode)
+        gtk_tree_selection_set_select_function(selection, marks_select_func,
+                                               self->priv, NULL);
     g_signal_connect_object(tree, "key-press-event",
                      G_CALLBACK(hildon_file_selection_on_content_pane_key),
                      self, 0);
@@ -2474,6 +3259,113 @@ static void hildon_file_selection_create_thumbnail_view(HildonFileSelection
     g_signal_connect_object(GTK_WIDGET(tree), "button-press-event",
                      G_CALLBACK(button_press_event_callback), self, 0);
 
+    /* Every frame drawn while scrolling moves the prefetch window */
+    g_signal_connect_object(GTK_WIDGET(tree), "expose-event",
+                     G_CALLBACK(content_view_expose), self,
+                     G_CONNECT_AFTER);
+    g_signal_connect_object(GTK_WIDGET(tree), "expose-event",
+                     G_CALLBACK(content_view_expose_marks), self, 0);
+}
+
+static void grid_cell_data_func(HildonFileGridView *grid,
+                                GtkCellRenderer *renderer,
+                                GtkTreeModel *model,
+                                GtkTreeIter *iter,
+                                gpointer data)
+{
+    thumbnail_cell_data_func(NULL, renderer, model, iter, data);
+}
+
+/* The grid draws the marks as they are, there is no selection to keep
+   in step with them */
+static gboolean grid_selected_func(HildonFileGridView *grid,
+                                   GtkTreeModel *model,
+                                   GtkTreeIter *iter,
+                                   gpointer data)
+{
+    HildonFileSelectionPrivate *priv = data;
+    GtkTreeIter main_iter;
+
+    if (!priv->edit_mode || model != priv->view_filter)
+        return FALSE;
+
+    view_iter_to_main_iter(priv, &main_iter, iter);
+    return marks_contains(priv, main_iter.user_data);
+}
+
+/* A tap on a cell of the grid opens its row, or in edit mode toggles
+   its mark.  Dimmed rows are reported like the tree views do. */
+static void grid_item_activated(HildonFileGridView *grid,
+                                GtkTreePath *path,
+                                HildonFileSelection *self)
+{
+    HildonFileSelectionPrivate *priv = self->priv;
+    GtkTreeIter main_iter;
+    guint32 flags;
+
+    hildon_file_selection_user_moved(self);
+
+    if (!view_path_to_main_iter(priv, &main_iter, path))
+        return;
+
+    flags = _hildon_file_system_model_peek_row_flags
+      (HILDON_FILE_SYSTEM_MODEL(priv->main_model), &main_iter, NULL);
+
+    if (!(flags & ROW_FLAG_IS_AVAILABLE))
+        g_signal_emit(self, signals[LOCATION_INSENSITIVE], 0, &main_iter);
+    else if (priv->edit_mode) {
+        marks_set(priv, main_iter.user_data,
+                  !marks_contains(priv, main_iter.user_data));
+        marks_changed(self);
+    }
+    else
+        content_row_activated(priv->view_filter, path, self);
+}
+
+static void hildon_file_selection_create_grid_view(HildonFileSelection *
+                                                   self)
+{
+    HildonFileGridView *grid;
+
+    self->priv->grid = _hildon_file_grid_view_new(THUMBNAIL_CELL_WIDTH,
+                                                  THUMBNAIL_CELL_HEIGHT);
+    grid = HILDON_FILE_GRID_VIEW(self->priv->grid);
+
+    _hildon_file_grid_view_set_columns(grid,
+        HILDON_FILE_SYSTEM_MODEL_COLUMN_THUMBNAIL, PRIV_COLUMN_DISPLAY_TEXT,
+        HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE);
+    _hildon_file_grid_view_set_data_func(grid, grid_cell_data_func, self);
+    _hildon_file_grid_view_set_selected_func(grid, grid_selected_func,
+                                             self->priv);
+
+    g_signal_connect_object(grid, "item-activated",
+                     G_CALLBACK(grid_item_activated), self, 0);
+    g_signal_connect_object(grid, "key-press-event",
+                     G_CALLBACK(hildon_file_selection_user_moved), self,
+                     G_CONNECT_SWAPPED);
+    /* Arrows leave the grid only at its edges */
+    g_signal_connect_object(grid, "key-press-event",
+                     G_CALLBACK(hildon_file_selection_on_content_pane_key),
+                     self, G_CONNECT_AFTER);
+
+    gtk_widget_tap_and_hold_setup(GTK_WIDGET(grid), NULL, NULL,
+                                  GTK_TAP_AND_HOLD_NONE | GTK_TAP_AND_HOLD_NO_INTERNALS);
+    g_signal_connect_object (grid, "tap-and-hold-query",
+                             G_CALLBACK (content_pane_tap_and_hold_query),
+                             self, 0);
+    g_signal_connect_object(grid, "tap-and-hold",
+                     G_CALLBACK
+                     (hildon_file_selection_content_pane_context), self, 0);
+
+    g_signal_connect_object(grid, "notify::has-focus",
+                     G_CALLBACK(content_pane_focus), self, 0);
+
+    g_signal_connect_object(grid, "button-press-event",
+                     G_CALLBACK(button_press_event_callback), self, 0);
+
+    g_signal_connect_object(grid, "expose-event",
+                     G_CALLBACK(content_view_expose), self,
+                     G_CONNECT_AFTER);
 }
 
 static void hildon_file_selection_create_list_view(HildonFileSelection *
@@ -2482,6 +3374,12 @@ static void hildon_file_selection_create_list_view(HildonFileSelection *
 
     self->priv->view[0] = gtk_tree_view_new();
     // creating empty dummy  tree view
+
+    /* Grows windowed folders like the thumbnail view, should it ever
+       be given the content pane model */
+    g_signal_connect_object(self->priv->view[0], "expose-event",
+                     G_CALLBACK(content_view_expose), self,
+                     G_CONNECT_AFTER);
 }
 
 static void hildon_file_selection_create_dir_view(HildonFileSelection *
@@ -2494,17 +3392,19 @@ static void hildon_file_selection_create_dir_view(HildonFileSelection *
     /* We really cannot use fixed height mode for hierarchial list, because
         we want that the width of the list can grow dynamically when
         folders are expanded (fixed height forces fixed width */
-    self->priv->dir_sort = hildon_file_selection_create_sort_model
-      (self, navigation_pane_sort_function, self->priv->main_model);
-
-    self->priv->dir_filter =
-        gtk_tree_model_filter_new(self->priv->dir_sort, NULL);
-    gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER
+    /* The model keeps the folders in navigation pane order itself, so
+       no GtkTreeModelSort is needed on top of it */
+    _hildon_file_system_model_set_sort
+      (HILDON_FILE_SYSTEM_MODEL(self->priv->main_model),
+       HILDON_FILE_SELECTION_SORT_NAME, GTK_SORT_ASCENDING);
+
+    /* Only the folders of the model are ever looked at */
+    self->priv->dir_filter = GTK_TREE_MODEL(_hildon_file_folder_tree_new
+        (HILDON_FILE_SYSTEM_MODEL(self->priv->main_model)));
+    _hildon_file_folder_tree_set_visible_func(HILDON_FILE_FOLDER_TREE
         (self->priv->dir_filter),
         navigation_pane_filter_func, self->priv,
         NULL);
-    gtk_tree_model_filter_refilter (
-        GTK_TREE_MODEL_FILTER (self->priv->dir_filter));
 
     hildon_file_selection_enable_cursor_magic (self, self->priv->dir_filter);
 
@@ -3051,6 +3951,7 @@ update_local_device_visibility (GMount              *mount,
   {
     reload_local_device_folders(selection);
     priv->show_localdevice = TRUE;
+    priv->predicate.valid = FALSE;
     g_free (uri);
     return;
   }
@@ -3058,12 +3959,13 @@ update_local_device_visibility (GMount              *mount,
   if (g_str_equal (&uri[7], g_getenv ("MYDOCSDIR")))
     {
       priv->show_localdevice = mounted;
+      priv->predicate.valid = FALSE;
       if (priv->dir_filter) {
-	gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (priv->dir_filter));
+	_hildon_file_folder_tree_refilter (HILDON_FILE_FOLDER_TREE (priv->dir_filter));
       }
-      if (priv->view_filter) {
-	gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-                                               (priv->view_filter));
+      view_cache_clear(priv);
+      if (priv->folder_view) {
+	_hildon_file_folder_view_refilter(priv->folder_view);
 	hildon_file_selection_inspect_view(priv);
       }
 #if someone_explains_this
@@ -3099,15 +4001,24 @@ static void hildon_file_selection_init(HildonFileSelection * self)
     GTK_WIDGET_SET_FLAGS(GTK_WIDGET(self), GTK_NO_WINDOW);
 
     self->priv->show_files = TRUE;
+    self->priv->view_cache = g_queue_new();
+    self->priv->view_cache_size = VIEW_CACHE_SIZE_DEFAULT;
+    self->priv->prefetch_start = self->priv->prefetch_end = -1;
+    self->priv->marks = g_hash_table_new(NULL, NULL);
+    self->priv->windowed_folders =
+      g_hash_table_new_full(NULL, NULL, NULL,
+                            (GDestroyNotify) gtk_tree_row_reference_free);
     self->priv->scroll_dir = hildon_pannable_area_new();
     self->priv->scroll_list = hildon_pannable_area_new();
     self->priv->scroll_thumb = hildon_pannable_area_new();
+    self->priv->scroll_grid = hildon_pannable_area_new();
     if(!(HILDON_IS_PANNABLE_AREA(self->priv->scroll_dir) &&
 	 HILDON_IS_PANNABLE_AREA(self->priv->scroll_dir) &&
 	 HILDON_IS_PANNABLE_AREA(self->priv->scroll_dir))){
       self->priv->scroll_dir = gtk_scrolled_window_new(NULL, NULL);
       self->priv->scroll_list = gtk_scrolled_window_new(NULL, NULL);
       self->priv->scroll_thumb = gtk_scrolled_window_new(NULL, NULL);
+      self->priv->scroll_grid = gtk_scrolled_window_new(NULL, NULL);
       gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW
 				     (self->priv->scroll_dir),
 				     GTK_POLICY_AUTOMATIC,
@@ -3118,6 +4029,9 @@ static void hildon_file_selection_init(HildonFileSelection * self)
       gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW
 				     (self->priv->scroll_thumb),
 				     GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+      gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW
+				     (self->priv->scroll_grid),
+				     GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
 
       gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW
 					  (self->priv->scroll_dir),
@@ -3128,6 +4042,9 @@ static void hildon_file_selection_init(HildonFileSelection * self)
       gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW
 					  (self->priv->scroll_thumb),
 					  GTK_SHADOW_NONE);
+      gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW
+					  (self->priv->scroll_grid),
+					  GTK_SHADOW_NONE);
     }
         
     self->priv->view_selector = gtk_vbox_new (FALSE, 0);
@@ -3205,7 +4122,7 @@ static GObject *hildon_file_selection_constructor(GType type,
     GObject *obj;
     HildonFileSelection *self;
     HildonFileSelectionPrivate *priv;
-    GtkTreePath *temp_path;
+    GtkTreeIter temp_iter;
 
     obj =
         G_OBJECT_CLASS(hildon_file_selection_parent_class)->
@@ -3215,7 +4132,6 @@ static GObject *hildon_file_selection_constructor(GType type,
        construction */
     self = HILDON_FILE_SELECTION(obj);
     priv = self->priv;
-  /*priv->sort_model =   <SNIP> */
 
     priv->monitor = g_volume_monitor_get ();
 
@@ -3258,27 +4174,37 @@ static GObject *hildon_file_selection_constructor(GType type,
 
     /* we need to create view models here, even if dummy ones */
 
-    temp_path = gtk_tree_path_new_from_string("0");
-    priv->view_filter = gtk_tree_model_filter_new(priv->main_model, temp_path);
-    gtk_tree_path_free (temp_path);
-
-    gtk_tree_model_filter_set_visible_func
-      (GTK_TREE_MODEL_FILTER (priv->view_filter), filter_func, priv, NULL);
-    gtk_tree_model_filter_refilter (
-        GTK_TREE_MODEL_FILTER (priv->view_filter));
-
-    priv->sort_model = hildon_file_selection_create_sort_model
-      (self, content_pane_sort_function, priv->view_filter);
+    priv->folder_view = _hildon_file_folder_view_new
+      (HILDON_FILE_SYSTEM_MODEL (priv->main_model),
+       gtk_tree_model_get_iter_first (priv->main_model, &temp_iter) ?
+       &temp_iter : NULL);
+    _hildon_file_folder_view_set_visible_func (priv->folder_view,
+                                               filter_func, priv, NULL);
+    _hildon_file_folder_view_set_hide_func (priv->folder_view,
+                                            marks_row_hidden, priv);
+    g_signal_connect (priv->folder_view, "row-inserted",
+                      G_CALLBACK (marks_row_inserted), priv);
+    hildon_file_selection_setup_sortable
+      (GTK_TREE_SORTABLE (priv->folder_view), content_pane_sort_function);
+    priv->search_rejected = g_hash_table_new (NULL, NULL);
+    live_search_connect (priv);
+
+    priv->view_filter = gtk_tree_model_filter_new
+      (GTK_TREE_MODEL (priv->folder_view), NULL);
     if (!priv->edit_mode)
-      hildon_file_selection_enable_cursor_magic (self, priv->sort_model);
+      hildon_file_selection_enable_cursor_magic (self, priv->view_filter);
     hildon_file_selection_create_dir_view(self);
     hildon_file_selection_create_list_view(self);
     hildon_file_selection_create_thumbnail_view(self);
+    hildon_file_selection_create_grid_view(self);
 
     /* Live search */
     priv->live_search = HILDON_LIVE_SEARCH (hildon_live_search_new ());
     hildon_live_search_set_filter (priv->live_search,
         GTK_TREE_MODEL_FILTER (priv->view_filter));
+    gtk_tree_model_filter_set_visible_func
+      (GTK_TREE_MODEL_FILTER (priv->view_filter),
+       (GtkTreeModelFilterVisibleFunc) visible_for_live_search, priv, NULL);
 
     hildon_live_search_widget_hook (priv->live_search,
         GTK_WIDGET (priv->view_selector),
@@ -3287,11 +4213,14 @@ static GObject *hildon_file_selection_constructor(GType type,
     gtk_container_add(GTK_CONTAINER(priv->scroll_dir), priv->dir_tree);
     gtk_container_add(GTK_CONTAINER(priv->scroll_list), priv->view[0]);
     gtk_container_add(GTK_CONTAINER(priv->scroll_thumb), priv->view[1]);
+    gtk_container_add(GTK_CONTAINER(priv->scroll_grid), priv->grid);
 
     gtk_box_pack_start (GTK_BOX (self->priv->view_selector),
 		      self->priv->scroll_list, TRUE, TRUE, 0);
     gtk_box_pack_start (GTK_BOX (self->priv->view_selector),
 		      self->priv->scroll_thumb, TRUE, TRUE, 0);
+    gtk_box_pack_start (GTK_BOX (self->priv->view_selector),
+		      self->priv->scroll_grid, TRUE, TRUE, 0);
     gtk_box_pack_start (GTK_BOX (self->priv->view_selector),
                       GTK_WIDGET(self->priv->live_search), FALSE, FALSE, 0);
 
@@ -3379,6 +4308,7 @@ static GObject *hildon_file_selection_constructor(GType type,
     priv->cur_view = -1;
     gtk_widget_hide (priv->scroll_list);
     gtk_widget_hide (priv->scroll_thumb);
+    gtk_widget_hide (priv->scroll_grid);
     gtk_widget_hide (priv->view[2]);
     gtk_widget_hide (priv->view[3]);
 
@@ -3387,20 +4317,61 @@ static GObject *hildon_file_selection_constructor(GType type,
 }
 
 static void
-get_selected_uris_helper (GtkTreeModel *model,
-                          GtkTreePath *path,
-                          GtkTreeIter *iter,
-                          gpointer data)
+get_selected_files_helper (HildonFileSelectionPrivate *priv,
+                           GtkTreeIter *main_iter,
+                           gpointer data)
 {
-  char *file_uri;
-  GSList **list;
+  GFile *file;
 
-  list = data;
-  gtk_tree_model_get (model, iter,
-                      HILDON_FILE_SYSTEM_MODEL_COLUMN_URI, &file_uri,
-                      -1);
-  *list = g_slist_append (*list, file_uri);   /* file_uri is already a
-                                                 copy */
+  _hildon_file_system_model_peek_row_flags (HILDON_FILE_SYSTEM_MODEL
+                                            (priv->main_model), main_iter,
+                                            &file);
+  if (file)
+    g_ptr_array_add (data, g_object_ref (file));
+}
+
+static void
+get_selected_plain_files_helper (HildonFileSelectionPrivate *priv,
+                                 GtkTreeIter *main_iter,
+                                 gpointer data)
+{
+  GFile *file;
+  guint32 flags;
+
+  flags = _hildon_file_system_model_peek_row_flags (HILDON_FILE_SYSTEM_MODEL
+                                                    (priv->main_model),
+                                                    main_iter, &file);
+  if (file && !(flags & ROW_FLAG_IS_FOLDER))
+    g_ptr_array_add (data, g_object_ref (file));
+}
+
+/* Adds the GFiles of the edit mode selection to FILES, without the
+   folders if FILES_ONLY is set */
+static void
+selected_file_array_add (HildonFileSelectionPrivate *priv,
+                         GPtrArray *files,
+                         gboolean files_only)
+{
+  GtkTreeIter folder;
+
+  marks_foreach (priv, files_only ? get_selected_plain_files_helper
+                                  : get_selected_files_helper, files);
+
+  /* Select all takes in the files of a windowed folder that have no
+     row yet, which are never folders.  A live search makes rows for
+     all of them. */
+  if (priv->marks_inverted && !live_search_active (priv)
+      && _hildon_file_folder_view_get_folder (priv->folder_view, &folder))
+    _hildon_file_system_model_add_record_files
+      (HILDON_FILE_SYSTEM_MODEL (priv->main_model), &folder, files);
+}
+
+static void
+collect_main_iters_helper (HildonFileSelectionPrivate *priv,
+                           GtkTreeIter *main_iter,
+                           gpointer data)
+{
+  g_array_append_val ((GArray *) data, *main_iter);
 }
 
 /*** Public API **********************************************************/
@@ -3499,7 +4470,7 @@ void hildon_file_selection_set_sort_key(HildonFileSelection * self,
 {
     g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
     gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE
-                                         (self->priv->sort_model),
+                                         (self->priv->folder_view),
                                          (gint) key, order);
 }
 
@@ -3517,7 +4488,7 @@ void hildon_file_selection_get_sort_key(HildonFileSelection * self,
 {
     g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
     gtk_tree_sortable_get_sort_column_id(GTK_TREE_SORTABLE
-                                         (self->priv->sort_model),
+                                         (self->priv->folder_view),
                                          (gint *) key, order);
 }
 
@@ -3533,7 +4504,7 @@ void
 hildon_file_selection_set_current_folder_iter(HildonFileSelection * self,
                                               GtkTreeIter * main_iter)
 {
-    GtkTreeIter sort_iter, filter_iter;
+    GtkTreeIter filter_iter;
     GtkTreeView *view;
     GtkTreePath *treepath;
     gboolean res;
@@ -3562,15 +4533,11 @@ hildon_file_selection_set_current_folder_iter(HildonFileSelection * self,
 /*       return; */
 /*     } */
 /*     free(uri); */
-    gtk_tree_model_sort_convert_child_iter_to_iter(GTK_TREE_MODEL_SORT
-                                                   (self->priv->
-                                                    dir_sort),
-                                                   &sort_iter, main_iter);
-    gtk_tree_model_filter_convert_child_iter_to_iter(GTK_TREE_MODEL_FILTER
-                                                     (self->priv->
-                                                      dir_filter),
-                                                     &filter_iter,
-                                                     &sort_iter);
+    if (!_hildon_file_folder_tree_convert_child_iter_to_iter
+          (HILDON_FILE_FOLDER_TREE(self->priv->dir_filter),
+           &filter_iter, main_iter))
+        return;
+
     view = GTK_TREE_VIEW(self->priv->dir_tree);
     treepath =
         gtk_tree_model_get_path(self->priv->dir_filter, &filter_iter);
@@ -3725,20 +4692,15 @@ void hildon_file_selection_set_filter(HildonFileSelection * self,
         }
 
         self->priv->filter = filter;
-
-        if (self->priv->view_filter) {
-            /* gtk_tree_model_filter_refilter displays many critical
-               warnings. This is because of Gtk bug: When refiltering is
-               asked gtk uses foreach for THE WHOLE child model (not just
-               for pats under the virtual root). In respective callback
-               it displays errors when such an item found that has
-               greater depth than virtual root but is form different
-               branch. We don't need to fear these warnings, though. */
-
-        gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER
-                                           (self->priv->view_filter));
-        hildon_file_selection_inspect_view(self->priv);
-      }
+        self->priv->filter_generation =
+            filter ? get_filter_generation(filter) : 0;
+        self->priv->predicate.valid = FALSE;
+        view_cache_clear(self->priv);
+
+        if (self->priv->folder_view) {
+            _hildon_file_folder_view_refilter(self->priv->folder_view);
+            hildon_file_selection_inspect_view(self->priv);
+        }
     }
 }
 
@@ -3799,14 +4761,32 @@ gboolean hildon_file_selection_get_select_multiple(HildonFileSelection *
  * hildon_file_selection_select_all:
  * @self: a pointer to #HildonFileSelection
  *
- * Selects the first row in the content pane.
+ * In edit mode, selects every row of the content pane, together with
+ * the files of the folder that are not shown as rows yet.  Files that
+ * appear afterwards are not selected.  Otherwise selects the first
+ * row in the content pane, which earlier versions did in edit mode
+ * too.
  */
 void hildon_file_selection_select_all(HildonFileSelection * self)
 {
+    HildonFileSelectionPrivate *priv;
+    GtkTreePath *path;
+
     g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
+    priv = self->priv;
+
+    /* No row is touched, the view catches up as it draws */
+    if (priv->edit_mode)
+    {
+      marks_reset(priv, TRUE);
+      marks_changed(self);
+      return;
+    }
 
-    gtk_tree_row_reference_free(self->priv->current_row);
-    self->priv->current_row = gtk_tree_row_reference_new(self->priv->sort_model, gtk_tree_path_new_first());
+    path = gtk_tree_path_new_first();
+    gtk_tree_row_reference_free(priv->current_row);
+    priv->current_row = gtk_tree_row_reference_new(priv->view_filter, path);
+    gtk_tree_path_free(path);
 }
 
 /**
@@ -3821,6 +4801,13 @@ void hildon_file_selection_unselect_all(HildonFileSelection * self)
 
     g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
 
+    if (self->priv->edit_mode)
+    {
+      marks_reset(self->priv, FALSE);
+      marks_changed(self);
+      return;
+    }
+
     view = get_current_view(self->priv);
     if (GTK_IS_TREE_VIEW(view))
     {
@@ -3845,23 +4832,34 @@ void hildon_file_selection_clear_multi_selection(HildonFileSelection * self)
     g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
 
     view = get_current_view(self->priv);
-    if (GTK_IS_TREE_VIEW(view))
+    if (is_row_view(view))
     {
       GtkTreePath *path;
-      GtkTreeSelection *sel;
+      gboolean multiple;
 
-      sel = gtk_tree_view_get_selection(GTK_TREE_VIEW(view));
+      /* The grid has no selection of its own, it shows the marks */
+      if (GTK_IS_TREE_VIEW(view))
+        multiple = gtk_tree_selection_get_mode
+          (gtk_tree_view_get_selection(GTK_TREE_VIEW(view)))
+          == GTK_SELECTION_MULTIPLE;
+      else
+        multiple = self->priv->edit_mode;
 
-      if (gtk_tree_selection_get_mode(sel) == GTK_SELECTION_MULTIPLE)
+      if (multiple)
       {
-        gtk_tree_view_get_cursor(GTK_TREE_VIEW(view), &path, NULL);
-        gtk_tree_selection_unselect_all(sel);
+        GtkTreeIter main_iter;
+
+        path = row_view_get_cursor(view);
+        marks_reset(self->priv, FALSE);
 
         if (path)
         {
-          gtk_tree_view_set_cursor(GTK_TREE_VIEW(view), path, NULL, FALSE);
+          if (view_path_to_main_iter(self->priv, &main_iter, path))
+            marks_set(self->priv, main_iter.user_data, TRUE);
           gtk_tree_path_free(path);
         }
+
+        marks_changed(self);
       }
     }
 }
@@ -3888,22 +4886,25 @@ hildon_file_selection_get_selected_uris (HildonFileSelection *self)
 
   view = get_current_view (self->priv);
 
-  if (GTK_IS_TREE_VIEW (view))
+  if (is_row_view (view))
     {
         GSList *uris = NULL;
         if (self->priv->edit_mode) {
             /* in Fremantle tree selection exists only in edit mode */
-            gtk_tree_selection_selected_foreach (gtk_tree_view_get_selection
-                                                 (GTK_TREE_VIEW(view)),
-                                                 get_selected_uris_helper,
-                                                 &uris);
-      
+            GPtrArray *files =
+              _hildon_file_selection_get_selected_file_array (self);
+            guint i;
+
+            for (i = files->len; i > 0; i--)
+              uris = g_slist_prepend
+                (uris, g_file_get_uri (g_ptr_array_index (files, i - 1)));
+            g_ptr_array_free (files, TRUE);
         } else {
             /* and in normal mode we use the last activated item (current_row) */
             GtkTreeModel *model;
             gchar *file_uri;
 
-            model = gtk_tree_view_get_model(GTK_TREE_VIEW(view));
+            model = row_view_get_model(view);
 
             if (gtk_tree_row_reference_valid(self->priv->current_row)) {
                 GtkTreeIter iter;
@@ -3932,18 +4933,7 @@ hildon_file_selection_select_unselect_main_iter(HildonFileSelectionPrivate
 {
     GtkWidget *view = get_current_view(priv);
 
-    if (GTK_IS_TREE_VIEW(view)) {
-        GtkTreeIter sort_iter, filter_iter;
-        GtkTreeView *treeview = GTK_TREE_VIEW(view);
-
-        gtk_tree_model_filter_convert_child_iter_to_iter
-          (GTK_TREE_MODEL_FILTER(priv->view_filter),
-           &filter_iter, iter);
-
-        gtk_tree_model_sort_convert_child_iter_to_iter
-          (GTK_TREE_MODEL_SORT(priv->sort_model),
-           &sort_iter, &filter_iter);
-
+    if (is_row_view(view)) {
         if (select)
         {
           GtkTreePath *path;
@@ -3951,13 +4941,13 @@ hildon_file_selection_select_unselect_main_iter(HildonFileSelectionPrivate
           /* Setting cursor is a hack, but it ensures that we do not
              end up having old cursor value selected as well
              if we are in the multiselection mode... */
-          path = gtk_tree_model_get_path(priv->sort_model, &sort_iter);
+          path = main_iter_to_view_path(priv, iter);
 
           if (path)
           {
-            gtk_tree_view_set_cursor(treeview, path, NULL, FALSE);
+            row_view_set_cursor(view, path);
             gtk_tree_row_reference_free(priv->current_row);
-            priv->current_row = gtk_tree_row_reference_new(priv->sort_model, path);
+            priv->current_row = gtk_tree_row_reference_new(priv->view_filter, path);
             gtk_tree_path_free(path);
           }
 
@@ -4047,7 +5037,7 @@ hildon_file_selection_select_iter (HildonFileSelection *self,
         (self->priv, iter, TRUE, !dir_changed);
 
       view = get_current_view(self->priv);
-      if (GTK_IS_TREE_VIEW(view))
+      if (is_row_view(view))
         activate_view(view);
       else
         activate_view(self->priv->dir_tree);
@@ -4150,39 +5140,45 @@ void hildon_file_selection_show_content_pane(HildonFileSelection * self)
 
 /* Path is a location in content pane filter model - convert it to main model
    iterator if possible */
-static gboolean view_path_to_main_iter(GtkTreeModel *model,
+static gboolean view_path_to_main_iter(HildonFileSelectionPrivate *priv,
   GtkTreeIter *iter, GtkTreePath *path)
 {
-  GtkTreeModel *child_model;
-  GtkTreeIter filter_iter, sort_iter;
+  GtkTreeIter filter_iter, folder_iter;
 
-  if (gtk_tree_model_get_iter(model, &filter_iter, path))
+  if (gtk_tree_model_get_iter(priv->view_filter, &filter_iter, path))
   {
-    if(GTK_IS_TREE_MODEL_SORT(model))
-    {
-      child_model = gtk_tree_model_sort_get_model(GTK_TREE_MODEL_SORT(model));
+    gtk_tree_model_filter_convert_iter_to_child_iter(GTK_TREE_MODEL_FILTER
+                                                     (priv->view_filter),
+                                                     &folder_iter,
+                                                     &filter_iter);
+    _hildon_file_folder_view_convert_iter_to_child_iter(priv->folder_view,
+                                                        iter, &folder_iter);
+    return TRUE;
+  }
+  return FALSE;
+}
 
-      gtk_tree_model_sort_convert_iter_to_child_iter(GTK_TREE_MODEL_SORT
-                                                       (model),
-                                                       &sort_iter, &filter_iter);
-      gtk_tree_model_filter_convert_iter_to_child_iter(GTK_TREE_MODEL_FILTER
-                                                     (child_model), iter, &sort_iter);
-    }
-    else
-    {
-      child_model = gtk_tree_model_filter_get_model(GTK_TREE_MODEL_FILTER(model));
+/* The other way round: returns the location of a main model iterator
+   in content pane filter model, or NULL if it is not shown there */
+static GtkTreePath *main_iter_to_view_path(HildonFileSelectionPrivate *priv,
+  GtkTreeIter *main_iter)
+{
+  GtkTreeIter folder_iter;
+  GtkTreePath *folder_path, *path;
 
-      gtk_tree_model_filter_convert_iter_to_child_iter(GTK_TREE_MODEL_FILTER
-                                                       (model),
-                                                       &sort_iter, &filter_iter);
+  if (!priv->folder_view ||
+      !_hildon_file_folder_view_convert_child_iter_to_iter(priv->folder_view,
+                                                           &folder_iter,
+                                                           main_iter))
+    return NULL;
 
-      gtk_tree_model_sort_convert_iter_to_child_iter(GTK_TREE_MODEL_SORT
-                                                     (child_model), iter, &sort_iter);
-    }
+  folder_path = gtk_tree_model_get_path(GTK_TREE_MODEL(priv->folder_view),
+                                        &folder_iter);
+  path = gtk_tree_model_filter_convert_child_path_to_path
+    (GTK_TREE_MODEL_FILTER(priv->view_filter), folder_path);
+  gtk_tree_path_free(folder_path);
 
-    return TRUE;
-  }
-  return FALSE;
+  return path;
 }
 
 /**
@@ -4216,13 +5212,13 @@ gboolean hildon_file_selection_get_current_content_iter(HildonFileSelection
         return FALSE;
 
     view = get_current_view(self->priv);
-    if (!GTK_IS_TREE_VIEW(view))
+    if (!is_row_view(view))
         return FALSE;
 
     if (self->priv->current_row) {
         selected_paths = g_list_append(NULL, gtk_tree_row_reference_get_path(self->priv->current_row));
         if (selected_paths) {
-            result = view_path_to_main_iter(self->priv->sort_model, iter, selected_paths->data);
+            result = view_path_to_main_iter(self->priv, iter, selected_paths->data);
             g_list_foreach(selected_paths, (GFunc) gtk_tree_path_free, NULL);
             g_list_free(selected_paths);
         }
@@ -4264,14 +5260,14 @@ hildon_file_selection_get_active_content_iter(HildonFileSelection *self,
         return FALSE;
 
     view = get_current_view(self->priv);
-    if (!GTK_IS_TREE_VIEW(view) || !self->priv->content_pane_last_used)
+    if (!is_row_view(view) || !self->priv->content_pane_last_used)
         return FALSE;
 
-    gtk_tree_view_get_cursor(GTK_TREE_VIEW(view), &path, NULL);
+    path = row_view_get_cursor(view);
     if (!path)
       return FALSE;
 
-    result = view_path_to_main_iter(self->priv->sort_model, iter, path);
+    result = view_path_to_main_iter(self->priv, iter, path);
     gtk_tree_path_free(path);
     return result;
 }
@@ -4294,7 +5290,7 @@ hildon_file_selection_content_iter_is_selected(HildonFileSelection *self,
 {
     GtkWidget *view;
     GList *selected_paths;
-    GtkTreePath *main_path, *sort_path, *filter_path;
+    GtkTreePath *filter_path;
     gboolean result = FALSE;
 
     g_return_val_if_fail(HILDON_IS_FILE_SELECTION(self), FALSE);
@@ -4303,38 +5299,32 @@ hildon_file_selection_content_iter_is_selected(HildonFileSelection *self,
         return FALSE;
 
     view = get_current_view(self->priv);
-    if (!GTK_IS_TREE_VIEW(view))
+    if (!is_row_view(view))
         return FALSE;
 
-    main_path = gtk_tree_model_get_path(self->priv->main_model, iter);
+    filter_path = main_iter_to_view_path(self->priv, iter);
 
-    if (main_path)
+    /* Outside edit mode only a tree view selects rows */
+    if (filter_path && self->priv->edit_mode)
     {
-      sort_path = gtk_tree_model_sort_convert_child_path_to_path(
-          GTK_TREE_MODEL_SORT(self->priv->sort_model), main_path);
-
-      if (sort_path)
-      {
-        filter_path = gtk_tree_model_filter_convert_child_path_to_path(
-            GTK_TREE_MODEL_FILTER(self->priv->view_filter), sort_path);
-
-        if (filter_path)
-        {
-          /* Ok, we now need to check if filter path is present in selection */
-          selected_paths = gtk_tree_selection_get_selected_rows(
-            gtk_tree_view_get_selection(GTK_TREE_VIEW(view)), NULL);
+      result = marks_contains(self->priv, iter->user_data);
+      gtk_tree_path_free(filter_path);
+    }
+    else if (filter_path && !GTK_IS_TREE_VIEW(view))
+      gtk_tree_path_free(filter_path);
+    else if (filter_path)
+    {
+      /* Ok, we now need to check if filter path is present in selection */
+      selected_paths = gtk_tree_selection_get_selected_rows(
+        gtk_tree_view_get_selection(GTK_TREE_VIEW(view)), NULL);
 
-          result = g_list_find_custom(selected_paths,
-            filter_path, (GCompareFunc) gtk_tree_path_compare) != NULL;
+      result = g_list_find_custom(selected_paths,
+        filter_path, (GCompareFunc) gtk_tree_path_compare) != NULL;
 
-          g_list_foreach(selected_paths, (GFunc) gtk_tree_path_free, NULL);
-          g_list_free(selected_paths);
+      g_list_foreach(selected_paths, (GFunc) gtk_tree_path_free, NULL);
+      g_list_free(selected_paths);
 
-          gtk_tree_path_free(filter_path);
-        }
-        gtk_tree_path_free(sort_path);
-      }
-      gtk_tree_path_free(main_path);
+      gtk_tree_path_free(filter_path);
     }
 
     return result;
@@ -4357,7 +5347,7 @@ gboolean hildon_file_selection_get_current_folder_iter(HildonFileSelection
                                                        GtkTreeIter * iter)
 {
     GtkTreeSelection *selection;
-    GtkTreeIter filter_iter, sort_iter;
+    GtkTreeIter filter_iter;
 
     g_return_val_if_fail(HILDON_IS_FILE_SELECTION(self), FALSE);
 
@@ -4366,15 +5356,11 @@ gboolean hildon_file_selection_get_current_folder_iter(HildonFileSelection
     if (!gtk_tree_selection_get_selected(selection, NULL, &filter_iter))
         return gtk_tree_model_get_iter_first(self->priv->main_model, iter);
 
-    gtk_tree_model_filter_convert_iter_to_child_iter(GTK_TREE_MODEL_FILTER
-                                                     (self->priv->
-                                                      dir_filter),
-                                                     &sort_iter,
-                                                     &filter_iter);
-    gtk_tree_model_sort_convert_iter_to_child_iter(GTK_TREE_MODEL_SORT
-                                                   (self->priv->
-                                                    dir_sort), iter,
-                                                   &sort_iter);
+    _hildon_file_folder_tree_convert_iter_to_child_iter(HILDON_FILE_FOLDER_TREE
+                                                        (self->priv->
+                                                         dir_filter),
+                                                        iter,
+                                                        &filter_iter);
 
     return TRUE;
 }
@@ -4385,7 +5371,8 @@ gboolean hildon_file_selection_get_current_folder_iter(HildonFileSelection
  * _hildon_file_selection_get_selected_files:
  * @self:  a #HildonFileSelection.
  *
- * This function always returns a list of one file or NULL.
+ * In edit mode this returns the selected files, without the folders.
+ * Otherwise it always returns a list of one file or NULL.
  */
 GSList *_hildon_file_selection_get_selected_files(HildonFileSelection* self)
 {
@@ -4399,8 +5386,23 @@ GSList *_hildon_file_selection_get_selected_files(HildonFileSelection* self)
 
     view = get_current_view(self->priv);
 
-    if (GTK_IS_TREE_VIEW(view) && self->priv->content_pane_last_used) {
-        model = gtk_tree_view_get_model(GTK_TREE_VIEW(view));
+    if (self->priv->edit_mode) {
+        GPtrArray *files = g_ptr_array_new();
+        GSList *list = NULL;
+        guint i;
+
+        if (is_row_view(view) && self->priv->content_pane_last_used)
+            selected_file_array_add(self->priv, files, TRUE);
+
+        for (i = files->len; i > 0; i--)
+            list = g_slist_prepend(list, g_ptr_array_index(files, i - 1));
+        g_ptr_array_free(files, TRUE);
+
+        return list;
+    }
+
+    if (is_row_view(view) && self->priv->content_pane_last_used) {
+        model = row_view_get_model(view);
         if (gtk_tree_row_reference_valid(self->priv->current_row)) {
             GtkTreePath *path = gtk_tree_row_reference_get_path(self->priv->current_row);
             if (gtk_tree_model_get_iter(model, &iter, path)) {
@@ -4421,6 +5423,104 @@ GSList *_hildon_file_selection_get_selected_files(HildonFileSelection* self)
     return NULL;
 }
 
+/* Like hildon_file_selection_get_selected_uris, but returns the
+   GFiles in a GPtrArray that unrefs them when freed.  No URIs are
+   made and, unless everything is selected, only the selected rows are
+   looked at, so this is meant for large selections. */
+GPtrArray *
+_hildon_file_selection_get_selected_file_array(HildonFileSelection *self)
+{
+    HildonFileSelectionPrivate *priv;
+    GPtrArray *files;
+    GtkWidget *view;
+
+    g_return_val_if_fail(HILDON_IS_FILE_SELECTION(self), NULL);
+    priv = self->priv;
+
+    files = g_ptr_array_new_with_free_func(g_object_unref);
+    view = get_current_view(priv);
+
+    if (!is_row_view(view))
+        return files;
+
+    if (priv->edit_mode)
+        selected_file_array_add(priv, files, FALSE);
+    else if (gtk_tree_row_reference_valid(priv->current_row)) {
+        GtkTreePath *path = gtk_tree_row_reference_get_path(priv->current_row);
+        GtkTreeIter main_iter;
+
+        if (view_path_to_main_iter(priv, &main_iter, path))
+            get_selected_files_helper(priv, &main_iter, files);
+        gtk_tree_path_free(path);
+    }
+
+    return files;
+}
+
+/* Selects the rows of the content pane from FIRST to LAST, iterators
+   of the main model, in edit mode.  Only the rows of the range are
+   looked at.  Returns FALSE if either of them is not shown. */
+gboolean _hildon_file_selection_select_range(HildonFileSelection *self,
+                                             GtkTreeIter *first,
+                                             GtkTreeIter *last)
+{
+    HildonFileSelectionPrivate *priv;
+    GtkTreePath *start, *end;
+    GtkTreeIter iter, main_iter;
+    gint i, n;
+
+    g_return_val_if_fail(HILDON_IS_FILE_SELECTION(self), FALSE);
+    priv = self->priv;
+
+    if (!priv->edit_mode)
+        return FALSE;
+
+    start = main_iter_to_view_path(priv, first);
+    end = main_iter_to_view_path(priv, last);
+    if (!start || !end) {
+        if (start)
+            gtk_tree_path_free(start);
+        if (end)
+            gtk_tree_path_free(end);
+        return FALSE;
+    }
+
+    if (gtk_tree_path_compare(start, end) > 0) {
+        GtkTreePath *tmp = start;
+        start = end;
+        end = tmp;
+    }
+
+    n = gtk_tree_path_get_indices(end)[0] - gtk_tree_path_get_indices(start)[0];
+    if (gtk_tree_model_get_iter(priv->view_filter, &iter, start))
+        for (i = 0; i <= n; i++) {
+            view_iter_to_main_iter(priv, &main_iter, &iter);
+            marks_set(priv, main_iter.user_data, TRUE);
+            if (!gtk_tree_model_iter_next(priv->view_filter, &iter))
+                break;
+        }
+
+    gtk_tree_path_free(start);
+    gtk_tree_path_free(end);
+    marks_changed(self);
+
+    return TRUE;
+}
+
+/* Selects the rows of the content pane that are not selected and
+   unselects the others, in edit mode.  Only a flag is flipped, the
+   view picks the change up for the rows it draws. */
+void _hildon_file_selection_invert_selection(HildonFileSelection *self)
+{
+    g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
+
+    if (!self->priv->edit_mode)
+        return;
+
+    self->priv->marks_inverted = !self->priv->marks_inverted;
+    marks_changed(self);
+}
+
 /**
  * hildon_file_selection_dim_current_selection:
  * @self: a #HildonFileSelection.
@@ -4440,16 +5540,35 @@ void hildon_file_selection_dim_current_selection(HildonFileSelection *self)
     g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
 
     view = get_current_view(self->priv);
+    model = HILDON_FILE_SYSTEM_MODEL(self->priv->main_model);
+
+    if (self->priv->edit_mode)
+    {
+        GArray *iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
+        guint i;
+
+        /* Dimming can hide rows, which changes the marks.  Files of a
+           windowed folder without a row have nothing to dim. */
+        if (is_row_view(view))
+            marks_foreach(self->priv, collect_main_iters_helper, iters);
+        marks_reset(self->priv, FALSE);
+        marks_changed(self);
+
+        for (i = 0; i < iters->len; i++)
+            hildon_file_system_model_iter_available
+              (model, &g_array_index(iters, GtkTreeIter, i), FALSE);
+        g_array_free(iters, TRUE);
+        return;
+    }
 
     if (GTK_IS_TREE_VIEW(view))
     {
-        model = HILDON_FILE_SYSTEM_MODEL(self->priv->main_model);
         sel = gtk_tree_view_get_selection(GTK_TREE_VIEW(view));
         paths = gtk_tree_selection_get_selected_rows(sel, NULL);
         gtk_tree_selection_unselect_all(sel);
 
         for (path = paths; path; path = path->next)
-          if (view_path_to_main_iter(self->priv->sort_model, &iter, path->data))
+          if (view_path_to_main_iter(self->priv, &iter, path->data))
             hildon_file_system_model_iter_available(model, &iter, FALSE);
 
         g_list_foreach(paths, (GFunc) gtk_tree_path_free, NULL);
@@ -4497,6 +5616,108 @@ void _hildon_file_selection_realize_help(HildonFileSelection *self)
   gtk_widget_realize(self->priv->dir_tree);
 }
 
+/* How many recently visited folders keep their content pane models
+   around.  0 turns the cache off. */
+void _hildon_file_selection_set_view_cache_size(HildonFileSelection *self,
+                                                guint size)
+{
+  g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
+
+  self->priv->view_cache_size = size;
+  view_cache_trim(self->priv, size);
+}
+
+/* Whether the content pane models of FOLDER, an iter of the main
+   model, are waiting in the cache */
+gboolean _hildon_file_selection_view_cache_has_folder(HildonFileSelection *self,
+                                                      GtkTreeIter *folder)
+{
+  GList *link;
+
+  g_return_val_if_fail(HILDON_IS_FILE_SELECTION(self), FALSE);
+  g_return_val_if_fail(folder != NULL, FALSE);
+
+  for (link = self->priv->view_cache->head; link; link = link->next)
+    {
+      ViewCacheEntry *entry = link->data;
+      GtkTreeIter iter;
+
+      if (_hildon_file_folder_view_get_folder(entry->folder_view, &iter)
+          && iter.user_data == folder->user_data)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Whether the folders shown in the content pane from now on only get
+   rows as far as they are scrolled.  Meant for dialogs that own their
+   model, other users of a shared one would miss the files. */
+void _hildon_file_selection_set_windowed(HildonFileSelection *self,
+                                         gboolean windowed)
+{
+  GtkTreeIter iter;
+
+  g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
+
+  windowed = windowed != FALSE;
+  if (self->priv->windowed == windowed)
+    return;
+
+  self->priv->windowed = windowed;
+  if (!windowed)
+    unwindow_folders(self->priv);
+  else if (hildon_file_selection_content_pane_visible(self->priv) &&
+           hildon_file_selection_get_current_folder_iter(self, &iter))
+    window_folder(self->priv, &iter);
+}
+
+
+/* Whether the thumbnail mode of the content pane shows the files in a
+   grid, several to a line, instead of the tree view.  The grid does
+   not drag and drop. */
+void _hildon_file_selection_set_grid(HildonFileSelection *self,
+                                     gboolean grid)
+{
+  HildonFileSelectionPrivate *priv;
+  GtkWidget *view;
+  GtkTreePath *cursor = NULL;
+  gboolean shown, focused = FALSE;
+
+  g_return_if_fail(HILDON_IS_FILE_SELECTION(self));
+  priv = self->priv;
+
+  grid = grid != FALSE;
+  if (priv->grid_mode == grid)
+    return;
+
+  /* The cursor goes over to the other view */
+  view = get_current_view(priv);
+  if (is_row_view(view))
+    {
+      cursor = row_view_get_cursor(view);
+      focused = GTK_WIDGET_HAS_FOCUS(view);
+    }
+
+  shown = priv->cur_view == HILDON_FILE_SELECTION_MODE_THUMBNAILS;
+  if (shown)
+    gtk_widget_hide(view_widget(priv, priv->cur_view));
+  priv->grid_mode = grid;
+  if (shown)
+    gtk_widget_show(view_widget(priv, priv->cur_view));
+
+  rebind_models(priv);
+
+  view = get_current_view(priv);
+  if (cursor)
+    {
+      if (is_row_view(view))
+        row_view_set_cursor(view, cursor);
+      gtk_tree_path_free(cursor);
+    }
+  if (focused)
+    activate_view(view);
+}
 
 /**
  * hildon_file_selection_set_column_headers_visible:
@@ -4577,7 +5798,7 @@ hildon_file_selection_set_cursor_stubbornly (HildonFileSelection *self,
 
 struct idle_cursor_data {
   HildonFileSelection *self;
-  GtkTreeView *view;
+  GtkWidget *view;            /* a tree view or the grid */
   GtkTreePath *path;
   gboolean stubbornly;
 };
@@ -4589,12 +5810,19 @@ set_cursor_idle_handler (gpointer data)
 
   GDK_THREADS_ENTER ();
 
-  gtk_tree_view_expand_to_path (c->view, c->path);
-
-  if (c->stubbornly)
-    hildon_file_selection_set_cursor_stubbornly (c->self, c->view, c->path);
+  if (HILDON_IS_FILE_GRID_VIEW (c->view))
+    row_view_set_cursor (c->view, c->path);
   else
-    gtk_tree_view_set_cursor (c->view, c->path, NULL, FALSE);
+    {
+      GtkTreeView *view = GTK_TREE_VIEW (c->view);
+
+      gtk_tree_view_expand_to_path (view, c->path);
+
+      if (c->stubbornly)
+        hildon_file_selection_set_cursor_stubbornly (c->self, view, c->path);
+      else
+        gtk_tree_view_set_cursor (view, c->path, NULL, FALSE);
+    }
 
   gtk_tree_path_free (c->path);
 
@@ -4608,7 +5836,7 @@ set_cursor_idle_handler (gpointer data)
 
 static void
 set_cursor_when_idle (HildonFileSelection *self,
-		      GtkTreeView *view, GtkTreePath *path,
+		      GtkWidget *view, GtkTreePath *path,
                       gboolean stubbornly)
 {
   struct idle_cursor_data *c;
@@ -4632,7 +5860,7 @@ set_cursor_when_idle (HildonFileSelection *self,
 
   c = g_new (struct idle_cursor_data, 1);
   c->self = self;
-  c->view = GTK_TREE_VIEW (view);
+  c->view = view;
   c->path = p;
   c->stubbornly = stubbornly;
 
@@ -4736,7 +5964,7 @@ hildon_file_selection_row_deleted (GtkTreeModel *model,
 		 in an idle func as there model is no longer available
 	       */
 	      if (use_idle)
-		set_cursor_when_idle (self, view, p, TRUE);
+		set_cursor_when_idle (self, GTK_WIDGET (view), p, TRUE);
 	      else
 		hildon_file_selection_set_cursor_stubbornly (self, view, p);
 	    }
@@ -4747,7 +5975,7 @@ hildon_file_selection_row_deleted (GtkTreeModel *model,
 	}
 
       gtk_tree_path_free (cursor_path);
-      set_cursor_when_idle (self, view, path, TRUE);
+      set_cursor_when_idle (self, GTK_WIDGET (view), path, TRUE);
     }
 }
 
@@ -4758,28 +5986,36 @@ hildon_file_selection_row_inserted (GtkTreeModel *model,
 {
   HildonFileSelection *self = (HildonFileSelection *)data;
   HildonFileSelectionPrivate *priv = self->priv;
-  GtkTreeSelection *selection;
   GtkTreeView *view;
+  GtkWidget *cursor_view;
   char *uri;
 
   if (priv->cursor_goal_uri == NULL)
     return;
 
+  /* The grid picks up the row after this handler, so it gets the
+     cursor in an idle as well */
   view = get_view_for_model (self, model);
-  if (view == NULL)
+  if (view)
+    cursor_view = GTK_WIDGET (view);
+  else if (HILDON_IS_FILE_GRID_VIEW (get_current_view (priv))
+           && model == priv->view_filter)
+    cursor_view = priv->grid;
+  else
     return;
 
-  selection = gtk_tree_view_get_selection (view);
   gtk_tree_model_get (model, iter,
                       HILDON_FILE_SYSTEM_MODEL_COLUMN_URI, &uri,
                       -1);
 
   if (g_str_equal (uri, priv->cursor_goal_uri) &&
-      !gtk_tree_selection_get_selected (selection, NULL, NULL))
+      (view == NULL ||
+       !gtk_tree_selection_get_selected (gtk_tree_view_get_selection (view),
+                                         NULL, NULL)))
     {
-
-      gtk_tree_view_expand_to_path (view, path);
-      set_cursor_when_idle (self, view, path, FALSE);
+      if (view)
+        gtk_tree_view_expand_to_path (view, path);
+      set_cursor_when_idle (self, cursor_view, path, FALSE);
 
       g_free (priv->cursor_goal_uri);
       priv->cursor_goal_uri = NULL;
@@ -4835,7 +6071,7 @@ hildon_file_selection_move_cursor_to_uri (HildonFileSelection * self,
       (HILDON_FILE_SYSTEM_MODEL (priv->main_model), uri, &iter);
   if (loaded)
     {
-      GtkTreeIter filter_iter, sort_iter;
+      GtkTreeIter filter_iter;
       GtkTreePath *path;
 
       /* Now find the view corresponding to ITER and set its cursor.
@@ -4843,31 +6079,24 @@ hildon_file_selection_move_cursor_to_uri (HildonFileSelection * self,
 
       if (priv->content_pane_last_used)
         {
-          GtkTreeView *view = get_view_for_model (self, priv->sort_model);
-          if (view == NULL)
+          GtkWidget *view = get_current_view (priv);
+          if (!is_row_view (view)
+              || row_view_get_model (view) != priv->view_filter)
             return;
 
-          gtk_tree_model_filter_convert_child_iter_to_iter
-            (GTK_TREE_MODEL_FILTER(priv->view_filter),
-             &filter_iter, &iter);
-
-          gtk_tree_model_sort_convert_child_iter_to_iter
-            (GTK_TREE_MODEL_SORT(priv->sort_model),
-             &sort_iter, &filter_iter);
+          path = main_iter_to_view_path (priv, &iter);
+          if (path == NULL)
+            return;
 
-          path = gtk_tree_model_get_path (priv->sort_model, &sort_iter);
-          gtk_tree_view_set_cursor (GTK_TREE_VIEW (view), path, NULL, FALSE);
+          row_view_set_cursor (view, path);
           gtk_tree_path_free (path);
         }
       else
         {
-          gtk_tree_model_sort_convert_child_iter_to_iter
-            (GTK_TREE_MODEL_SORT(priv->dir_sort),
-             &sort_iter, &iter);
-
-          gtk_tree_model_filter_convert_child_iter_to_iter
-            (GTK_TREE_MODEL_FILTER(priv->dir_filter),
-             &filter_iter, &sort_iter);
+          if (!_hildon_file_folder_tree_convert_child_iter_to_iter
+                (HILDON_FILE_FOLDER_TREE(priv->dir_filter),
+                 &filter_iter, &iter))
+            return;
 
           path = gtk_tree_model_get_path (priv->dir_filter, &filter_iter);
           gtk_tree_view_set_cursor (GTK_TREE_VIEW (priv->dir_tree), path,
@@ -4893,27 +6122,20 @@ hildon_file_selection_move_cursor_to_uri (HildonFileSelection * self,
 
       /* XXX - we only want to unset the cursor...
        */
-      selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (view));
-      gtk_tree_selection_unselect_all (selection);
+      if (HILDON_IS_FILE_GRID_VIEW (view))
+        row_view_set_cursor (view, NULL);
+      else if (GTK_IS_TREE_VIEW (view))
+        {
+          selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (view));
+          gtk_tree_selection_unselect_all (selection);
+        }
     }
 }
 
-static GtkTreeModel *
-hildon_file_selection_create_sort_model (HildonFileSelection *self,
-                                         GtkTreeIterCompareFunc sort_function,
-                                         GtkTreeModel *parent_model)
+static void
+hildon_file_selection_setup_sortable (GtkTreeSortable *sortable,
+                                      GtkTreeIterCompareFunc sort_function)
 {
-  GtkTreeModel *ret;
-  GtkTreeSortable *sortable;
-
-
-  if(!parent_model) {
-    return NULL;
-  }
-
-  ret = gtk_tree_model_sort_new_with_model(parent_model);
-
-  sortable = GTK_TREE_SORTABLE(ret);
   gtk_tree_sortable_set_sort_func(sortable,
                                   HILDON_FILE_SELECTION_SORT_NAME,
                                   sort_function, sortable, NULL);
@@ -4932,8 +6154,6 @@ hildon_file_selection_create_sort_model (HildonFileSelection *self,
                                        (gint)
                                        HILDON_FILE_SELECTION_SORT_NAME,
                                        GTK_SORT_ASCENDING);
-
-  return ret;
 }
 
 static void reload_local_device_folders(HildonFileSelection *selection)
@@ -26,6 +26,12 @@
  * @short_description: a #GtkTreeModel-compatible file system model
  *
  * This is the model used by #HildonFileSelection.
+ *
+ * The values of a row are up to date as soon as it changes, but
+ * #GtkTreeModel::row-changed is emitted later, from an idle of
+ * %G_PRIORITY_HIGH_IDLE.  A row that changes many times before that
+ * gets a single signal.  Code that waits for the signal, rather than
+ * reading the row, has to run the main loop first.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -50,6 +56,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <hildon-mime.h>
+#include <hildon/hildon-helper.h>
 #ifdef UPSTREAM_DISABLED
 #include <tracker.h>
 #endif
@@ -58,6 +65,7 @@
 #include "hildon-file-system-root.h"
 #include "hildon-file-system-local-device.h"
 #include "hildon-file-details-dialog.h"
+#include "hildon-file-name-index.h"
 
 /*#define DEBUG*/
 
@@ -69,15 +77,49 @@
                                    thumbnail mode. Using the value 60 made
                                    icons to have size 60x51!!! */
 #define DEFAULT_MAX_CACHE 50
+#define THUMBNAIL_CACHE_SIZE 200 /* Rows that keep their thumbnail */
+#define DEAD_NODES_PER_IDLE 500  /* Kicked nodes freed per idle call */
+#define MAX_DEVICE_LOADS 3       /* Folders of one device enumerated at
+                                    the same time, by default */
 #define MIN_CACHE 20
 
 #define MAX_BATCH 20
+#define FILTER_RESULTS 2         /* File filter results kept per row */
 
 static const char *EXPANDED_EMBLEM_NAME = "qgn_list_gene_fldr_exp";
 static const char *COLLAPSED_EMBLEM_NAME = "qgn_list_gene_fldr_clp";
 
 static GQuark hildon_file_system_model_quark = 0;
 
+typedef struct _SortKeyJob SortKeyJob;
+
+/* Classes of folder loads, the most urgent first */
+typedef enum {
+    LOAD_PRIORITY_CURRENT,      /* The folder the user has opened, or
+                                   one that a caller waits for */
+    LOAD_PRIORITY_VISIBLE,      /* Folders whose rows have been shown */
+    LOAD_PRIORITY_SPECULATIVE,  /* Locations nobody has looked into */
+    N_LOAD_PRIORITIES
+} LoadPriority;
+
+/* A file of a windowed folder that has no row yet, see
+   _hildon_file_system_model_window_children() */
+typedef struct {
+    GFile *file;
+    GFileInfo *info;
+    gchar *sort_key;    /* Made when first sorted */
+    guint serial;       /* Order in which the files were found */
+} ChildRecord;
+
+typedef struct {
+    /* In reverse display order while sorted is set, so that the
+       next record to get a row is the last one */
+    GPtrArray *list;
+    GHashTable *index;  /* GFile -> ChildRecord */
+    guint serial;
+    gboolean sorted;
+} ChildRecords;
+
 typedef struct {
     GFile *file;
     GFileInfo *info;
@@ -93,11 +135,19 @@ typedef struct {
     gchar *key_cache;
     HildonFileSystemModel *model;
     HildonThumbnailRequest* thumbnail_request;
+    GList *thumbnail_link; /* In thumbnail_lru while either of the above
+                              is set */
+    GList *load_link; /* In a load_queue or in loading of the model */
+    GNode *load_device; /* Holds a load slot of this device while
+                           in loading */
     time_t load_time;
     guint present_flag : 1;
     guint available : 1; /* Set by code */
     guint accessed : 1;  /* Replaces old gateway_accessed from model */
     guint linking : 1; /* whether it's being linked */
+    guint folder_listed : 1; /* In the folder_children of the parent */
+    guint load_queued : 1; /* load_link is in a load_queue */
+    guint load_priority : 2; /* LoadPriority of the last load */
     GError *error;      /* Set if cannot get children */
     gchar *thumb_title, *thumb_author, *thumb_album;
     HildonFileSystemSpecialLocation *location;
@@ -105,8 +155,55 @@ typedef struct {
      * cellrenderer. */
     gchar *display_text;
     PangoAttrList *display_attrs;
+    /* The display_epoch of the model that the above were made in */
+    guint display_epoch;
+    /* Normalized file name and display_text for live search */
+    gchar *search_cache;
+    gchar *display_search_cache;
+    /* Set while key_cache and search_cache are being computed in the
+       background */
+    SortKeyJob *key_job;
+    /* ROW_FLAG_* bits, item type and sort weight.  Recomputed by
+       model_node_update_row_flags() when the info or the location
+       changes. */
+    guint32 row_flags;
+    /* Results of the last file filters of HildonFileSelection, most
+       recent first, by the generation of the filter.  Switching back
+       and forth between two filters does not run either again.
+       Dropped together with row_flags. */
+    guint filter_generation[FILTER_RESULTS];
+    gboolean filter_result[FILTER_RESULTS];
+    /* Children in display order, kept while the model is sorted */
+    GPtrArray *sorted_children;
+    /* The children that are folders, in model order.  Built when first
+       asked for and kept up to date from then on. */
+    GPtrArray *folder_children;
+    /* The files of a windowed folder that have no row yet */
+    ChildRecords *records;
+    /* Rows made before the rest of the files are kept as records, the
+       largest size asked for by the views that window this folder.  0
+       if every file gets a row. */
+    guint window_size;
+    guint window_users;
+    /* Order in which the rows were made, kept while unsorted */
+    guint serial;
 } HildonFileSystemModelNode;
 
+/* Sort keys and live search names of enumerated files are computed
+   by a worker thread, so that the first sort of a freshly loaded
+   folder does not have to collate every name on the UI thread.  The
+   worker only ever touches the job, never the node.  Nodes are
+   detached from their jobs and results are published on the main
+   thread, so no locking is needed. */
+struct _SortKeyJob {
+    GNode *node;        /* NULL once the node has been detached */
+    gchar *name;
+    gchar *key;
+    gchar *search_name;
+};
+
+static GThreadPool *sort_key_pool = NULL;
+
 typedef struct {
     GNode *parent_node;
     GtkFolder *folder;
@@ -145,6 +242,89 @@ struct _HildonFileSystemModelPrivate {
        enumerated at least once.
     */
    gboolean first_root_scan_completed;
+
+    /* SortKeyJobs of the current enumeration batch, handed to the
+       worker when the batch ends or from key_jobs_idle_id */
+    GPtrArray *key_jobs;
+    guint key_jobs_idle_id;
+
+    /* Shared display_attrs lists for the current style, keyed by the
+       length of the first row */
+    GHashTable *display_attrs_cache;
+
+    /* Order of the children of every folder, see
+       _hildon_file_system_model_set_sort().  sort_users counts the
+       callers that have not unset it yet. */
+    gboolean sorted;
+    guint sort_users;
+    HildonFileSelectionSortKey sort_key;
+    GtkSortType sort_order;
+    guint node_serial;
+
+    /* How many folders have been windowed, see
+       _hildon_file_system_model_window_children() */
+    guint windowed_folders;
+
+    /* Created by the first hildon_file_system_model_search_async() */
+    HildonFileNameIndex *name_index;
+    GSList *pending_searches;
+    /* Folders whose children are handed to the index from
+       name_index_idle, so that a burst of changes costs one pass */
+    GHashTable *name_index_nodes;
+    guint name_index_id;
+
+    /* The folder_children of the fake root, which has no model node */
+    GPtrArray *root_folder_children;
+
+    /* Nodes with a thumbnail or a thumbnail request, the most recently
+       shown first.  Only THUMBNAIL_CACHE_SIZE of them are kept, so
+       scrolling through a large folder does not keep every thumbnail
+       in memory or the thumbnailer busy with rows long gone. */
+    GQueue thumbnail_lru;
+
+    /* Nodes whose row has changed since the last flush.  Each of them
+       gets one row-changed, in path order, before the next frame. */
+    GHashTable *changed_nodes;
+    guint changed_idle_id;
+    /* Bumped whenever rows are inserted, deleted or reordered */
+    guint rows_serial;
+    /* How many changes were queued, how many row-changed signals they
+       turned into and in how many flushes */
+    guint changes_queued;
+    guint changes_emitted;
+    guint change_flushes;
+
+    /* Bumped when the style or the time format changes.  The display
+       text and attributes of a node made in an older epoch are made
+       again when next asked for, instead of walking the whole tree. */
+    guint display_epoch;
+    /* Nodes made unavailable by hildon_file_system_model_iter_available() */
+    GHashTable *unavailable_nodes;
+
+    /* Nodes that have a special location.  Volume changes are passed
+       to these only, so that they do not cost a walk over every file
+       the model has loaded. */
+    GHashTable *location_nodes;
+
+    /* Kicked subtrees that are no longer part of the tree and have
+       been cut off from their folders, locations and thumbnails.  They
+       are freed a few at a time, so that removing a memory card with
+       thousands of loaded files does not freeze the UI. */
+    GQueue dead_nodes;
+    guint dead_nodes_idle_id;
+
+    /* Folders waiting to be loaded, one queue per LoadPriority, and
+       the folders being loaded.  Only max_device_loads folders of a
+       device are enumerated at once, except for current loads, which
+       never wait.  See link_file_folder(). */
+    GQueue load_queue[N_LOAD_PRIORITIES];
+    GQueue loading;
+    guint n_loading[N_LOAD_PRIORITIES];
+    GHashTable *device_loads;   /* device GNode -> loads running on it */
+    guint max_device_loads;     /* 0 for no limit */
+    guint load_idle_id;
+    /* Set by _hildon_file_system_model_prioritize_folder() */
+    GNode *current_folder;
 };
 
 typedef struct {
@@ -199,18 +379,28 @@ static void hildon_file_system_model_change_node_list(GtkTreeModel * model,
 						      GtkFolder *
                                                       folder,
                                                       GSList * children);
+static void hildon_file_system_model_rename_node(GtkTreeModel * model,
+                                                 GNode * node,
+                                                 GtkFolder * folder,
+                                                 GFile * file);
 static gboolean is_node_loaded (GNode * node);
 static GNode *
 hildon_file_system_model_kick_node(GNode *node, gpointer data);
 static void
+hildon_file_system_model_kick_children(GNode *node, gpointer data);
+static void
 clear_model_node_caches(HildonFileSystemModelNode *model_node);
+static void
+clear_model_node_name_caches(HildonFileSystemModelNode *model_node);
 static void unlink_file_folder(GNode *node);
+static void load_forget(GNode *node);
 static gboolean
-link_file_folder(GNode *node, GFile *file);
+link_file_folder(GNode *node, GFile *file, LoadPriority priority);
 static void
 hildon_file_system_model_folder_finished_loading(GtkFolder *monitor,
   gpointer data);
 static void emit_node_changed(GNode *node);
+static void sync_folder_list(HildonFileSystemModelPrivate *priv, GNode *node);
 static void
 location_changed(HildonFileSystemSpecialLocation *location, GNode *node);
 static void
@@ -219,6 +409,10 @@ location_connection_state_changed(HildonFileSystemSpecialLocation *location,
 static void
 location_rescan (HildonFileSystemSpecialLocation *location, GNode *node);
 static void setup_node_for_location(GNode *node);
+static void name_index_update_folder(GNode *node);
+static void name_index_remove_files(GNode *node, GSList *files);
+static void name_index_add_file(GNode *node, GFile *file);
+static void name_index_update_roots(HildonFileSystemModel *model);
 static void
 hildon_file_system_model_reload_node (HildonFileSystemModel *model,
                                             GNode *node,
@@ -235,6 +429,8 @@ hildon_file_system_model_search_path_internal (GNode *parent_node,
                                                gboolean recursively);
 static gboolean
 model_node_is_folder(HildonFileSystemModelNode *model_node);
+static void
+model_node_update_row_flags(HildonFileSystemModelNode *model_node);
 
 
 #define CAST_GET_PRIVATE(o) \
@@ -257,6 +453,10 @@ handle_finished_node (GNode *node)
   HildonFileSystemModel *model = MODEL_FROM_NODE(node);
   GNode *child_node;
 
+  /* Let the next folder load */
+  if (!((HildonFileSystemModelNode *) node->data)->load_queued)
+    load_forget(node);
+
   child_node = g_node_first_child(node);
   while (child_node)
     {
@@ -277,6 +477,7 @@ handle_finished_node (GNode *node)
     }
 
   emit_node_changed (node);
+  name_index_update_folder (node);
 
   iter.stamp = model->priv->stamp;
   iter.user_data = node;
@@ -290,7 +491,7 @@ handle_finished_node (GNode *node)
 static void hildon_file_system_model_real_device_disconnected(
   HildonFileSystemModel *self, GtkTreeIter *iter)
 {
-  GNode *node, *child;
+  GNode *node;
   HildonFileSystemModelNode *model_node;
 
   g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(self));
@@ -298,10 +499,7 @@ static void hildon_file_system_model_real_device_disconnected(
 
   node = iter->user_data;
   unlink_file_folder(node);
-
-  child = node->children;
-  while (child)
-    child = hildon_file_system_model_kick_node(child, self);
+  hildon_file_system_model_kick_children(node, self);
 
   model_node = node->data;
   g_return_if_fail(model_node != NULL);
@@ -313,6 +511,7 @@ static void hildon_file_system_model_real_device_disconnected(
     g_object_unref (model_node->info);
     model_node->info = NULL;
   }
+  model_node_update_row_flags(model_node);
 
   if (model_node->location
       && (model_node->location->compatibility_type ==
@@ -447,7 +646,7 @@ node_needs_reload (HildonFileSystemModel *model, GNode *node,
       return FALSE;
     }
 
-  if (model_node->cancellable != NULL
+  if (model_node->cancellable != NULL || model_node->load_queued
       || (model_node->folder
 	  && gtk_file_folder_is_finished_loading (model_node->folder)))
     {
@@ -634,23 +833,155 @@ is_node_loaded (GNode * node)
 	      && model_node->pending_adds == 0)); /* this is the only place pending_adds is checked, thus no need to know the exact amount, just equality to 0 */
 }
 
+typedef struct {
+  GNode *node;
+  GtkTreePath *path;
+} ChangedRow;
+
+static gint
+compare_changed_rows(gconstpointer a, gconstpointer b)
+{
+  return gtk_tree_path_compare(((const ChangedRow *) a)->path,
+                               ((const ChangedRow *) b)->path);
+}
+
+static gboolean
+flush_changed_nodes(gpointer data)
+{
+  GtkTreeModel *model = data;
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  GHashTableIter hash_iter;
+  GArray *rows;
+  GtkTreeIter iter;
+  gpointer node;
+  guint i, serial;
+
+  GDK_THREADS_ENTER ();
+
+  priv->changed_idle_id = 0;
+  priv->change_flushes++;
+
+  iter.stamp = priv->stamp;
+  rows = g_array_sized_new(FALSE, FALSE, sizeof(ChangedRow),
+                           g_hash_table_size(priv->changed_nodes));
+  g_hash_table_iter_init(&hash_iter, priv->changed_nodes);
+  while (g_hash_table_iter_next(&hash_iter, &node, NULL))
+  {
+    ChangedRow row;
+
+    iter.user_data = node;
+    row.node = node;
+    row.path = hildon_file_system_model_get_path(model, &iter);
+    g_array_append_val(rows, row);
+  }
+  g_array_sort(rows, compare_changed_rows);
+  serial = priv->rows_serial;
+
+  for (i = 0; i < rows->len; i++)
+  {
+    ChangedRow *row = &g_array_index(rows, ChangedRow, i);
+
+    /* A handler may have removed a row, or changed the paths of the
+       rest.  Rows that changed again meanwhile are still emitted once. */
+    if (g_hash_table_remove(priv->changed_nodes, row->node))
+    {
+      iter.user_data = row->node;
+      if (serial != priv->rows_serial)
+      {
+        gtk_tree_path_free(row->path);
+        row->path = hildon_file_system_model_get_path(model, &iter);
+      }
+      if (gtk_tree_path_get_depth(row->path) > 0)
+      {
+        gtk_tree_model_row_changed(model, row->path, &iter);
+        priv->changes_emitted++;
+      }
+    }
+    gtk_tree_path_free(row->path);
+  }
+  g_array_free(rows, TRUE);
+
+  GDK_THREADS_LEAVE ();
+
+  return FALSE;
+}
+
+/* The row-changed of NODE is delayed until the next flush, so that a
+   burst of changes, like thumbnails arriving, makes the filter and
+   sort models look at each row only once.  The flush runs before
+   GTK+ resizes and redraws. */
 static void emit_node_changed(GNode *node)
 {
   HildonFileSystemModelNode *model_node;
-  GtkTreeModel *model;
-  GtkTreeIter iter;
-  GtkTreePath *path;
+  HildonFileSystemModelPrivate *priv;
 
   g_assert(node != NULL);
 
   model_node = node->data;
-  model = GTK_TREE_MODEL(model_node->model);
-  iter.stamp = CAST_GET_PRIVATE(model)->stamp;
-  iter.user_data = node;
-  path = hildon_file_system_model_get_path(model, &iter);
-  if (gtk_tree_path_get_depth (path) > 0)
-    gtk_tree_model_row_changed(model, path, &iter);
-  gtk_tree_path_free(path);
+  priv = CAST_GET_PRIVATE(model_node->model);
+  sync_folder_list(priv, node);
+
+  priv->changes_queued++;
+  g_hash_table_insert(priv->changed_nodes, node, node);
+  if (priv->changed_idle_id == 0)
+    priv->changed_idle_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+                                            flush_changed_nodes,
+                                            model_node->model, NULL);
+}
+
+static void
+thumbnail_release(HildonFileSystemModelNode *model_node)
+{
+  if (model_node->thumbnail_cache)
+  {
+    g_object_unref(model_node->thumbnail_cache);
+    model_node->thumbnail_cache = NULL;
+  }
+  if (model_node->thumbnail_request)
+  {
+    hildon_thumbnail_request_unqueue(model_node->thumbnail_request);
+    g_object_unref (model_node->thumbnail_request);
+    model_node->thumbnail_request = NULL;
+  }
+}
+
+static void
+thumbnail_forget(HildonFileSystemModelNode *model_node)
+{
+  if (model_node->thumbnail_link)
+  {
+    g_queue_delete_link(&CAST_GET_PRIVATE(model_node->model)->thumbnail_lru,
+                        model_node->thumbnail_link);
+    model_node->thumbnail_link = NULL;
+  }
+}
+
+/* Called whenever the thumbnail of NODE is asked for.  The rows that
+   have not been shown for the longest time lose theirs, they are
+   loaded again from the thumbnail cache on disk when needed. */
+static void
+thumbnail_touch(HildonFileSystemModelPrivate *priv, GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+
+  if (model_node->thumbnail_link)
+  {
+    g_queue_unlink(&priv->thumbnail_lru, model_node->thumbnail_link);
+    g_queue_push_head_link(&priv->thumbnail_lru, model_node->thumbnail_link);
+    return;
+  }
+
+  g_queue_push_head(&priv->thumbnail_lru, node);
+  model_node->thumbnail_link = priv->thumbnail_lru.head;
+
+  while (priv->thumbnail_lru.length > THUMBNAIL_CACHE_SIZE)
+  {
+    GNode *old = g_queue_pop_tail(&priv->thumbnail_lru);
+    HildonFileSystemModelNode *old_node = old->data;
+
+    old_node->thumbnail_link = NULL;
+    thumbnail_release(old_node);
+  }
 }
 
 static void
@@ -727,3124 +1058,5876 @@ path_is_readonly(GFile *file)
   return retval;
 }
 
-/* Returns whether model_node is considered to be a folder (by
- * HildonFileSystemModel's definitions). */
+/* Whether FILE is below $UPNP_ROOT.  The usual "upnpav://" root is
+   checked by scheme, so that no URI has to be built. */
 static gboolean
-model_node_is_folder(HildonFileSystemModelNode *model_node)
+file_is_upnp(GFile *file)
 {
-    return model_node->folder
-	|| model_node->location
-	|| model_node->cancellable
-	|| (model_node->info &&
-	    _gtk_file_info_consider_as_directory(model_node->info));
-}
+  static gsize initialized = 0;
+  static gchar *upnp_scheme = NULL;
+  static gchar *upnp_prefix = NULL;
+  gboolean result;
+  gchar *uri;
 
-static gboolean
-model_node_invalidate_display_props(GNode *node, gpointer _)
-{
-  HildonFileSystemModelNode *model_node;
+  if (g_once_init_enter(&initialized))
+    {
+      const gchar *prefix = g_getenv("UPNP_ROOT");
 
-  model_node = node->data;
-  g_free(model_node->display_text);
-  model_node->display_text = NULL;
-  pango_attr_list_unref(model_node->display_attrs);
-  model_node->display_attrs = NULL;
-  return FALSE;
+      if (prefix)
+        {
+          gchar *scheme = g_uri_parse_scheme(prefix);
+
+          if (scheme && strlen(prefix) == strlen(scheme) + 3 &&
+              g_str_has_suffix(prefix, "://"))
+            upnp_scheme = scheme;
+          else
+            {
+              g_free(scheme);
+              upnp_prefix = g_strdup(prefix);
+            }
+        }
+
+      g_once_init_leave(&initialized, 1);
+    }
+
+  if (upnp_scheme)
+    return g_file_has_uri_scheme(file, upnp_scheme);
+  if (!upnp_prefix)
+    return FALSE;
+
+  uri = g_file_get_uri(file);
+  result = g_str_has_prefix(uri, upnp_prefix);
+  g_free(uri);
+
+  return result;
 }
 
-/* Clears ->display_text and ->display_attrs of all nodes.  Used when style or
-   time-format changes.  We use g_signal_connect_swapped(), as then it is
-   possible to pass this function as handler. */
 static void
-invalidate_display_props(HildonFileSystemModel *self)
+model_node_update_row_flags(HildonFileSystemModelNode *model_node)
 {
-  g_node_traverse(self->priv->roots, G_POST_ORDER, G_TRAVERSE_ALL, -1,
-		  model_node_invalidate_display_props, NULL);
+    HildonFileSystemSpecialLocation *location = model_node->location;
+    gboolean info_is_folder;
+    guint32 flags = ROW_FLAG_VALID;
+    gint type, weight;
+
+    memset(model_node->filter_generation, 0,
+           sizeof(model_node->filter_generation));
+
+    info_is_folder = model_node->info &&
+      _gtk_file_info_consider_as_directory(model_node->info);
+
+    if (location || info_is_folder)
+      flags |= ROW_FLAG_IS_FOLDER;
+    if (model_node->file && g_file_has_native_path(model_node->file))
+      flags |= ROW_FLAG_HAS_LOCAL_PATH;
+    if (!location || hildon_file_system_special_location_is_available(location))
+      flags |= ROW_FLAG_IS_AVAILABLE;
+    if (model_node->file && file_is_upnp(model_node->file))
+      flags |= ROW_FLAG_IS_UPNP;
+
+    /* Folders are read with all attributes, so the access bits are
+       in the info already.  Special locations decide visibility by
+       themselves, see node_is_hidden(). */
+    if (model_node->info)
+      {
+        if (!location && g_file_info_get_is_hidden(model_node->info))
+          flags |= ROW_FLAG_IS_HIDDEN;
+        if (g_file_info_has_attribute(model_node->info,
+                                      G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE)
+            && !g_file_info_get_attribute_boolean(model_node->info,
+                                                  G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+          flags |= ROW_FLAG_IS_READONLY;
+      }
+
+    if (location)
+      {
+        type = location->compatibility_type;
+        weight = location->sort_weight;
+      }
+    else if (info_is_folder)
+      {
+        type = HILDON_FILE_SYSTEM_MODEL_FOLDER;
+        weight = SORT_WEIGHT_FOLDER;
+      }
+    else
+      {
+        type = HILDON_FILE_SYSTEM_MODEL_FILE;
+        weight = SORT_WEIGHT_FILE;
+      }
+
+    flags |= (type & 0xff) << ROW_FLAGS_TYPE_SHIFT;
+    flags |= ((guint32) weight & 0xffff) << ROW_FLAGS_SORT_WEIGHT_SHIFT;
+
+    model_node->row_flags = flags;
 }
 
-/* Formats file_time as expected by specs.  NOTE: return value points to a
- * static buffer, don't try to free it. */
-static const char *
-get_date_string(GTimeVal file_time)
+/* The stored flags only depend on the info, the file and the
+   location.  Folder linking, errors and the available bit change
+   often and are cheap to test, so they are folded in here. */
+static guint32
+model_node_get_row_flags(HildonFileSystemModelNode *model_node)
 {
-    static char buf[128];
-    gboolean format24h;
-    time_t time_val;
-    struct tm *time_struct;
-    size_t ds, ts;
+    guint32 flags;
 
-    if (file_time.tv_sec == 0)
-	return "-";
+    if (!(model_node->row_flags & ROW_FLAG_VALID))
+      model_node_update_row_flags(model_node);
 
-    time_val = file_time.tv_sec;
-    time_struct = localtime(&time_val);
+    flags = model_node->row_flags;
 
-    ds = strftime(buf, sizeof(buf), dgettext("hildon-libs", "wdgt_va_date"), time_struct);
-    if (ds == 0)
-	return "-";
+    if (model_node->folder || model_node->cancellable
+        || model_node->load_queued)
+      flags |= ROW_FLAG_IS_FOLDER;
 
-    g_object_get(_hildon_file_system_settings_get_instance(),
-		 "hour24", &format24h, NULL);
+    /* Folders that cause access errors are dimmed. Devices are not */
+    if (!model_node->available ||
+        (!model_node->location && model_node->error))
+      flags &= ~ROW_FLAG_IS_AVAILABLE;
 
-    buf[ds] = ' ';
-    ts = strftime(buf + ds + 1, sizeof(buf) - ds - 1,
-		  dgettext("hildon-libs",
-			   format24h ? "wdgt_va_24h_time"
-		                     : time_struct->tm_hour > 11 ? "wdgt_va_12h_time_pm"
-		   	                                         : "wdgt_va_12h_time_am"),
-		  time_struct);
-    if (ts == 0)
-	buf[ds] = '\0';
+    return flags;
+}
 
-    g_assert(ds + 1 + ts + 1 <= sizeof(buf));
+static const gchar *
+model_node_get_file_name(HildonFileSystemModelNode *model_node)
+{
+    /* Gtk+'s display name contains also extension */
+    if (model_node->name_cache == NULL)
+      model_node->name_cache =
+        _hildon_file_system_create_file_name(model_node->file,
+                                             model_node->location,
+                                             model_node->info);
 
-    return buf;
+    return model_node->name_cache;
 }
 
-/* Generates properties used by HildonFileSelection's cell renderer, cached in
-   model_node->display_{text,attrs}. */
-static void
-generate_display_text_and_attrs(HildonFileSystemModel *model, GtkTreeIter *iter)
+static const gchar *
+model_node_get_sort_key(HildonFileSystemModelNode *model_node)
 {
-    HildonFileSystemModelNode *model_node;
-    gchar *title;
-    GTimeVal time = {0, 0};
-    const gchar *mime;
-    guint row1len;
-    PangoAttrList *alist;
-    GdkColor color1, color2;
-    GString *text;
-
-    model_node = ((GNode *)iter->user_data)->data;
-    /* We have to get title via gtk_tree_model_get_value, because it triggers
-     * loading of next level.  Sad. */
-    gtk_tree_model_get(GTK_TREE_MODEL(model), iter,
-		       HILDON_FILE_SYSTEM_MODEL_COLUMN_DISPLAY_NAME, &title,
-		       -1);
+    /* Usually already computed in the background */
+    if (model_node->key_cache == NULL)
+      model_node->key_cache =
+        _hildon_file_system_create_sort_key(
+          model_node_get_file_name(model_node));
 
-    /* type    1st row         2nd row
-     * ------  -----------     --------
-     * folder  title           -
-     * audio   track/title     author/-
-     * image   title           date
-     * other   title           date, size
-     */
-    text = g_string_sized_new(48);
-    mime = "";
+    return model_node->key_cache;
+}
 
-    if (model_node->info) {
-	mime = g_file_info_get_content_type(model_node->info);
-	g_file_info_get_modification_time(model_node->info, &time);
-    }
+static const gchar *
+model_node_get_search_name(HildonFileSystemModelNode *model_node)
+{
+    /* Usually already computed in the background */
+    if (model_node->search_cache == NULL)
+      model_node->search_cache =
+        hildon_helper_normalize_string(model_node_get_file_name(model_node));
 
-    if (model_node_is_folder(model_node)) {
-	g_string_append(text, title);
-	row1len = text->len;
-    } else if (g_str_has_prefix(mime, "audio/")) {
-	gchar *track, *author;
+    return model_node->search_cache;
+}
 
-	gtk_tree_model_get(GTK_TREE_MODEL(model), iter,
-			   HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE, &track,
-			   HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR, &author,
-			   -1);
-	if (track[0])
-	    g_string_append(text, track);
-	else
-	    g_string_append(text, title);
-	row1len = text->len;
+/* Returns whether model_node is considered to be a folder (by
+ * HildonFileSystemModel's definitions). */
+static gboolean
+model_node_is_folder(HildonFileSystemModelNode *model_node)
+{
+    return (model_node_get_row_flags(model_node) & ROW_FLAG_IS_FOLDER) != 0;
+}
 
-	if (author[0]) {
-	    g_string_append_c(text, '\n');
-	    g_string_append(text, author);
-	}
-	g_free(track);
-	g_free(author);
-    } else if (g_str_has_prefix(mime, "image/") || g_str_has_prefix(mime, "video/")) {
-	g_string_append(text, title);
-	row1len = text->len;
-	g_string_append_c(text, '\n');
-	g_string_append(text, get_date_string(time));
-    } else {
-	gchar *fsize;
+/* Returns whether the row of NODE is hidden.  Hidden files are known
+   from their info, but special locations become visible when they get
+   children, so they are asked every time. */
+static gboolean
+node_is_hidden(GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  GtkTreeIter iter;
 
-	g_string_append(text, title);
-	row1len = text->len;
-	g_string_append_c(text, '\n');
-	g_string_append(text, get_date_string(time));
+  if (!model_node->location)
+    return (model_node_get_row_flags(model_node) & ROW_FLAG_IS_HIDDEN) != 0;
 
-	g_string_append(text, ", ");
-	fsize = hildon_format_file_size_for_display(model_node->info ?
-						    g_file_info_get_size(model_node->info)
-						    : 0);
-	g_string_append(text, fsize);
-	g_free(fsize);
+  if (hildon_file_system_special_location_is_visible(model_node->location,
+                                                     g_node_first_child(node)
+                                                     != NULL))
+    return FALSE;
 
+  /* When this item is actually hidden, and it is a special
+     location, we queue it for reload if it hasn't been loaded
+     at all yet.  Special locations can become visible when
+     they have children, and we need to scan them to figure
+     this out.
+  */
+  if (model_node->load_time == 0
+      && (!hildon_file_system_special_location_requires_access
+          (model_node->location)))
+    {
+      DEBUG_GFILE_URI ("SCANNING FOR VISIBILITY: %s", model_node->file);
+      iter.stamp = model_node->model->priv->stamp;
+      iter.user_data = node;
+      _hildon_file_system_model_queue_reload(model_node->model, &iter, FALSE);
     }
-    g_free(title);
-    model_node->display_text = g_string_free(text, FALSE);
-
-    alist = NULL;
-    if (model->priv->ref_widget
-	&& gtk_style_lookup_color(model->priv->ref_widget->style,
-				  "DefaultTextColor", &color1)
-	&& gtk_style_lookup_color(model->priv->ref_widget->style,
-				  "SecondaryTextColor", &color2)) {
-	PangoAttribute *row1, *row2;
 
-	alist = pango_attr_list_new();
-	row1 = pango_attr_foreground_new(color1.red, color1.green, color1.blue);
-	row1->start_index = 0;
-	row1->end_index = row1len;
-	row2 = pango_attr_foreground_new(color2.red, color2.green, color2.blue);
-	row2->start_index = row1len + 1;
-	pango_attr_list_insert(alist, row1);
-	pango_attr_list_insert(alist, row2);
-    }
-    model_node->display_attrs = alist;
+  return TRUE;
 }
 
-static void hildon_file_system_model_get_value(GtkTreeModel * model,
-                                               GtkTreeIter * iter,
-                                               gint column, GValue * value)
+static void
+model_node_peek_row(HildonFileSystemModelNode *model_node,
+                    HildonFileSystemModelRow *row)
 {
-    GNode *node;
-    GFileInfo *info;
-    GFile *file;
-    HildonFileSystemModelNode *model_node;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  row->flags = model_node_get_row_flags(model_node);
+  row->file = model_node->file;
+  row->file_name = model_node_get_file_name(model_node);
+  row->sort_key = model_node_get_sort_key(model_node);
 
-    g_return_if_fail(iter && priv->stamp == iter->stamp);
-#if 0  /* Enable the following to get statistics which info is requested.
-          Actually TYPE and SORT_KEY are the two most often asked fields */
+  if (model_node->info)
     {
-      static gint columns[NUM_COLUMNS] = { 0 };
-      gint i;
+      GTimeVal timeval = {0, 0};
 
-      columns[column]++;
-      for (i = 0; i < NUM_COLUMNS; i++)
-        g_debug("%d ", columns[i]);
+      g_file_info_get_modification_time(model_node->info, &timeval);
+
+      row->mime_type = g_file_info_get_content_type(model_node->info);
+      row->size = g_file_info_get_size(model_node->info);
+      row->mtime = timeval.tv_sec;
+    }
+  else
+    {
+      row->mime_type = NULL;
+      row->size = 0;
+      row->mtime = 0;
     }
-#endif
-    g_value_init(value, priv->column_types[column]);
 
-    node = iter->user_data;
-    g_assert(node != NULL);
-    model_node = node->data;
-    g_assert(model_node != NULL);
+  if (row->mime_type == NULL)
+    row->mime_type = "";
+}
 
-    info = model_node->info;
-    file = model_node->file;
-    g_assert(file != NULL);
+/* _hildon_file_system_model_compare_rows() leaves reversing a
+   descending order to the sorting model, as GtkTreeModelSort does.
+   The model sorts its children itself, so it reverses here. */
+static gint
+compare_rows(HildonFileSystemModelPrivate *priv,
+             const HildonFileSystemModelRow *a,
+             const HildonFileSystemModelRow *b)
+{
+  gint result;
 
-    switch (column) {
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_GTK_PATH_INTERNAL:
-	g_value_set_object(value, file);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_LOCAL_PATH:
-	g_value_take_string (value, g_file_get_path(file));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_URI:
-	g_value_take_string(value, g_file_get_uri (file));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME:
-        /* Gtk+'s display name contains also extension */
-        if (model_node->name_cache == NULL)
-	  model_node->name_cache = _hildon_file_system_create_file_name(
-				     file, model_node->location, info);
-        g_value_set_string(value, model_node->name_cache);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_DISPLAY_NAME:
-        if (!model_node->title_cache)
-	  {
-	    model_node->title_cache = 
-	      _hildon_file_system_create_display_name (file,
-						       model_node->location,
-						       info);
+  result = _hildon_file_system_model_compare_rows(a, b, priv->sort_key,
+                                                  priv->sort_order);
 
-	    /* We load this node if this is the first time someone
-	       asks for its display name and if it is a folder and it
-	       has not been loaded yet.
-	    */
+  return priv->sort_order == GTK_SORT_DESCENDING ? -result : result;
+}
 
-	    if (model_node->load_time == 0
-		&& model_node->error == NULL
-		&& (model_node->location ||
-		    (info && _gtk_file_info_consider_as_directory(info))))
-	      {
-		unlink_file_folder (node);
-		link_file_folder (node, model_node->file);
-	      }
-	  }
+static gint
+compare_nodes(HildonFileSystemModelPrivate *priv, GNode *a, GNode *b)
+{
+  HildonFileSystemModelNode *model_node_a = a->data, *model_node_b = b->data;
+  HildonFileSystemModelRow row_a, row_b;
 
-        g_value_set_string(value, model_node->title_cache);
+  if (!priv->sorted)
+    return (gint) model_node_a->serial - (gint) model_node_b->serial;
 
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY:
-        /* We cannot just use display_key from GtkFileInfo, because it is
-         * case sensitive */
-        if (!model_node->key_cache)
-        {
-          gchar *name, *casefold;
-
-	  name = _hildon_file_system_create_file_name(file,
-						      model_node->location,
-						      info);
-          casefold = g_utf8_casefold(name, -1);
-          model_node->key_cache = g_utf8_collate_key_for_filename(casefold, -1);
-          g_free(casefold);
-          g_free(name);
-        }
+  model_node_peek_row(model_node_a, &row_a);
+  model_node_peek_row(model_node_b, &row_b);
 
-        g_value_set_string(value, model_node->key_cache);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE:
-        /* get_mime_type do not make a duplicate */
-	g_value_set_string(value, info ? g_file_info_get_content_type(info) : "");
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_SIZE:
-	g_value_set_int64(value, info ? g_file_info_get_size(info) : 0);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_TIME:
-	{
-	  GTimeVal timeval = {0, 0};
+  return compare_rows(priv, &row_a, &row_b);
+}
 
-	  if (info)
-	    g_file_info_get_modification_time(info, &timeval);
+/* The fake root has no model node, so its children are left in the
+   order they were added. */
+static GPtrArray *
+get_sorted_children(GNode *parent)
+{
+  HildonFileSystemModelNode *model_node = parent->data;
+  GNode *child;
 
-	  g_value_set_int64(value, timeval.tv_sec);
-	  break;
-	}
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER:
-        g_value_set_boolean(value, model_node_is_folder(model_node));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE:
-      g_value_set_boolean(value, model_node->available &&
-            /* Folders that cause access errors are dimmed. Devices are not */
-            (model_node->location ?
-             hildon_file_system_special_location_is_available(model_node->location) :
-             !model_node->error));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_READONLY:
-	g_value_set_boolean(value, file ? path_is_readonly(file) : FALSE);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH:
-        g_value_set_boolean(value,
-	    file ? g_file_has_native_path(file) : FALSE);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_TYPE:
-        g_value_set_int(value, model_node->location ?
-            model_node->location->compatibility_type :
-	    (_gtk_file_info_consider_as_directory(model_node->info) ?
-                HILDON_FILE_SYSTEM_MODEL_FOLDER :
-                HILDON_FILE_SYSTEM_MODEL_FILE));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON:
-      if (!model_node->icon_cache)
-        model_node->icon_cache =
-          hildon_file_system_model_create_image(priv, model_node,
-                                                TREE_ICON_SIZE);
+  if (model_node == NULL)
+    return NULL;
 
-      g_value_set_object(value, model_node->icon_cache);
-      break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_COLLAPSED:
-        if (!model_node->icon_cache_collapsed)
-            model_node->icon_cache_collapsed =
-                hildon_file_system_model_create_composite_image
-                    (priv, model_node, get_collapsed_emblem(priv));
+  if (model_node->sorted_children == NULL)
+    {
+      model_node->sorted_children = g_ptr_array_new();
+      for (child = parent->children; child; child = child->next)
+        g_ptr_array_add(model_node->sorted_children, child);
+    }
 
-        g_value_set_object(value, model_node->icon_cache_collapsed);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_EXPANDED:
-        if (!model_node->icon_cache_expanded)
-            model_node->icon_cache_expanded =
-                hildon_file_system_model_create_composite_image
-                    (priv, model_node, get_expanded_emblem(priv));
+  return model_node->sorted_children;
+}
 
-        g_value_set_object(value, model_node->icon_cache_expanded);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_THUMBNAIL:
-        if (!model_node->thumbnail_cache)
-        {
-            gchar *uri = NULL;
-            const gchar *mime_type = NULL;
-            gboolean is_image = FALSE;
-            gboolean is_audio = FALSE;
+/* Position of NODE among the sorted CHILDREN, after its equals.  NODE
+   must not be in CHILDREN. */
+static guint
+find_sorted_position(HildonFileSystemModelPrivate *priv,
+                     GPtrArray *children, GNode *node)
+{
+  guint lo = 0, hi = children->len;
 
-	    if (file)
-	      uri = g_file_get_uri(file);
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
 
-            if (info)
-            {
-	      mime_type = g_file_info_get_content_type(info);
-	      is_image = mime_type && (g_str_has_prefix (mime_type, "image/")
-				       || g_str_has_prefix (mime_type, "sketch/png"));
-	      is_audio = mime_type && g_str_has_prefix (mime_type, "audio/");
-            }
+      if (compare_nodes(priv, g_ptr_array_index(children, mid), node) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
 
-            if (is_image && hildon_thumbnail_is_cached (uri,
-              THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE))
-            {
-              GError *error = NULL;
-              gchar *thumb_uri = hildon_thumbnail_get_uri(uri, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE);
-              gchar *thumb_file = g_filename_from_uri(thumb_uri, NULL, NULL);
-              g_free(thumb_uri);
-              model_node->thumbnail_cache = gdk_pixbuf_new_from_file_at_size(thumb_file, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, &error);
-              g_free(thumb_file);
-              if (error == NULL)
-              {
-                  g_free(uri);
-                  break;
-              }
-              g_debug("Failed to load cached thumbnail: %s", error->message);
-              g_error_free(error);
-            }
+  return lo;
+}
 
-            if (is_image)
-            {
-              if (!model_node->thumbnail_request)
-              {  /* This can fail with GtkFileSystemUnix if the
-                           name contains invalid UTF-8 */
-                HildonThumbnailFactory *factory;
+static void
+insert_sorted_child(GPtrArray *children, guint pos, GNode *parent,
+                    GNode *node)
+{
+  if (pos < children->len)
+    g_node_insert_before(parent, g_ptr_array_index(children, pos), node);
+  else if (children->len > 0)
+    g_node_insert_after(parent, g_ptr_array_index(children, pos - 1), node);
+  else
+    g_node_prepend(parent, node);
 
-		g_object_ref(model_node->model);
-                factory = hildon_thumbnail_factory_get_instance();
-                model_node->thumbnail_request =
-                    hildon_thumbnail_factory_request_pixbuf(factory,
-                        uri, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE,
-			g_file_info_get_content_type(info),
-                        thumbnail_request_pixbuf_cb, node, NULL);
-                g_object_unref(factory);
-              }
+  g_ptr_array_add(children, NULL);
+  memmove(&children->pdata[pos + 1], &children->pdata[pos],
+          (children->len - 1 - pos) * sizeof(gpointer));
+  children->pdata[pos] = node;
+}
 
-              /* the following if clause handles the hourglass icon */
-              if (!model_node->thumbnail_cache)
-              {
-                HildonMimeCategory cat =
-                    hildon_mime_get_category_for_mime_type(mime_type);
+static void
+emit_rows_reordered(HildonFileSystemModel *model, GNode *parent,
+                    gint *new_order)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
 
-                if (cat == HILDON_MIME_CATEGORY_IMAGES)
-                  model_node->thumbnail_cache =
-                      _hildon_file_system_load_icon_cached(
-                        gtk_icon_theme_get_default(),
-                        "filemanager_file_loading", THUMBNAIL_ICON);
-              }
-            }
+  model->priv->rows_serial++;
+  iter.stamp = model->priv->stamp;
+  iter.user_data = parent;
 
-            /* Tracker get the albumart and stores it according to the spec
-             * http://live.gnome.org/MediaArtStorageSpec
-             * Then, it generates a thumbnail. We use that thumbnail instead
-             * of the generic music icon.
-             *
-             * FIXME: if there is several audio files from the same albums, we
-             * load the same thumbnail for each of them. It would be better to
-             * load it only one time.
-             * FIXME: if Tracker generates the albumart and thumbnail later, it
-             * does not update the icon.
-             */
-            if (is_audio)
-            {
-              gchar *album;
-              gchar *album_art;
-              gchar *album_art_uri;
-              gchar *thumbnail_uri;
-              gchar *thumbnail_file;
+  if (G_NODE_IS_ROOT(parent))
+    {
+      path = gtk_tree_path_new();
+      gtk_tree_model_rows_reordered(GTK_TREE_MODEL(model), path, NULL,
+                                    new_order);
+    }
+  else
+    {
+      path = hildon_file_system_model_get_path(GTK_TREE_MODEL(model), &iter);
+      gtk_tree_model_rows_reordered(GTK_TREE_MODEL(model), path, &iter,
+                                    new_order);
+    }
 
-              /* We have to get album via gtk_tree_model_get_value, because
-               * it triggers loading of next level.  Sad. */
-              gtk_tree_model_get(GTK_TREE_MODEL(model), iter,
-                  HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM, &album,
-                  -1);
+  gtk_tree_path_free(path);
+}
 
-              /* Fremantle does not use 'artist' to find the albumart. The
-               * decision to drop the artist from the name effectively was
-               * made based on requests from mafw/media player. This was
-               * needed to support albums with variable artists. Hence the
-               * NULL parameter.
-               */
-              album_art = hildon_albumart_get_path (NULL, album, "album");
-              album_art_uri = g_filename_to_uri (album_art, NULL, NULL);
-              thumbnail_uri = hildon_thumbnail_get_uri (album_art_uri,
-                  THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE);
-              thumbnail_file = g_filename_from_uri(thumbnail_uri, NULL, NULL);
+/* The folder children of every node, so that the navigation pane
+   never has to look at the files.  A list is only built when it is
+   first asked for, usually while the folder is still empty, and from
+   then on adding or changing a file only costs a flag test. */
+static GPtrArray **
+folder_list_slot(HildonFileSystemModelPrivate *priv, GNode *parent)
+{
+  HildonFileSystemModelNode *model_node = parent->data;
 
-              model_node->thumbnail_cache = gdk_pixbuf_new_from_file_at_size
-                (thumbnail_file, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, NULL);
+  return model_node ? &model_node->folder_children
+                    : &priv->root_folder_children;
+}
 
-              g_free (thumbnail_uri);
-              g_free (thumbnail_file);
-              g_free (album_art_uri);
-              g_free (album_art);
-            }
+static GPtrArray *
+get_folder_children(HildonFileSystemModelPrivate *priv, GNode *parent)
+{
+  GPtrArray **folders = folder_list_slot(priv, parent);
+  GNode *child;
 
-            g_free(uri);
+  if (*folders == NULL)
+    {
+      *folders = g_ptr_array_new();
+      for (child = parent->children; child; child = child->next)
+        {
+          HildonFileSystemModelNode *model_node = child->data;
 
-            if (!model_node->thumbnail_cache)
-              model_node->thumbnail_cache =
-                 hildon_file_system_model_create_image(priv, model_node,
-                                                       THUMBNAIL_ICON);
-        }
-
-        g_value_set_object(value, model_node->thumbnail_cache);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY:
-        g_value_set_boolean(value, is_node_loaded(node));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FREE_SPACE:
-        g_warning("USING FREE SPACE COLUMN IS DEPRECATED");
-        g_value_set_int64(value, 0);
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE:
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR:
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM:
-    {
-#ifdef UPSTREAM_DISABLED
-        const gchar *keys [] =  {
-            "Audio:Artist",
-            "Audio:Title",
-            "Audio:Album",
-            NULL
-        };
-        gchar **arr;
-        GError *error=NULL;
-
-        if (!model_node->thumb_author)
-        {
-            gchar *str = gtk_file_system_path_to_filename(priv->filesystem, path);
-            arr = tracker_metadata_get(priv->tracker_client, SERVICE_MUSIC, str, keys, &error);
-            g_free(str);
-
-            if (G_UNLIKELY(error ))
-            {
-                g_error_free(error);
-                model_node->thumb_author = g_strdup("");
-                model_node->thumb_title = g_strdup("");
-                model_node->thumb_album = g_strdup("");
-            }
-            else if (arr != NULL && arr[0] != NULL
-                && arr[1] != NULL && arr[2] != NULL)
-            {
-                model_node->thumb_author = g_strdup(arr[0]);
-                model_node->thumb_title = g_strdup(arr[1]);
-                model_node->thumb_album = g_strdup(arr[2]);
-            }
-            else
+          if (model_node_is_folder(model_node))
             {
-                model_node->thumb_author = g_strdup("");
-                model_node->thumb_title = g_strdup("");
-                model_node->thumb_album = g_strdup("");
+              g_ptr_array_add(*folders, child);
+              model_node->folder_listed = TRUE;
             }
-            g_strfreev(arr);
         }
-
-        if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR)
-          g_value_set_string(value, model_node->thumb_author);
-        else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE)
-          g_value_set_string(value, model_node->thumb_title);
-        else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM)
-          g_value_set_string(value, model_node->thumb_album);
-        else
-          g_assert_not_reached ();
-        break;
-#else
-      if (!model_node->thumb_author)
-      {
-          g_warning("Tracker support not implemented, using dummy values");
-          model_node->thumb_author = g_strdup("Author");
-          model_node->thumb_title = g_strdup("Title");
-          model_node->thumb_album = g_strdup("Album");
-      }
-      if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR)
-        g_value_set_string(value, model_node->thumb_author);
-      else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE)
-        g_value_set_string(value, model_node->thumb_title);
-      else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM)
-        g_value_set_string(value, model_node->thumb_album);
-      else
-        g_assert_not_reached ();
-      break;
-#endif
     }
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_HIDDEN:
-    {
-      gboolean result;
-
-      if (model_node->location)
-        result = !hildon_file_system_special_location_is_visible(model_node->location, g_node_first_child(node) != NULL);
-      else if (!info)
-        result = FALSE;
-      else
-	result = g_file_info_get_is_hidden(info);
-
-      if (result == TRUE)
-        {
-          /* When this item is actually hidden, and it is a special
-             location, we queue it for reload if it hasn't been loaded
-             at all yet.  Special locations can become visible when
-             they have children, and we need to scan them to figure
-             this out.
-          */
-
-          if (model_node->location
-              && model_node->load_time == 0
-              && (!hildon_file_system_special_location_requires_access
-                  (model_node->location)))
-            {
-	      DEBUG_GFILE_URI ("SCANNING FOR VISIBILITY: %s", model_node->file);
-              _hildon_file_system_model_queue_reload
-                (HILDON_FILE_SYSTEM_MODEL(model), iter, FALSE);
-            }
-        }
 
-      g_value_set_boolean(value, result);
-      break;
-    }
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_UNAVAILABLE_REASON:
-        g_value_take_string(value, model_node->location ?
-            hildon_file_system_special_location_get_unavailable_reason(model_node->location) :
-            g_strdup(_("sfil_ib_opening_not_allowed")));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FAILED_ACCESS_MESSAGE:
-        if (model_node->location && model_node->location->failed_access_message)
-        {
-          if (!model_node->title_cache)
-            model_node->title_cache = _hildon_file_system_create_display_name(
-		file, model_node->location, info);
-          g_value_take_string(value,
-                g_strdup_printf(model_node->location->failed_access_message,
-                model_node->title_cache));
-        }
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT:
-        /* Temporary version of the weight calculation */
-        g_value_set_int(value, model_node->location ?
-                model_node->location->sort_weight : (
-	    (info && _gtk_file_info_consider_as_directory(info)) ?
-                SORT_WEIGHT_FOLDER : SORT_WEIGHT_FILE));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_EXTRA_INFO:
-        if (model_node->location)
-            g_value_take_string(value,
-                hildon_file_system_special_location_get_extra_info(model_node->location));
-        break;
-    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_DRIVE:
-        g_value_set_boolean (value, is_drive (model_node));
-        break;
-    case PRIV_COLUMN_DISPLAY_TEXT:
-	if (!model_node->display_text)
-	    generate_display_text_and_attrs(HILDON_FILE_SYSTEM_MODEL(model), iter);
-	g_value_set_string(value, model_node->display_text);
-	break;
-    case PRIV_COLUMN_DISPLAY_ATTRS:
-	if (!model_node->display_attrs)
-	    generate_display_text_and_attrs(HILDON_FILE_SYSTEM_MODEL(model), iter);
-	g_value_set_boxed(value, model_node->display_attrs);
-	break;
-    default:
-        g_assert_not_reached();
-    };
+  return *folders;
 }
 
-static gboolean hildon_file_system_model_iter_next(GtkTreeModel * model,
-                                                   GtkTreeIter * iter)
+static gint
+folder_list_index(GPtrArray *folders, GNode *node)
 {
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  guint i;
 
-    g_return_val_if_fail(iter != NULL, FALSE);
-    g_return_val_if_fail(priv->stamp == iter->stamp, FALSE);
-    iter->user_data = g_node_next_sibling((GNode *) iter->user_data);
+  for (i = 0; i < folders->len; i++)
+    if (g_ptr_array_index(folders, i) == node)
+      return i;
 
-    return iter->user_data != NULL;
+  return -1;
 }
 
-static gint hildon_file_system_model_iter_n_children(GtkTreeModel * model,
-                                                     GtkTreeIter * iter)
-{
-    HildonFileSystemModel *self;
-    HildonFileSystemModelPrivate *priv;
+#define FOLDER_LISTED(node) \
+  (((HildonFileSystemModelNode *) (node)->data)->folder_listed)
 
-    g_assert(HILDON_IS_FILE_SYSTEM_MODEL(model));
-    self = HILDON_FILE_SYSTEM_MODEL(model);
-    priv = self->priv;
+/* Adds NODE, which is already linked at its place, next to the nearest
+   listed sibling.  Looking in both directions at once finds it right
+   away both when folders are sorted first and when NODE has just been
+   appended. */
+static void
+folder_list_insert(GPtrArray *folders, GNode *node)
+{
+  GNode *prev = node->prev, *next = node->next;
+  guint pos = 0;
 
-    if (iter == NULL)   /* Roots are always in tree, we don't need to ask
-                           loading */
-        return g_node_n_children(priv->roots);
+  while (prev || next)
+    {
+      if (prev && FOLDER_LISTED(prev))
+        {
+          pos = folder_list_index(folders, prev) + 1;
+          break;
+        }
+      if (next && FOLDER_LISTED(next))
+        {
+          pos = folder_list_index(folders, next);
+          break;
+        }
 
-    g_return_val_if_fail(priv->stamp == iter->stamp, 0);
+      if (prev)
+        prev = prev->prev;
+      if (next)
+        next = next->next;
+    }
 
-    return g_node_n_children(iter->user_data);
+  g_ptr_array_add(folders, NULL);
+  memmove(&folders->pdata[pos + 1], &folders->pdata[pos],
+          (folders->len - 1 - pos) * sizeof(gpointer));
+  folders->pdata[pos] = node;
+  FOLDER_LISTED(node) = TRUE;
 }
 
-static gboolean hildon_file_system_model_iter_has_child(GtkTreeModel *
-                                                        model,
-                                                        GtkTreeIter * iter)
+static void
+folder_list_remove(GPtrArray *folders, GNode *node)
 {
-    return (hildon_file_system_model_iter_n_children(model, iter) > 0);
+  g_ptr_array_remove(folders, node);
+  FOLDER_LISTED(node) = FALSE;
 }
 
-static gboolean hildon_file_system_model_iter_nth_child(GtkTreeModel *
-                                                        model,
-                                                        GtkTreeIter * iter,
-                                                        GtkTreeIter *
-                                                        parent, gint n)
+/* Called when NODE has been added or its row flags may have changed. */
+static void
+sync_folder_list(HildonFileSystemModelPrivate *priv, GNode *node)
 {
-    GNode *node;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
-
-    if (parent) {
-        g_return_val_if_fail(parent->stamp == priv->stamp, FALSE);
-        node = g_node_nth_child(parent->user_data, n);
-    } else
-        node = g_node_nth_child(priv->roots, n);
+  GPtrArray *folders;
+  gboolean is_folder;
 
-    iter->stamp = priv->stamp;
-    iter->user_data = node;
+  if (node->parent == NULL ||
+      (folders = *folder_list_slot(priv, node->parent)) == NULL)
+    return;
 
-    return node != NULL;
+  is_folder = model_node_is_folder(node->data);
+  if (is_folder && !FOLDER_LISTED(node))
+    folder_list_insert(folders, node);
+  else if (!is_folder && FOLDER_LISTED(node))
+    folder_list_remove(folders, node);
 }
 
-static gboolean hildon_file_system_model_iter_children(GtkTreeModel *
-                                                       model,
-                                                       GtkTreeIter * iter,
-                                                       GtkTreeIter *
-                                                       parent)
+/* Moves the freshly added last child NODE of its parent to its sorted
+   place.  Called before ::row-inserted is emitted. */
+static void
+place_new_node(HildonFileSystemModelPrivate *priv, GNode *node)
 {
-    return hildon_file_system_model_iter_nth_child(model, iter, parent, 0);
+  GNode *parent = node->parent;
+  GPtrArray *children;
+
+  if (!priv->sorted)
+    return;
+
+  g_node_unlink(node);
+
+  children = get_sorted_children(parent);
+  if (children == NULL)
+    g_node_append(parent, node);
+  else
+    insert_sorted_child(children, find_sorted_position(priv, children, node),
+                        parent, node);
 }
 
-static gboolean hildon_file_system_model_iter_parent(GtkTreeModel * model,
-                                                     GtkTreeIter * iter,
-                                                     GtkTreeIter * child)
+/* Called when the fields of NODE that are used for sorting may have
+   changed. */
+static void
+reposition_node(HildonFileSystemModel *model, GNode *node)
 {
-    GNode *node;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  HildonFileSystemModelPrivate *priv = model->priv;
+  HildonFileSystemModelNode *parent_model_node;
+  GNode *parent = node->parent;
+  GPtrArray *children, *folders;
+  gint *new_order;
+  guint old_pos, new_pos, i;
 
-    g_return_val_if_fail(child->stamp == priv->stamp, FALSE);
+  sync_folder_list(priv, node);
 
-    node = child->user_data;
-    iter->stamp = priv->stamp;
-    iter->user_data = node->parent;
+  if (!priv->sorted || parent == NULL)
+    return;
 
-    return node->parent != NULL && node->parent != priv->roots;
-}
+  parent_model_node = parent->data;
+  if (parent_model_node == NULL ||
+      (children = parent_model_node->sorted_children) == NULL)
+    return;
 
-/*********************************************/
-/* End of GTK_TREE_MODEL interface methods */
-/*********************************************/
+  for (old_pos = 0; old_pos < children->len; old_pos++)
+    if (g_ptr_array_index(children, old_pos) == node)
+      break;
+  g_assert(old_pos < children->len);
+
+  if ((old_pos == 0 ||
+       compare_nodes(priv, g_ptr_array_index(children, old_pos - 1),
+                     node) <= 0) &&
+      (old_pos == children->len - 1 ||
+       compare_nodes(priv, node,
+                     g_ptr_array_index(children, old_pos + 1)) <= 0))
+    return;
 
-static gint path_compare_helper(gconstpointer a, gconstpointer b)
-{
-    /* This is really a macro, so we cannot pass it directly to search
-       function */
-    if (a == NULL || b == NULL)
-      return 1;
+  folders = FOLDER_LISTED(node) ? *folder_list_slot(priv, parent) : NULL;
+  if (folders)
+    folder_list_remove(folders, node);
 
-    return !g_file_equal((GFile *) a, (GFile *) b);
+  g_ptr_array_remove_index(children, old_pos);
+  g_node_unlink(node);
+
+  new_pos = find_sorted_position(priv, children, node);
+  insert_sorted_child(children, new_pos, parent, node);
+
+  if (folders)
+    folder_list_insert(folders, node);
+
+  new_order = g_new(gint, children->len);
+  for (i = 0; i < children->len; i++)
+    new_order[i] = i;
+  if (new_pos > old_pos)
+    for (i = old_pos; i < new_pos; i++)
+      new_order[i] = i + 1;
+  else
+    for (i = new_pos + 1; i <= old_pos; i++)
+      new_order[i] = i - 1;
+  new_order[new_pos] = old_pos;
+
+  emit_rows_reordered(model, parent, new_order);
+  g_free(new_order);
 }
 
-static GNode
-    *hildon_file_system_model_search_folder(GtkFolder * folder)
+typedef struct {
+  GNode *node;
+  gint old_pos;
+} SortEntry;
+
+static gint
+compare_sort_entries(gconstpointer a, gconstpointer b, gpointer data)
 {
-    return (GNode *) g_object_get_qdata(G_OBJECT(folder),
-                                        hildon_file_system_model_quark);
-}
+  const SortEntry *entry_a = a, *entry_b = b;
+  gint result;
 
-static void hildon_file_system_model_files_added (GtkFolder * monitor,
-						  GSList * paths,
-						  gpointer data);
+  result = compare_nodes(data, entry_a->node, entry_b->node);
 
-typedef struct {
-  GtkFolder *monitor;
-  GSList *paths;
-  gpointer data;
-  GSList *next_path;
-  gboolean all_new;
-} dfa_clos;
+  return result ? result : entry_a->old_pos - entry_b->old_pos;
+}
 
+/* Sorts the children of NODE in one go.  Used as a g_node_traverse()
+   callback when the sort order changes. */
 static gboolean
-dfa_run (gpointer data)
+sort_children(GNode *node, gpointer data)
 {
-  GNode *node;
-  HildonFileSystemModelNode *model_node;
+  HildonFileSystemModel *model = data;
+  GPtrArray *children;
+  GPtrArray *folders;
+  SortEntry *entries;
+  gint *new_order;
+  gboolean moved = FALSE;
+  guint i, n;
+
+  children = get_sorted_children(node);
+  if (children == NULL || children->len < 2)
+    return FALSE;
 
-  dfa_clos *c = (dfa_clos *)data;
-  
-  GDK_THREADS_ENTER ();
-  
-  node = hildon_file_system_model_search_folder (c->monitor);
-  if (node)
+  n = children->len;
+  entries = g_new(SortEntry, n);
+  for (i = 0; i < n; i++)
     {
-      gint i;
-      model_node = node->data;
-/*       model_node->pending_adds -= g_slist_length (c->paths); */
-      model_node->pending_adds = 0; //no need to count
-      i = 0;
-      while (c->next_path && i < MAX_BATCH)
-	  {
-              hildon_file_system_model_add_node (GTK_TREE_MODEL (model_node->model),
-                                                 node,
-                                                 c->monitor,
-						 c->next_path->data,
-                                                 TRUE);
-              c->next_path = c->next_path->next;
-              i++;
-	  }
-      model_node->pending_adds = (c->next_path != NULL)? 1 : 0;
+      entries[i].node = g_ptr_array_index(children, i);
+      entries[i].old_pos = i;
     }
 
-  GDK_THREADS_LEAVE ();
+  g_qsort_with_data(entries, n, sizeof(SortEntry), compare_sort_entries,
+                    model->priv);
 
-  if (node) {
-      emit_node_changed (node);
+  new_order = g_new(gint, n);
+  for (i = 0; i < n; i++)
+    {
+      GNode *child = entries[i].node;
 
-      if (is_node_loaded (node))
-          handle_finished_node (node);
-  }
-  if (c->next_path)
-    return TRUE;
+      new_order[i] = entries[i].old_pos;
+      moved |= (entries[i].old_pos != (gint) i);
 
-  g_object_unref (c->monitor);
-  g_slist_foreach (c->paths, (GFunc) g_object_unref, NULL);
-  g_slist_free (c->paths);
-  g_object_unref (c->data);
-  g_free (c);
+      children->pdata[i] = child;
+      child->prev = i > 0 ? entries[i - 1].node : NULL;
+      child->next = i < n - 1 ? entries[i + 1].node : NULL;
+    }
+  node->children = entries[0].node;
+
+  folders = *folder_list_slot(model->priv, node);
+  if (moved && folders)
+    {
+      g_ptr_array_set_size(folders, 0);
+      for (i = 0; i < n; i++)
+        if (FOLDER_LISTED(entries[i].node))
+          g_ptr_array_add(folders, entries[i].node);
+    }
+
+  if (moved)
+    emit_rows_reordered(model, node, new_order);
+
+  g_free(new_order);
+  g_free(entries);
 
   return FALSE;
 }
 
-static void
-delay_files_added (GtkFolder * monitor,
-		   GSList * paths,
-		   gpointer data,
-                   gboolean all_new)
+/* Returns TRUE if ->display_text and ->display_attrs of MODEL_NODE
+   are there and up to date.  Stale ones are freed. */
+static gboolean
+model_node_has_display_props(HildonFileSystemModelNode *model_node)
 {
-  GNode *node;
-  HildonFileSystemModelNode *model_node;
+  if (model_node->display_epoch ==
+      CAST_GET_PRIVATE(model_node->model)->display_epoch)
+    return model_node->display_text != NULL;
 
-  node = hildon_file_system_model_search_folder (monitor);
-  if (node)
-    {
-      dfa_clos *c = g_new0 (dfa_clos, 1);
+  g_free(model_node->display_text);
+  model_node->display_text = NULL;
+  g_free(model_node->display_search_cache);
+  model_node->display_search_cache = NULL;
+  pango_attr_list_unref(model_node->display_attrs);
+  model_node->display_attrs = NULL;
+  return FALSE;
+}
 
-      g_object_ref (monitor);
-      paths = g_slist_copy_deep (paths, (GCopyFunc) g_object_ref, NULL);
-      g_object_ref (data);
-      
-      model_node = node->data;
-/*       model_node->pending_adds += g_slist_length (paths); */
-      model_node->pending_adds = 1; // it is faster than counting all items
+/* Makes ->display_text and ->display_attrs of all nodes stale.  Used when
+   style or time-format changes. */
+static void
+invalidate_display_props(HildonFileSystemModel *self)
+{
+  if (++self->priv->display_epoch == 0)
+    ++self->priv->display_epoch;
+}
 
-      c->monitor = monitor;
-      c->paths = paths;
-      c->data = data;
-      c->next_path = paths;
-      c->all_new = all_new;
-      
-      g_idle_add (dfa_run, c);
-    }
+static void
+style_changed(HildonFileSystemModel *self)
+{
+  /* The shared attribute lists carry the colors of the old style */
+  g_hash_table_remove_all(self->priv->display_attrs_cache);
+  invalidate_display_props(self);
 }
 
-static void hildon_file_system_model_files_added(GtkFolder * monitor,
-                                                 GSList * paths,
-                                                 gpointer data)
+/* Returns a new reference to the attribute list coloring the first
+   ROW1LEN bytes with the primary and the rest with the secondary text
+   color.  The lists only depend on the style and ROW1LEN, so all rows
+   with the same title length share one list. */
+static PangoAttrList *
+get_display_attrs(HildonFileSystemModel *model, guint row1len)
 {
-  /* The files identified by PATHS have been created.  Normally, they
-     are children of MONITOR, but it might happen that the file
-     corresponding to MONITOR is among PATHS, too.  This happens when
-     you start monitoring a filename before it exists.
+    HildonFileSystemModelPrivate *priv = model->priv;
+    PangoAttrList *alist;
+    GdkColor color1, color2;
 
-     XXX - maybe this situation should be filtered out by the GnomeVFS
-           GtkFileSystem backend, depending on what guarantees the
-           "files-added" signal makes.
-  */
+    alist = g_hash_table_lookup(priv->display_attrs_cache,
+				GUINT_TO_POINTER(row1len));
+    if (alist)
+	return pango_attr_list_ref(alist);
 
-  if (paths != NULL)
-  {
-    GNode *node;
-    HildonFileSystemModelNode *model_node;
+    if (priv->ref_widget
+	&& gtk_style_lookup_color(priv->ref_widget->style,
+				  "DefaultTextColor", &color1)
+	&& gtk_style_lookup_color(priv->ref_widget->style,
+				  "SecondaryTextColor", &color2)) {
+	PangoAttribute *row1, *row2;
 
-    node = hildon_file_system_model_search_folder(monitor);
-    if (node != NULL)
-      {
-	gint i;
-	GtkTreeModel *model;
-	GFile *real_file;
-        gboolean all_new = TRUE;
+	alist = pango_attr_list_new();
+	row1 = pango_attr_foreground_new(color1.red, color1.green, color1.blue);
+	row1->start_index = 0;
+	row1->end_index = row1len;
+	/* The second row runs up to the end of the text, whatever its
+	   length is */
+	row2 = pango_attr_foreground_new(color2.red, color2.green, color2.blue);
+	row2->start_index = row1len + 1;
+	pango_attr_list_insert(alist, row1);
+	pango_attr_list_insert(alist, row2);
 
-	model_node = node->data;
-	model = GTK_TREE_MODEL (model_node->model);
+	g_hash_table_insert(priv->display_attrs_cache,
+			    GUINT_TO_POINTER(row1len),
+			    pango_attr_list_ref(alist));
+    }
 
-	i = 0;
-	while (paths && i < MAX_BATCH)
-	  {
-	    GNode *n;
+    return alist;
+}
 
-	    if (model_node->location)
-	      {
-		real_file =
-		    hildon_file_system_special_location_rewrite_path (
-		      model_node->location, CAST_GET_PRIVATE(model)->filesystem, paths->data);
-	      }
-	    else
-	      real_file = g_object_ref(paths->data);
+/* Thumbnail view rows of a folder mostly share a handful of dates, so
+   the formatted date portion is cached per calendar day.  The 12/24h
+   setting is cached as well; it is reset from hour24_changed(). */
+static struct {
+    gint year, yday;            /* Day of ->date, year is -1 if none */
+    gchar date[128];
+    gsize date_len;
+    gint hour24;                /* -1 if not known */
+    const gchar *date_format;
+    const gchar *time_format_24h;
+    const gchar *time_format_am;
+    const gchar *time_format_pm;
+} date_cache = { -1, -1, "", 0, -1, NULL, NULL, NULL, NULL };
 
-	    //search whether this node already exists
-	    if ((n = hildon_file_system_model_search_path_internal (node, real_file, FALSE)) &&
-		!g_file_has_uri_scheme(real_file, "upnpav"))
-	      {
-		//node already exists no need to add
-		HildonFileSystemModelNode *mn = n->data;
-		DEBUG_GFILE_URI("%s %p setting present_flag to TRUE", real_file, mn);
-		mn->present_flag = TRUE;
-		all_new = FALSE;
-	      }
-	    else
-	      {
-		hildon_file_system_model_add_node (model,
-						   node,
-						   monitor,
-						   paths->data,
-						   TRUE);
-	      }
+/* Formats file_time as expected by specs.  NOTE: return value points to a
+ * static buffer, don't try to free it. */
+static const char *
+get_date_string(GTimeVal file_time)
+{
+    /* Room for a full date_cache.date, a space and the time */
+    static char buf[256];
+    time_t time_val;
+    struct tm time_struct;
+    const gchar *time_format;
+    size_t ds, ts;
 
-	    g_object_unref (real_file);
-	    paths = paths->next;
-	    i++;
-	  }
+    if (file_time.tv_sec == 0)
+	return "-";
 
-	emit_node_changed (node);
+    if (date_cache.date_format == NULL)
+      {
+	date_cache.date_format = dgettext("hildon-libs", "wdgt_va_date");
+	date_cache.time_format_24h = dgettext("hildon-libs", "wdgt_va_24h_time");
+	date_cache.time_format_am = dgettext("hildon-libs", "wdgt_va_12h_time_am");
+	date_cache.time_format_pm = dgettext("hildon-libs", "wdgt_va_12h_time_pm");
+      }
 
-	if (paths)
-            delay_files_added (monitor, paths, data, all_new);
+    time_val = file_time.tv_sec;
+    localtime_r(&time_val, &time_struct);
 
-	if (is_node_loaded (node))
-	  handle_finished_node (node);
+    if (time_struct.tm_year != date_cache.year
+	|| time_struct.tm_yday != date_cache.yday)
+      {
+	date_cache.date_len = strftime(date_cache.date, sizeof(date_cache.date),
+				       date_cache.date_format, &time_struct);
+	date_cache.year = time_struct.tm_year;
+	date_cache.yday = time_struct.tm_yday;
       }
-    else
-      g_warning("Data destination not found!");
-  }
-}
 
-static void hildon_file_system_model_files_removed(GtkFolder * monitor,
-                                                   GSList * paths,
-                                                   gpointer data)
-{
-  if (paths != NULL)
-  {
-    GNode *node;
+    ds = date_cache.date_len;
+    if (ds == 0)
+	return "-";
 
-    g_debug("Removing files (monitor = %p)", (void *) monitor);
+    if (date_cache.hour24 < 0)
+      {
+	gboolean format24h;
 
-    node = hildon_file_system_model_search_folder(monitor);
-    if (node != NULL)
-        hildon_file_system_model_remove_node_list(data, node, paths);
-    else
-        g_warning("Data destination not found!");
-  }
-}
+	g_object_get(_hildon_file_system_settings_get_instance(),
+		     "hour24", &format24h, NULL);
+	date_cache.hour24 = format24h ? 1 : 0;
+      }
 
-static void hildon_file_system_model_dir_removed(GtkFolder * monitor,
-                                                 gpointer data)
-{
-    g_warning("Dir removed callback called, but this method is not "
-               "implemented (and probably there is no need to implement "
-               "it either).");
-}
+    memcpy(buf, date_cache.date, ds);
+    buf[ds] = ' ';
 
-static void hildon_file_system_model_files_changed(GtkFolder * monitor,
-                                                   GSList * paths,
-                                                   gpointer data)
-{
-  if (paths != NULL)
-  {
-    GNode *node;
+    time_format = date_cache.hour24 ? date_cache.time_format_24h
+		: time_struct.tm_hour > 11 ? date_cache.time_format_pm
+					   : date_cache.time_format_am;
+    ts = strftime(buf + ds + 1, sizeof(buf) - ds - 1, time_format,
+		  &time_struct);
+    if (ts == 0)
+	buf[ds] = '\0';
 
-    g_debug("Files changed (monitor = %p)", (void *) monitor);
+    g_assert(ds + 1 + ts + 1 <= sizeof(buf));
 
-    node = hildon_file_system_model_search_folder(monitor);
-    if (node != NULL)
-        hildon_file_system_model_change_node_list(data, node, monitor,
-                                                  paths);
-    else
-        g_warning("Data destination not found!");
-  }
+    return buf;
 }
 
-static void hildon_file_system_model_folder_finished_loading(GtkFolder *monitor, gpointer data)
+static void
+hour24_changed(HildonFileSystemModel *self)
 {
-  GNode *node = hildon_file_system_model_search_folder(monitor);
-  if (node)
-    {
-      g_debug("Finished loading (monitor = %p)", (void *) monitor);
-      if (is_node_loaded (node))
-	handle_finished_node (node);
-    }
+  date_cache.hour24 = -1;
+  invalidate_display_props(self);
 }
 
-static GNode *
-hildon_file_system_model_search_path_internal (GNode *parent_node,
-					       GFile *file,
-                                               gboolean recursively)
+/* Generates properties used by HildonFileSelection's cell renderer, cached in
+   model_node->display_{text,attrs}. */
+static void
+generate_display_text_and_attrs(HildonFileSystemModel *model, GtkTreeIter *iter)
 {
-    GNode *node;
     HildonFileSystemModelNode *model_node;
+    gchar *title;
+    GTimeVal time = {0, 0};
+    const gchar *mime;
+    guint row1len;
+    GString *text;
 
-    g_assert(parent_node != NULL && file != NULL);
-
-    model_node = parent_node->data;
+    model_node = ((GNode *)iter->user_data)->data;
+    /* We have to get title via gtk_tree_model_get_value, because it triggers
+     * loading of next level.  Sad. */
+    gtk_tree_model_get(GTK_TREE_MODEL(model), iter,
+		       HILDON_FILE_SYSTEM_MODEL_COLUMN_DISPLAY_NAME, &title,
+		       -1);
 
-    /* First consider the parent itself.
+    /* type    1st row         2nd row
+     * ------  -----------     --------
+     * folder  title           -
+     * audio   track/title     author/-
+     * image   title           date
+     * other   title           date, size
      */
-    if (model_node)
-      {
-	if (g_file_equal (file, model_node->file))
-	  {
-	    DEBUG_GFILE_URI("EQUAL FOUND %s model_node %p", model_node->file,
-			    model_node);
-	    return parent_node;
-	  }
-      }
-
-    for (node = g_node_first_child(parent_node); node;
-	 node = g_node_next_sibling(node))
-      {
-        model_node = node->data;
-
-	if (g_file_equal (file, model_node->file))
-	  {
-	    DEBUG_GFILE_URI("CHILD FOUND %s model_node %p", model_node->file,
-			    model_node);
-	    return node;
-	  }
-
-        if (recursively) {
-            /* Allways peek into devices, since they can include different
-               base locations within them */
+    text = g_string_sized_new(48);
+    mime = "";
 
-	  if (model_node->location ||
-	      g_file_has_prefix(file, model_node->file))
-          {
-                GNode *result =
-                      hildon_file_system_model_search_path_internal(node,
-								    file,
-                                                                    TRUE);
-		if (result)
-		  return result;
-          }
-        }
+    if (model_node->info) {
+	mime = g_file_info_get_content_type(model_node->info);
+	g_file_info_get_modification_time(model_node->info, &time);
     }
 
-    return NULL;
-}
-
-static void hildon_file_system_model_send_has_child_toggled(GtkTreeModel *
-                                                            model,
-                                                            GNode *
-                                                            parent_node)
-{
-    GtkTreePath *tree_path;
-    GtkTreeIter iter;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
-
-    iter.stamp = priv->stamp;
-    iter.user_data = parent_node;
-    tree_path = hildon_file_system_model_get_path(model, &iter);
-    gtk_tree_model_row_has_child_toggled(model, tree_path, &iter);
-    gtk_tree_path_free(tree_path);
-}
+    if (model_node_is_folder(model_node)) {
+	g_string_append(text, title);
+	row1len = text->len;
+    } else if (g_str_has_prefix(mime, "audio/")) {
+	gchar *track, *author;
 
-static void
-unlink_file_folder(GNode *node)
-{
-  HildonFileSystemModelNode *model_node = node->data;
-  g_assert(model_node != NULL);
+	gtk_tree_model_get(GTK_TREE_MODEL(model), iter,
+			   HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE, &track,
+			   HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR, &author,
+			   -1);
+	if (track[0])
+	    g_string_append(text, track);
+	else
+	    g_string_append(text, title);
+	row1len = text->len;
 
-  DEBUG_GFILE_URI("file %s model_node %p folder %p", model_node->file, model_node, model_node->folder);
+	if (author[0]) {
+	    g_string_append_c(text, '\n');
+	    g_string_append(text, author);
+	}
+	g_free(track);
+	g_free(author);
+    } else if (g_str_has_prefix(mime, "image/") || g_str_has_prefix(mime, "video/")) {
+	g_string_append(text, title);
+	row1len = text->len;
+	g_string_append_c(text, '\n');
+	g_string_append(text, get_date_string(time));
+    } else {
+	gchar *fsize;
 
-  if (model_node->cancellable)
-    {
-      DEBUG_GFILE_URI("CANCEL %s %p", model_node->file, model_node->cancellable);
-      g_cancellable_cancel (model_node->cancellable);
-      g_object_unref (model_node->cancellable);
-      model_node->cancellable = NULL;
-    }
+	g_string_append(text, title);
+	row1len = text->len;
+	g_string_append_c(text, '\n');
+	g_string_append(text, get_date_string(time));
 
-  if (model_node->folder)
-    {
-      g_object_set_qdata(G_OBJECT(model_node->folder),
-			 hildon_file_system_model_quark, NULL);
-      
-      g_signal_handlers_disconnect_by_func
-        (model_node->folder,
-         (gpointer) hildon_file_system_model_dir_removed,
-         model_node->model);
-      g_signal_handlers_disconnect_by_func
-        (model_node->folder,
-         (gpointer) hildon_file_system_model_files_added,
-         model_node->model);
-      g_signal_handlers_disconnect_by_func
-        (model_node->folder,
-         (gpointer) hildon_file_system_model_files_removed,
-         model_node->model);
-      g_signal_handlers_disconnect_by_func
-        (model_node->folder,
-         (gpointer) hildon_file_system_model_files_changed,
-         model_node->model);
-      g_signal_handlers_disconnect_by_func
-        (model_node->folder,
-         (gpointer) hildon_file_system_model_folder_finished_loading,
-         model_node->model);
+	g_string_append(text, ", ");
+	fsize = hildon_format_file_size_for_display(model_node->info ?
+						    g_file_info_get_size(model_node->info)
+						    : 0);
+	g_string_append(text, fsize);
+	g_free(fsize);
 
-      g_object_unref(model_node->folder);
-      model_node->folder = NULL;
     }
+    g_free(title);
+    model_node->display_text = g_string_free(text, FALSE);
+    model_node->display_attrs = get_display_attrs(model, row1len);
+    model_node->display_epoch = model->priv->display_epoch;
 }
 
-static void
-free_handle_data (HandleData *handle_data)
-{
-    g_object_unref (handle_data->model);
-    g_slice_free (HandleData, handle_data);
-}
-
-static void
-get_folder_callback (GCancellable *cancellable,
-		     GtkFolder *folder,
-                     const GError *error,
-                     gpointer data)
+static void hildon_file_system_model_get_value(GtkTreeModel * model,
+                                               GtkTreeIter * iter,
+                                               gint column, GValue * value)
 {
-  gboolean cancelled = g_cancellable_is_cancelled(cancellable);
-  HildonFileSystemModelNode *model_node;
-  HildonFileSystemModel *model;
-  HandleData *handle_data = (HandleData *) data;
-  GNode *node;
-
-  node = handle_data->node;
-  model_node = (HildonFileSystemModelNode *) node->data;
+    GNode *node;
+    GFileInfo *info;
+    GFile *file;
+    HildonFileSystemModelNode *model_node;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
 
-  /* When the operation has been cancelled, handle_data->node is no
-     longer valid.
-   */
-  if (cancelled)
+    g_return_if_fail(iter && priv->stamp == iter->stamp);
+#if 0  /* Enable the following to get statistics which info is requested.
+          Actually TYPE and SORT_KEY are the two most often asked fields */
     {
-      DEBUG_GFILE_URI ("LINK CANCELLED %s model_node %p\n", model_node->file, model_node);
-      free_handle_data (handle_data);
-      return;
+      static gint columns[NUM_COLUMNS] = { 0 };
+      gint i;
+
+      columns[column]++;
+      for (i = 0; i < NUM_COLUMNS; i++)
+        g_debug("%d ", columns[i]);
     }
+#endif
+    g_value_init(value, priv->column_types[column]);
 
+    node = iter->user_data;
+    g_assert(node != NULL);
+    model_node = node->data;
+    g_assert(model_node != NULL);
 
-  model = model_node->model;
+    info = model_node->info;
+    file = model_node->file;
+    g_assert(file != NULL);
 
-  if (model_node->cancellable)
-    g_object_unref(model_node->cancellable);
-  model_node->cancellable = NULL;
-  model_node->folder = folder ? g_object_ref(folder) : NULL;
-  model_node->error = error ? g_error_copy (error) : NULL;
-  model_node->linking = FALSE;
+    switch (column) {
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_GTK_PATH_INTERNAL:
+	g_value_set_object(value, file);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_LOCAL_PATH:
+	g_value_take_string (value, g_file_get_path(file));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_URI:
+	g_value_take_string(value, g_file_get_uri (file));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME:
+        g_value_set_string(value, model_node_get_file_name(model_node));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_DISPLAY_NAME:
+        if (!model_node->title_cache)
+	  {
+	    model_node->title_cache = 
+	      _hildon_file_system_create_display_name (file,
+						       model_node->location,
+						       info);
 
-  if (folder == NULL)
-    {
-      WARN_GFILE_URI("Failed to create monitor for path %s", model_node->file);
+	    /* We load this node if this is the first time someone
+	       asks for its display name and if it is a folder and it
+	       has not been loaded yet.
+	    */
 
-      if (model_node->error == NULL)
-	model_node->error = g_error_new (G_FILE_ERROR, G_FILE_ERROR_FAILED,
-					 "failure");
-    }
+	    if (model_node->load_time == 0
+		&& model_node->error == NULL
+		&& (model_node->location ||
+		    (info && _gtk_file_info_consider_as_directory(info))))
+	      {
+		unlink_file_folder (node);
+		link_file_folder (node, model_node->file,
+				  LOAD_PRIORITY_VISIBLE);
+	      }
+	  }
 
-  DEBUG_GFILE_URI ("LINK DONE %s %s model_node %p folder %p\n",
-       model_node->file, error ? error->message : "(success)",
-	   model_node, folder);
+        g_value_set_string(value, model_node->title_cache);
 
-  if (folder)
-      g_assert (GTK_IS_FOLDER (folder));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY:
+        g_value_set_string(value, model_node_get_sort_key(model_node));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE:
+        /* get_mime_type do not make a duplicate */
+	g_value_set_string(value, info ? g_file_info_get_content_type(info) : "");
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_SIZE:
+	g_value_set_int64(value, info ? g_file_info_get_size(info) : 0);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_TIME:
+	{
+	  GTimeVal timeval = {0, 0};
 
-  if (model_node->error)
-    {
-      handle_finished_node (node);
-      handle_load_error (node);
-      free_handle_data (handle_data);
-      return;
-    }
-
-  g_signal_connect_object
-    (model_node->folder, "deleted",
-     G_CALLBACK(hildon_file_system_model_dir_removed),
-     model, 0);
+	  if (info)
+	    g_file_info_get_modification_time(info, &timeval);
 
-  g_object_set_qdata (G_OBJECT(model_node->folder),
-                      hildon_file_system_model_quark, node);
+	  g_value_set_int64(value, timeval.tv_sec);
+	  break;
+	}
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER:
+        g_value_set_boolean(value, model_node_is_folder(model_node));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE:
+        g_value_set_boolean(value, (model_node_get_row_flags(model_node) &
+                                    ROW_FLAG_IS_AVAILABLE) != 0);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_READONLY:
+        if (info && g_file_info_has_attribute(info,
+                                              G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+          g_value_set_boolean(value, (model_node_get_row_flags(model_node) &
+                                      ROW_FLAG_IS_READONLY) != 0);
+        else
+          g_value_set_boolean(value, file ? path_is_readonly(file) : FALSE);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH:
+        g_value_set_boolean(value, (model_node_get_row_flags(model_node) &
+                                    ROW_FLAG_HAS_LOCAL_PATH) != 0);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_TYPE:
+        g_value_set_int(value,
+            ROW_FLAGS_TYPE(model_node_get_row_flags(model_node)));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON:
+      if (!model_node->icon_cache)
+        model_node->icon_cache =
+          hildon_file_system_model_create_image(priv, model_node,
+                                                TREE_ICON_SIZE);
 
-  g_signal_connect_object
-    (model_node->folder, "files-added",
-     G_CALLBACK(hildon_file_system_model_files_added),
-     model, 0);
-  g_signal_connect_object
-    (model_node->folder, "files-removed",
-     G_CALLBACK
-     (hildon_file_system_model_files_removed), model, 0);
-  g_signal_connect_object
-    (model_node->folder, "files-changed",
-     G_CALLBACK
-     (hildon_file_system_model_files_changed), model, 0);
-  g_signal_connect_object
-    (model_node->folder, "finished-loading",
-     G_CALLBACK (hildon_file_system_model_folder_finished_loading), model,
-     0);
+      g_value_set_object(value, model_node->icon_cache);
+      break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_COLLAPSED:
+        if (!model_node->icon_cache_collapsed)
+            model_node->icon_cache_collapsed =
+                hildon_file_system_model_create_composite_image
+                    (priv, model_node, get_collapsed_emblem(priv));
 
-  /* The following has to be done last since it might do anything to
-     model_node, including loading it again.
-  */
+        g_value_set_object(value, model_node->icon_cache_collapsed);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_EXPANDED:
+        if (!model_node->icon_cache_expanded)
+            model_node->icon_cache_expanded =
+                hildon_file_system_model_create_composite_image
+                    (priv, model_node, get_expanded_emblem(priv));
 
-  if (gtk_file_folder_is_finished_loading (folder))
-    {
-      GSList *children = NULL;
-      gboolean result;
+        g_value_set_object(value, model_node->icon_cache_expanded);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_THUMBNAIL:
+        thumbnail_touch(priv, node);
+        if (!model_node->thumbnail_cache)
+        {
+            gchar *uri = NULL;
+            const gchar *mime_type = NULL;
+            gboolean is_image = FALSE;
+            gboolean is_audio = FALSE;
 
-      DEBUG_GFILE_URI ("LINK FINISHED %s", model_node->file);
+	    if (file)
+	      uri = g_file_get_uri(file);
 
-      result = gtk_file_folder_list_children(folder, &children,
-					     &(model_node->error));
-      if (result)
-        {
-	  hildon_file_system_model_files_added (model_node->folder,
-						children,
-						model);
+            if (info)
+            {
+	      mime_type = g_file_info_get_content_type(info);
+	      is_image = mime_type && (g_str_has_prefix (mime_type, "image/")
+				       || g_str_has_prefix (mime_type, "sketch/png"));
+	      is_audio = mime_type && g_str_has_prefix (mime_type, "audio/");
+            }
 
-	  /* XXX - We assume that the root node has less than
-   	           MAX_BATCH entries and that has thus been added
-   	           completely now.
-	  */
-	  if (model_node->location
-	      && HILDON_IS_FILE_SYSTEM_ROOT (model_node->location))
-	    {
-	      model->priv->first_root_scan_completed = TRUE;
-	    }
+            if (is_image && hildon_thumbnail_is_cached (uri,
+              THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE))
+            {
+              GError *error = NULL;
+              gchar *thumb_uri = hildon_thumbnail_get_uri(uri, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE);
+              gchar *thumb_file = g_filename_from_uri(thumb_uri, NULL, NULL);
+              g_free(thumb_uri);
+              model_node->thumbnail_cache = gdk_pixbuf_new_from_file_at_size(thumb_file, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, &error);
+              g_free(thumb_file);
+              if (error == NULL)
+              {
+                  g_free(uri);
+                  break;
+              }
+              g_debug("Failed to load cached thumbnail: %s", error->message);
+              g_error_free(error);
+            }
 
-	  hildon_file_system_model_folder_finished_loading (model_node->folder,
-							    model);
-	  gtk_file_paths_free (children);
-	}
-      else
-	handle_load_error (node);
-    }
+            if (is_image)
+            {
+              if (!model_node->thumbnail_request)
+              {  /* This can fail with GtkFileSystemUnix if the
+                           name contains invalid UTF-8 */
+                HildonThumbnailFactory *factory;
 
-  free_handle_data (handle_data);
-}
+		g_object_ref(model_node->model);
+                factory = hildon_thumbnail_factory_get_instance();
+                model_node->thumbnail_request =
+                    hildon_thumbnail_factory_request_pixbuf(factory,
+                        uri, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE,
+			g_file_info_get_content_type(info),
+                        thumbnail_request_pixbuf_cb, node, NULL);
+                g_object_unref(factory);
+              }
 
-static gboolean
-link_file_folder (GNode *node, GFile *file)
-{
-  HildonFileSystemModel *model;
-  HildonFileSystemModelNode *model_node;
-/*  GtkFolder *parent_folder; */
-  HandleData *handle_data;
-  GNode *child_node;
+              /* the following if clause handles the hourglass icon */
+              if (!model_node->thumbnail_cache)
+              {
+                HildonMimeCategory cat =
+                    hildon_mime_get_category_for_mime_type(mime_type);
 
-  g_assert(node != NULL && file != NULL);
-  model_node = node->data;
-  g_assert(model_node != NULL);
+                if (cat == HILDON_MIME_CATEGORY_IMAGES)
+                  model_node->thumbnail_cache =
+                      _hildon_file_system_load_icon_cached(
+                        gtk_icon_theme_get_default(),
+                        "filemanager_file_loading", THUMBNAIL_ICON);
+              }
+            }
 
-  DEBUG_GFILE_URI ("check %s model_node %p folder %p cancellable %p",
-		   model_node->file, model_node, model_node->folder, model_node->cancellable);
+            /* Tracker get the albumart and stores it according to the spec
+             * http://live.gnome.org/MediaArtStorageSpec
+             * Then, it generates a thumbnail. We use that thumbnail instead
+             * of the generic music icon.
+             *
+             * FIXME: if there is several audio files from the same albums, we
+             * load the same thumbnail for each of them. It would be better to
+             * load it only one time.
+             * FIXME: if Tracker generates the albumart and thumbnail later, it
+             * does not update the icon.
+             */
+            if (is_audio)
+            {
+              gchar *album;
+              gchar *album_art;
+              gchar *album_art_uri;
+              gchar *thumbnail_uri;
+              gchar *thumbnail_file;
 
-  /* Folder already exists or we have already asked for it.
-   */
-  if (model_node->folder || model_node->cancellable)
-    return TRUE;
+              /* We have to get album via gtk_tree_model_get_value, because
+               * it triggers loading of next level.  Sad. */
+              gtk_tree_model_get(GTK_TREE_MODEL(model), iter,
+                  HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM, &album,
+                  -1);
 
-  DEBUG_GFILE_URI ("LINK %s", model_node->file);
+              /* Fremantle does not use 'artist' to find the albumart. The
+               * decision to drop the artist from the name effectively was
+               * made based on requests from mafw/media player. This was
+               * needed to support albums with variable artists. Hence the
+               * NULL parameter.
+               */
+              album_art = hildon_albumart_get_path (NULL, album, "album");
+              album_art_uri = g_filename_to_uri (album_art, NULL, NULL);
+              thumbnail_uri = hildon_thumbnail_get_uri (album_art_uri,
+                  THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, TRUE);
+              thumbnail_file = g_filename_from_uri(thumbnail_uri, NULL, NULL);
 
-  model = model_node->model;
-  g_assert(HILDON_IS_FILE_SYSTEM_MODEL(model));
+              model_node->thumbnail_cache = gdk_pixbuf_new_from_file_at_size
+                (thumbnail_file, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, NULL);
 
-  model_node->load_time = time(NULL);
-  model_node->linking = TRUE;
+              g_free (thumbnail_uri);
+              g_free (thumbnail_file);
+              g_free (album_art_uri);
+              g_free (album_art);
+            }
 
-  if (!model_node->file)
-    model_node->file = g_object_ref(file);
+            g_free(uri);
 
-/*  parent_folder = (node->parent && node->parent->data) ?
-      ((HildonFileSystemModelNode *) node->parent->data)->folder : NULL; */
+            if (!model_node->thumbnail_cache)
+              model_node->thumbnail_cache =
+                 hildon_file_system_model_create_image(priv, model_node,
+                                                       THUMBNAIL_ICON);
+        }
 
-  /* Reset the present_flags.
-   */
-  child_node = g_node_first_child(node);
-  while (child_node)
+        g_value_set_object(value, model_node->thumbnail_cache);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY:
+        g_value_set_boolean(value, is_node_loaded(node));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FREE_SPACE:
+        g_warning("USING FREE SPACE COLUMN IS DEPRECATED");
+        g_value_set_int64(value, 0);
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE:
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR:
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM:
     {
-      HildonFileSystemModelNode *n = child_node->data;
+#ifdef UPSTREAM_DISABLED
+        const gchar *keys [] =  {
+            "Audio:Artist",
+            "Audio:Title",
+            "Audio:Album",
+            NULL
+        };
+        gchar **arr;
+        GError *error=NULL;
 
-      DEBUG_GFILE_URI("%s node %p present_flag = FALSE", n->file, n);
-      n->present_flag = FALSE;
-      child_node = g_node_next_sibling(child_node);
-    }
-
-  /* hold a reference to the model, it will be released
-   * when the get_folder operation has finished
-   */
-  handle_data = g_slice_new (HandleData);
-  handle_data->model = g_object_ref (model);
-  handle_data->node = node;
+        if (!model_node->thumb_author)
+        {
+            gchar *str = gtk_file_system_path_to_filename(priv->filesystem, path);
+            arr = tracker_metadata_get(priv->tracker_client, SERVICE_MUSIC, str, keys, &error);
+            g_free(str);
 
-  if (model_node->location)
-    {
-      model_node->cancellable =
-	  hildon_file_system_special_location_get_folder(
-	    model_node->location,
-	    model->priv->filesystem,
-	    file, "*",
-	    get_folder_callback, handle_data);
-    }
-  else
-    {
-      model_node->cancellable =
-        gtk_file_system_get_folder (model->priv->filesystem,
-				    file, "*",
-                                    get_folder_callback, handle_data);
-    }
+            if (G_UNLIKELY(error ))
+            {
+                g_error_free(error);
+                model_node->thumb_author = g_strdup("");
+                model_node->thumb_title = g_strdup("");
+                model_node->thumb_album = g_strdup("");
+            }
+            else if (arr != NULL && arr[0] != NULL
+                && arr[1] != NULL && arr[2] != NULL)
+            {
+                model_node->thumb_author = g_strdup(arr[0]);
+                model_node->thumb_title = g_strdup(arr[1]);
+                model_node->thumb_album = g_strdup(arr[2]);
+            }
+            else
+            {
+                model_node->thumb_author = g_strdup("");
+                model_node->thumb_title = g_strdup("");
+                model_node->thumb_album = g_strdup("");
+            }
+            g_strfreev(arr);
+        }
 
-  if (model_node->cancellable == NULL)
-    {
-      model_node->linking = FALSE;
-      free_handle_data (handle_data);
-      return FALSE;
-    }
-  else
-    {
-      g_clear_error (&(model_node->error));
-      return TRUE;
+        if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR)
+          g_value_set_string(value, model_node->thumb_author);
+        else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE)
+          g_value_set_string(value, model_node->thumb_title);
+        else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM)
+          g_value_set_string(value, model_node->thumb_album);
+        else
+          g_assert_not_reached ();
+        break;
+#else
+      if (!model_node->thumb_author)
+      {
+          g_warning("Tracker support not implemented, using dummy values");
+          model_node->thumb_author = g_strdup("Author");
+          model_node->thumb_title = g_strdup("Title");
+          model_node->thumb_album = g_strdup("Album");
+      }
+      if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR)
+        g_value_set_string(value, model_node->thumb_author);
+      else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE)
+        g_value_set_string(value, model_node->thumb_title);
+      else if (column == HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM)
+        g_value_set_string(value, model_node->thumb_album);
+      else
+        g_assert_not_reached ();
+      break;
+#endif
     }
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_HIDDEN:
+        g_value_set_boolean(value, node_is_hidden(node));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_UNAVAILABLE_REASON:
+        g_value_take_string(value, model_node->location ?
+            hildon_file_system_special_location_get_unavailable_reason(model_node->location) :
+            g_strdup(_("sfil_ib_opening_not_allowed")));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_FAILED_ACCESS_MESSAGE:
+        if (model_node->location && model_node->location->failed_access_message)
+        {
+          if (!model_node->title_cache)
+            model_node->title_cache = _hildon_file_system_create_display_name(
+		file, model_node->location, info);
+          g_value_take_string(value,
+                g_strdup_printf(model_node->location->failed_access_message,
+                model_node->title_cache));
+        }
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT:
+        g_value_set_int(value,
+            ROW_FLAGS_SORT_WEIGHT(model_node_get_row_flags(model_node)));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_EXTRA_INFO:
+        if (model_node->location)
+            g_value_take_string(value,
+                hildon_file_system_special_location_get_extra_info(model_node->location));
+        break;
+    case HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_DRIVE:
+        g_value_set_boolean (value, is_drive (model_node));
+        break;
+    case PRIV_COLUMN_DISPLAY_TEXT:
+	if (!model_node_has_display_props(model_node))
+	    generate_display_text_and_attrs(HILDON_FILE_SYSTEM_MODEL(model), iter);
+	g_value_set_string(value, model_node->display_text);
+	break;
+    case PRIV_COLUMN_DISPLAY_ATTRS:
+	if (!model_node_has_display_props(model_node))
+	    generate_display_text_and_attrs(HILDON_FILE_SYSTEM_MODEL(model), iter);
+	g_value_set_boxed(value, model_node->display_attrs);
+	break;
+    case PRIV_COLUMN_SEARCH_NAME:
+        g_value_set_string(value, model_node_get_search_name(model_node));
+        break;
+    default:
+        g_assert_not_reached();
+    };
 }
 
-static gboolean hildon_file_system_model_destroy_model_node(GNode * node,
-                                                        gpointer data)
+static gboolean hildon_file_system_model_iter_next(GtkTreeModel * model,
+                                                   GtkTreeIter * iter)
 {
-    HildonFileSystemModelNode *model_node = node->data;
-    g_assert(HILDON_IS_FILE_SYSTEM_MODEL(data));
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
 
-    if (model_node)
-    {
-      DEBUG_GFILE_URI("Remove [%s]", model_node->file);
+    g_return_val_if_fail(iter != NULL, FALSE);
+    g_return_val_if_fail(priv->stamp == iter->stamp, FALSE);
+    iter->user_data = g_node_next_sibling((GNode *) iter->user_data);
 
-      g_object_unref (model_node->file);
-      unlink_file_folder(node);
+    return iter->user_data != NULL;
+}
 
-      if (model_node->info)
-      {
-	g_object_unref (model_node->info);
-        model_node->info = NULL;
-      }
+static gint hildon_file_system_model_iter_n_children(GtkTreeModel * model,
+                                                     GtkTreeIter * iter)
+{
+    HildonFileSystemModel *self;
+    HildonFileSystemModelPrivate *priv;
 
-      g_clear_error(&model_node->error);
-      clear_model_node_caches(model_node);
+    g_assert(HILDON_IS_FILE_SYSTEM_MODEL(model));
+    self = HILDON_FILE_SYSTEM_MODEL(model);
+    priv = self->priv;
 
-      if (model_node->location) {
-          /* We don't want to save the actual ID:s, since that would
-             needlessly increase the memory consumption by 2 ints per item.
-             Ensure that all expected handlers were disconnected. */
-          gint check = g_signal_handlers_disconnect_matched(
-            model_node->location, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, node);
-          g_assert(check == 3);
-          g_object_unref(model_node->location);
-      }
+    if (iter == NULL)   /* Roots are always in tree, we don't need to ask
+                           loading */
+        return g_node_n_children(priv->roots);
 
-      g_free(model_node);
-      node->data = NULL;
-    }
+    g_return_val_if_fail(priv->stamp == iter->stamp, 0);
 
-    return FALSE;
+    return g_node_n_children(iter->user_data);
 }
 
-/* Kicks off the node and all the children. Both GNodes and ModelNodes.
-    returns the next sibling of the deleted node */
-static GNode *
-hildon_file_system_model_kick_node(GNode *node, gpointer data)
+static gboolean hildon_file_system_model_iter_has_child(GtkTreeModel *
+                                                        model,
+                                                        GtkTreeIter * iter)
 {
-  HildonFileSystemModelPrivate *priv;
-  GNode *parent_node;
-  GNode *destroy_node = node;
-
-  GtkTreePath *tree_path;
-  GtkTreeIter iter;
+    return (hildon_file_system_model_iter_n_children(model, iter) > 0);
+}
 
-  priv = CAST_GET_PRIVATE(data);
+static gboolean hildon_file_system_model_iter_nth_child(GtkTreeModel *
+                                                        model,
+                                                        GtkTreeIter * iter,
+                                                        GtkTreeIter *
+                                                        parent, gint n)
+{
+    GNode *node;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
 
-  g_assert(node != NULL && (node->parent != NULL || node == priv->roots));
+    if (parent) {
+        g_return_val_if_fail(parent->stamp == priv->stamp, FALSE);
+        node = g_node_nth_child(parent->user_data, n);
+    } else
+        node = g_node_nth_child(priv->roots, n);
 
-  iter.stamp = priv->stamp;
-  iter.user_data = destroy_node;
-  tree_path =
-        hildon_file_system_model_get_path(GTK_TREE_MODEL(data), &iter);
+    iter->stamp = priv->stamp;
+    iter->user_data = node;
 
-  gtk_tree_model_row_deleted(GTK_TREE_MODEL(data), tree_path);
-  gtk_tree_path_free(tree_path);
+    return node != NULL;
+}
 
-  parent_node = node->parent;
-  node = g_node_next_sibling(node);
+static gboolean hildon_file_system_model_iter_children(GtkTreeModel *
+                                                       model,
+                                                       GtkTreeIter * iter,
+                                                       GtkTreeIter *
+                                                       parent)
+{
+    return hildon_file_system_model_iter_nth_child(model, iter, parent, 0);
+}
 
-  g_node_traverse(destroy_node, G_POST_ORDER, G_TRAVERSE_ALL,
-      -1, hildon_file_system_model_destroy_model_node, data);
+static gboolean hildon_file_system_model_iter_parent(GtkTreeModel * model,
+                                                     GtkTreeIter * iter,
+                                                     GtkTreeIter * child)
+{
+    GNode *node;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
 
-  g_node_destroy(destroy_node);
+    g_return_val_if_fail(child->stamp == priv->stamp, FALSE);
 
-  if (parent_node && parent_node != priv->roots && parent_node->children ==NULL)
-    hildon_file_system_model_send_has_child_toggled( GTK_TREE_MODEL(data),
-                                                     parent_node);
+    node = child->user_data;
+    iter->stamp = priv->stamp;
+    iter->user_data = node->parent;
 
-  return node;
+    return node->parent != NULL && node->parent != priv->roots;
 }
 
-static gboolean notify_volumes_changed(GNode *node, gpointer data)
-{
-  HildonFileSystemModelNode *model_node = node->data;
-  HildonFileSystemVoldev *voldev = NULL;
-
-  if (model_node->location)
-    {
-      hildon_file_system_special_location_volumes_changed(model_node->location);
-
-      /* check if the special location is voldev */
-      if (HILDON_IS_FILE_SYSTEM_VOLDEV(model_node->location))
-	{
-	  if (!model_node->model)
-	    g_warning("hildon tree model is NULL");
-	  else
-	    {
-	      voldev = HILDON_FILE_SYSTEM_VOLDEV (model_node->location);
+/*********************************************/
+/* End of GTK_TREE_MODEL interface methods */
+/*********************************************/
 
-	      if ((voldev->vol_type == EXT_CARD) ||
-		  (voldev->vol_type == USB_STORAGE) ||
-		  (voldev->vol_type == INT_CARD))
-		{
-		  voldev->mount = find_mount(model_node->location->basepath);
-
-		  if (voldev->mount != NULL)
-		    {
-		      if (hildon_file_system_voldev_is_visible(model_node->location, FALSE) == TRUE)
-			{
-			  g_signal_emit(model_node->model, signals[VOLDEV_MOUNTED],
-					0, model_node->location->basepath);
-			}
-		    }
-		}
-	    }
-	}
-    }
+static gint path_compare_helper(gconstpointer a, gconstpointer b)
+{
+    /* This is really a macro, so we cannot pass it directly to search
+       function */
+    if (a == NULL || b == NULL)
+      return 1;
 
-  return FALSE;
+    return !g_file_equal((GFile *) a, (GFile *) b);
 }
 
-static void real_volumes_changed(GtkFileSystem *fs, gpointer data)
+static GNode
+    *hildon_file_system_model_search_folder(GtkFolder * folder)
 {
-    HildonFileSystemModel *model;
-    HildonFileSystemModelPrivate *priv;
+    return (GNode *) g_object_get_qdata(G_OBJECT(folder),
+                                        hildon_file_system_model_quark);
+}
 
-    model = HILDON_FILE_SYSTEM_MODEL (data);
-    priv = CAST_GET_PRIVATE(model);
+static void hildon_file_system_model_files_added (GtkFolder * monitor,
+						  GSList * paths,
+						  gpointer data);
 
-    g_node_traverse(priv->roots,
-            G_PRE_ORDER, G_TRAVERSE_ALL, -1,
-	    notify_volumes_changed, fs);
+static void
+sort_key_job_free (SortKeyJob *job)
+{
+  g_free (job->name);
+  g_free (job->key);
+  g_free (job->search_name);
+  g_free (job);
 }
 
-static GNode *
-hildon_file_system_model_add_node (GtkTreeModel * model,
-				   GNode * parent_node,
-				   GtkFolder *parent_folder,
-				   GFile *file,
-                                   gboolean with_search)
+static void
+sort_key_job_detach (HildonFileSystemModelNode *model_node)
 {
-    GNode *node;
-    HildonFileSystemModelPrivate *priv;
-    HildonFileSystemModelNode *parent_model_node, *model_node;
-    GFileInfo *file_info = NULL;
-    GtkTreePath *tree_path;
-    GtkTreeIter iter;
-    GFile *real_file;
-
-    /* Path can be NULL for removable devices that are not present */
-    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), NULL);
-    g_return_val_if_fail(parent_node != NULL, NULL);
-    g_return_val_if_fail(file != NULL, NULL);
-
-    priv = CAST_GET_PRIVATE(model);
-
-    parent_model_node = parent_node->data ? parent_node->data : NULL;
-
-    if (parent_model_node && parent_model_node->location)
-      real_file =
-	hildon_file_system_special_location_rewrite_path (parent_model_node->location,
-							  priv->filesystem,
-							  file);
-    else
-      real_file = g_object_ref (file);
-
-    DEBUG_GFILE_URI ("Adding %s", file);
-    DEBUG_GFILE_URI ("-> (%s)", real_file);
-
-    if (parent_folder) {
-        /* This can cause main loop execution on vfs backend */
+  if (model_node->key_job)
+    {
+      model_node->key_job->node = NULL;
+      model_node->key_job = NULL;
+    }
+}
 
-	/* We need to use PATH instead of REAL_PATH here since
-	   PARENT_FOLDER only knows about the original paths.
-	*/
+static gboolean
+sort_key_jobs_publish (gpointer data)
+{
+  GPtrArray *jobs = data;
+  guint i;
 
-      /* If we have received the path that we are adding by some other
-         means than listing the folder (like via some API function),
-         then the backend will send us "files-added" signal immediately
-         after we first time use it. This is *not good*, because it
-         places "garbage list" info processing queue and rest of
-         the model believes that model is loading. See bug #14040. */
-	g_signal_handlers_block_by_func(parent_folder,
-	  hildon_file_system_model_files_added, model);
-	file_info = gtk_file_folder_get_info(parent_folder, file);
-	g_signal_handlers_unblock_by_func(parent_folder,
-	  hildon_file_system_model_files_added, model);
+  for (i = 0; i < jobs->len; i++)
+    {
+      SortKeyJob *job = g_ptr_array_index (jobs, i);
 
-        /* If file is created and then renamed it can happen that file
-         * with this name no longer exists. */
-	if (!file_info)
+      if (job->node)
         {
-	  g_debug ("ADD ERR");
-	  g_object_unref (real_file);
-          return NULL;
-        }
+          HildonFileSystemModelNode *model_node = job->node->data;
 
-        g_assert(file_info != NULL);
-    }
-
-    /* First check if this item is already part of the model */
-    if (with_search)
-    {
-      node =
-        hildon_file_system_model_search_path_internal (parent_node,
-						       real_file, FALSE);
+          /* The values may have been asked for meanwhile */
+          if (!model_node->key_cache)
+            {
+              model_node->key_cache = job->key;
+              job->key = NULL;
+            }
+          if (!model_node->search_cache)
+            {
+              model_node->search_cache = job->search_name;
+              job->search_name = NULL;
+            }
 
-        if (node) {
-            HildonFileSystemModelNode *model_node = node->data;
-            g_assert(model_node);
-            model_node->present_flag = TRUE;
-	    if (model_node->info)
-	      g_object_unref (model_node->info);
-	    model_node->info = file_info;
-	    g_object_unref (real_file);
-            return node;
+          model_node->key_job = NULL;
         }
+
+      sort_key_job_free (job);
     }
 
-    model_node = g_new0(HildonFileSystemModelNode, 1);
-    model_node->info = file_info;
-    model_node->model = HILDON_FILE_SYSTEM_MODEL(model);
-    model_node->present_flag = TRUE;
-    model_node->available = TRUE;
-    model_node->file = real_file;
+  g_ptr_array_free (jobs, TRUE);
 
-    node = g_node_new(model_node);
-    g_node_append(parent_node, node);
+  return FALSE;
+}
 
-    if (!parent_folder
-	|| (file_info && _gtk_file_info_consider_as_directory(file_info))
-	|| g_file_has_uri_scheme (file, "obex:///"))
-    {
-        model_node->location =
-	    _hildon_file_system_get_special_location(real_file);
-        setup_node_for_location(node);
-    }
+static void
+sort_key_jobs_run (gpointer data, gpointer user_data)
+{
+  GPtrArray *jobs = data;
+  guint i;
 
-    /* The following should be replaced by appending the functionality into
-       GtkFileInfo, but this requires API changes into gtkfilesystem.h,
-       gtkfilesystemunix.h and gtkfilesystemgnomevfs.h (as well as into
-       memory backend). Currently we can handle only local files, but
-       that's better than nothing... */
-    if (!model_node->location)
+  for (i = 0; i < jobs->len; i++)
     {
-      gchar *local_path = g_file_get_path(real_file);
+      SortKeyJob *job = g_ptr_array_index (jobs, i);
 
-      if (local_path)
-      {
-        if (access(local_path, R_OK) != 0)
-        {
-          GFileError code = g_file_error_from_errno(errno);
-          if (code == G_FILE_ERROR_ACCES)
-          {
-            g_set_error(&model_node->error, G_FILE_ERROR, code,
-                        "%s", local_path);
-          }
-        }
-	g_free (local_path);
-      }
+      job->key = _hildon_file_system_create_sort_key (job->name);
+      job->search_name = hildon_helper_normalize_string (job->name);
     }
 
-    /* We need to report first that new like has been inserted */
+  g_idle_add (sort_key_jobs_publish, jobs);
+}
 
-    iter.stamp = priv->stamp;
-    iter.user_data = node;
-    tree_path = hildon_file_system_model_get_path(model, &iter);
-    gtk_tree_model_row_inserted(model, tree_path, &iter);
-    gtk_tree_path_free(tree_path);
+static void flush_sort_key_jobs (HildonFileSystemModelPrivate *priv);
 
-    if (/* g_node_n_children(parent_node) <= 1 */ g_node_nth_child (parent_node, 1) == NULL /* means - no second child, should work faster */ &&
-        parent_node != priv->roots) {
-        /* Don't emit signals for fake root */
-        hildon_file_system_model_send_has_child_toggled(model,
-                                                        parent_node);
-    }
+static gboolean
+flush_sort_key_jobs_idle (gpointer data)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE (data);
 
-    return node;
+  priv->key_jobs_idle_id = 0;
+  flush_sort_key_jobs (priv);
+
+  return FALSE;
 }
 
+/* Queues the file name of a freshly added node for background key
+   computation.  The jobs are handed to the worker by
+   flush_sort_key_jobs() once the whole batch has been added, or by an
+   idle for nodes that are added one at a time. */
 static void
-clear_model_node_caches(HildonFileSystemModelNode *model_node)
+queue_sort_key_job (HildonFileSystemModelPrivate *priv, GNode *node)
 {
-  if (model_node->icon_cache)
-  {
-    g_object_unref(model_node->icon_cache);
-    model_node->icon_cache = NULL;
-  }
-  if (model_node->icon_cache_expanded)
-  {
-    g_object_unref(model_node->icon_cache_expanded);
-    model_node->icon_cache_expanded = NULL;
-  }
-  if (model_node->icon_cache_collapsed)
-  {
-    g_object_unref(model_node->icon_cache_collapsed);
-    model_node->icon_cache_collapsed = NULL;
-  }
-  if (model_node->thumbnail_cache)
-  {
-    g_object_unref(model_node->thumbnail_cache);
-    model_node->thumbnail_cache = NULL;
-  }
-  if (model_node->thumbnail_request)
-  {
-    hildon_thumbnail_request_unqueue(model_node->thumbnail_request);
-    g_object_unref (model_node->thumbnail_request);
-    model_node->thumbnail_request = NULL;
-  }
-
-  g_free(model_node->display_text);
-  model_node->display_text = NULL;
-  pango_attr_list_unref(model_node->display_attrs);
-  model_node->display_attrs = NULL;
+  HildonFileSystemModelNode *model_node = node->data;
+  SortKeyJob *job;
 
-  g_free(model_node->title_cache);
-  g_free(model_node->name_cache);
-  g_free(model_node->key_cache);
-  model_node->title_cache = NULL;
-  model_node->key_cache = NULL;
-  model_node->name_cache = NULL;
+  if (model_node->key_job || model_node->key_cache)
+    return;
 
-  if(model_node->thumb_title)
-  {
-    g_free(model_node->thumb_title);
-    model_node->thumb_title = NULL;
-  }
-  if(model_node->thumb_author)
-  {
-    g_free(model_node->thumb_author);
-    model_node->thumb_author = NULL;
-  }
-  if(model_node->thumb_album)
-  {
-    g_free(model_node->thumb_album);
-    model_node->thumb_album = NULL;
-  }
-}
+  if (model_node->name_cache == NULL)
+    model_node->name_cache =
+      _hildon_file_system_create_file_name (model_node->file,
+                                            model_node->location,
+                                            model_node->info);
 
-static void hildon_file_system_model_remove_node_list(GtkTreeModel * model,
-                                                      GNode * parent_node,
-                                                      GSList * children)
-{
-    GNode *child_node = g_node_first_child(parent_node);
+  job = g_new0 (SortKeyJob, 1);
+  job->node = node;
+  job->name = g_strdup (model_node->name_cache);
+  model_node->key_job = job;
 
-    while (child_node)
-      {
-        HildonFileSystemModelNode *model_node = child_node->data;
+  if (!priv->key_jobs)
+    priv->key_jobs = g_ptr_array_new ();
+  g_ptr_array_add (priv->key_jobs, job);
 
-	if (g_slist_find_custom (children, model_node->file, path_compare_helper))
-	    child_node = hildon_file_system_model_kick_node (child_node, model);
-        else
-	    child_node = g_node_next_sibling (child_node);
-      }
+  if (priv->key_jobs_idle_id == 0)
+    priv->key_jobs_idle_id =
+      g_idle_add (flush_sort_key_jobs_idle, model_node->model);
 }
 
-static void hildon_file_system_model_change_node_list(GtkTreeModel * model,
-                                                      GNode * parent_node,
-						      GtkFolder *
-                                                      folder,
-                                                      GSList * children)
+static void
+flush_sort_key_jobs (HildonFileSystemModelPrivate *priv)
 {
-    GNode *node;
-
-    g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
-    g_return_if_fail(parent_node != NULL);
-    g_return_if_fail(GTK_IS_FOLDER(folder));
-    g_return_if_fail(children != NULL);
-
-    for (node = g_node_first_child(parent_node); node;
-	 node = g_node_next_sibling(node))
-      {
-        HildonFileSystemModelNode *model_node = node->data;
+  if (priv->key_jobs_idle_id)
+    {
+      g_source_remove (priv->key_jobs_idle_id);
+      priv->key_jobs_idle_id = 0;
+    }
 
-	if (g_slist_find_custom (children, model_node->file, path_compare_helper))
-	  {
-	    DEBUG_GFILE_URI("Path changed [%s]", model_node->file);
+  if (!priv->key_jobs)
+    return;
 
-            /* Ok, current node is updated. We need to refresh it and send
-               needed signals. Visible information of special nodes is not going to change */
+  if (!sort_key_pool)
+    sort_key_pool = g_thread_pool_new (sort_key_jobs_run, NULL,
+                                       1, FALSE, NULL);
 
-            clear_model_node_caches(model_node);
+  g_thread_pool_push (sort_key_pool, priv->key_jobs, NULL);
+  priv->key_jobs = NULL;
+}
 
-            if (model_node->info && !model_node->location)
-            {
-	      g_object_unref(model_node->info);
+typedef struct {
+  GtkFolder *monitor;
+  GSList *paths;
+  gpointer data;
+  GSList *next_path;
+  gboolean all_new;
+} dfa_clos;
 
-              model_node->info =
-		gtk_file_folder_get_info(folder, model_node->file);
-            }
+static gboolean
+dfa_run (gpointer data)
+{
+  GNode *node;
+  HildonFileSystemModelNode *model_node;
 
-            emit_node_changed(node);
-        }
+  dfa_clos *c = (dfa_clos *)data;
+  
+  GDK_THREADS_ENTER ();
+  
+  node = hildon_file_system_model_search_folder (c->monitor);
+  if (node)
+    {
+      gint i;
+      model_node = node->data;
+/*       model_node->pending_adds -= g_slist_length (c->paths); */
+      model_node->pending_adds = 0; //no need to count
+      i = 0;
+      while (c->next_path && i < MAX_BATCH)
+	  {
+              hildon_file_system_model_add_node (GTK_TREE_MODEL (model_node->model),
+                                                 node,
+                                                 c->monitor,
+						 c->next_path->data,
+                                                 TRUE);
+              c->next_path = c->next_path->next;
+              i++;
+	  }
+      model_node->pending_adds = (c->next_path != NULL)? 1 : 0;
+      flush_sort_key_jobs (CAST_GET_PRIVATE (model_node->model));
     }
+
+  GDK_THREADS_LEAVE ();
+
+  if (node) {
+      emit_node_changed (node);
+
+      if (is_node_loaded (node))
+          handle_finished_node (node);
+  }
+  if (c->next_path)
+    return TRUE;
+
+  g_object_unref (c->monitor);
+  g_slist_foreach (c->paths, (GFunc) g_object_unref, NULL);
+  g_slist_free (c->paths);
+  g_object_unref (c->data);
+  g_free (c);
+
+  return FALSE;
 }
 
-static void wait_node_load(HildonFileSystemModelPrivate * priv,
-                           GNode * node)
+/* Windowed folders
+
+   Once a folder that a view has windowed has window_size rows, the
+   files found after that are kept as ChildRecords: the file, its info
+   shared with the GtkFolder and a sort key.  Rows are made for them in
+   display order when _hildon_file_system_model_grow_children() is
+   called, usually when the view showing the folder is scrolled near
+   its end, and when one of them is searched for.  The rows
+   are kept a prefix of the folder in display order, so a new file
+   that sorts before the last row takes the place of that row.
+   Folders always get a row, so the navigation pane sees them all. */
+
+static void
+child_record_free(ChildRecord *record)
 {
-  HildonFileSystemModelNode *model_node = node->data;
+  g_object_unref(record->file);
+  g_object_unref(record->info);
+  g_free(record->sort_key);
+  g_slice_free(ChildRecord, record);
+}
 
-  if (model_node->folder
-      || model_node->cancellable)   /* Sanity check: node has to
-					     be a folder */
-  {
-    g_debug("Waiting folder [%s] to load", (char *) model_node->file);
-    while (!is_node_loaded(node))
+static void
+model_node_clear_records(HildonFileSystemModelNode *model_node)
+{
+  ChildRecords *records = model_node->records;
+
+  if (records == NULL)
+    return;
+
+  g_ptr_array_foreach(records->list, (GFunc) child_record_free, NULL);
+  g_ptr_array_free(records->list, TRUE);
+  g_hash_table_destroy(records->index);
+  g_slice_free(ChildRecords, records);
+  model_node->records = NULL;
+}
+
+/* Records are never folders.  The file name is not needed for
+   sorting, so it is left out. */
+static void
+child_record_peek_row(ChildRecord *record, HildonFileSystemModelRow *row)
+{
+  GTimeVal timeval = {0, 0};
+
+  if (record->sort_key == NULL)
     {
-        g_usleep(2000); /* microseconds */
-        if (gtk_events_pending())       /* Don't do while here, because
-                                           there can be enormous amount of
-                                           events waiting */
-            gtk_main_iteration();
+      gchar *name = _hildon_file_system_create_file_name(record->file, NULL,
+                                                         record->info);
+
+      record->sort_key = _hildon_file_system_create_sort_key(name);
+      g_free(name);
     }
-    DEBUG_GFILE_URI("Folder [%s] loaded", model_node->file);
-  }
+
+  g_file_info_get_modification_time(record->info, &timeval);
+
+  row->flags = ROW_FLAG_VALID | ROW_FLAG_IS_AVAILABLE
+    | (HILDON_FILE_SYSTEM_MODEL_FILE << ROW_FLAGS_TYPE_SHIFT)
+    | (((guint32) SORT_WEIGHT_FILE & 0xffff) << ROW_FLAGS_SORT_WEIGHT_SHIFT);
+  row->file = record->file;
+  row->file_name = NULL;
+  row->sort_key = record->sort_key;
+  row->mime_type = g_file_info_get_content_type(record->info);
+  row->size = g_file_info_get_size(record->info);
+  row->mtime = timeval.tv_sec;
+
+  if (row->mime_type == NULL)
+    row->mime_type = "";
 }
 
-static void hildon_file_system_model_init(HildonFileSystemModel * self)
+static gint
+compare_records(HildonFileSystemModelPrivate *priv,
+                ChildRecord *a, ChildRecord *b)
 {
-    HildonFileSystemModelPrivate *priv;
+  HildonFileSystemModelRow row_a, row_b;
+  gint result;
 
-    priv =
-        G_TYPE_INSTANCE_GET_PRIVATE(self, HILDON_TYPE_FILE_SYSTEM_MODEL,
-                                    HildonFileSystemModelPrivate);
-    self->priv = (gpointer) priv;
+  if (!priv->sorted)
+    return (gint) a->serial - (gint) b->serial;
 
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_GTK_PATH_INTERNAL] =
-	G_TYPE_FILE;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_LOCAL_PATH] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_URI] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_DISPLAY_NAME] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_SIZE] =
-        G_TYPE_INT64;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_TIME] =
-        G_TYPE_INT64;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER] =
-        G_TYPE_BOOLEAN;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_READONLY] =
-        G_TYPE_BOOLEAN;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE] =
-        G_TYPE_BOOLEAN;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH] =
-        G_TYPE_BOOLEAN;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_TYPE] = G_TYPE_INT;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON] =
-        GDK_TYPE_PIXBUF;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_EXPANDED] =
-        GDK_TYPE_PIXBUF;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_COLLAPSED] =
-        GDK_TYPE_PIXBUF;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_THUMBNAIL] =
-        GDK_TYPE_PIXBUF;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY] =
-        G_TYPE_BOOLEAN;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FREE_SPACE] =
-        G_TYPE_INT64;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_HIDDEN] =
-        G_TYPE_BOOLEAN;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_UNAVAILABLE_REASON] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FAILED_ACCESS_MESSAGE] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT] =
-        G_TYPE_INT;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_EXTRA_INFO] =
-        G_TYPE_STRING;
-    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_DRIVE] =
-        G_TYPE_BOOLEAN;
-    priv->column_types[PRIV_COLUMN_DISPLAY_TEXT] =
-	G_TYPE_STRING;
-    priv->column_types[PRIV_COLUMN_DISPLAY_ATTRS] =
-        PANGO_TYPE_ATTR_LIST;
-#ifdef UPSTREAM_DISABLED
-    priv->tracker_client = tracker_connect(FALSE);
-#endif
-    priv->hour24_changed_handler = g_signal_connect_swapped(_hildon_file_system_settings_get_instance(),
-							    "notify::hour24",
-							    G_CALLBACK(invalidate_display_props),
-							    self);
-    priv->stamp = g_random_int();
-    priv->first_root_scan_completed = FALSE;
+  child_record_peek_row(a, &row_a);
+  child_record_peek_row(b, &row_b);
+  result = compare_rows(priv, &row_a, &row_b);
+
+  return result ? result : (gint) a->serial - (gint) b->serial;
 }
 
-static void hildon_file_system_model_dispose(GObject *self)
+static gint
+compare_records_reversed(gconstpointer a, gconstpointer b, gpointer data)
 {
-  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(self);
+  return compare_records(data, *(ChildRecord **) b, *(ChildRecord **) a);
+}
 
-  if (priv->ref_widget)
-  {
-    g_signal_handler_disconnect(priv->ref_widget, priv->style_changed_handler);
-    g_object_unref(priv->ref_widget);
-    priv->ref_widget = NULL;
-  }
-  if (priv->hour24_changed_handler)
+static gint
+compare_record_with_node(HildonFileSystemModelPrivate *priv,
+                         ChildRecord *record, GNode *node)
+{
+  HildonFileSystemModelRow row_a, row_b;
+
+  /* Unsorted records come after the rows, they were found later */
+  if (!priv->sorted)
+    return 1;
+
+  child_record_peek_row(record, &row_a);
+  model_node_peek_row(node->data, &row_b);
+
+  return compare_rows(priv, &row_a, &row_b);
+}
+
+static void
+child_records_sort(HildonFileSystemModelPrivate *priv, ChildRecords *records)
+{
+  if (!records->sorted)
     {
-      g_signal_handler_disconnect(_hildon_file_system_settings_get_instance(),
-				  priv->hour24_changed_handler);
-      priv->hour24_changed_handler = 0;
+      g_ptr_array_sort_with_data(records->list, compare_records_reversed,
+                                 priv);
+      records->sorted = TRUE;
     }
-  if (priv->timeout_id)
-  {
-    g_source_remove(priv->timeout_id);
-    priv->timeout_id = 0;
-  }
-  /* This won't work in finalize (removing nodes sends signals) */
-  if (priv->roots)
-  {
-    hildon_file_system_model_kick_node(priv->roots, self);
-    priv->roots = NULL;
-  }
-#ifdef UPSTREAM_DISABLED
-  if (priv->tracker_client)
-  {
-      tracker_disconnect(priv->tracker_client);
-      priv->tracker_client = NULL;
-  }
-#endif
-  G_OBJECT_CLASS(hildon_file_system_model_parent_class)->dispose(self);
 }
 
-static void hildon_file_system_model_finalize(GObject * self)
+static void
+child_records_insert(HildonFileSystemModelPrivate *priv,
+                     ChildRecords *records, ChildRecord *record)
 {
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(self);
+  guint lo = 0, hi = records->list->len;
 
-    g_free(priv->backend_name); /* No need to check NULL */
-    g_free(priv->alternative_root_dir);
+  g_hash_table_insert(records->index, record->file, record);
 
-    /* Disconnecting filesystem volumes-changed signal */
-    if (g_signal_handler_is_connected (priv->filesystem,
-                                       priv->volumes_changed_handler))
-      g_signal_handler_disconnect (priv->filesystem,
-                                   priv->volumes_changed_handler);
+  if (!records->sorted)
+    {
+      g_ptr_array_add(records->list, record);
+      return;
+    }
 
-    g_debug("ref count = %d", G_OBJECT(priv->filesystem)->ref_count);
-    g_object_unref(priv->filesystem);
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
 
-    if (priv->expanded_emblem)
-      g_object_unref(priv->expanded_emblem);
-    if (priv->collapsed_emblem)
-      g_object_unref(priv->collapsed_emblem);
+      if (compare_records(priv, g_ptr_array_index(records->list, mid),
+                          record) > 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
 
-    G_OBJECT_CLASS(hildon_file_system_model_parent_class)->finalize(self);
+  g_ptr_array_insert(records->list, lo, record);
 }
 
-static void hildon_file_system_model_set_property(GObject * object,
-                                                  guint property_id,
-                                                  const GValue * value,
-                                                  GParamSpec * pspec)
+/* Removes RECORD from the records of NODE without freeing it */
+static void
+child_records_steal(ChildRecords *records, ChildRecord *record)
 {
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(object);
+  g_hash_table_steal(records->index, record->file);
 
-    switch (property_id) {
-    case PROP_BACKEND:
-        g_assert(priv->backend_name == NULL);   /* We come here exactly
-                                                   once */
-        priv->backend_name = g_value_dup_string(value);
-        break;
-    case PROP_BACKEND_OBJECT:
-        g_assert(priv->filesystem == NULL);
-        priv->filesystem = g_value_get_object(value);
-        if (priv->filesystem)
-          g_object_ref(priv->filesystem);
-        break;
-    case PROP_THUMBNAIL_CALLBACK:
-        g_warning("Setting thumbnail callback is depricated");
-        break;
-    case PROP_REF_WIDGET:
-        if (priv->ref_widget)
-            g_object_unref(priv->ref_widget);
-        priv->ref_widget = g_value_get_object(value);
-        if (priv->ref_widget) {
-            g_object_ref(priv->ref_widget);
-	    priv->style_changed_handler =
-	      g_signal_connect_swapped(priv->ref_widget, "notify::style",
-				       G_CALLBACK(invalidate_display_props), object);
-	}
-        break;
-    case PROP_ROOT_DIR:
-        g_assert(priv->alternative_root_dir == NULL);
-        priv->alternative_root_dir = g_value_dup_string(value);
-        break;
-    case PROP_MULTI_ROOT:
-        priv->multiroot = g_value_get_boolean(value);
-        break;
-    default:
-        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
-        break;
+  if (records->list->len > 0 &&
+      g_ptr_array_index(records->list, records->list->len - 1) == record)
+    g_ptr_array_remove_index(records->list, records->list->len - 1);
+  else
+    g_ptr_array_remove(records->list, record);
+}
+
+static ChildRecord *
+child_records_lookup(GNode *node, GFile *file)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+
+  if (model_node == NULL || model_node->records == NULL)
+    return NULL;
+
+  return g_hash_table_lookup(model_node->records->index, file);
+}
+
+/* The file of RECORD has changed */
+static void
+child_record_refresh(ChildRecords *records, ChildRecord *record,
+                     GtkFolder *folder)
+{
+  GFileInfo *info = gtk_file_folder_get_info(folder, record->file);
+
+  if (info == NULL)
+    {
+      child_records_steal(records, record);
+      child_record_free(record);
+      return;
     }
+
+  g_object_unref(record->info);
+  record->info = info;
+  g_free(record->sort_key);
+  record->sort_key = NULL;
+  records->sorted = FALSE;
 }
 
-static void hildon_file_system_model_get_property(GObject * object,
-                                                  guint property_id,
-                                                  GValue * value,
-                                                  GParamSpec * pspec)
+/* Only plain files can go back to being records */
+static gboolean
+node_is_demotable(GNode *node)
 {
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(object);
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileSystemModelNode *parent_model_node = node->parent->data;
 
-    switch (property_id) {
-    case PROP_BACKEND:
-        g_value_set_string(value, priv->backend_name);
-        break;
-    case PROP_BACKEND_OBJECT:
-        g_value_set_object(value, priv->filesystem);
-        break;
-    case PROP_THUMBNAIL_CALLBACK:
-        g_warning("Getting thumbnail callback is depricated");
-        g_value_set_pointer(value, NULL);
-        break;
-    case PROP_REF_WIDGET:
-        g_value_set_object(value, priv->ref_widget);
-        break;
-    case PROP_ROOT_DIR:
-        g_value_set_string(value, priv->alternative_root_dir);
-        break;
-    case PROP_MULTI_ROOT:
-        g_value_set_boolean(value, priv->multiroot);
-        break;
-    default:
-        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+  return node->children == NULL && model_node->info != NULL
+    && model_node->location == NULL && parent_model_node->location == NULL
+    && model_node->folder == NULL && model_node->cancellable == NULL
+    && !model_node->linking && !model_node_is_folder(model_node);
+}
+
+/* Turns the row of NODE back into a record of its parent */
+static void
+demote_node(HildonFileSystemModel *model, GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  ChildRecords *records =
+    ((HildonFileSystemModelNode *) node->parent->data)->records;
+  ChildRecord *record;
+
+  record = g_slice_new(ChildRecord);
+  record->file = g_object_ref(model_node->file);
+  record->info = g_object_ref(model_node->info);
+  record->sort_key = g_strdup(model_node->key_cache);
+  record->serial = records->serial++;
+
+  hildon_file_system_model_kick_node(node, model);
+  child_records_insert(model->priv, records, record);
+}
+
+static GNode *
+materialize_record(HildonFileSystemModel *model, GNode *parent,
+                   ChildRecord *record)
+{
+  HildonFileSystemModelNode *parent_model_node = parent->data;
+  GNode *node;
+
+  child_records_steal(parent_model_node->records, record);
+  node = hildon_file_system_model_add_node(GTK_TREE_MODEL(model), parent,
+                                           parent_model_node->folder,
+                                           record->file, FALSE);
+  child_record_free(record);
+
+  return node;
+}
+
+/* Called for a FILE of the folder of PARENT that is not in the model.
+   Returns TRUE if it was kept as a record instead of getting a row. */
+static gboolean
+child_records_take(HildonFileSystemModel *model, GNode *parent,
+                   GtkFolder *folder, GFile *file)
+{
+  HildonFileSystemModelPrivate *priv = model->priv;
+  HildonFileSystemModelNode *parent_model_node = parent->data;
+  ChildRecords *records;
+  ChildRecord *record;
+  GFileInfo *info;
+  GNode *last;
+
+  if (parent_model_node == NULL || parent_model_node->window_size == 0 ||
+      parent_model_node->location != NULL)
+    return FALSE;
+
+  records = parent_model_node->records;
+  if (records == NULL &&
+      g_node_n_children(parent) < parent_model_node->window_size)
+    return FALSE;
+
+  /* See hildon_file_system_model_add_node() */
+  g_signal_handlers_block_by_func(folder,
+    hildon_file_system_model_files_added, model);
+  info = gtk_file_folder_get_info(folder, file);
+  g_signal_handlers_unblock_by_func(folder,
+    hildon_file_system_model_files_added, model);
+
+  if (info == NULL)
+    return FALSE;
+  if (_gtk_file_info_consider_as_directory(info))
+    {
+      g_object_unref(info);
+      return FALSE;
+    }
+
+  if (records == NULL)
+    {
+      records = g_slice_new0(ChildRecords);
+      records->list = g_ptr_array_new();
+      records->index = g_hash_table_new(g_file_hash,
+                                        (GEqualFunc) g_file_equal);
+      records->sorted = TRUE;
+      parent_model_node->records = records;
+    }
+
+  record = g_slice_new(ChildRecord);
+  record->file = g_object_ref(file);
+  record->info = info;
+  record->sort_key = NULL;
+  record->serial = records->serial++;
+
+  last = g_node_last_child(parent);
+  if (priv->sorted && last != NULL &&
+      compare_record_with_node(priv, record, last) < 0)
+    {
+      /* It belongs among the rows, the last row makes room for it */
+      child_record_free(record);
+      if (node_is_demotable(last))
+        demote_node(model, last);
+      return FALSE;
+    }
+
+  child_records_insert(priv, records, record);
+  return TRUE;
+}
+
+/* Makes rows for the records that sort before the last row of NODE,
+   after the sort order has changed */
+static void
+child_records_rebalance(HildonFileSystemModel *model, GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  ChildRecords *records;
+
+  if (model_node == NULL || (records = model_node->records) == NULL)
+    return;
+
+  records->sorted = FALSE;
+  child_records_sort(model->priv, records);
+
+  while (records->list->len > 0)
+    {
+      ChildRecord *record =
+        g_ptr_array_index(records->list, records->list->len - 1);
+      GNode *last = g_node_last_child(node);
+
+      if (last == NULL || !node_is_demotable(last) ||
+          compare_record_with_node(model->priv, record, last) >= 0)
         break;
+
+      materialize_record(model, node, record);
+      demote_node(model, last);
+    }
+}
+
+static gboolean
+child_records_grow(HildonFileSystemModel *model, GNode *node, guint n)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  ChildRecords *records;
+
+  if (model_node == NULL || (records = model_node->records) == NULL)
+    return FALSE;
+
+  child_records_sort(model->priv, records);
+
+  while (n-- > 0 && records->list->len > 0)
+    materialize_record(model, node,
+                       g_ptr_array_index(records->list,
+                                         records->list->len - 1));
+
+  flush_sort_key_jobs(model->priv);
+
+  if (records->list->len > 0)
+    return TRUE;
+
+  model_node_clear_records(model_node);
+  return FALSE;
+}
+
+static gboolean
+rebalance_records(GNode *node, gpointer data)
+{
+  child_records_rebalance(data, node);
+  return FALSE;
+}
+
+/* Gives FILE a row if it is a record of PARENT.  Returns the node of
+   the new row, or NULL. */
+static GNode *
+child_records_materialize_file(HildonFileSystemModel *model, GNode *parent,
+                               GFile *file)
+{
+  ChildRecord *record = child_records_lookup(parent, file);
+  GNode *node;
+
+  if (record == NULL)
+    return NULL;
+
+  node = materialize_record(model, parent, record);
+  flush_sort_key_jobs(model->priv);
+
+  return node;
+}
+
+static void
+delay_files_added (GtkFolder * monitor,
+		   GSList * paths,
+		   gpointer data,
+                   gboolean all_new)
+{
+  GNode *node;
+  HildonFileSystemModelNode *model_node;
+
+  node = hildon_file_system_model_search_folder (monitor);
+  if (node)
+    {
+      dfa_clos *c = g_new0 (dfa_clos, 1);
+
+      g_object_ref (monitor);
+      paths = g_slist_copy_deep (paths, (GCopyFunc) g_object_ref, NULL);
+      g_object_ref (data);
+      
+      model_node = node->data;
+/*       model_node->pending_adds += g_slist_length (paths); */
+      model_node->pending_adds = 1; // it is faster than counting all items
+
+      c->monitor = monitor;
+      c->paths = paths;
+      c->data = data;
+      c->next_path = paths;
+      c->all_new = all_new;
+      
+      g_idle_add (dfa_run, c);
+    }
+}
+
+static void hildon_file_system_model_files_added(GtkFolder * monitor,
+                                                 GSList * paths,
+                                                 gpointer data)
+{
+  /* The files identified by PATHS have been created.  Normally, they
+     are children of MONITOR, but it might happen that the file
+     corresponding to MONITOR is among PATHS, too.  This happens when
+     you start monitoring a filename before it exists.
+
+     XXX - maybe this situation should be filtered out by the GnomeVFS
+           GtkFileSystem backend, depending on what guarantees the
+           "files-added" signal makes.
+  */
+
+  if (paths != NULL)
+  {
+    GNode *node;
+    HildonFileSystemModelNode *model_node;
+
+    node = hildon_file_system_model_search_folder(monitor);
+    if (node != NULL)
+      {
+	gint i;
+	GtkTreeModel *model;
+	GFile *real_file;
+        gboolean all_new = TRUE;
+
+	model_node = node->data;
+	model = GTK_TREE_MODEL (model_node->model);
+
+	i = 0;
+	while (paths && i < MAX_BATCH)
+	  {
+	    GNode *n;
+	    ChildRecord *record;
+
+	    if ((record = child_records_lookup (node, paths->data)))
+	      {
+		child_record_refresh (model_node->records, record, monitor);
+		all_new = FALSE;
+		paths = paths->next;
+		i++;
+		continue;
+	      }
+
+	    if (model_node->location)
+	      {
+		real_file =
+		    hildon_file_system_special_location_rewrite_path (
+		      model_node->location, CAST_GET_PRIVATE(model)->filesystem, paths->data);
+	      }
+	    else
+	      real_file = g_object_ref(paths->data);
+
+	    //search whether this node already exists
+	    if ((n = hildon_file_system_model_search_path_internal (node, real_file, FALSE)) &&
+		!g_file_has_uri_scheme(real_file, "upnpav"))
+	      {
+		//node already exists no need to add
+		HildonFileSystemModelNode *mn = n->data;
+		DEBUG_GFILE_URI("%s %p setting present_flag to TRUE", real_file, mn);
+		mn->present_flag = TRUE;
+		all_new = FALSE;
+	      }
+	    else if (!child_records_take (HILDON_FILE_SYSTEM_MODEL (model),
+					  node, monitor, paths->data))
+	      {
+		hildon_file_system_model_add_node (model,
+						   node,
+						   monitor,
+						   paths->data,
+						   TRUE);
+	      }
+
+	    g_object_unref (real_file);
+	    paths = paths->next;
+	    i++;
+	  }
+
+	flush_sort_key_jobs (CAST_GET_PRIVATE (model));
+	emit_node_changed (node);
+
+	if (paths)
+            delay_files_added (monitor, paths, data, all_new);
+
+	if (is_node_loaded (node))
+	  handle_finished_node (node);
+      }
+    else
+      g_warning("Data destination not found!");
+  }
+}
+
+static void hildon_file_system_model_files_removed(GtkFolder * monitor,
+                                                   GSList * paths,
+                                                   gpointer data)
+{
+  if (paths != NULL)
+  {
+    GNode *node;
+
+    g_debug("Removing files (monitor = %p)", (void *) monitor);
+
+    node = hildon_file_system_model_search_folder(monitor);
+    if (node != NULL)
+    {
+        hildon_file_system_model_remove_node_list(data, node, paths);
+        name_index_remove_files(node, paths);
+    }
+    else
+        g_warning("Data destination not found!");
+  }
+}
+
+static void hildon_file_system_model_dir_removed(GtkFolder * monitor,
+                                                 gpointer data)
+{
+    g_warning("Dir removed callback called, but this method is not "
+               "implemented (and probably there is no need to implement "
+               "it either).");
+}
+
+static void hildon_file_system_model_files_changed(GtkFolder * monitor,
+                                                   GSList * paths,
+                                                   gpointer data)
+{
+  if (paths != NULL)
+  {
+    GNode *node;
+
+    g_debug("Files changed (monitor = %p)", (void *) monitor);
+
+    node = hildon_file_system_model_search_folder(monitor);
+    if (node != NULL)
+        hildon_file_system_model_change_node_list(data, node, monitor,
+                                                  paths);
+    else
+        g_warning("Data destination not found!");
+  }
+}
+
+static void hildon_file_system_model_files_renamed(GtkFolder * monitor,
+                                                   GSList * paths,
+                                                   gpointer data)
+{
+  GSList *pairs = paths;
+  GNode *node;
+
+  g_debug("Files renamed (monitor = %p)", (void *) monitor);
+
+  node = hildon_file_system_model_search_folder(monitor);
+  if (node == NULL)
+  {
+    g_warning("Data destination not found!");
+    return;
+  }
+
+  for (; paths && paths->next; paths = paths->next->next)
+  {
+    GFile *old_file = paths->data, *new_file = paths->next->data;
+    GNode *child, *replaced;
+    ChildRecord *record;
+
+    if ((record = child_records_lookup(node, old_file)))
+    {
+      GSList added = { new_file, NULL };
+
+      child_records_steal(((HildonFileSystemModelNode *) node->data)->records,
+                          record);
+      child_record_free(record);
+      hildon_file_system_model_files_added(monitor, &added, data);
+      continue;
+    }
+
+    child = hildon_file_system_model_search_path_internal(node, old_file,
+                                                          FALSE);
+    if (child == node)
+      child = NULL;
+
+    /* Special locations are set up for their path, make them again */
+    if (child && ((HildonFileSystemModelNode *) child->data)->location)
+    {
+      hildon_file_system_model_kick_node(child, data);
+      child = NULL;
+    }
+
+    if (child == NULL)
+    {
+      GSList added = { new_file, NULL };
+
+      hildon_file_system_model_files_added(monitor, &added, data);
+      continue;
+    }
+
+    /* The file may have been renamed over another one */
+    replaced = hildon_file_system_model_search_path_internal(node, new_file,
+                                                             FALSE);
+    if (replaced && replaced != node && replaced != child)
+      hildon_file_system_model_kick_node(replaced, data);
+
+    hildon_file_system_model_rename_node(data, child, monitor, new_file);
+  }
+
+  for (; pairs && pairs->next; pairs = pairs->next->next)
+  {
+    GSList removed = { pairs->data, NULL };
+
+    name_index_remove_files(node, &removed);
+    name_index_add_file(node, pairs->next->data);
+  }
+}
+
+static void hildon_file_system_model_folder_finished_loading(GtkFolder *monitor, gpointer data)
+{
+  GNode *node = hildon_file_system_model_search_folder(monitor);
+  if (node)
+    {
+      g_debug("Finished loading (monitor = %p)", (void *) monitor);
+      if (is_node_loaded (node))
+	handle_finished_node (node);
+    }
+}
+
+static GNode *
+hildon_file_system_model_search_path_internal (GNode *parent_node,
+					       GFile *file,
+                                               gboolean recursively)
+{
+    GNode *node;
+    HildonFileSystemModelNode *model_node;
+
+    g_assert(parent_node != NULL && file != NULL);
+
+    model_node = parent_node->data;
+
+    /* First consider the parent itself.
+     */
+    if (model_node)
+      {
+	if (g_file_equal (file, model_node->file))
+	  {
+	    DEBUG_GFILE_URI("EQUAL FOUND %s model_node %p", model_node->file,
+			    model_node);
+	    return parent_node;
+	  }
+      }
+
+    for (node = g_node_first_child(parent_node); node;
+	 node = g_node_next_sibling(node))
+      {
+        model_node = node->data;
+
+	if (g_file_equal (file, model_node->file))
+	  {
+	    DEBUG_GFILE_URI("CHILD FOUND %s model_node %p", model_node->file,
+			    model_node);
+	    return node;
+	  }
+
+        if (recursively) {
+            /* Allways peek into devices, since they can include different
+               base locations within them */
+
+	  if (model_node->location ||
+	      g_file_has_prefix(file, model_node->file))
+          {
+                GNode *result =
+                      hildon_file_system_model_search_path_internal(node,
+								    file,
+                                                                    TRUE);
+		if (result)
+		  return result;
+          }
+        }
+    }
+
+    return NULL;
+}
+
+static void hildon_file_system_model_send_has_child_toggled(GtkTreeModel *
+                                                            model,
+                                                            GNode *
+                                                            parent_node)
+{
+    GtkTreePath *tree_path;
+    GtkTreeIter iter;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+
+    iter.stamp = priv->stamp;
+    iter.user_data = parent_node;
+    tree_path = hildon_file_system_model_get_path(model, &iter);
+    gtk_tree_model_row_has_child_toggled(model, tree_path, &iter);
+    gtk_tree_path_free(tree_path);
+}
+
+/* Folder loads.  Showing a folder in the navigation pane asks for the
+   display names of its subfolders, which links each of them, so
+   without a limit dozens of enumerations would compete with the folder
+   the user has actually opened, and a card with a slow file system
+   would be thrashed.  Loads beyond the limit of their device wait in
+   load_queue and are started in priority order as others finish. */
+
+static gboolean load_queue_idle(gpointer data);
+
+/* The node of the device that NODE is on: the closest location that
+   is more than a special folder, or the top of the tree.  Each device
+   has slots of its own, so that a busy memory card does not hold up
+   the internal memory. */
+static GNode *
+node_get_load_device(GNode *node)
+{
+  for (; node->parent && node->parent->data; node = node->parent)
+    {
+      HildonFileSystemModelNode *model_node = node->data;
+
+      if (model_node->location
+          && G_OBJECT_TYPE(model_node->location)
+             != HILDON_TYPE_FILE_SYSTEM_SPECIAL_LOCATION)
+        break;
+    }
+
+  return node;
+}
+
+static gboolean
+load_device_is_full(HildonFileSystemModelPrivate *priv, GNode *device)
+{
+  return priv->max_device_loads > 0
+    && GPOINTER_TO_UINT(g_hash_table_lookup(priv->device_loads, device))
+         >= priv->max_device_loads;
+}
+
+static void
+load_device_add(HildonFileSystemModelPrivate *priv, GNode *device,
+                gint n)
+{
+  guint loads;
+
+  loads = GPOINTER_TO_UINT(g_hash_table_lookup(priv->device_loads, device));
+  loads += n;
+
+  if (loads > 0)
+    g_hash_table_insert(priv->device_loads, device, GUINT_TO_POINTER(loads));
+  else
+    g_hash_table_remove(priv->device_loads, device);
+}
+
+static void
+load_queue_schedule(HildonFileSystemModel *model)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+
+  if (priv->load_idle_id == 0)
+    priv->load_idle_id = g_idle_add(load_queue_idle, model);
+}
+
+static void
+load_queue_push(GNode *node, LoadPriority priority, gboolean first)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model_node->model);
+  GQueue *queue = &priv->load_queue[priority];
+
+  g_assert(model_node->load_link == NULL);
+
+  if (first)
+    {
+      g_queue_push_head(queue, node);
+      model_node->load_link = queue->head;
+    }
+  else
+    {
+      g_queue_push_tail(queue, node);
+      model_node->load_link = queue->tail;
+    }
+
+  model_node->load_priority = priority;
+  model_node->load_queued = TRUE;
+  load_queue_schedule(model_node->model);
+}
+
+/* Takes NODE out of the load queue, or gives back its load slot */
+static void
+load_forget(GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileSystemModelPrivate *priv;
+
+  if (model_node->load_link == NULL)
+    return;
+
+  priv = CAST_GET_PRIVATE(model_node->model);
+
+  if (model_node->load_queued)
+    g_queue_delete_link(&priv->load_queue[model_node->load_priority],
+                        model_node->load_link);
+  else
+    {
+      g_queue_delete_link(&priv->loading, model_node->load_link);
+      priv->n_loading[model_node->load_priority]--;
+      load_device_add(priv, model_node->load_device, -1);
+      model_node->load_device = NULL;
+      load_queue_schedule(model_node->model);
+    }
+
+  model_node->load_link = NULL;
+  model_node->load_queued = FALSE;
+}
+
+/* Moves a waiting or running load of NODE to PRIORITY */
+static void
+load_set_priority(GNode *node, LoadPriority priority)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileSystemModelPrivate *priv;
+
+  if (model_node->load_link == NULL
+      || model_node->load_priority == priority)
+    return;
+
+  priv = CAST_GET_PRIVATE(model_node->model);
+
+  if (model_node->load_queued)
+    {
+      load_forget(node);
+      load_queue_push(node, priority, TRUE);
+    }
+  else
+    {
+      priv->n_loading[model_node->load_priority]--;
+      priv->n_loading[priority]++;
+      model_node->load_priority = priority;
+      load_queue_schedule(model_node->model);
+    }
+}
+
+static void
+unlink_file_folder(GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  g_assert(model_node != NULL);
+
+  DEBUG_GFILE_URI("file %s model_node %p folder %p", model_node->file, model_node, model_node->folder);
+
+  /* The folder lists them again when linked */
+  model_node_clear_records(model_node);
+  load_forget(node);
+
+  if (model_node->cancellable)
+    {
+      DEBUG_GFILE_URI("CANCEL %s %p", model_node->file, model_node->cancellable);
+      g_cancellable_cancel (model_node->cancellable);
+      g_object_unref (model_node->cancellable);
+      model_node->cancellable = NULL;
+    }
+
+  if (model_node->folder)
+    {
+      g_object_set_qdata(G_OBJECT(model_node->folder),
+			 hildon_file_system_model_quark, NULL);
+      
+      g_signal_handlers_disconnect_by_func
+        (model_node->folder,
+         (gpointer) hildon_file_system_model_dir_removed,
+         model_node->model);
+      g_signal_handlers_disconnect_by_func
+        (model_node->folder,
+         (gpointer) hildon_file_system_model_files_added,
+         model_node->model);
+      g_signal_handlers_disconnect_by_func
+        (model_node->folder,
+         (gpointer) hildon_file_system_model_files_removed,
+         model_node->model);
+      g_signal_handlers_disconnect_by_func
+        (model_node->folder,
+         (gpointer) hildon_file_system_model_files_changed,
+         model_node->model);
+      g_signal_handlers_disconnect_by_func
+        (model_node->folder,
+         (gpointer) hildon_file_system_model_files_renamed,
+         model_node->model);
+      g_signal_handlers_disconnect_by_func
+        (model_node->folder,
+         (gpointer) hildon_file_system_model_folder_finished_loading,
+         model_node->model);
+
+      g_object_unref(model_node->folder);
+      model_node->folder = NULL;
+    }
+}
+
+static void
+free_handle_data (HandleData *handle_data)
+{
+    g_object_unref (handle_data->model);
+    g_slice_free (HandleData, handle_data);
+}
+
+static void
+get_folder_callback (GCancellable *cancellable,
+		     GtkFolder *folder,
+                     const GError *error,
+                     gpointer data)
+{
+  gboolean cancelled = g_cancellable_is_cancelled(cancellable);
+  HildonFileSystemModelNode *model_node;
+  HildonFileSystemModel *model;
+  HandleData *handle_data = (HandleData *) data;
+  GNode *node;
+
+  node = handle_data->node;
+  model_node = (HildonFileSystemModelNode *) node->data;
+
+  /* When the operation has been cancelled, handle_data->node is no
+     longer valid.
+   */
+  if (cancelled)
+    {
+      DEBUG_GFILE_URI ("LINK CANCELLED %s model_node %p\n", model_node->file, model_node);
+      free_handle_data (handle_data);
+      return;
+    }
+
+
+  model = model_node->model;
+
+  if (model_node->cancellable)
+    g_object_unref(model_node->cancellable);
+  model_node->cancellable = NULL;
+  model_node->folder = folder ? g_object_ref(folder) : NULL;
+  model_node->error = error ? g_error_copy (error) : NULL;
+  model_node->linking = FALSE;
+
+  if (folder == NULL)
+    {
+      WARN_GFILE_URI("Failed to create monitor for path %s", model_node->file);
+
+      if (model_node->error == NULL)
+	model_node->error = g_error_new (G_FILE_ERROR, G_FILE_ERROR_FAILED,
+					 "failure");
+    }
+
+  DEBUG_GFILE_URI ("LINK DONE %s %s model_node %p folder %p\n",
+       model_node->file, error ? error->message : "(success)",
+	   model_node, folder);
+
+  if (folder)
+      g_assert (GTK_IS_FOLDER (folder));
+
+  if (model_node->error)
+    {
+      handle_finished_node (node);
+      handle_load_error (node);
+      free_handle_data (handle_data);
+      return;
+    }
+
+  g_signal_connect_object
+    (model_node->folder, "deleted",
+     G_CALLBACK(hildon_file_system_model_dir_removed),
+     model, 0);
+
+  g_object_set_qdata (G_OBJECT(model_node->folder),
+                      hildon_file_system_model_quark, node);
+
+  g_signal_connect_object
+    (model_node->folder, "files-added",
+     G_CALLBACK(hildon_file_system_model_files_added),
+     model, 0);
+  g_signal_connect_object
+    (model_node->folder, "files-removed",
+     G_CALLBACK
+     (hildon_file_system_model_files_removed), model, 0);
+  g_signal_connect_object
+    (model_node->folder, "files-changed",
+     G_CALLBACK
+     (hildon_file_system_model_files_changed), model, 0);
+  g_signal_connect_object
+    (model_node->folder, "files-renamed",
+     G_CALLBACK
+     (hildon_file_system_model_files_renamed), model, 0);
+  g_signal_connect_object
+    (model_node->folder, "finished-loading",
+     G_CALLBACK (hildon_file_system_model_folder_finished_loading), model,
+     0);
+
+  /* The following has to be done last since it might do anything to
+     model_node, including loading it again.
+  */
+
+  if (gtk_file_folder_is_finished_loading (folder))
+    {
+      GSList *children = NULL;
+      gboolean result;
+
+      DEBUG_GFILE_URI ("LINK FINISHED %s", model_node->file);
+
+      result = gtk_file_folder_list_children(folder, &children,
+					     &(model_node->error));
+      if (result)
+        {
+	  hildon_file_system_model_files_added (model_node->folder,
+						children,
+						model);
+
+	  /* XXX - We assume that the root node has less than
+   	           MAX_BATCH entries and that has thus been added
+   	           completely now.
+	  */
+	  if (model_node->location
+	      && HILDON_IS_FILE_SYSTEM_ROOT (model_node->location))
+	    {
+	      model->priv->first_root_scan_completed = TRUE;
+	    }
+
+	  hildon_file_system_model_folder_finished_loading (model_node->folder,
+							    model);
+	  gtk_file_paths_free (children);
+	}
+      else
+	handle_load_error (node);
+    }
+
+  free_handle_data (handle_data);
+}
+
+/* Asks for the folder of NODE.  Called with the node unlinked. */
+static gboolean
+start_folder_load (GNode *node, LoadPriority priority)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileSystemModel *model = model_node->model;
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  HandleData *handle_data;
+
+  DEBUG_GFILE_URI ("LINK %s", model_node->file);
+
+  /* hold a reference to the model, it will be released
+   * when the get_folder operation has finished
+   */
+  handle_data = g_slice_new (HandleData);
+  handle_data->model = g_object_ref (model);
+  handle_data->node = node;
+
+  if (model_node->location)
+    {
+      model_node->cancellable =
+	  hildon_file_system_special_location_get_folder(
+	    model_node->location,
+	    priv->filesystem,
+	    model_node->file, "*",
+	    get_folder_callback, handle_data);
+    }
+  else
+    {
+      model_node->cancellable =
+        gtk_file_system_get_folder (priv->filesystem,
+				    model_node->file, "*",
+                                    get_folder_callback, handle_data);
+    }
+
+  if (model_node->cancellable == NULL)
+    {
+      model_node->linking = FALSE;
+      free_handle_data (handle_data);
+      return FALSE;
+    }
+
+  g_queue_push_tail (&priv->loading, node);
+  model_node->load_link = priv->loading.tail;
+  model_node->load_priority = priority;
+  priv->n_loading[priority]++;
+  model_node->load_device = node_get_load_device (node);
+  load_device_add (priv, model_node->load_device, 1);
+
+  g_clear_error (&(model_node->error));
+  return TRUE;
+}
+
+static gboolean
+load_queue_idle (gpointer data)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(data);
+  LoadPriority priority;
+
+  priv->load_idle_id = 0;
+
+  for (priority = LOAD_PRIORITY_CURRENT; priority < N_LOAD_PRIORITIES;
+       priority++)
+    {
+      GQueue *queue = &priv->load_queue[priority];
+      GList *link;
+
+      /* Speculative loads wait until the current folder is loaded */
+      if (priority == LOAD_PRIORITY_SPECULATIVE
+	  && priv->n_loading[LOAD_PRIORITY_CURRENT] > 0)
+	break;
+
+      /* Folders of a device start in the order they were asked for,
+	 but a full device does not hold up the others */
+      link = queue->head;
+      while (link)
+	{
+	  GNode *node = link->data;
+	  HildonFileSystemModelNode *model_node = node->data;
+
+	  link = link->next;
+
+	  if (load_device_is_full (priv, node_get_load_device (node)))
+	    continue;
+
+	  g_queue_delete_link (queue, model_node->load_link);
+	  model_node->load_link = NULL;
+	  model_node->load_queued = FALSE;
+	  start_folder_load (node, priority);
+	}
+    }
+
+  return FALSE;
+}
+
+/* Loads the children of NODE.  PRIORITY decides how long the load
+   may wait for a free slot, current loads start right away.  Returns
+   FALSE if the folder could not be asked for. */
+static gboolean
+link_file_folder (GNode *node, GFile *file, LoadPriority priority)
+{
+  HildonFileSystemModel *model;
+  HildonFileSystemModelNode *model_node;
+  HildonFileSystemModelPrivate *priv;
+  GNode *child_node;
+
+  g_assert(node != NULL && file != NULL);
+  model_node = node->data;
+  g_assert(model_node != NULL);
+
+  DEBUG_GFILE_URI ("check %s model_node %p folder %p cancellable %p",
+		   model_node->file, model_node, model_node->folder, model_node->cancellable);
+
+  model = model_node->model;
+  g_assert(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  priv = CAST_GET_PRIVATE(model);
+
+  if (node == priv->current_folder)
+    priority = LOAD_PRIORITY_CURRENT;
+
+  /* Already waiting, but maybe more urgent now.
+   */
+  if (model_node->load_queued)
+    {
+      if (priority == LOAD_PRIORITY_CURRENT)
+	{
+	  load_forget (node);
+	  return start_folder_load (node, priority);
+	}
+
+      if (priority < model_node->load_priority)
+	load_set_priority (node, priority);
+
+      return TRUE;
+    }
+
+  /* Folder already exists or we have already asked for it.
+   */
+  if (model_node->folder || model_node->cancellable)
+    {
+      if (priority < model_node->load_priority)
+	load_set_priority (node, priority);
+
+      return TRUE;
+    }
+
+  model_node->load_time = time(NULL);
+  model_node->linking = TRUE;
+
+  if (!model_node->file)
+    model_node->file = g_object_ref(file);
+
+  /* Reset the present_flags.
+   */
+  child_node = g_node_first_child(node);
+  while (child_node)
+    {
+      HildonFileSystemModelNode *n = child_node->data;
+
+      DEBUG_GFILE_URI("%s node %p present_flag = FALSE", n->file, n);
+      n->present_flag = FALSE;
+      child_node = g_node_next_sibling(child_node);
+    }
+
+  if (priority != LOAD_PRIORITY_CURRENT
+      && (load_device_is_full (priv, node_get_load_device (node))
+	  || (priority == LOAD_PRIORITY_SPECULATIVE
+	      && priv->n_loading[LOAD_PRIORITY_CURRENT] > 0)))
+    {
+      DEBUG_GFILE_URI ("QUEUE %s", model_node->file);
+      load_queue_push (node, priority, FALSE);
+      return TRUE;
+    }
+
+  return start_folder_load (node, priority);
+}
+
+/* Cuts NODE off from everything that could still reach it: the
+   model's node sets, its folder, location and thumbnail request.  The
+   memory is released later by free_model_node(). */
+static gboolean hildon_file_system_model_detach_model_node(GNode * node,
+                                                          gpointer data)
+{
+    HildonFileSystemModelNode *model_node = node->data;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(data);
+
+    g_hash_table_remove(priv->changed_nodes, node);
+    g_hash_table_remove(priv->unavailable_nodes, node);
+    g_hash_table_remove(priv->name_index_nodes, node);
+
+    if (priv->current_folder == node)
+      priv->current_folder = NULL;
+
+    if (model_node)
+    {
+      DEBUG_GFILE_URI("Remove [%s]", model_node->file);
+
+      unlink_file_folder(node);
+      thumbnail_forget(model_node);
+      thumbnail_release(model_node);
+      sort_key_job_detach(model_node);
+
+      /* The views that windowed the folder cannot undo it any more */
+      if (model_node->window_users > 0)
+        priv->windowed_folders--;
+
+      if (model_node->location) {
+          /* We don't want to save the actual ID:s, since that would
+             needlessly increase the memory consumption by 2 ints per item.
+             Ensure that all expected handlers were disconnected. */
+          gint check = g_signal_handlers_disconnect_matched(
+            model_node->location, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, node);
+          g_assert(check == 3);
+          g_hash_table_remove(priv->location_nodes, node);
+      }
+    }
+
+    return FALSE;
+}
+
+static void free_model_node(HildonFileSystemModelNode *model_node)
+{
+    g_object_unref (model_node->file);
+
+    if (model_node->info)
+      g_object_unref (model_node->info);
+
+    g_clear_error(&model_node->error);
+    clear_model_node_caches(model_node);
+
+    if (model_node->sorted_children)
+      g_ptr_array_free(model_node->sorted_children, TRUE);
+    if (model_node->folder_children)
+      g_ptr_array_free(model_node->folder_children, TRUE);
+    if (model_node->location)
+      g_object_unref(model_node->location);
+
+    g_free(model_node);
+}
+
+/* Frees up to MAX nodes of the kicked subtrees, a node at a time so
+   that a huge folder does not have to go in one go.  Returns TRUE if
+   some are left. */
+static gboolean
+free_dead_nodes(HildonFileSystemModelPrivate *priv, guint max)
+{
+  while (max-- > 0)
+  {
+    GNode *node = g_queue_pop_head(&priv->dead_nodes);
+
+    if (node == NULL)
+      return FALSE;
+
+    while (node->children)
+    {
+      GNode *child = node->children;
+
+      g_node_unlink(child);
+      g_queue_push_tail(&priv->dead_nodes, child);
+    }
+
+    if (node->data)
+      free_model_node(node->data);
+    g_node_destroy(node);
+  }
+
+  return !g_queue_is_empty(&priv->dead_nodes);
+}
+
+static gboolean
+free_dead_nodes_idle(gpointer data)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(data);
+
+  if (free_dead_nodes(priv, DEAD_NODES_PER_IDLE))
+    return TRUE;
+
+  priv->dead_nodes_idle_id = 0;
+  return FALSE;
+}
+
+/* Detaches NODE, which has already been unlinked from the tree, and
+   queues it to be freed */
+static void
+bury_node(HildonFileSystemModel *model, GNode *node)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+
+  g_node_traverse(node, G_POST_ORDER, G_TRAVERSE_ALL,
+      -1, hildon_file_system_model_detach_model_node, model);
+
+  g_queue_push_tail(&priv->dead_nodes, node);
+
+  if (priv->dead_nodes_idle_id == 0)
+    priv->dead_nodes_idle_id = g_idle_add(free_dead_nodes_idle, model);
+}
+
+/* Kicks off the node and all the children. Both GNodes and ModelNodes.
+    returns the next sibling of the deleted node */
+static GNode *
+hildon_file_system_model_kick_node(GNode *node, gpointer data)
+{
+  HildonFileSystemModelPrivate *priv;
+  GNode *parent_node;
+  GNode *destroy_node = node;
+
+  GtkTreePath *tree_path;
+  GtkTreeIter iter;
+
+  priv = CAST_GET_PRIVATE(data);
+
+  g_assert(node != NULL && (node->parent != NULL || node == priv->roots));
+
+  iter.stamp = priv->stamp;
+  iter.user_data = destroy_node;
+  tree_path =
+        hildon_file_system_model_get_path(GTK_TREE_MODEL(data), &iter);
+
+  priv->rows_serial++;
+  gtk_tree_model_row_deleted(GTK_TREE_MODEL(data), tree_path);
+  gtk_tree_path_free(tree_path);
+
+  parent_node = node->parent;
+  node = g_node_next_sibling(node);
+
+  if (parent_node && FOLDER_LISTED(destroy_node))
+    folder_list_remove(*folder_list_slot(priv, parent_node), destroy_node);
+
+  if (parent_node && parent_node->data &&
+      ((HildonFileSystemModelNode *) parent_node->data)->sorted_children)
+    g_ptr_array_remove(
+      ((HildonFileSystemModelNode *) parent_node->data)->sorted_children,
+      destroy_node);
+
+  g_node_unlink(destroy_node);
+  bury_node(HILDON_FILE_SYSTEM_MODEL(data), destroy_node);
+
+  if (parent_node && parent_node != priv->roots && parent_node->children ==NULL)
+    hildon_file_system_model_send_has_child_toggled( GTK_TREE_MODEL(data),
+                                                     parent_node);
+
+  return node;
+}
+
+/* Kicks off all the children of NODE at once.  The rows are deleted
+   from the last one, so that the path needs to be computed only once
+   and neither the model nor the views have to shift the rows that
+   follow.  The subtrees are freed later, see bury_node(). */
+static void
+hildon_file_system_model_kick_children(GNode *node, gpointer data)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(data);
+  HildonFileSystemModelNode *model_node = node->data;
+  GPtrArray **folders;
+  GNode *child, *prev;
+  GtkTreePath *tree_path;
+  GtkTreeIter iter;
+  gint *indices, depth;
+
+  if (node->children == NULL)
+    return;
+
+  iter.stamp = priv->stamp;
+  iter.user_data = node;
+  tree_path =
+        hildon_file_system_model_get_path(GTK_TREE_MODEL(data), &iter);
+  gtk_tree_path_append_index(tree_path, g_node_n_children(node));
+  indices = gtk_tree_path_get_indices(tree_path);
+  depth = gtk_tree_path_get_depth(tree_path);
+
+  priv->rows_serial++;
+
+  /* Made again from the remaining children if needed */
+  if (model_node && model_node->sorted_children)
+  {
+    g_ptr_array_free(model_node->sorted_children, TRUE);
+    model_node->sorted_children = NULL;
+  }
+
+  folders = folder_list_slot(priv, node);
+
+  for (child = g_node_last_child(node); child; child = prev)
+  {
+    prev = child->prev;
+    indices[depth - 1]--;
+    gtk_tree_model_row_deleted(GTK_TREE_MODEL(data), tree_path);
+
+    /* The folder list is in row order, so this is its last entry */
+    if (FOLDER_LISTED(child))
+    {
+      if ((*folders)->len > 0 &&
+          g_ptr_array_index(*folders, (*folders)->len - 1) == child)
+      {
+        g_ptr_array_remove_index(*folders, (*folders)->len - 1);
+        FOLDER_LISTED(child) = FALSE;
+      }
+      else
+        folder_list_remove(*folders, child);
+    }
+
+    g_node_unlink(child);
+    bury_node(HILDON_FILE_SYSTEM_MODEL(data), child);
+  }
+
+  gtk_tree_path_free(tree_path);
+
+  if (node != priv->roots)
+    hildon_file_system_model_send_has_child_toggled(GTK_TREE_MODEL(data),
+                                                    node);
+}
+
+static void notify_volumes_changed(GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileSystemVoldev *voldev = NULL;
+
+  hildon_file_system_special_location_volumes_changed(model_node->location);
+
+  /* check if the special location is voldev */
+  if (HILDON_IS_FILE_SYSTEM_VOLDEV(model_node->location))
+    {
+      if (!model_node->model)
+	g_warning("hildon tree model is NULL");
+      else
+	{
+	  voldev = HILDON_FILE_SYSTEM_VOLDEV (model_node->location);
+
+	  /* The voldev has just looked up its mount in
+	     volumes_changed, no need to block on doing it again. */
+	  if (((voldev->vol_type == EXT_CARD) ||
+	       (voldev->vol_type == USB_STORAGE) ||
+	       (voldev->vol_type == INT_CARD)) &&
+	      voldev->mount != NULL)
+	    {
+	      if (hildon_file_system_voldev_is_visible(model_node->location, FALSE) == TRUE)
+		{
+		  g_signal_emit(model_node->model, signals[VOLDEV_MOUNTED],
+				0, model_node->location->basepath);
+		}
+	    }
+	}
+    }
+}
+
+static void real_volumes_changed(GtkFileSystem *fs, gpointer data)
+{
+    HildonFileSystemModel *model;
+    HildonFileSystemModelPrivate *priv;
+    GList *nodes, *l;
+
+    model = HILDON_FILE_SYSTEM_MODEL (data);
+    priv = CAST_GET_PRIVATE(model);
+
+    /* The signal doesn't tell which volume changed, so every location
+       is told.  Handlers may kick location nodes, so work on a copy
+       and skip the nodes that are gone. */
+    nodes = g_hash_table_get_keys(priv->location_nodes);
+
+    for (l = nodes; l; l = l->next)
+      if (g_hash_table_lookup(priv->location_nodes, l->data))
+        notify_volumes_changed(l->data);
+
+    g_list_free(nodes);
+
+    if (priv->name_index)
+      name_index_update_roots(model);
+}
+
+static GNode *
+hildon_file_system_model_add_node (GtkTreeModel * model,
+				   GNode * parent_node,
+				   GtkFolder *parent_folder,
+				   GFile *file,
+                                   gboolean with_search)
+{
+    GNode *node;
+    HildonFileSystemModelPrivate *priv;
+    HildonFileSystemModelNode *parent_model_node, *model_node;
+    GFileInfo *file_info = NULL;
+    GtkTreePath *tree_path;
+    GtkTreeIter iter;
+    GFile *real_file;
+
+    /* Path can be NULL for removable devices that are not present */
+    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), NULL);
+    g_return_val_if_fail(parent_node != NULL, NULL);
+    g_return_val_if_fail(file != NULL, NULL);
+
+    priv = CAST_GET_PRIVATE(model);
+
+    parent_model_node = parent_node->data ? parent_node->data : NULL;
+
+    if (parent_model_node && parent_model_node->location)
+      real_file =
+	hildon_file_system_special_location_rewrite_path (parent_model_node->location,
+							  priv->filesystem,
+							  file);
+    else
+      real_file = g_object_ref (file);
+
+    DEBUG_GFILE_URI ("Adding %s", file);
+    DEBUG_GFILE_URI ("-> (%s)", real_file);
+
+    if (parent_folder) {
+        /* This can cause main loop execution on vfs backend */
+
+	/* We need to use PATH instead of REAL_PATH here since
+	   PARENT_FOLDER only knows about the original paths.
+	*/
+
+      /* If we have received the path that we are adding by some other
+         means than listing the folder (like via some API function),
+         then the backend will send us "files-added" signal immediately
+         after we first time use it. This is *not good*, because it
+         places "garbage list" info processing queue and rest of
+         the model believes that model is loading. See bug #14040. */
+	g_signal_handlers_block_by_func(parent_folder,
+	  hildon_file_system_model_files_added, model);
+	file_info = gtk_file_folder_get_info(parent_folder, file);
+	g_signal_handlers_unblock_by_func(parent_folder,
+	  hildon_file_system_model_files_added, model);
+
+        /* If file is created and then renamed it can happen that file
+         * with this name no longer exists. */
+	if (!file_info)
+        {
+	  g_debug ("ADD ERR");
+	  g_object_unref (real_file);
+          return NULL;
+        }
+
+        g_assert(file_info != NULL);
+    }
+
+    /* First check if this item is already part of the model */
+    if (with_search)
+    {
+      node =
+        hildon_file_system_model_search_path_internal (parent_node,
+						       real_file, FALSE);
+
+        if (node) {
+            HildonFileSystemModelNode *model_node = node->data;
+            g_assert(model_node);
+            model_node->present_flag = TRUE;
+	    if (model_node->info)
+	      g_object_unref (model_node->info);
+	    model_node->info = file_info;
+	    model_node_update_row_flags(model_node);
+	    reposition_node(HILDON_FILE_SYSTEM_MODEL(model), node);
+	    g_object_unref (real_file);
+            return node;
+        }
+    }
+
+    model_node = g_new0(HildonFileSystemModelNode, 1);
+    model_node->info = file_info;
+    model_node->model = HILDON_FILE_SYSTEM_MODEL(model);
+    model_node->serial = priv->node_serial++;
+    model_node->present_flag = TRUE;
+    model_node->available = TRUE;
+    model_node->file = real_file;
+
+    node = g_node_new(model_node);
+    g_node_append(parent_node, node);
+
+    if (!parent_folder
+	|| (file_info && _gtk_file_info_consider_as_directory(file_info))
+	|| g_file_has_uri_scheme (file, "obex:///"))
+    {
+        model_node->location =
+	    _hildon_file_system_get_special_location(real_file);
+        setup_node_for_location(node);
+    }
+
+    /* The following should be replaced by appending the functionality into
+       GtkFileInfo, but this requires API changes into gtkfilesystem.h,
+       gtkfilesystemunix.h and gtkfilesystemgnomevfs.h (as well as into
+       memory backend). Currently we can handle only local files, but
+       that's better than nothing... */
+    if (!model_node->location)
+    {
+      gchar *local_path = g_file_get_path(real_file);
+
+      if (local_path)
+      {
+        if (access(local_path, R_OK) != 0)
+        {
+          GFileError code = g_file_error_from_errno(errno);
+          if (code == G_FILE_ERROR_ACCES)
+          {
+            g_set_error(&model_node->error, G_FILE_ERROR, code,
+                        "%s", local_path);
+          }
+        }
+	g_free (local_path);
+      }
+    }
+
+    model_node_update_row_flags(model_node);
+    place_new_node(priv, node);
+    sync_folder_list(priv, node);
+
+    if (parent_folder)
+      queue_sort_key_job (priv, node);
+
+    /* We need to report first that new like has been inserted */
+
+    iter.stamp = priv->stamp;
+    iter.user_data = node;
+    tree_path = hildon_file_system_model_get_path(model, &iter);
+    priv->rows_serial++;
+    gtk_tree_model_row_inserted(model, tree_path, &iter);
+    gtk_tree_path_free(tree_path);
+
+    if (/* g_node_n_children(parent_node) <= 1 */ g_node_nth_child (parent_node, 1) == NULL /* means - no second child, should work faster */ &&
+        parent_node != priv->roots) {
+        /* Don't emit signals for fake root */
+        hildon_file_system_model_send_has_child_toggled(model,
+                                                        parent_node);
+    }
+
+    return node;
+}
+
+/* The caches that depend on the name of the file only */
+static void
+clear_model_node_name_caches(HildonFileSystemModelNode *model_node)
+{
+  g_free(model_node->display_text);
+  model_node->display_text = NULL;
+  g_free(model_node->display_search_cache);
+  model_node->display_search_cache = NULL;
+  pango_attr_list_unref(model_node->display_attrs);
+  model_node->display_attrs = NULL;
+
+  g_free(model_node->title_cache);
+  g_free(model_node->name_cache);
+  g_free(model_node->key_cache);
+  g_free(model_node->search_cache);
+  model_node->title_cache = NULL;
+  model_node->key_cache = NULL;
+  model_node->name_cache = NULL;
+  model_node->search_cache = NULL;
+  sort_key_job_detach(model_node);
+}
+
+static void
+clear_model_node_caches(HildonFileSystemModelNode *model_node)
+{
+  if (model_node->icon_cache)
+  {
+    g_object_unref(model_node->icon_cache);
+    model_node->icon_cache = NULL;
+  }
+  if (model_node->icon_cache_expanded)
+  {
+    g_object_unref(model_node->icon_cache_expanded);
+    model_node->icon_cache_expanded = NULL;
+  }
+  if (model_node->icon_cache_collapsed)
+  {
+    g_object_unref(model_node->icon_cache_collapsed);
+    model_node->icon_cache_collapsed = NULL;
+  }
+  thumbnail_forget(model_node);
+  thumbnail_release(model_node);
+
+  clear_model_node_name_caches(model_node);
+
+  if(model_node->thumb_title)
+  {
+    g_free(model_node->thumb_title);
+    model_node->thumb_title = NULL;
+  }
+  if(model_node->thumb_author)
+  {
+    g_free(model_node->thumb_author);
+    model_node->thumb_author = NULL;
+  }
+  if(model_node->thumb_album)
+  {
+    g_free(model_node->thumb_album);
+    model_node->thumb_album = NULL;
+  }
+}
+
+static void hildon_file_system_model_remove_node_list(GtkTreeModel * model,
+                                                      GNode * parent_node,
+                                                      GSList * children)
+{
+    GNode *child_node = g_node_first_child(parent_node);
+    HildonFileSystemModelNode *parent_model_node = parent_node->data;
+    GSList *l;
+
+    if (parent_model_node && parent_model_node->records)
+      for (l = children; l; l = l->next)
+      {
+        ChildRecord *record = child_records_lookup(parent_node, l->data);
+
+        if (record)
+        {
+          child_records_steal(parent_model_node->records, record);
+          child_record_free(record);
+        }
+      }
+
+    while (child_node)
+      {
+        HildonFileSystemModelNode *model_node = child_node->data;
+
+	if (g_slist_find_custom (children, model_node->file, path_compare_helper))
+	    child_node = hildon_file_system_model_kick_node (child_node, model);
+        else
+	    child_node = g_node_next_sibling (child_node);
+      }
+}
+
+static void hildon_file_system_model_change_node_list(GtkTreeModel * model,
+                                                      GNode * parent_node,
+						      GtkFolder *
+                                                      folder,
+                                                      GSList * children)
+{
+    GNode *node;
+    HildonFileSystemModelNode *parent_model_node;
+    GSList *l;
+
+    g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+    g_return_if_fail(parent_node != NULL);
+    g_return_if_fail(GTK_IS_FOLDER(folder));
+    g_return_if_fail(children != NULL);
+
+    parent_model_node = parent_node->data;
+    if (parent_model_node && parent_model_node->records)
+      for (l = children; l; l = l->next)
+      {
+        ChildRecord *record = child_records_lookup(parent_node, l->data);
+
+        if (record)
+          child_record_refresh(parent_model_node->records, record, folder);
+      }
+
+    for (node = g_node_first_child(parent_node); node;
+	 node = g_node_next_sibling(node))
+      {
+        HildonFileSystemModelNode *model_node = node->data;
+
+	if (g_slist_find_custom (children, model_node->file, path_compare_helper))
+	  {
+	    DEBUG_GFILE_URI("Path changed [%s]", model_node->file);
+
+            /* Ok, current node is updated. We need to refresh it and send
+               needed signals. Visible information of special nodes is not going to change */
+
+            clear_model_node_caches(model_node);
+
+            if (model_node->info && !model_node->location)
+            {
+	      g_object_unref(model_node->info);
+
+              model_node->info =
+		gtk_file_folder_get_info(folder, model_node->file);
+              model_node_update_row_flags(model_node);
+              reposition_node(HILDON_FILE_SYSTEM_MODEL(model), node);
+            }
+
+            emit_node_changed(node);
+        }
+    }
+}
+
+/* Gives NODE the new name of its file.  The thumbnail and the icons
+   stay, since the contents of the file did not change.  A folder that
+   has been loaded drops its children and is listed again from the new
+   location, their files and its GtkFolder still point to the old one. */
+static void hildon_file_system_model_rename_node(GtkTreeModel * model,
+                                                 GNode * node,
+                                                 GtkFolder * folder,
+                                                 GFile * file)
+{
+    HildonFileSystemModelNode *model_node = node->data;
+    GFileInfo *info;
+
+    DEBUG_GFILE_URI("Path renamed [%s]", file);
+
+    info = gtk_file_folder_get_info(folder, file);
+
+    if (info && model_node->info &&
+        g_strcmp0(g_file_info_get_content_type(info),
+                  g_file_info_get_content_type(model_node->info)) != 0)
+      clear_model_node_caches(model_node);
+    else
+      clear_model_node_name_caches(model_node);
+
+    g_object_unref(model_node->file);
+    model_node->file = g_object_ref(file);
+
+    if (info)
+    {
+      if (model_node->info)
+        g_object_unref(model_node->info);
+      model_node->info = info;
+    }
+
+    model_node_update_row_flags(model_node);
+    reposition_node(HILDON_FILE_SYSTEM_MODEL(model), node);
+    emit_node_changed(node);
+
+    if (model_node->folder || model_node->cancellable)
+    {
+      hildon_file_system_model_kick_children(node, model);
+      unlink_file_folder(node);
+      link_file_folder(node, model_node->file, LOAD_PRIORITY_VISIBLE);
+    }
+}
+
+static void wait_node_load(HildonFileSystemModelPrivate * priv,
+                           GNode * node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+
+  if (model_node->folder
+      || model_node->cancellable)   /* Sanity check: node has to
+					     be a folder */
+  {
+    g_debug("Waiting folder [%s] to load", (char *) model_node->file);
+    while (!is_node_loaded(node))
+    {
+        g_usleep(2000); /* microseconds */
+        if (gtk_events_pending())       /* Don't do while here, because
+                                           there can be enormous amount of
+                                           events waiting */
+            gtk_main_iteration();
+    }
+    DEBUG_GFILE_URI("Folder [%s] loaded", model_node->file);
+  }
+}
+
+static void hildon_file_system_model_init(HildonFileSystemModel * self)
+{
+    HildonFileSystemModelPrivate *priv;
+
+    priv =
+        G_TYPE_INSTANCE_GET_PRIVATE(self, HILDON_TYPE_FILE_SYSTEM_MODEL,
+                                    HildonFileSystemModelPrivate);
+    self->priv = (gpointer) priv;
+
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_GTK_PATH_INTERNAL] =
+	G_TYPE_FILE;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_LOCAL_PATH] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_URI] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_DISPLAY_NAME] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_SIZE] =
+        G_TYPE_INT64;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_TIME] =
+        G_TYPE_INT64;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER] =
+        G_TYPE_BOOLEAN;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_READONLY] =
+        G_TYPE_BOOLEAN;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE] =
+        G_TYPE_BOOLEAN;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH] =
+        G_TYPE_BOOLEAN;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_TYPE] = G_TYPE_INT;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON] =
+        GDK_TYPE_PIXBUF;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_EXPANDED] =
+        GDK_TYPE_PIXBUF;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ICON_COLLAPSED] =
+        GDK_TYPE_PIXBUF;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_THUMBNAIL] =
+        GDK_TYPE_PIXBUF;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY] =
+        G_TYPE_BOOLEAN;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FREE_SPACE] =
+        G_TYPE_INT64;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_TITLE] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_AUTHOR] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_ALBUM] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_HIDDEN] =
+        G_TYPE_BOOLEAN;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_UNAVAILABLE_REASON] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_FAILED_ACCESS_MESSAGE] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT] =
+        G_TYPE_INT;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_EXTRA_INFO] =
+        G_TYPE_STRING;
+    priv->column_types[HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_DRIVE] =
+        G_TYPE_BOOLEAN;
+    priv->column_types[PRIV_COLUMN_DISPLAY_TEXT] =
+	G_TYPE_STRING;
+    priv->column_types[PRIV_COLUMN_DISPLAY_ATTRS] =
+        PANGO_TYPE_ATTR_LIST;
+    priv->column_types[PRIV_COLUMN_SEARCH_NAME] =
+	G_TYPE_STRING;
+#ifdef UPSTREAM_DISABLED
+    priv->tracker_client = tracker_connect(FALSE);
+#endif
+    priv->hour24_changed_handler = g_signal_connect_swapped(_hildon_file_system_settings_get_instance(),
+							    "notify::hour24",
+							    G_CALLBACK(hour24_changed),
+							    self);
+    /* The setting may have changed while no model was listening */
+    date_cache.hour24 = -1;
+    priv->display_attrs_cache =
+      g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+			    (GDestroyNotify) pango_attr_list_unref);
+    priv->changed_nodes = g_hash_table_new(NULL, NULL);
+    priv->unavailable_nodes = g_hash_table_new(NULL, NULL);
+    priv->name_index_nodes = g_hash_table_new(NULL, NULL);
+    priv->location_nodes = g_hash_table_new(NULL, NULL);
+    priv->device_loads = g_hash_table_new(NULL, NULL);
+    priv->max_device_loads = MAX_DEVICE_LOADS;
+    priv->display_epoch = 1;
+    priv->stamp = g_random_int();
+    priv->first_root_scan_completed = FALSE;
+}
+
+static void hildon_file_system_model_dispose(GObject *self)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(self);
+
+  if (priv->ref_widget)
+  {
+    g_signal_handler_disconnect(priv->ref_widget, priv->style_changed_handler);
+    g_object_unref(priv->ref_widget);
+    priv->ref_widget = NULL;
+  }
+  if (priv->hour24_changed_handler)
+    {
+      g_signal_handler_disconnect(_hildon_file_system_settings_get_instance(),
+				  priv->hour24_changed_handler);
+      priv->hour24_changed_handler = 0;
+    }
+  if (priv->timeout_id)
+  {
+    g_source_remove(priv->timeout_id);
+    priv->timeout_id = 0;
+  }
+  /* Pending searches hold a reference to us, so there are none */
+  if (priv->name_index_id)
+  {
+    g_source_remove(priv->name_index_id);
+    priv->name_index_id = 0;
+  }
+  if (priv->name_index)
+  {
+    _hildon_file_name_index_free(priv->name_index);
+    priv->name_index = NULL;
+  }
+  /* This won't work in finalize (removing nodes sends signals) */
+  if (priv->roots)
+  {
+    hildon_file_system_model_kick_node(priv->roots, self);
+    priv->roots = NULL;
+  }
+  free_dead_nodes(priv, G_MAXUINT);
+  if (priv->dead_nodes_idle_id)
+  {
+    g_source_remove(priv->dead_nodes_idle_id);
+    priv->dead_nodes_idle_id = 0;
+  }
+  if (priv->root_folder_children)
+  {
+    g_ptr_array_free(priv->root_folder_children, TRUE);
+    priv->root_folder_children = NULL;
+  }
+  if (priv->changed_idle_id)
+  {
+    g_source_remove(priv->changed_idle_id);
+    priv->changed_idle_id = 0;
+  }
+  if (priv->load_idle_id)
+  {
+    g_source_remove(priv->load_idle_id);
+    priv->load_idle_id = 0;
+  }
+  /* The nodes of the jobs that were never handed to the worker have
+     been detached from them above */
+  if (priv->key_jobs_idle_id)
+  {
+    g_source_remove(priv->key_jobs_idle_id);
+    priv->key_jobs_idle_id = 0;
+  }
+  if (priv->key_jobs)
+  {
+    g_ptr_array_foreach(priv->key_jobs, (GFunc) sort_key_job_free, NULL);
+    g_ptr_array_free(priv->key_jobs, TRUE);
+    priv->key_jobs = NULL;
+  }
+#ifdef UPSTREAM_DISABLED
+  if (priv->tracker_client)
+  {
+      tracker_disconnect(priv->tracker_client);
+      priv->tracker_client = NULL;
+  }
+#endif
+  G_OBJECT_CLASS(hildon_file_system_model_parent_class)->dispose(self);
+}
+
+static void hildon_file_system_model_finalize(GObject * self)
+{
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(self);
+
+    g_free(priv->backend_name); /* No need to check NULL */
+    g_free(priv->alternative_root_dir);
+    g_hash_table_destroy(priv->display_attrs_cache);
+    g_hash_table_destroy(priv->changed_nodes);
+    g_hash_table_destroy(priv->unavailable_nodes);
+    g_hash_table_destroy(priv->name_index_nodes);
+    g_hash_table_destroy(priv->location_nodes);
+    g_hash_table_destroy(priv->device_loads);
+
+    /* Disconnecting filesystem volumes-changed signal */
+    if (g_signal_handler_is_connected (priv->filesystem,
+                                       priv->volumes_changed_handler))
+      g_signal_handler_disconnect (priv->filesystem,
+                                   priv->volumes_changed_handler);
+
+    g_debug("ref count = %d", G_OBJECT(priv->filesystem)->ref_count);
+    g_object_unref(priv->filesystem);
+
+    if (priv->expanded_emblem)
+      g_object_unref(priv->expanded_emblem);
+    if (priv->collapsed_emblem)
+      g_object_unref(priv->collapsed_emblem);
+
+    G_OBJECT_CLASS(hildon_file_system_model_parent_class)->finalize(self);
+}
+
+static void hildon_file_system_model_set_property(GObject * object,
+                                                  guint property_id,
+                                                  const GValue * value,
+                                                  GParamSpec * pspec)
+{
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(object);
+
+    switch (property_id) {
+    case PROP_BACKEND:
+        g_assert(priv->backend_name == NULL);   /* We come here exactly
+                                                   once */
+        priv->backend_name = g_value_dup_string(value);
+        break;
+    case PROP_BACKEND_OBJECT:
+        g_assert(priv->filesystem == NULL);
+        priv->filesystem = g_value_get_object(value);
+        if (priv->filesystem)
+          g_object_ref(priv->filesystem);
+        break;
+    case PROP_THUMBNAIL_CALLBACK:
+        g_warning("Setting thumbnail callback is depricated");
+        break;
+    case PROP_REF_WIDGET:
+        if (priv->ref_widget)
+            g_object_unref(priv->ref_widget);
+        priv->ref_widget = g_value_get_object(value);
+        if (priv->ref_widget) {
+            g_object_ref(priv->ref_widget);
+	    priv->style_changed_handler =
+	      g_signal_connect_swapped(priv->ref_widget, "notify::style",
+				       G_CALLBACK(style_changed), object);
+	}
+        break;
+    case PROP_ROOT_DIR:
+        g_assert(priv->alternative_root_dir == NULL);
+        priv->alternative_root_dir = g_value_dup_string(value);
+        break;
+    case PROP_MULTI_ROOT:
+        priv->multiroot = g_value_get_boolean(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+        break;
+    }
+}
+
+static void hildon_file_system_model_get_property(GObject * object,
+                                                  guint property_id,
+                                                  GValue * value,
+                                                  GParamSpec * pspec)
+{
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(object);
+
+    switch (property_id) {
+    case PROP_BACKEND:
+        g_value_set_string(value, priv->backend_name);
+        break;
+    case PROP_BACKEND_OBJECT:
+        g_value_set_object(value, priv->filesystem);
+        break;
+    case PROP_THUMBNAIL_CALLBACK:
+        g_warning("Getting thumbnail callback is depricated");
+        g_value_set_pointer(value, NULL);
+        break;
+    case PROP_REF_WIDGET:
+        g_value_set_object(value, priv->ref_widget);
+        break;
+    case PROP_ROOT_DIR:
+        g_value_set_string(value, priv->alternative_root_dir);
+        break;
+    case PROP_MULTI_ROOT:
+        g_value_set_boolean(value, priv->multiroot);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+        break;
+    }
+}
+
+static void hildon_file_system_model_class_init(HildonFileSystemModelClass
+                                                * klass)
+{
+    GObjectClass *object;
+
+    g_type_class_add_private(klass, sizeof(HildonFileSystemModelPrivate));
+
+    object = G_OBJECT_CLASS(klass);
+    object->constructor = hildon_file_system_model_constructor;
+    object->dispose = hildon_file_system_model_dispose;
+    object->finalize = hildon_file_system_model_finalize;
+    object->set_property = hildon_file_system_model_set_property;
+    object->get_property = hildon_file_system_model_get_property;
+    klass->device_disconnected =
+      hildon_file_system_model_real_device_disconnected;
+
+    g_object_class_install_property(object, PROP_BACKEND,
+        g_param_spec_string("backend",
+                            "HildonFileChooser backend",
+                            "Set GtkFileSystem backend to use",
+                            NULL,
+                            G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+
+    g_object_class_install_property(object, PROP_BACKEND_OBJECT,
+        g_param_spec_object("backend-object",
+                            "Backend object",
+                            "GtkFileSystem backend to use. Use this"
+                            "if you create backend yourself",
+                            GTK_TYPE_FILE_SYSTEM,
+                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object, PROP_THUMBNAIL_CALLBACK,
+        g_param_spec_pointer("thumbnail-callback",
+                             "Thumbnail creation callback",
+                             "This callback property is depricated",
+                             G_PARAM_READWRITE));
+
+    g_object_class_install_property(object, PROP_REF_WIDGET,
+        g_param_spec_object("ref-widget",
+                            "Refrence widget",
+                            "Any widget on the screen. Needed if "
+                            "you want icons.",
+                            GTK_TYPE_WIDGET,
+                            G_PARAM_READWRITE));
+
+    g_object_class_install_property(object, PROP_ROOT_DIR,
+        g_param_spec_string("root-dir",
+                            "Root directory",
+                            "Specify an alternative root directory. Note that"
+                            "gateway and MMCs appear ONLY if you leave"
+                            "this to default setting.", NULL,
+                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object, PROP_MULTI_ROOT,
+        g_param_spec_boolean("multi-root",
+                            "Multiple root directories",
+                            "When multiple root directories is enabled, "
+                            "each folder under root-dir "
+                            "(property) appear as a separate root level folder. "
+                            "The directory spesified by root-dir property is not "
+                            "displayed itself. This property has effect only when "
+                            "root-dir is set.", FALSE,
+                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    hildon_file_system_model_quark =
+        g_quark_from_static_string("HildonFileSystemModel Quark");
+
+    signals[FINISHED_LOADING] =
+        g_signal_new("finished-loading", G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(HildonFileSystemModelClass,
+                                     finished_loading), NULL, NULL,
+                     g_cclosure_marshal_VOID__BOXED, G_TYPE_NONE, 1, GTK_TYPE_TREE_ITER);
+
+    signals[DEVICE_DISCONNECTED] =
+        g_signal_new("device-disconnected", G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(HildonFileSystemModelClass,
+                                     device_disconnected), NULL, NULL,
+                     g_cclosure_marshal_VOID__BOXED, G_TYPE_NONE, 1,
+                     GTK_TYPE_TREE_ITER);
+
+    signals[VOLDEV_MOUNTED] =
+        g_signal_new("voldev-mounted", G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     0, NULL, NULL,
+                     g_cclosure_marshal_VOID__STRING, 
+                     G_TYPE_NONE, 1, G_TYPE_STRING);
+}
+
+/* We currently assume that all selectable rows can be dragged */
+static gboolean
+hildon_file_system_model_row_draggable(GtkTreeDragSource *source, GtkTreePath *path)
+{
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  gboolean draggable;
+
+  model = GTK_TREE_MODEL (source);
+  gtk_tree_model_get_iter (model, &iter, path);
+
+  gtk_tree_model_get(model, &iter,
+		     HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE,
+		     &draggable, -1);
+
+  return draggable;
+}
+
+static void hildon_file_system_model_iface_init(GtkTreeModelIface * iface)
+{
+    iface->get_flags = hildon_file_system_model_get_flags;
+    iface->get_n_columns = hildon_file_system_model_get_n_columns;
+    iface->get_column_type = hildon_file_system_model_get_column_type;
+    iface->get_iter = hildon_file_system_model_get_iter;
+    iface->get_path = hildon_file_system_model_get_path;
+    iface->get_value = hildon_file_system_model_get_value;
+    iface->iter_next = hildon_file_system_model_iter_next;
+    iface->iter_children = hildon_file_system_model_iter_children;
+    iface->iter_has_child = hildon_file_system_model_iter_has_child;
+    iface->iter_n_children = hildon_file_system_model_iter_n_children;
+    iface->iter_nth_child = hildon_file_system_model_iter_nth_child;
+    iface->iter_parent = hildon_file_system_model_iter_parent;
+}
+
+/* All bookkeeping related to DnD is in HildonFileSelection, since
+   GtkTreeDnD does not support dragging of multiple items. We only
+   use the interface because we want GtkTreeView to limit drag start
+   points to real rows (not empty space). */
+static void
+hildon_file_system_model_drag_source_iface_init(GtkTreeDragSourceIface *iface)
+{
+  iface->row_draggable = hildon_file_system_model_row_draggable;
+}
+
+static void
+location_changed(HildonFileSystemSpecialLocation *location, GNode *node)
+{
+    g_assert(HILDON_IS_FILE_SYSTEM_SPECIAL_LOCATION(location));
+    g_assert(node != NULL && node->data != NULL);
+
+    DEBUG_GFILE_URI ("LOCATION CHANGED: %s", location->basepath);
+
+    clear_model_node_caches(node->data);
+    model_node_update_row_flags(node->data);
+    reposition_node(MODEL_FROM_NODE(node), node);
+    emit_node_changed(node);
+}
+
+static void
+location_connection_state_changed(HildonFileSystemSpecialLocation *location,
+    GNode *node)
+{
+    HildonFileSystemModelNode *model_node;
+    GFile *file;
+
+    model_node = node->data;
+
+    g_assert(HILDON_IS_FILE_SYSTEM_SPECIAL_LOCATION(location));
+    g_assert(model_node != NULL);
+
+    file = _hildon_file_system_path_for_location(location);
+
+    if (file)
+      {
+        if (hildon_file_system_special_location_is_available(location))
+	  {
+	    g_debug("Location %s is now available", (char *) model_node->file);
+
+            if (!hildon_file_system_special_location_requires_access(location))
+		link_file_folder (node, model_node->file,
+				  LOAD_PRIORITY_SPECULATIVE);
+	  }
+	else
+	  {
+	    DEBUG_GFILE_URI("Location %s is no longer available",
+			    model_node->file);
+            send_device_disconnected(node);
+	  }
+
+        /* Ensure that the base path is updated */
+	g_object_unref (model_node->file);
+	model_node->file = file;
+	location_changed(location, node);
+      }
+    else
+      {
+	DEBUG_GFILE_URI("LOCATION %s FAILED => KICKING AWAY!!",
+			location->basepath);
+        hildon_file_system_model_kick_node(node, model_node->model);
+	g_object_unref (file);
+    }
+}
+
+static void
+location_rescan(HildonFileSystemSpecialLocation *location, GNode *node)
+{
+    HildonFileSystemModelNode *model_node;
+
+    g_assert(node != NULL && node->data != NULL);
+
+    model_node = node->data;
+    unlink_file_folder(node);
+    link_file_folder(node, model_node->file, LOAD_PRIORITY_SPECULATIVE);
+}
+
+static HildonFileSystemModelNode *
+create_model_node_for_location(HildonFileSystemModel *self,
+    HildonFileSystemSpecialLocation *location)
+{
+    HildonFileSystemModelNode *model_node = NULL;
+    GFile *file;
+
+    file = _hildon_file_system_path_for_location(location);
+
+    if (file) {
+	DEBUG_GFILE_URI ("BASE %s", location->basepath);
+	DEBUG_GFILE_URI ("PATH %s", file);
+
+        model_node = g_new0(HildonFileSystemModelNode, 1);
+	model_node->folder = NULL;
+        model_node->model = self;
+        model_node->serial = self->priv->node_serial++;
+        model_node->present_flag = TRUE;
+        model_node->available = TRUE;
+	model_node->file = file;
+        model_node->location = g_object_ref(location);
+
+        /* Let the location to initialize it's state */
+	hildon_file_system_special_location_volumes_changed(location);
+
+    } else {
+	DEBUG_GFILE_URI("BASE LOCATION: %s FAILED => SKIPPING",
+			location->basepath);
+    }
+
+    return model_node;
+}
+
+static void setup_node_for_location(GNode *node)
+{
+    HildonFileSystemModelNode *model_node;
+
+    g_assert(node != NULL);
+
+    if ((model_node = node->data) != NULL)
+    {
+        HildonFileSystemSpecialLocation *location;
+
+        if ((location = model_node->location) != NULL)
+        {
+            if (!hildon_file_system_special_location_requires_access(location) &&
+                hildon_file_system_special_location_is_available(location))
+	      link_file_folder(node, model_node->file,
+			       LOAD_PRIORITY_SPECULATIVE);
+
+	    if (location->basepath)
+	      {
+		if (model_node->file)
+		  g_object_unref (model_node->file);
+
+		model_node->file = g_object_ref (location->basepath);
+	      }
+
+            g_signal_connect(location, "changed",
+                G_CALLBACK(location_changed), node);
+            g_signal_connect(location, "connection-state",
+                G_CALLBACK(location_connection_state_changed), node);
+            g_signal_connect(location, "rescan",
+                G_CALLBACK(location_rescan), node);
+            g_hash_table_insert(model_node->model->priv->location_nodes,
+                                node, node);
+        }
+
+        model_node_update_row_flags(model_node);
+    }
+}
+/* Similar to g_node_copy_deep, but will also allow nodes to be skipped,
+   if they doesn't follow supported URI scheme */
+static GNode *my_copy_deep(GNode *node, gpointer data)
+{
+    GNode *result, *child, *new_child;
+    HildonFileSystemModelNode *model_node;
+    GFile *root;
+
+    g_assert(node != NULL);
+
+    /* the fakeroot in device model contains NULL */
+    if (node->data == NULL)
+      model_node = NULL;
+    else
+      {
+        model_node = create_model_node_for_location(data, node->data);
+        /* If generating the location was unsuccessfull, we skip the location */
+	if (model_node == NULL)
+	  return NULL;
+      }
+
+    result = g_node_new(model_node);
+
+    for (child = g_node_last_child (node); child; child = child->prev)
+      {
+        new_child = my_copy_deep(child, data);
+
+        if (new_child)
+	  g_node_prepend (result, new_child);
+      }
+    /* Let's setup parent after children, so that adding children do not
+       trigger premature "files-added" signals for parents. */
+
+    root = g_file_new_for_uri ("file:///");
+
+    if (!g_file_equal(HILDON_FILE_SYSTEM_SPECIAL_LOCATION(node->data)->basepath,
+		      root))
+      {
+        setup_node_for_location(result);
+      }
+    else
+      {
+	if(HILDON_IS_FILE_SYSTEM_ROOT(node->data))
+	  {
+            setup_node_for_location(result);
+        }
+	else if(HILDON_IS_FILE_SYSTEM_LOCAL_DEVICE(node->data))
+	  {
+            setup_node_for_location(result);
+        }
+	else
+	  {
+	    if (model_node->file)
+	      {
+		g_object_unref (model_node->file);
+		model_node->file = NULL;
+	      }
+
+	    model_node->file = g_object_ref (model_node->location->basepath);
+	    model_node_update_row_flags(model_node);
+	    g_signal_connect(model_node->location, "changed",
+                G_CALLBACK(location_changed), result);
+            g_signal_connect(model_node->location, "connection-state",
+                G_CALLBACK(location_connection_state_changed), result);
+            g_signal_connect(model_node->location, "rescan",
+                G_CALLBACK(location_rescan), result);
+            g_hash_table_insert(model_node->model->priv->location_nodes,
+                                result, result);
+	}
+    }
+
+    g_object_unref (root);
+
+    return result;
+}
+
+static GObject *
+hildon_file_system_model_constructor(GType type,
+                                     guint n_construct_properties,
+                                     GObjectConstructParam *
+                                     construct_properties)
+{
+  GObject *obj;
+  HildonFileSystemModelPrivate *priv;
+
+  obj = G_OBJECT_CLASS(hildon_file_system_model_parent_class)->
+	  constructor(type, n_construct_properties, construct_properties);
+  priv = CAST_GET_PRIVATE(obj);
+
+  if (!priv->filesystem)
+    priv->filesystem =
+	hildon_file_system_create_backend(priv->backend_name, TRUE);
+
+  if (priv->alternative_root_dir == NULL)
+    {
+      /* Let's use device tree as a base of our tree */
+      priv->roots =
+	  my_copy_deep(_hildon_file_system_get_locations(), obj);
+
+      priv->volumes_changed_handler =
+	  g_signal_connect_object(priv->filesystem,
+				  "volumes-changed",
+				  G_CALLBACK(real_volumes_changed),
+				  obj, 0);
+    }
+  else
+    {
+      GFile *file;
+
+      priv->roots = g_node_new(NULL);     /* This is a fake root that
+					   contains real ones */
+      g_debug("Alternative root = '%s'", priv->alternative_root_dir);
+
+      file = g_file_new_for_commandline_arg (priv->alternative_root_dir);
+
+      priv->first_root_scan_completed = TRUE;
+
+      if (priv->multiroot)
+	{
+	  HildonFileSystemModelNode *model_node;
+
+	  model_node = g_new0(HildonFileSystemModelNode, 1);
+	  model_node->folder = NULL;
+	  model_node->file = g_object_ref (file);
+	  model_node->available = TRUE;
+	  priv->roots->data = model_node;
+	  model_node->present_flag = TRUE;
+	  model_node->model = HILDON_FILE_SYSTEM_MODEL(obj);
+
+	  if (link_file_folder (priv->roots, model_node->file,
+				LOAD_PRIORITY_CURRENT))
+	    wait_node_load(priv, priv->roots);
+	}
+      else
+	{
+	  hildon_file_system_model_add_node(GTK_TREE_MODEL(obj), priv->roots,
+					    NULL, file, TRUE);
+	}
+
+      g_object_unref (file);
+    }
+
+  return obj;
+}
+
+/**
+ * hildon_file_system_model_search_local_path:
+ * @model: a #HildonFileSystemModel.
+ * @path: a #GtkFilePath to load.
+ * @iter: a #GtkTreeIter for the result.
+ * @start_iter: a #GtkTreeIter for starting point. %NULL for entire model.
+ * @recursive: if %FALSE, only immediate children of the parent are
+ *   searched. %TRUE searches the entire subtree.
+ *
+ * a wrapped for hildon_file_system_model_search_path that accepts local
+ *   paths.
+ *
+ * Returns: %TRUE, if the iterator points to desired file.
+ *          %FALSE otherwise.
+ */
+gboolean hildon_file_system_model_search_local_path(HildonFileSystemModel *
+                                                    model,
+                                                    const gchar * path,
+                                                    GtkTreeIter * iter,
+                                                    GtkTreeIter *
+                                                    start_iter,
+                                                    gboolean recursive)
+{
+    gboolean result;
+    GtkFilePath *filepath;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+
+    filepath = gtk_file_system_filename_to_path(priv->filesystem, path);
+    result =
+        hildon_file_system_model_search_path(model, filepath, iter,
+                                             start_iter, recursive);
+
+    gtk_file_path_free(filepath);
+    return result;
+}
+
+/**
+ * hildon_file_system_model_search_uri:
+ * @model: a #HildonFileSystemModel.
+ * @uri: a #GtkFilePath to load.
+ * @iter: a #GtkTreeIter for the result.
+ * @start_iter: a #GtkTreeIter for starting point. %NULL for entire model.
+ * @recursive: if %FALSE, only immediate children of the parent are
+ *   searched. %TRUE searches the entire subtree.
+ *
+ * a wrapped for hildon_file_system_model_search_path that accepts URIs.
+ *
+ * Returns: %TRUE, if the iterator points to desired file.
+ *          %FALSE otherwise.
+ */
+gboolean hildon_file_system_model_search_uri(HildonFileSystemModel * model,
+                                             const gchar * uri,
+                                             GtkTreeIter * iter,
+                                             GtkTreeIter * start_iter,
+                                             gboolean recursive)
+{
+    gboolean result;
+    GtkFilePath *filepath;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+
+    filepath = gtk_file_system_uri_to_path(priv->filesystem, uri);
+    result =
+        hildon_file_system_model_search_path(model, filepath, iter,
+                                             start_iter, recursive);
+
+    gtk_file_path_free(filepath);
+    return result;
+}
+
+/**
+ * hildon_file_system_model_search_path:
+ * @model: a #HildonFileSystemModel.
+ * @path: a #GtkFilePath to load.
+ * @iter: a #GtkTreeIter for the result.
+ * @start_iter: a #GtkTreeIter for starting point. %NULL for entire model.
+ * @recursive: if %FALSE, only immediate children of the parent are
+ *   searched. %TRUE searches the entire subtree.
+ *
+ * Searches the model for given path and fills an iterator pointing to it.
+ * Note that the path must already exist in model.
+ *
+ * Returns: %TRUE, if the iterator points to desired file.
+ *          %FALSE otherwise.
+ */
+#ifndef HILDON_DISABLE_DEPRECATED
+gboolean hildon_file_system_model_search_path(HildonFileSystemModel *
+                                              model,
+                                              const GtkFilePath * path,
+                                              GtkTreeIter * iter,
+                                              GtkTreeIter * start_iter,
+                                              gboolean recursive)
+{
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  GNode *start_node;
+  GFile *file;
+
+  g_return_val_if_fail(iter != NULL, FALSE);
+
+  start_node = get_node (priv, start_iter);
+  g_return_val_if_fail (start_node != NULL, FALSE);
+
+  file = g_file_new_for_uri (gtk_file_path_get_string(path));
+
+  iter->stamp = priv->stamp;
+  iter->user_data =
+    hildon_file_system_model_search_path_internal (start_node, file, recursive);
+
+  /* Files of a windowed folder may only have a record, give it a row */
+  if (iter->user_data == NULL)
+    {
+      GFile *parent_file = g_file_get_parent (file);
+
+      if (parent_file)
+        {
+          GNode *parent_node =
+            hildon_file_system_model_search_path_internal (start_node,
+                                                           parent_file,
+                                                           recursive);
+
+          if (parent_node && (recursive || parent_node == start_node))
+            iter->user_data =
+              child_records_materialize_file (model, parent_node, file);
+          g_object_unref (parent_file);
+        }
+    }
+
+  g_object_unref (file);
+
+  return iter->user_data != NULL;
+}
+#endif
+
+/**
+ * hildon_file_system_model_load_local_path:
+ * @model: a #HildonFileSystemModel.
+ * @path: a path to load.
+ * @iter: a #GtkTreeIter for the result.
+ *
+ * Converts the given path to #GtkFilePath and calls
+ * hildon_file_system_model_load_path.
+ *
+ * Returns: %TRUE, if the iterator points to desired file.
+ *          %FALSE otherwise.
+ */
+gboolean hildon_file_system_model_load_local_path(HildonFileSystemModel * model,
+                                            const gchar * path,
+                                            GtkTreeIter * iter)
+{
+    gboolean result;
+    GtkFilePath *filepath;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+
+    filepath = gtk_file_system_filename_to_path(priv->filesystem, path);
+    if (filepath == NULL)
+      return FALSE;
+
+    result = hildon_file_system_model_load_path(model, filepath, iter);
+
+    gtk_file_path_free(filepath);
+    return result;
+}
+
+/**
+ * hildon_file_system_model_load_uri:
+ * @model: a #HildonFileSystemModel.
+ * @uri: an URI to load.
+ * @iter: a #GtkTreeIter for the result.
+ *
+ * Converts the given URI to #GtkFilePath and calls
+ * hildon_file_system_model_load_path.
+ *
+ * Returns: %TRUE, if the iterator points to desired file.
+ *          %FALSE otherwise.
+ */
+gboolean hildon_file_system_model_load_uri(HildonFileSystemModel * model,
+                                            const gchar * uri,
+                                            GtkTreeIter * iter)
+{
+    HildonFileSystemSettings *settings;
+    gboolean result;
+    GtkFilePath *filepath;
+    GFile *file;
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+
+    g_return_val_if_fail (uri != NULL, FALSE);
+
+    filepath = gtk_file_system_uri_to_path(priv->filesystem, uri);
+    if (filepath == NULL)
+      return FALSE;
+
+    file = g_file_new_for_uri(uri);
+
+    if (!gtk_file_system_path_is_local(priv->filesystem, file))
+    {
+      /* If we're accessing a gateway, its root node doesn't exist until
+         settings are read. Wait here until they are */
+      settings = _hildon_file_system_settings_get_instance();
+      while (!_hildon_file_system_settings_ready(settings))
+        gtk_main_iteration();
+    }
+
+    g_object_unref (file);
+
+    result = hildon_file_system_model_load_path(model, filepath, iter);
+
+    gtk_file_path_free(filepath);
+
+    return result;
+}
+
+/**
+ * hildon_file_system_model_load_path:
+ * @model: a #HildonFileSystemModel.
+ * @path: a #GtkFilePath to load.
+ * @iter: a #GtkTreeIter for the result.
+ *
+ * This method locates the given path from data model. New branches are
+ * loaded if the given path doesn't exist in memory. Otherwise similar to
+ * hildon_file_system_model_search_path.
+ *
+ * Returns: %TRUE, if the iterator points to desired file.
+ *          %FALSE otherwise.
+ */
+gboolean hildon_file_system_model_load_path(HildonFileSystemModel * model,
+                                            const GtkFilePath * path,
+                                            GtkTreeIter * iter)
+{
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+    GtkFilePath *parent_path;
+    GtkTreeIter parent_iter;
+
+    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
+    g_return_val_if_fail(path != NULL, FALSE);
+    g_return_val_if_fail(iter != NULL, FALSE);
+
+    g_debug ("LOAD %s\n", (char *)path);
+
+    /* Block until the first scanning of the root folder is complete
+       so that we know about all memory cards, usb mass storage
+       devices, etc.
+    */
+    while (!priv->first_root_scan_completed)
+      {
+	g_debug ("+");
+	gtk_main_iteration();
+      }
+    g_debug ("DONE\n");
+  
+    /* Let's see if given path is already in the tree */
+    if (hildon_file_system_model_search_path(model, path, iter,
+                                             NULL, TRUE))
+    {
+      /* In case of gateway, we may need this to allow accessing contents */
+      _hildon_file_system_model_mount_device_iter(model, iter);
+      g_debug ("FOUND %s\n", (char *)path);
+      return TRUE;
     }
-}
-
-static void hildon_file_system_model_class_init(HildonFileSystemModelClass
-                                                * klass)
-{
-    GObjectClass *object;
 
-    g_type_class_add_private(klass, sizeof(HildonFileSystemModelPrivate));
+    g_debug ("NEED PARENT %s\n", (char *)path);
 
-    object = G_OBJECT_CLASS(klass);
-    object->constructor = hildon_file_system_model_constructor;
-    object->dispose = hildon_file_system_model_dispose;
-    object->finalize = hildon_file_system_model_finalize;
-    object->set_property = hildon_file_system_model_set_property;
-    object->get_property = hildon_file_system_model_get_property;
-    klass->device_disconnected =
-      hildon_file_system_model_real_device_disconnected;
+    /* No, path was not found. Let's try go one level up and loading more
+       contents */
+    if (!gtk_file_system_get_parent (model->priv->filesystem,
+                                     path, &parent_path, NULL)
+        || parent_path == NULL)
+      {
+        /* Let's check a special case: We want remote servers to report
+           the used protocol as their parent uri:
+               obex://mac/ => obex://
+         */
+        const gchar *s;
+        gint i;
 
-    g_object_class_install_property(object, PROP_BACKEND,
-        g_param_spec_string("backend",
-                            "HildonFileChooser backend",
-                            "Set GtkFileSystem backend to use",
-                            NULL,
-                            G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));
+        s = gtk_file_path_get_string(path);
+        i = strlen(s) - 1;
 
-    g_object_class_install_property(object, PROP_BACKEND_OBJECT,
-        g_param_spec_object("backend-object",
-                            "Backend object",
-                            "GtkFileSystem backend to use. Use this"
-                            "if you create backend yourself",
-                            GTK_TYPE_FILE_SYSTEM,
-                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+	g_debug ("SPECIAL CASE %s\n", s);
 
-    g_object_class_install_property(object, PROP_THUMBNAIL_CALLBACK,
-        g_param_spec_pointer("thumbnail-callback",
-                             "Thumbnail creation callback",
-                             "This callback property is depricated",
-                             G_PARAM_READWRITE));
+        /* Skip tailing slashes */
+        while (i >= 0 && s[i] == G_DIR_SEPARATOR) i--;
+        /* Skip characters backwards until we encounter next slash */
+        while (i >= 0 && s[i] != G_DIR_SEPARATOR) i--;
 
-    g_object_class_install_property(object, PROP_REF_WIDGET,
-        g_param_spec_object("ref-widget",
-                            "Refrence widget",
-                            "Any widget on the screen. Needed if "
-                            "you want icons.",
-                            GTK_TYPE_WIDGET,
-                            G_PARAM_READWRITE));
+	g_debug ("SPECIAL CASE I %d\n", i);
 
-    g_object_class_install_property(object, PROP_ROOT_DIR,
-        g_param_spec_string("root-dir",
-                            "Root directory",
-                            "Specify an alternative root directory. Note that"
-                            "gateway and MMCs appear ONLY if you leave"
-                            "this to default setting.", NULL,
-                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+        if (i >= 0)
+            parent_path = gtk_file_path_new_steal(g_strndup(s, i + 1));
+        else {
+            g_warning("Attempt to select folder that is not in user visible area");
+	    g_debug ("ERR %s\n", (char *)path);
+            return FALSE; /* Very BAD. We reached the real root. Given
+                             folder was probably not under any of our roots */
+        }
+      }
 
-    g_object_class_install_property(object, PROP_MULTI_ROOT,
-        g_param_spec_boolean("multi-root",
-                            "Multiple root directories",
-                            "When multiple root directories is enabled, "
-                            "each folder under root-dir "
-                            "(property) appear as a separate root level folder. "
-                            "The directory spesified by root-dir property is not "
-                            "displayed itself. This property has effect only when "
-                            "root-dir is set.", FALSE,
-                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+    if (hildon_file_system_model_load_path(model, parent_path, &parent_iter))
+      {
+	gtk_file_path_free(parent_path);
 
-    hildon_file_system_model_quark =
-        g_quark_from_static_string("HildonFileSystemModel Quark");
+	g_debug ("ADD %s\n", (char *)path);
 
-    signals[FINISHED_LOADING] =
-        g_signal_new("finished-loading", G_TYPE_FROM_CLASS(klass),
-                     G_SIGNAL_RUN_LAST,
-                     G_STRUCT_OFFSET(HildonFileSystemModelClass,
-                                     finished_loading), NULL, NULL,
-                     g_cclosure_marshal_VOID__BOXED, G_TYPE_NONE, 1, GTK_TYPE_TREE_ITER);
+	/* XXX - We trigger the parent to load its children and then
+	 *       wait for it to finish.  This is suboptimal of course
+	 *       since it might take a long time.  Instead, we should
+	 *       tolerate nodes without a GtkFileInfo and only acquire
+	 *       the file info when needed.
+	 */
+	_hildon_file_system_model_load_children (model, &parent_iter);
+      
+	/* Since we waited for the parent to load its children, we
+	   can now expect it to be there.
+	*/
 
-    signals[DEVICE_DISCONNECTED] =
-        g_signal_new("device-disconnected", G_TYPE_FROM_CLASS(klass),
-                     G_SIGNAL_RUN_LAST,
-                     G_STRUCT_OFFSET(HildonFileSystemModelClass,
-                                     device_disconnected), NULL, NULL,
-                     g_cclosure_marshal_VOID__BOXED, G_TYPE_NONE, 1,
-                     GTK_TYPE_TREE_ITER);
+	if (hildon_file_system_model_search_path (model, path, iter,
+						  NULL, TRUE))
+	  {
+	    g_debug ("FOUND %s\n", (char *)path);
+	    return TRUE;
+	  }
+	else
+	  {
+	    g_debug ("NOT FOUND %s\n", (char *)path);
+	    return FALSE;
+	  }
+      }
 
-    signals[VOLDEV_MOUNTED] =
-        g_signal_new("voldev-mounted", G_TYPE_FROM_CLASS(klass),
-                     G_SIGNAL_RUN_LAST,
-                     0, NULL, NULL,
-                     g_cclosure_marshal_VOID__STRING, 
-                     G_TYPE_NONE, 1, G_TYPE_STRING);
+    *iter = parent_iter;   /* Return parent iterator if we cannot
+                              found asked path */
+    gtk_file_path_free(parent_path);
+    g_debug ("NO PARENT %s\n", (char *)path);
+    return FALSE;
 }
 
-/* We currently assume that all selectable rows can be dragged */
-static gboolean
-hildon_file_system_model_row_draggable(GtkTreeDragSource *source, GtkTreePath *path)
+static void
+hildon_file_system_model_reload_node (HildonFileSystemModel *model,
+				      GNode *node,
+				      gboolean force)
 {
-  GtkTreeModel *model;
-  GtkTreeIter iter;
-  gboolean draggable;
-
-  model = GTK_TREE_MODEL (source);
-  gtk_tree_model_get_iter (model, &iter, path);
+  HildonFileSystemModelNode *model_node = node->data;
 
-  gtk_tree_model_get(model, &iter,
-		     HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE,
-		     &draggable, -1);
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
 
-  return draggable;
-}
+  if (!node_needs_reload (model, node, force))
+    return;
 
-static void hildon_file_system_model_iface_init(GtkTreeModelIface * iface)
-{
-    iface->get_flags = hildon_file_system_model_get_flags;
-    iface->get_n_columns = hildon_file_system_model_get_n_columns;
-    iface->get_column_type = hildon_file_system_model_get_column_type;
-    iface->get_iter = hildon_file_system_model_get_iter;
-    iface->get_path = hildon_file_system_model_get_path;
-    iface->get_value = hildon_file_system_model_get_value;
-    iface->iter_next = hildon_file_system_model_iter_next;
-    iface->iter_children = hildon_file_system_model_iter_children;
-    iface->iter_has_child = hildon_file_system_model_iter_has_child;
-    iface->iter_n_children = hildon_file_system_model_iter_n_children;
-    iface->iter_nth_child = hildon_file_system_model_iter_nth_child;
-    iface->iter_parent = hildon_file_system_model_iter_parent;
+  unlink_file_folder (node);
+  link_file_folder (node, model_node->file, LOAD_PRIORITY_VISIBLE);
 }
 
-/* All bookkeeping related to DnD is in HildonFileSelection, since
-   GtkTreeDnD does not support dragging of multiple items. We only
-   use the interface because we want GtkTreeView to limit drag start
-   points to real rows (not empty space). */
-static void
-hildon_file_system_model_drag_source_iface_init(GtkTreeDragSourceIface *iface)
+void _hildon_file_system_model_queue_reload(HildonFileSystemModel *model,
+  GtkTreeIter *parent_iter, gboolean force)
 {
-  iface->row_draggable = hildon_file_system_model_row_draggable;
-}
+  GNode *node;
 
-static void
-location_changed(HildonFileSystemSpecialLocation *location, GNode *node)
-{
-    g_assert(HILDON_IS_FILE_SYSTEM_SPECIAL_LOCATION(location));
-    g_assert(node != NULL && node->data != NULL);
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(parent_iter != NULL);
+  g_return_if_fail(parent_iter->stamp == model->priv->stamp);
 
-    DEBUG_GFILE_URI ("LOCATION CHANGED: %s", location->basepath);
+  node = parent_iter->user_data;
 
-    clear_model_node_caches(node->data);
-    emit_node_changed(node);
+  hildon_file_system_model_reload_node (model, node, force);
 }
 
 static void
-location_connection_state_changed(HildonFileSystemSpecialLocation *location,
-    GNode *node)
+_hildon_file_system_model_load_children(HildonFileSystemModel *model,
+                                        GtkTreeIter *parent_iter)
 {
-    HildonFileSystemModelNode *model_node;
-    GFile *file;
-
-    model_node = node->data;
+  GNode *parent_node;
+  HildonFileSystemModelNode *parent_model_node;
+  time_t max_time = time (NULL) + 5;
 
-    g_assert(HILDON_IS_FILE_SYSTEM_SPECIAL_LOCATION(location));
-    g_assert(model_node != NULL);
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(parent_iter != NULL);
+  g_return_if_fail(parent_iter->stamp == model->priv->stamp);
 
-    file = _hildon_file_system_path_for_location(location);
+  parent_node = parent_iter->user_data;
+  parent_model_node = parent_node->data;
 
-    if (file)
-      {
-        if (hildon_file_system_special_location_is_available(location))
-	  {
-	    g_debug("Location %s is now available", (char *) model_node->file);
+  if (!is_node_loaded (parent_node))
+    {
+      if (parent_model_node->cancellable == NULL)
+	link_file_folder (parent_node, parent_model_node->file,
+			  LOAD_PRIORITY_CURRENT);
+      else
+	DEBUG_GFILE_URI ("NOT LINKING %s\n", parent_model_node->file);
 
-            if (!hildon_file_system_special_location_requires_access(location))
-		link_file_folder (node, model_node->file);
-	  }
-	else
-	  {
-	    DEBUG_GFILE_URI("Location %s is no longer available",
-			    model_node->file);
-            send_device_disconnected(node);
-	  }
+      while (!is_node_loaded (parent_node)
+	     && time (NULL) < max_time)
+	{
+	  g_debug ("-");
+	  gtk_main_iteration ();
+	}
 
-        /* Ensure that the base path is updated */
-	g_object_unref (model_node->file);
-	model_node->file = file;
-	location_changed(location, node);
-      }
-    else
-      {
-	DEBUG_GFILE_URI("LOCATION %s FAILED => KICKING AWAY!!",
-			location->basepath);
-        hildon_file_system_model_kick_node(node, model_node->model);
-	g_object_unref (file);
+      DEBUG_GFILE_URI ("FINISHED %s\n", parent_model_node->file);
     }
+  else
+    DEBUG_GFILE_URI ("WAS LOADED %s\n", parent_model_node->file);
 }
 
-static void
-location_rescan(HildonFileSystemSpecialLocation *location, GNode *node)
+GtkFileSystem
+    *_hildon_file_system_model_get_file_system(HildonFileSystemModel *
+                                               model)
 {
-    HildonFileSystemModelNode *model_node;
-
-    g_assert(node != NULL && node->data != NULL);
+    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
 
-    model_node = node->data;
-    unlink_file_folder(node);
-    link_file_folder(node, model_node->file);
+    return priv->filesystem;
 }
 
-static HildonFileSystemModelNode *
-create_model_node_for_location(HildonFileSystemModel *self,
-    HildonFileSystemSpecialLocation *location)
+static gint
+compare_numbers(gconstpointer a, gconstpointer b)
 {
-    HildonFileSystemModelNode *model_node = NULL;
-    GFile *file;
+  return GPOINTER_TO_INT(a) - GPOINTER_TO_INT(b);
+}
 
-    file = _hildon_file_system_path_for_location(location);
+/**
+ * hildon_file_system_model_new_item:
+ * @model: a #HildonFileSystemModel.
+ * @parent: a parent iterator.
+ * @stub_name: a boby of the new name.
+ * @extension: extension of the new name.
+ *
+ * Creates a new unique name under #parent. The returned name can be used
+ * when creating a new file. If there are no name collisions, stub name
+ * will be the final name. If a file with that name already exists, then
+ * a number is appended to stub. This function is mainly used by dialog
+ * implementations. It's probably not needed in application development.
+ *
+ * Returns: a New unique name. You have to release this with #g_free. Can be %NULL, if
+ * the directory is not yet loaded.
+ */
+gchar *hildon_file_system_model_new_item(HildonFileSystemModel * model,
+                                         GtkTreeIter * parent,
+                                         const gchar * stub_name,
+                                         const gchar * extension)
+{
+    GtkTreeModel *treemodel;
+    GtkTreeIter iter;
+    GList *reserved = NULL;
+    GList *list_iter;
+    gint final;
+    gboolean has_next, full_match = FALSE;
+    gchar *result, *allocated = NULL;
+    GNode *node;
+    HildonFileSystemModelNode *model_node;
 
-    if (file) {
-	DEBUG_GFILE_URI ("BASE %s", location->basepath);
-	DEBUG_GFILE_URI ("PATH %s", file);
+    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), NULL);
+    g_return_val_if_fail(stub_name != NULL, NULL);
 
-        model_node = g_new0(HildonFileSystemModelNode, 1);
-	model_node->folder = NULL;
-        model_node->model = self;
-        model_node->present_flag = TRUE;
-        model_node->available = TRUE;
-	model_node->file = file;
-        model_node->location = g_object_ref(location);
+    treemodel = GTK_TREE_MODEL(model);
+    node = parent->user_data;
 
-        /* Let the location to initialize it's state */
-	hildon_file_system_special_location_volumes_changed(location);
+    if (!is_node_loaded(node))
+      return NULL;
 
-    } else {
-	DEBUG_GFILE_URI("BASE LOCATION: %s FAILED => SKIPPING",
-			location->basepath);
-    }
+    model_node = node->data;
 
-    return model_node;
-}
+    /* Special locations can have sub-locations within themselves.
+       those can cause conflicts with autonaming. */
+    if (model_node->location && !extension)
+    {
+      GFile *file = NULL;
 
-static void setup_node_for_location(GNode *node)
-{
-    HildonFileSystemModelNode *model_node;
+      /* make_path doesn't work for the fake "files:///" root node */
+      if (!HILDON_IS_FILE_SYSTEM_ROOT(model_node->location))
+	{
+	  gchar *basename = g_file_get_uri (model_node->file);
+	  gchar *uri = g_build_path("", basename, stub_name, NULL);
 
-    g_assert(node != NULL);
+	  file = g_file_new_for_uri (uri);
+	  g_free (uri);
+	  g_free (basename);
+	}
 
-    if ((model_node = node->data) != NULL)
-    {
+      if (file)
+      {
         HildonFileSystemSpecialLocation *location;
 
-        if ((location = model_node->location) != NULL)
+	location = _hildon_file_system_get_special_location(file);
+        if (location) /* Ok, we are trying to autoname a special location. Let's use user visible name */
         {
-            if (!hildon_file_system_special_location_requires_access(location) &&
-                hildon_file_system_special_location_is_available(location))
-	      link_file_folder(node, model_node->file);
-
-	    if (location->basepath)
-	      {
-		if (model_node->file)
-		  g_object_unref (model_node->file);
-
-		model_node->file = g_object_ref (location->basepath);
-	      }
-
-            g_signal_connect(location, "changed",
-                G_CALLBACK(location_changed), node);
-            g_signal_connect(location, "connection-state",
-                G_CALLBACK(location_connection_state_changed), node);
-            g_signal_connect(location, "rescan",
-                G_CALLBACK(location_rescan), node);
+	  allocated = _hildon_file_system_create_file_name(file, location, NULL);
+          stub_name = allocated;
+          g_object_unref(location);
         }
+	g_object_unref (file);
+      }
     }
-}
-/* Similar to g_node_copy_deep, but will also allow nodes to be skipped,
-   if they doesn't follow supported URI scheme */
-static GNode *my_copy_deep(GNode *node, gpointer data)
-{
-    GNode *result, *child, *new_child;
-    HildonFileSystemModelNode *model_node;
-    GFile *root;
 
-    g_assert(node != NULL);
+    for (has_next = gtk_tree_model_iter_children(treemodel, &iter, parent);
+         has_next; has_next = gtk_tree_model_iter_next(treemodel, &iter)) {
+        gchar *filename;
 
-    /* the fakeroot in device model contains NULL */
-    if (node->data == NULL)
-      model_node = NULL;
-    else
-      {
-        model_node = create_model_node_for_location(data, node->data);
-        /* If generating the location was unsuccessfull, we skip the location */
-	if (model_node == NULL)
-	  return NULL;
-      }
+        gtk_tree_model_get(treemodel, &iter,
+                           HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME,
+                           &filename, -1);
 
-    result = g_node_new(model_node);
+        if (g_str_has_prefix(filename, stub_name)
+            && (extension == NULL
+                || g_str_has_suffix(filename, extension))) {
+            /* Ok, we have a possible candidate. If part after the stub
+               prior to extension contains just numbers we have to record
+               this information. if this part contains characters then we
+               are not concerned about this item */
 
-    for (child = g_node_last_child (node); child; child = child->prev)
-      {
-        new_child = my_copy_deep(child, data);
+            char *start = filename + strlen(stub_name);
 
-        if (new_child)
-	  g_node_prepend (result, new_child);
-      }
-    /* Let's setup parent after children, so that adding children do not
-       trigger premature "files-added" signals for parents. */
+            if (extension)      /* remove extension */
+                filename[strlen(filename) - strlen(extension)] = '\0';
 
-    root = g_file_new_for_uri ("file:///");
+            if (*start == 0)
+              full_match = TRUE;
+            else
+            {
+              long value = _hildon_file_system_parse_autonumber(start);
 
-    if (!g_file_equal(HILDON_FILE_SYSTEM_SPECIAL_LOCATION(node->data)->basepath,
-		      root))
-      {
-        setup_node_for_location(result);
-      }
-    else
-      {
-	if(HILDON_IS_FILE_SYSTEM_ROOT(node->data))
-	  {
-            setup_node_for_location(result);
-        }
-	else if(HILDON_IS_FILE_SYSTEM_LOCAL_DEVICE(node->data))
-	  {
-            setup_node_for_location(result);
+                    if (value >= 0)  /* the string is reserved */
+                reserved = g_list_insert_sorted(reserved,
+                  GINT_TO_POINTER(value), compare_numbers);
+            }
         }
-	else
-	  {
-	    if (model_node->file)
-	      {
-		g_object_unref (model_node->file);
-		model_node->file = NULL;
-	      }
 
-	    model_node->file = g_object_ref (model_node->location->basepath);
-	    g_signal_connect(model_node->location, "changed",
-                G_CALLBACK(location_changed), result);
-            g_signal_connect(model_node->location, "connection-state",
-                G_CALLBACK(location_connection_state_changed), result);
-            g_signal_connect(model_node->location, "rescan",
-                G_CALLBACK(location_rescan), result);
-	}
+        g_free(filename);
     }
 
-    g_object_unref (root);
+    final = 1;
+
+    for (list_iter = reserved; list_iter; list_iter = list_iter->next)
+    {
+      gint value = GPOINTER_TO_INT(list_iter->data);
+      if (final < value) break;
+      final = value + 1;
+    }
+
+    g_list_free(reserved);
+
+    if (!full_match)  /* No matches found. Candidate is a good name */
+      result = g_strdup(stub_name);
+    else
+      result = g_strdup_printf("%s (%d)", stub_name, final);
+
+    /* stub_name may point to this, so we have to free
+       this AFTER creating the result */
+    g_free(allocated);
 
     return result;
 }
 
-static GObject *
-hildon_file_system_model_constructor(GType type,
-                                     guint n_construct_properties,
-                                     GObjectConstructParam *
-                                     construct_properties)
+/* Devices are not mounted automatically, only in response to user action.
+   Additionally, we never try to mount MMC ourselves. So there is now even
+   less to do here. */
+gboolean _hildon_file_system_model_mount_device_iter(HildonFileSystemModel
+                                                     * model,
+                                                     GtkTreeIter * iter)
 {
-  GObject *obj;
-  HildonFileSystemModelPrivate *priv;
+    HildonFileSystemModelNode *model_node;
+/*    HildonFileSystemModelPrivate *priv; */
+    GNode *node;
+    static gboolean active_flag = FALSE;
 
-  obj = G_OBJECT_CLASS(hildon_file_system_model_parent_class)->
-	  constructor(type, n_construct_properties, construct_properties);
-  priv = CAST_GET_PRIVATE(obj);
+    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
+    g_return_val_if_fail(iter != NULL, FALSE);
+    g_return_val_if_fail(model->priv->stamp == iter->stamp, FALSE);
 
-  if (!priv->filesystem)
-    priv->filesystem =
-	hildon_file_system_create_backend(priv->backend_name, TRUE);
+/*    priv = model->priv; */
+    node = iter->user_data;
+    model_node = node->data;
 
-  if (priv->alternative_root_dir == NULL)
+    if (model_node->location && !active_flag && !model_node->accessed &&
+        hildon_file_system_special_location_requires_access(model_node->location))
     {
-      /* Let's use device tree as a base of our tree */
-      priv->roots =
-	  my_copy_deep(_hildon_file_system_get_locations(), obj);
+      HildonFileSystemSettings *settings;
 
-      priv->volumes_changed_handler =
-	  g_signal_connect_object(priv->filesystem,
-				  "volumes-changed",
-				  G_CALLBACK(real_volumes_changed),
-				  obj, 0);
-    }
-  else
-    {
-      GFile *file;
+      settings = _hildon_file_system_settings_get_instance();
+      active_flag = TRUE;
 
-      priv->roots = g_node_new(NULL);     /* This is a fake root that
-					   contains real ones */
-      g_debug("Alternative root = '%s'", priv->alternative_root_dir);
+      /* We really have to know gateway state until we can continue.
+         Entering main loop can be dangerous (some functions
+         experience re-entrancy issues). Anyway, this is issue only
+         if this function is called almost immediately after creating
+         the first model in a process. Then settings are not yet ready.
+      */
+      while (!_hildon_file_system_settings_ready(settings))
+        gtk_main_iteration();
 
-      file = g_file_new_for_commandline_arg (priv->alternative_root_dir);
+      active_flag = FALSE;
 
-      priv->first_root_scan_completed = TRUE;
+      if (hildon_file_system_special_location_is_available(
+                                                   model_node->location))
+      {
+        gboolean success;
 
-      if (priv->multiroot)
-	{
-	  HildonFileSystemModelNode *model_node;
+	success = link_file_folder(node, model_node->file,
+				   LOAD_PRIORITY_CURRENT);
 
-	  model_node = g_new0(HildonFileSystemModelNode, 1);
-	  model_node->folder = NULL;
-	  model_node->file = g_object_ref (file);
-	  model_node->available = TRUE;
-	  priv->roots->data = model_node;
-	  model_node->present_flag = TRUE;
-	  model_node->model = HILDON_FILE_SYSTEM_MODEL(obj);
+        model_node->accessed = TRUE;
 
-	  if (link_file_folder (priv->roots, model_node->file))
-	    wait_node_load(priv, priv->roots);
-	}
-      else
-	{
-	  hildon_file_system_model_add_node(GTK_TREE_MODEL(obj), priv->roots,
-					    NULL, file, TRUE);
-	}
+        if (!success)
+            return FALSE;
 
-      g_object_unref (file);
+        return TRUE;
+      }
     }
 
-  return obj;
+    return FALSE;
 }
 
 /**
- * hildon_file_system_model_search_local_path:
+ * hildon_file_system_model_finished_loading:
  * @model: a #HildonFileSystemModel.
- * @path: a #GtkFilePath to load.
- * @iter: a #GtkTreeIter for the result.
- * @start_iter: a #GtkTreeIter for starting point. %NULL for entire model.
- * @recursive: if %FALSE, only immediate children of the parent are
- *   searched. %TRUE searches the entire subtree.
  *
- * a wrapped for hildon_file_system_model_search_path that accepts local
- *   paths.
+ * Checks if model has data in it's processing queue.
+ * 
+ * Deprecated: This api is broken. It only checks internal processing queue
+ * and this information is mostly useless.
  *
- * Returns: %TRUE, if the iterator points to desired file.
- *          %FALSE otherwise.
+ * Returns: %TRUE, data queues are empty.
  */
-gboolean hildon_file_system_model_search_local_path(HildonFileSystemModel *
-                                                    model,
-                                                    const gchar * path,
-                                                    GtkTreeIter * iter,
-                                                    GtkTreeIter *
-                                                    start_iter,
-                                                    gboolean recursive)
+#ifndef HILDON_DISABLE_DEPRECATED
+gboolean hildon_file_system_model_finished_loading(HildonFileSystemModel *
+                                                   model)
 {
-    gboolean result;
-    GtkFilePath *filepath;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
-
-    filepath = gtk_file_system_filename_to_path(priv->filesystem, path);
-    result =
-        hildon_file_system_model_search_path(model, filepath, iter,
-                                             start_iter, recursive);
+    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
 
-    gtk_file_path_free(filepath);
-    return result;
+    /* Cough...
+     */
+    return TRUE;
 }
-
+#endif
 /**
- * hildon_file_system_model_search_uri:
+ * hildon_file_system_model_autoname_uri:
  * @model: a #HildonFileSystemModel.
- * @uri: a #GtkFilePath to load.
- * @iter: a #GtkTreeIter for the result.
- * @start_iter: a #GtkTreeIter for starting point. %NULL for entire model.
- * @recursive: if %FALSE, only immediate children of the parent are
- *   searched. %TRUE searches the entire subtree.
+ * @uri: an URI to be autonamed.
+ * @error: a GError to hold possible error information.
  *
- * a wrapped for hildon_file_system_model_search_path that accepts URIs.
+ * This function checks if the given URI already exists in the model.
+ * if not, then a copy of it is returned unmodified. If the URI already
+ * exists then a number is added in a form file://file(2).html.
  *
- * Returns: %TRUE, if the iterator points to desired file.
- *          %FALSE otherwise.
+ * Returns: either the same uri given as parameter or a modified
+ * uri that contains proper index number. In both cases free
+ * this value using #g_free. Value can be %NULL, if error was
+ * encountered.
  */
-gboolean hildon_file_system_model_search_uri(HildonFileSystemModel * model,
-                                             const gchar * uri,
-                                             GtkTreeIter * iter,
-                                             GtkTreeIter * start_iter,
-                                             gboolean recursive)
+gchar *hildon_file_system_model_autoname_uri(HildonFileSystemModel *model,
+  const gchar *uri, GError **error)
 {
-    gboolean result;
-    GtkFilePath *filepath;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  GtkFileSystem *backend;
+  GtkFilePath *folder = NULL;
+  GtkFilePath * uri_path = NULL;
+  gchar *file = NULL;
+  gboolean is_folder = FALSE;
+  gchar *result = NULL;
+  GtkTreeIter iter;
 
-    filepath = gtk_file_system_uri_to_path(priv->filesystem, uri);
-    result =
-        hildon_file_system_model_search_path(model, filepath, iter,
-                                             start_iter, recursive);
+  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), NULL);
+  g_return_val_if_fail(uri != NULL, NULL);
 
-    gtk_file_path_free(filepath);
-    return result;
-}
+  backend = model->priv->filesystem;
 
-/**
- * hildon_file_system_model_search_path:
- * @model: a #HildonFileSystemModel.
- * @path: a #GtkFilePath to load.
- * @iter: a #GtkTreeIter for the result.
- * @start_iter: a #GtkTreeIter for starting point. %NULL for entire model.
- * @recursive: if %FALSE, only immediate children of the parent are
- *   searched. %TRUE searches the entire subtree.
- *
- * Searches the model for given path and fills an iterator pointing to it.
- * Note that the path must already exist in model.
- *
- * Returns: %TRUE, if the iterator points to desired file.
- *          %FALSE otherwise.
- */
-#ifndef HILDON_DISABLE_DEPRECATED
-gboolean hildon_file_system_model_search_path(HildonFileSystemModel *
-                                              model,
-                                              const GtkFilePath * path,
-                                              GtkTreeIter * iter,
-                                              GtkTreeIter * start_iter,
-                                              gboolean recursive)
-{
-  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
-  GNode *start_node;
-  GFile *file;
 
-  g_return_val_if_fail(iter != NULL, FALSE);
+  if ( ((uri_path = gtk_file_system_uri_to_path(backend, uri)) != NULL) &&
+        gtk_file_system_get_parent(backend, uri_path, &folder, NULL)    &&
+        (folder != NULL)                                                &&
+        hildon_file_system_model_load_path(model, folder, &iter) )
+  {
 
-  start_node = get_node (priv, start_iter);
-  g_return_val_if_fail (start_node != NULL, FALSE);
+      _hildon_file_system_model_load_children(model, &iter);
 
-  file = g_file_new_for_uri (gtk_file_path_get_string(path));
+      GtkTreeIter ret_iter;
 
-  iter->stamp = priv->stamp;
-  iter->user_data =
-    hildon_file_system_model_search_path_internal (start_node, file, recursive);
-  g_object_unref (file);
+      if ( hildon_file_system_model_search_uri(model, uri, &ret_iter, &iter, FALSE) )
+      {
+         gtk_tree_model_get
+           (GTK_TREE_MODEL(model), &ret_iter,
+            HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME, &file,
+            HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER, &is_folder,
+            -1);
+      }
+  }
+
+  gtk_file_path_free(uri_path);
+
+  if( file == NULL )
+  {
+      gtk_file_path_free(folder);
+      return g_strdup(uri);
+  }
+
+  gchar *extension = NULL, *dot, *autonamed;
+
+  dot = _hildon_file_system_search_extension (file, FALSE, is_folder);
+  if (dot && dot != file) {
+     extension = g_strdup(dot);
+     *dot = '\0';
+  }
+
+  _hildon_file_system_remove_autonumber(file);
+
+  autonamed = hildon_file_system_model_new_item(model,
+                                &iter, file, extension);
+  g_free(file);
+
+  if (autonamed)
+  {
+    GtkFilePath *result_path;
+
+    if (extension) {
+       /* Dot is part of the extension */
+        gchar *ext_name = g_strconcat(autonamed, extension, NULL);
+        g_free(extension);
+        g_free(autonamed);
+        autonamed = ext_name;
+    }
+
+    result_path = gtk_file_system_make_path(backend, folder, autonamed, error);
+
+    if (result_path) {
+       result = gtk_file_system_path_to_uri(backend, result_path);
+       gtk_file_path_free(result_path);
+    }
+
+    g_free(autonamed);
+  }
 
-  return iter->user_data != NULL;
+  gtk_file_path_free(folder);
+
+  return result;
 }
-#endif
 
 /**
- * hildon_file_system_model_load_local_path:
+ * hildon_file_system_model_iter_available:
  * @model: a #HildonFileSystemModel.
- * @path: a path to load.
- * @iter: a #GtkTreeIter for the result.
+ * @iter: a #GtkTreeIter to location to modify.
+ * @available: new availability state.
  *
- * Converts the given path to #GtkFilePath and calls
- * hildon_file_system_model_load_path.
+ * This function sets some paths available/not available. Locations
+ * that are not available are usually shown dimmed in the gui. This
+ * function can be used if program needs for some reason to disable some
+ * locations. By default all paths are available.
  *
- * Returns: %TRUE, if the iterator points to desired file.
- *          %FALSE otherwise.
+ * The new state can be read from the row at once, but
+ * #GtkTreeModel::row-changed is only emitted from the main loop.
  */
-gboolean hildon_file_system_model_load_local_path(HildonFileSystemModel * model,
-                                            const gchar * path,
-                                            GtkTreeIter * iter)
+void hildon_file_system_model_iter_available (HildonFileSystemModel *model,
+					      GtkTreeIter *iter,
+					      gboolean available)
 {
-    gboolean result;
-    GtkFilePath *filepath;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  GNode *node;
+  HildonFileSystemModelNode *model_node;
+  GtkTreeIter child;
 
-    filepath = gtk_file_system_filename_to_path(priv->filesystem, path);
-    if (filepath == NULL)
-      return FALSE;
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(iter != NULL);
+  g_return_if_fail(model->priv->stamp == iter->stamp);
 
-    result = hildon_file_system_model_load_path(model, filepath, iter);
+  node = iter->user_data;
+  model_node = node->data;
 
-    gtk_file_path_free(filepath);
-    return result;
+  if (model_node->available != available)
+    {
+      model_node->available = available;
+      if (available)
+        g_hash_table_remove(model->priv->unavailable_nodes, node);
+      else
+        g_hash_table_insert(model->priv->unavailable_nodes, node, node);
+      emit_node_changed(node);
+    }
+
+  if (gtk_tree_model_iter_children (GTK_TREE_MODEL (model), &child, iter)) 
+    {
+      do {
+	hildon_file_system_model_iter_available (model, &child, FALSE);
+      } while (gtk_tree_model_iter_next (GTK_TREE_MODEL (model), &child));
+    }
+}
+
+static gboolean
+reset_callback(gpointer key, gpointer value, gpointer data)
+{
+  GNode *node = key;
+  HildonFileSystemModelNode *model_node = node->data;
+
+  model_node->available = TRUE;
+  emit_node_changed(node);
+
+  return TRUE;
 }
 
 /**
- * hildon_file_system_model_load_uri:
+ * hildon_file_system_model_reset_available:
  * @model: a #HildonFileSystemModel.
- * @uri: an URI to load.
- * @iter: a #GtkTreeIter for the result.
  *
- * Converts the given URI to #GtkFilePath and calls
- * hildon_file_system_model_load_path.
- *
- * Returns: %TRUE, if the iterator points to desired file.
- *          %FALSE otherwise.
+ * Cancels all changes made by #hildon_file_system_model_iter_available.
+ * Selection is back to it's default state.
  */
-gboolean hildon_file_system_model_load_uri(HildonFileSystemModel * model,
-                                            const gchar * uri,
-                                            GtkTreeIter * iter)
+void hildon_file_system_model_reset_available(HildonFileSystemModel *model)
 {
-    HildonFileSystemSettings *settings;
-    gboolean result;
-    GtkFilePath *filepath;
-    GFile *file;
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
 
-    g_return_val_if_fail (uri != NULL, FALSE);
+  /* Only the nodes that were made unavailable are looked at */
+  g_hash_table_foreach_remove(model->priv->unavailable_nodes,
+                              reset_callback, NULL);
+}
 
-    filepath = gtk_file_system_uri_to_path(priv->filesystem, uri);
-    if (filepath == NULL)
-      return FALSE;
 
-    file = g_file_new_for_uri(uri);
+/* The index of the model of NODE, if there is one yet */
+static HildonFileNameIndex *
+node_get_name_index(GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
 
-    if (!gtk_file_system_path_is_local(priv->filesystem, file))
-    {
-      /* If we're accessing a gateway, its root node doesn't exist until
-         settings are read. Wait here until they are */
-      settings = _hildon_file_system_settings_get_instance();
-      while (!_hildon_file_system_settings_ready(settings))
-        gtk_main_iteration();
-    }
+  if (!model_node || !model_node->model || !model_node->file)
+    return NULL;
 
-    g_object_unref (file);
+  return CAST_GET_PRIVATE(model_node->model)->name_index;
+}
 
-    result = hildon_file_system_model_load_path(model, filepath, iter);
+/* Hands all children of NODE to the index */
+static void
+name_index_store_folder(GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileNameIndex *index = node_get_name_index(node);
+  GSList *infos = NULL;
+  GNode *child;
+  guint64 mtime = 0;
 
-    gtk_file_path_free(filepath);
+  if (!index || model_node->error)
+    return;
 
-    return result;
+  for (child = g_node_last_child(node); child; child = child->prev)
+  {
+    HildonFileSystemModelNode *child_node = child->data;
+
+    if (child_node->info)
+      infos = g_slist_prepend(infos, child_node->info);
+  }
+
+  if (model_node->records)
+  {
+    guint i;
+
+    for (i = 0; i < model_node->records->list->len; i++)
+      infos = g_slist_prepend(infos,
+        ((ChildRecord *) g_ptr_array_index(model_node->records->list, i))->info);
+  }
+
+  if (model_node->info)
+    mtime = g_file_info_get_attribute_uint64(model_node->info,
+                                             G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+  _hildon_file_name_index_set_folder(index, model_node->file, mtime, infos);
+  g_slist_free(infos);
 }
 
-/**
- * hildon_file_system_model_load_path:
- * @model: a #HildonFileSystemModel.
- * @path: a #GtkFilePath to load.
- * @iter: a #GtkTreeIter for the result.
- *
- * This method locates the given path from data model. New branches are
- * loaded if the given path doesn't exist in memory. Otherwise similar to
- * hildon_file_system_model_search_path.
- *
- * Returns: %TRUE, if the iterator points to desired file.
- *          %FALSE otherwise.
- */
-gboolean hildon_file_system_model_load_path(HildonFileSystemModel * model,
-                                            const GtkFilePath * path,
-                                            GtkTreeIter * iter)
+static gboolean
+name_index_idle(gpointer data)
 {
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
-    GtkFilePath *parent_path;
-    GtkTreeIter parent_iter;
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(data);
+  GHashTableIter iter;
+  gpointer node;
 
-    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
-    g_return_val_if_fail(path != NULL, FALSE);
-    g_return_val_if_fail(iter != NULL, FALSE);
+  priv->name_index_id = 0;
 
-    g_debug ("LOAD %s\n", (char *)path);
+  g_hash_table_iter_init(&iter, priv->name_index_nodes);
+  while (g_hash_table_iter_next(&iter, &node, NULL))
+    name_index_store_folder(node);
+  g_hash_table_remove_all(priv->name_index_nodes);
 
-    /* Block until the first scanning of the root folder is complete
-       so that we know about all memory cards, usb mass storage
-       devices, etc.
-    */
-    while (!priv->first_root_scan_completed)
-      {
-	g_debug ("+");
-	gtk_main_iteration();
-      }
-    g_debug ("DONE\n");
-  
-    /* Let's see if given path is already in the tree */
-    if (hildon_file_system_model_search_path(model, path, iter,
-                                             NULL, TRUE))
-    {
-      /* In case of gateway, we may need this to allow accessing contents */
-      _hildon_file_system_model_mount_device_iter(model, iter);
-      g_debug ("FOUND %s\n", (char *)path);
-      return TRUE;
-    }
+  return FALSE;
+}
 
-    g_debug ("NEED PARENT %s\n", (char *)path);
+/* Rebuilding the entries of a folder sorts and compares all of them,
+   so the folders that finish loading or get files are only handed to
+   the index once the main loop is idle */
+static void
+name_index_update_folder(GNode *node)
+{
+  HildonFileSystemModelNode *model_node = node->data;
+  HildonFileSystemModelPrivate *priv;
 
-    /* No, path was not found. Let's try go one level up and loading more
-       contents */
-    if (!gtk_file_system_get_parent (model->priv->filesystem,
-                                     path, &parent_path, NULL)
-        || parent_path == NULL)
-      {
-        /* Let's check a special case: We want remote servers to report
-           the used protocol as their parent uri:
-               obex://mac/ => obex://
-         */
-        const gchar *s;
-        gint i;
+  if (!node_get_name_index(node))
+    return;
 
-        s = gtk_file_path_get_string(path);
-        i = strlen(s) - 1;
+  priv = CAST_GET_PRIVATE(model_node->model);
+  g_hash_table_insert(priv->name_index_nodes, node, node);
+  if (!priv->name_index_id)
+    priv->name_index_id = g_idle_add_full(G_PRIORITY_LOW, name_index_idle,
+                                          model_node->model, NULL);
+}
 
-	g_debug ("SPECIAL CASE %s\n", s);
+/* Removals and renames are applied to the index one file at a time */
+static void
+name_index_remove_files(GNode *node, GSList *files)
+{
+  HildonFileNameIndex *index = node_get_name_index(node);
 
-        /* Skip tailing slashes */
-        while (i >= 0 && s[i] == G_DIR_SEPARATOR) i--;
-        /* Skip characters backwards until we encounter next slash */
-        while (i >= 0 && s[i] != G_DIR_SEPARATOR) i--;
+  for (; index && files; files = files->next)
+    _hildon_file_name_index_remove_file(index, files->data);
+}
 
-	g_debug ("SPECIAL CASE I %d\n", i);
+static void
+name_index_add_file(GNode *node, GFile *file)
+{
+  HildonFileNameIndex *index = node_get_name_index(node);
+  ChildRecord *record;
+  GNode *child;
 
-        if (i >= 0)
-            parent_path = gtk_file_path_new_steal(g_strndup(s, i + 1));
-        else {
-            g_warning("Attempt to select folder that is not in user visible area");
-	    g_debug ("ERR %s\n", (char *)path);
-            return FALSE; /* Very BAD. We reached the real root. Given
-                             folder was probably not under any of our roots */
-        }
-      }
+  if (!index)
+    return;
 
-    if (hildon_file_system_model_load_path(model, parent_path, &parent_iter))
-      {
-	gtk_file_path_free(parent_path);
+  /* Files that are still being added are listed when their folder
+     is handed over again */
+  if ((record = child_records_lookup(node, file)))
+    _hildon_file_name_index_add_file(index, file, record->info);
+  else if ((child = hildon_file_system_model_search_path_internal(node, file,
+                                                                   FALSE))
+           && child != node
+           && ((HildonFileSystemModelNode *) child->data)->info)
+    _hildon_file_name_index_add_file(index, file,
+      ((HildonFileSystemModelNode *) child->data)->info);
+}
 
-	g_debug ("ADD %s\n", (char *)path);
+static void
+collect_index_roots(gpointer key, gpointer value, gpointer data)
+{
+  GNode *node = key;
+  HildonFileSystemModelNode *model_node = node->data;
+  GSList **roots = data;
 
-	/* XXX - We trigger the parent to load its children and then
-	 *       wait for it to finish.  This is suboptimal of course
-	 *       since it might take a long time.  Instead, we should
-	 *       tolerate nodes without a GtkFileInfo and only acquire
-	 *       the file info when needed.
-	 */
-	_hildon_file_system_model_load_children (model, &parent_iter);
-      
-	/* Since we waited for the parent to load its children, we
-	   can now expect it to be there.
-	*/
+  if (HILDON_IS_FILE_SYSTEM_LOCAL_DEVICE(model_node->location) &&
+      g_file_is_native(model_node->file))
+    *roots = g_slist_prepend(*roots, g_object_ref(model_node->file));
+  else if (HILDON_IS_FILE_SYSTEM_VOLDEV(model_node->location))
+  {
+    HildonFileSystemVoldev *voldev =
+      HILDON_FILE_SYSTEM_VOLDEV(model_node->location);
 
-	if (hildon_file_system_model_search_path (model, path, iter,
-						  NULL, TRUE))
-	  {
-	    g_debug ("FOUND %s\n", (char *)path);
-	    return TRUE;
-	  }
-	else
-	  {
-	    g_debug ("NOT FOUND %s\n", (char *)path);
-	    return FALSE;
-	  }
-      }
+    /* Cards that are used over USB are not mounted here */
+    if (voldev->mount && !voldev->used_over_usb)
+      *roots = g_slist_prepend(*roots, g_mount_get_root(voldev->mount));
+  }
+}
 
-    *iter = parent_iter;   /* Return parent iterator if we cannot
-                              found asked path */
-    gtk_file_path_free(parent_path);
-    g_debug ("NO PARENT %s\n", (char *)path);
-    return FALSE;
+/* The local device and the mounted memory cards, or the root folder
+   given as a property */
+static void
+name_index_update_roots(HildonFileSystemModel *model)
+{
+  HildonFileSystemModelPrivate *priv = model->priv;
+  GSList *roots = NULL;
+
+  if (priv->alternative_root_dir)
+  {
+    GFile *file = g_file_new_for_commandline_arg(priv->alternative_root_dir);
+
+    if (g_file_is_native(file))
+      roots = g_slist_prepend(roots, file);
+    else
+      g_object_unref(file);
+  }
+  else
+    g_hash_table_foreach(priv->location_nodes, collect_index_roots, &roots);
+
+  _hildon_file_name_index_set_roots(priv->name_index, roots);
+
+  g_slist_foreach(roots, (GFunc) g_object_unref, NULL);
+  g_slist_free(roots);
 }
 
+/* The text to look for is the task data */
 static void
-hildon_file_system_model_reload_node (HildonFileSystemModel *model,
-				      GNode *node,
-				      gboolean force)
+pending_search_complete(HildonFileSystemModelPrivate *priv, GTask *task)
 {
-  HildonFileSystemModelNode *model_node = node->data;
-
-  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  if (!g_task_return_error_if_cancelled(task))
+    g_task_return_pointer(task,
+      _hildon_file_name_index_search(priv->name_index,
+                                     g_task_get_task_data(task)),
+      (GDestroyNotify) g_strfreev);
 
-  if (!node_needs_reload (model, node, force))
-    return;
-
-  unlink_file_folder (node);
-  link_file_folder (node, model_node->file);
+  g_object_unref(task);
 }
 
-void _hildon_file_system_model_queue_reload(HildonFileSystemModel *model,
-  GtkTreeIter *parent_iter, gboolean force)
+static void
+name_index_ready(HildonFileNameIndex *index, gpointer data)
 {
-  GNode *node;
+  HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(data);
+  GSList *searches, *l;
 
-  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
-  g_return_if_fail(parent_iter != NULL);
-  g_return_if_fail(parent_iter->stamp == model->priv->stamp);
-
-  node = parent_iter->user_data;
+  searches = g_slist_reverse(priv->pending_searches);
+  priv->pending_searches = NULL;
 
-  hildon_file_system_model_reload_node (model, node, force);
+  for (l = searches; l; l = l->next)
+    pending_search_complete(priv, l->data);
+  g_slist_free(searches);
 }
 
-static void
-_hildon_file_system_model_load_children(HildonFileSystemModel *model,
-                                        GtkTreeIter *parent_iter)
+/**
+ * hildon_file_system_model_search_async:
+ * @model: a #HildonFileSystemModel.
+ * @text: the text to look for.
+ * @cancellable: optional #GCancellable object, %NULL to ignore.
+ * @callback: a #GAsyncReadyCallback to call when the search is done.
+ * @user_data: the data to pass to @callback.
+ *
+ * Looks for files below the local device and the mounted memory
+ * cards (or below the root folder of @model) whose names match @text
+ * the same way the live search of #HildonFileSelection matches.
+ * Folders do not need to be loaded into @model for this.
+ *
+ * The names are kept in an index that is built in the background by
+ * the first search and saved on disk for the next time.  The saved
+ * index is read without blocking the main loop.  Until it has been
+ * read, or built if there is none, the search waits for it.
+ * Afterwards searches complete right away, while the index is being
+ * brought up to date.
+ *
+ * Call hildon_file_system_model_search_finish() from @callback to
+ * get the result.
+ */
+void
+hildon_file_system_model_search_async(HildonFileSystemModel *model,
+                                      const gchar *text,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data)
 {
-  GNode *parent_node;
-  HildonFileSystemModelNode *parent_model_node;
-  time_t max_time = time (NULL) + 5;
+  HildonFileSystemModelPrivate *priv;
+  GTask *task;
 
   g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
-  g_return_if_fail(parent_iter != NULL);
-  g_return_if_fail(parent_iter->stamp == model->priv->stamp);
+  g_return_if_fail(text != NULL);
 
-  parent_node = parent_iter->user_data;
-  parent_model_node = parent_node->data;
+  priv = model->priv;
 
-  if (!is_node_loaded (parent_node))
-    {
-      if (parent_model_node->cancellable == NULL)
-	link_file_folder (parent_node, parent_model_node->file);
-      else
-	DEBUG_GFILE_URI ("NOT LINKING %s\n", parent_model_node->file);
+  task = g_task_new(model, cancellable, callback, user_data);
+  g_task_set_source_tag(task, hildon_file_system_model_search_async);
+  g_task_set_task_data(task, g_strdup(text), g_free);
 
-      while (!is_node_loaded (parent_node)
-	     && time (NULL) < max_time)
-	{
-	  g_debug ("-");
-	  gtk_main_iteration ();
-	}
+  if (!priv->name_index)
+  {
+    gchar *cache_file, *name;
 
-      DEBUG_GFILE_URI ("FINISHED %s\n", parent_model_node->file);
+    /* Models with their own root have an index of their own */
+    if (priv->alternative_root_dir)
+    {
+      gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5,
+                                            priv->alternative_root_dir, -1);
+      name = g_strconcat("name-index-", checksum, NULL);
+      g_free(checksum);
     }
-  else
-    DEBUG_GFILE_URI ("WAS LOADED %s\n", parent_model_node->file);
-}
+    else
+      name = g_strdup("name-index");
 
-GtkFileSystem
-    *_hildon_file_system_model_get_file_system(HildonFileSystemModel *
-                                               model)
-{
-    HildonFileSystemModelPrivate *priv = CAST_GET_PRIVATE(model);
+    cache_file = g_build_filename(g_get_user_cache_dir(), "hildon-fm",
+                                  name, NULL);
+    priv->name_index = _hildon_file_name_index_new(cache_file,
+                                                   name_index_ready, model);
+    g_free(cache_file);
+    g_free(name);
 
-    return priv->filesystem;
-}
+    name_index_update_roots(model);
+  }
 
-static gint
-compare_numbers(gconstpointer a, gconstpointer b)
-{
-  return GPOINTER_TO_INT(a) - GPOINTER_TO_INT(b);
+  if (_hildon_file_name_index_is_ready(priv->name_index))
+    pending_search_complete(priv, task);
+  else
+    priv->pending_searches = g_slist_prepend(priv->pending_searches, task);
 }
 
 /**
- * hildon_file_system_model_new_item:
+ * hildon_file_system_model_search_finish:
  * @model: a #HildonFileSystemModel.
- * @parent: a parent iterator.
- * @stub_name: a boby of the new name.
- * @extension: extension of the new name.
+ * @result: the #GAsyncResult passed to the callback.
+ * @error: return location for a #GError, or %NULL.
  *
- * Creates a new unique name under #parent. The returned name can be used
- * when creating a new file. If there are no name collisions, stub name
- * will be the final name. If a file with that name already exists, then
- * a number is appended to stub. This function is mainly used by dialog
- * implementations. It's probably not needed in application development.
+ * Finishes a search started with
+ * hildon_file_system_model_search_async().
  *
- * Returns: a New unique name. You have to release this with #g_free. Can be %NULL, if
- * the directory is not yet loaded.
+ * Returns: a %NULL terminated array of the URIs of the matching files,
+ *          free it with g_strfreev(), or %NULL with @error set if the
+ *          search was cancelled.
  */
-gchar *hildon_file_system_model_new_item(HildonFileSystemModel * model,
-                                         GtkTreeIter * parent,
-                                         const gchar * stub_name,
-                                         const gchar * extension)
+gchar **
+hildon_file_system_model_search_finish(HildonFileSystemModel *model,
+                                       GAsyncResult *result,
+                                       GError **error)
 {
-    GtkTreeModel *treemodel;
-    GtkTreeIter iter;
-    GList *reserved = NULL;
-    GList *list_iter;
-    gint final;
-    gboolean has_next, full_match = FALSE;
-    gchar *result, *allocated = NULL;
-    GNode *node;
-    HildonFileSystemModelNode *model_node;
+  g_return_val_if_fail(g_task_is_valid(result, model), NULL);
+  g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) ==
+                       hildon_file_system_model_search_async, NULL);
 
-    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), NULL);
-    g_return_val_if_fail(stub_name != NULL, NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
 
-    treemodel = GTK_TREE_MODEL(model);
-    node = parent->user_data;
+/**
+ * _hildon_file_system_model_prioritize_folder:
+ * @model: a #HildonFileSystemModel
+ * @folder_iter: the folder that the user has opened
+ *
+ * Makes @folder_iter the current folder.  Its load jumps the queue
+ * and never waits for a free slot.  The previous current folder
+ * continues loading like any shown folder.  Locations that are being
+ * loaded speculatively are cancelled and queued again, so that they
+ * do not compete with the current folder until it has been loaded.
+ */
+void
+_hildon_file_system_model_prioritize_folder(HildonFileSystemModel *model,
+                                            GtkTreeIter *folder_iter)
+{
+  HildonFileSystemModelPrivate *priv;
+  GNode *node;
+  GList *link;
 
-    if (!is_node_loaded(node))
-      return NULL;
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(folder_iter != NULL);
+  g_return_if_fail(folder_iter->stamp == model->priv->stamp);
 
-    model_node = node->data;
+  priv = model->priv;
+  node = folder_iter->user_data;
 
-    /* Special locations can have sub-locations within themselves.
-       those can cause conflicts with autonaming. */
-    if (model_node->location && !extension)
-    {
-      GFile *file = NULL;
+  if (priv->current_folder == node)
+    return;
 
-      /* make_path doesn't work for the fake "files:///" root node */
-      if (!HILDON_IS_FILE_SYSTEM_ROOT(model_node->location))
-	{
-	  gchar *basename = g_file_get_uri (model_node->file);
-	  gchar *uri = g_build_path("", basename, stub_name, NULL);
+  if (priv->current_folder)
+    load_set_priority(priv->current_folder, LOAD_PRIORITY_VISIBLE);
 
-	  file = g_file_new_for_uri (uri);
-	  g_free (uri);
-	  g_free (basename);
-	}
+  priv->current_folder = node;
 
-      if (file)
-      {
-        HildonFileSystemSpecialLocation *location;
+  if (is_node_loaded(node))
+    return;
 
-	location = _hildon_file_system_get_special_location(file);
-        if (location) /* Ok, we are trying to autoname a special location. Let's use user visible name */
+  link = priv->loading.head;
+  while (link)
+    {
+      GNode *loading_node = link->data;
+      HildonFileSystemModelNode *model_node = loading_node->data;
+
+      link = link->next;
+
+      if (model_node->load_priority == LOAD_PRIORITY_SPECULATIVE
+          && loading_node != node)
         {
-	  allocated = _hildon_file_system_create_file_name(file, location, NULL);
-          stub_name = allocated;
-          g_object_unref(location);
+          DEBUG_GFILE_URI("DEFER %s", model_node->file);
+          unlink_file_folder(loading_node);
+          model_node->linking = TRUE;
+          load_queue_push(loading_node, LOAD_PRIORITY_SPECULATIVE, TRUE);
         }
-	g_object_unref (file);
-      }
     }
 
-    for (has_next = gtk_tree_model_iter_children(treemodel, &iter, parent);
-         has_next; has_next = gtk_tree_model_iter_next(treemodel, &iter)) {
-        gchar *filename;
+  if (((HildonFileSystemModelNode *) node->data)->load_link)
+    link_file_folder(node, ((HildonFileSystemModelNode *) node->data)->file,
+                     LOAD_PRIORITY_CURRENT);
+}
 
-        gtk_tree_model_get(treemodel, &iter,
-                           HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME,
-                           &filename, -1);
+/* Fills ROW with the cached fields of the row at ITER, without going
+   through GValues or copying strings.  Used by the sort and filter
+   functions of HildonFileSelection, which run for every row. */
+void
+_hildon_file_system_model_peek_row(HildonFileSystemModel *model,
+                                   GtkTreeIter *iter,
+                                   HildonFileSystemModelRow *row)
+{
+  HildonFileSystemModelNode *model_node;
+  GNode *node;
 
-        if (g_str_has_prefix(filename, stub_name)
-            && (extension == NULL
-                || g_str_has_suffix(filename, extension))) {
-            /* Ok, we have a possible candidate. If part after the stub
-               prior to extension contains just numbers we have to record
-               this information. if this part contains characters then we
-               are not concerned about this item */
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(iter != NULL);
+  g_return_if_fail(model->priv->stamp == iter->stamp);
+  g_return_if_fail(row != NULL);
 
-            char *start = filename + strlen(stub_name);
+  node = iter->user_data;
+  model_node = node->data;
 
-            if (extension)      /* remove extension */
-                filename[strlen(filename) - strlen(extension)] = '\0';
+  model_node_peek_row(model_node, row);
 
-            if (*start == 0)
-              full_match = TRUE;
-            else
-            {
-              long value = _hildon_file_system_parse_autonumber(start);
+  if (model_node->location && node_is_hidden(node))
+    row->flags |= ROW_FLAG_IS_HIDDEN;
+}
 
-                    if (value >= 0)  /* the string is reserved */
-                reserved = g_list_insert_sorted(reserved,
-                  GINT_TO_POINTER(value), compare_numbers);
-            }
-        }
+/* Returns the ROW_FLAG_* bits of the row at ITER and stores its file
+   in FILE, if not NULL.  Unlike _hildon_file_system_model_peek_row()
+   this makes neither the display name nor the sort key, so the filter
+   and cell data functions can test a row without collating its name. */
+guint32
+_hildon_file_system_model_peek_row_flags(HildonFileSystemModel *model,
+                                         GtkTreeIter *iter,
+                                         GFile **file)
+{
+  HildonFileSystemModelNode *model_node;
+  GNode *node;
+  guint32 flags;
 
-        g_free(filename);
-    }
+  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), 0);
+  g_return_val_if_fail(iter != NULL, 0);
+  g_return_val_if_fail(model->priv->stamp == iter->stamp, 0);
 
-    final = 1;
+  node = iter->user_data;
+  model_node = node->data;
 
-    for (list_iter = reserved; list_iter; list_iter = list_iter->next)
+  flags = model_node_get_row_flags(model_node);
+
+  if (model_node->location && node_is_hidden(node))
+    flags |= ROW_FLAG_IS_HIDDEN;
+
+  if (file)
+    *file = model_node->file;
+
+  return flags;
+}
+
+/* Looks up the result of the file filter with GENERATION for the row
+   at ITER, as stored by _hildon_file_system_model_set_filter_result().
+   Returns FALSE if the row has changed since, or the results are for
+   other filters. */
+gboolean
+_hildon_file_system_model_get_filter_result(HildonFileSystemModel *model,
+                                            GtkTreeIter *iter,
+                                            guint generation,
+                                            gboolean *result)
+{
+  HildonFileSystemModelNode *model_node;
+  guint i;
+
+  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
+  g_return_val_if_fail(iter != NULL, FALSE);
+  g_return_val_if_fail(model->priv->stamp == iter->stamp, FALSE);
+
+  model_node = ((GNode *) iter->user_data)->data;
+
+  if (generation == 0)
+    return FALSE;
+
+  for (i = 0; i < FILTER_RESULTS; i++)
+    if (model_node->filter_generation[i] == generation)
+      {
+        *result = model_node->filter_result[i];
+        return TRUE;
+      }
+
+  return FALSE;
+}
+
+void
+_hildon_file_system_model_set_filter_result(HildonFileSystemModel *model,
+                                            GtkTreeIter *iter,
+                                            guint generation,
+                                            gboolean result)
+{
+  HildonFileSystemModelNode *model_node;
+  guint i;
+
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(iter != NULL);
+  g_return_if_fail(model->priv->stamp == iter->stamp);
+
+  model_node = ((GNode *) iter->user_data)->data;
+
+  /* The result of the same filter, or else the oldest one, is
+     replaced and the others move down */
+  for (i = 0; i < FILTER_RESULTS - 1; i++)
+    if (model_node->filter_generation[i] == generation)
+      break;
+
+  for (; i > 0; i--)
     {
-      gint value = GPOINTER_TO_INT(list_iter->data);
-      if (final < value) break;
-      final = value + 1;
+      model_node->filter_generation[i] = model_node->filter_generation[i - 1];
+      model_node->filter_result[i] = model_node->filter_result[i - 1];
     }
 
-    g_list_free(reserved);
+  model_node->filter_generation[0] = generation;
+  model_node->filter_result[0] = result;
+}
+
+/* Returns the normalized file name and display text of the row at
+   ITER, as used by the live search of HildonFileSelection.  Both are
+   cached in the node, so typing in the live search does not allocate
+   anything per row.  DISPLAY_TEXT is set to NULL for rows without
+   one. */
+void
+_hildon_file_system_model_peek_search_names(HildonFileSystemModel *model,
+                                            GtkTreeIter *iter,
+                                            const gchar **name,
+                                            const gchar **display_text)
+{
+  HildonFileSystemModelNode *model_node;
+
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(iter != NULL);
+  g_return_if_fail(model->priv->stamp == iter->stamp);
+
+  model_node = ((GNode *) iter->user_data)->data;
+
+  *name = model_node_get_search_name(model_node);
+
+  if (!model_node_has_display_props(model_node))
+    generate_display_text_and_attrs(model, iter);
+
+  if (!model_node->display_search_cache && model_node->display_text)
+    model_node->display_search_cache =
+      hildon_helper_normalize_string(model_node->display_text);
+
+  *display_text = model_node->display_search_cache;
+}
+
+/* The folders among the children of PARENT, or of the top level when
+   PARENT is NULL, in model order.  This is all that the navigation
+   pane needs to walk, however many files there are next to them. */
+gint
+_hildon_file_system_model_get_n_folders(HildonFileSystemModel *model,
+                                        GtkTreeIter *parent)
+{
+  HildonFileSystemModelPrivate *priv;
+
+  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), 0);
+  priv = model->priv;
+  g_return_val_if_fail(parent == NULL || parent->stamp == priv->stamp, 0);
+
+  return get_folder_children(priv, parent ? parent->user_data
+                                          : priv->roots)->len;
+}
+
+gboolean
+_hildon_file_system_model_iter_nth_folder(HildonFileSystemModel *model,
+                                          GtkTreeIter *iter,
+                                          GtkTreeIter *parent,
+                                          gint n)
+{
+  HildonFileSystemModelPrivate *priv;
+  GPtrArray *folders;
+
+  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
+  priv = model->priv;
+  g_return_val_if_fail(parent == NULL || parent->stamp == priv->stamp,
+                       FALSE);
+
+  folders = get_folder_children(priv, parent ? parent->user_data
+                                             : priv->roots);
+  if (n < 0 || (guint) n >= folders->len)
+    return FALSE;
+
+  iter->stamp = priv->stamp;
+  iter->user_data = g_ptr_array_index(folders, n);
+  return TRUE;
+}
+
+/* Returns the index of the row at ITER among the folders next to it,
+   or -1 if it is not a folder, which is a flag test once the folders
+   of its parent are known. */
+gint
+_hildon_file_system_model_get_folder_position(HildonFileSystemModel *model,
+                                              GtkTreeIter *iter)
+{
+  HildonFileSystemModelPrivate *priv;
+  GPtrArray *folders;
+  GNode *node;
+
+  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), -1);
+  priv = model->priv;
+  g_return_val_if_fail(iter != NULL && iter->stamp == priv->stamp, -1);
 
-    if (!full_match)  /* No matches found. Candidate is a good name */
-      result = g_strdup(stub_name);
-    else
-      result = g_strdup_printf("%s (%d)", stub_name, final);
+  node = iter->user_data;
+  if (node->parent == NULL)
+    return -1;
 
-    /* stub_name may point to this, so we have to free
-       this AFTER creating the result */
-    g_free(allocated);
+  folders = get_folder_children(priv, node->parent);
+  if (!FOLDER_LISTED(node))
+    return -1;
 
-    return result;
+  return folder_list_index(folders, node);
 }
 
-/* Devices are not mounted automatically, only in response to user action.
-   Additionally, we never try to mount MMC ourselves. So there is now even
-   less to do here. */
-gboolean _hildon_file_system_model_mount_device_iter(HildonFileSystemModel
-                                                     * model,
-                                                     GtkTreeIter * iter)
+/* Statistics of the coalescing of row-changed: how many changes were
+   queued, how many signals were emitted for them and in how many
+   flushes.  Any of the pointers can be NULL. */
+void
+_hildon_file_system_model_get_change_counts(HildonFileSystemModel *model,
+                                            guint *queued,
+                                            guint *emitted,
+                                            guint *flushes)
 {
-    HildonFileSystemModelNode *model_node;
-/*    HildonFileSystemModelPrivate *priv; */
-    GNode *node;
-    static gboolean active_flag = FALSE;
+  HildonFileSystemModelPrivate *priv;
 
-    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
-    g_return_val_if_fail(iter != NULL, FALSE);
-    g_return_val_if_fail(model->priv->stamp == iter->stamp, FALSE);
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  priv = model->priv;
+
+  if (queued)
+    *queued = priv->changes_queued;
+  if (emitted)
+    *emitted = priv->changes_emitted;
+  if (flushes)
+    *flushes = priv->change_flushes;
+}
 
-/*    priv = model->priv; */
-    node = iter->user_data;
-    model_node = node->data;
+/* The order used by the navigation pane and by the content pane of
+   HildonFileSelection.  Devices and folders come first and are always
+   sorted by name, files are sorted by KEY in ORDER. */
+gint
+_hildon_file_system_model_compare_rows(const HildonFileSystemModelRow *a,
+                                       const HildonFileSystemModelRow *b,
+                                       HildonFileSelectionSortKey key,
+                                       GtkSortType order)
+{
+    gint value, weight_a, weight_b, diff;
 
-    if (model_node->location && !active_flag && !model_node->accessed &&
-        hildon_file_system_special_location_requires_access(model_node->location))
+    weight_a = ROW_FLAGS_SORT_WEIGHT(a->flags);
+    weight_b = ROW_FLAGS_SORT_WEIGHT(b->flags);
+
+    /* If the items are in different sorting groups, we can determine
+       the order directly by checking the weights. */
+    if ((diff = weight_a - weight_b) != 0)
     {
-      HildonFileSystemSettings *settings;
+        /* If either of the weights is negative, we need to preserve the
+           order independenty of ascending/descending mode */
+        if ((weight_a < 0 || weight_b < 0) && order == GTK_SORT_DESCENDING)
+          return -diff;
 
-      settings = _hildon_file_system_settings_get_instance();
-      active_flag = TRUE;
+        return diff;
+    }
 
-      /* We really have to know gateway state until we can continue.
-         Entering main loop can be dangerous (some functions
-         experience re-entrancy issues). Anyway, this is issue only
-         if this function is called almost immediately after creating
-         the first model in a process. Then settings are not yet ready.
-      */
-      while (!_hildon_file_system_settings_ready(settings))
-        gtk_main_iteration();
+    /* In case of fodlers sort only by name */
+    if (weight_a < 0) key = HILDON_FILE_SELECTION_SORT_NAME;
 
-      active_flag = FALSE;
+    if (key == HILDON_FILE_SELECTION_SORT_MODIFIED) {
+        gint retval;
 
-      if (hildon_file_system_special_location_is_available(
-                                                   model_node->location))
-      {
-        gboolean success;
+        retval = a->mtime > b->mtime ? 1 : (a->mtime == b->mtime ? 0 : -1);
+        if (weight_a < 0 && order == GTK_SORT_ASCENDING) {
+	  retval = -retval;
+	}
+	if (retval != 0) return retval;
+	else key = HILDON_FILE_SELECTION_SORT_NAME;
+    }
 
-	success = link_file_folder(node, model_node->file);
+    if (key == HILDON_FILE_SELECTION_SORT_SIZE) {
+        gint retval;
 
-        model_node->accessed = TRUE;
+        retval = a->size > b->size ? 1 : (a->size == b->size ? 0 : -1);
+        if (weight_a < 0 && order == GTK_SORT_ASCENDING)
+	  retval = -retval;
 
-        if (!success)
-            return FALSE;
+	if (retval != 0) return retval;
+	else key = HILDON_FILE_SELECTION_SORT_NAME;
+    }
 
-        return TRUE;
-      }
+    /* Note! Actually we should sort by extension, not by MIME type.
+       Getting extension is also related to other problem */
+    if (key == HILDON_FILE_SELECTION_SORT_TYPE) {
+        value = strcmp(a->mime_type, b->mime_type);
+        if (value != 0)
+          return value;
     }
 
-    return FALSE;
-}
+    /* Sort by name. This allways applies for directories and also for
+       files when name sorting is selected */
+    value = strcmp(a->sort_key, b->sort_key);
 
-/**
- * hildon_file_system_model_finished_loading:
- * @model: a #HildonFileSystemModel.
- *
- * Checks if model has data in it's processing queue.
- * 
- * Deprecated: This api is broken. It only checks internal processing queue
- * and this information is mostly useless.
- *
- * Returns: %TRUE, data queues are empty.
- */
-#ifndef HILDON_DISABLE_DEPRECATED
-gboolean hildon_file_system_model_finished_loading(HildonFileSystemModel *
-                                                   model)
-{
-    g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
+    /* Directories are always sorted alphabetically, so we
+        have to reverse order in descending mode. */
+    if (weight_a < 0 && order == GTK_SORT_DESCENDING)
+      value = -value;
 
-    /* Cough...
-     */
-    return TRUE;
+    return value;
 }
-#endif
+
 /**
- * hildon_file_system_model_autoname_uri:
+ * _hildon_file_system_model_set_sort:
  * @model: a #HildonFileSystemModel.
- * @uri: an URI to be autonamed.
- * @error: a GError to hold possible error information.
+ * @key: the sort key.
+ * @order: the sort order.
  *
- * This function checks if the given URI already exists in the model.
- * if not, then a copy of it is returned unmodified. If the URI already
- * exists then a number is added in a form file://file(2).html.
+ * Keeps the children of every folder in the order of
+ * _hildon_file_system_model_compare_rows(), with folders first and
+ * files reversed for %GTK_SORT_DESCENDING.  Existing children are
+ * reordered once, with one ::rows-reordered per folder, and new ones
+ * are inserted at their place.  By default children are kept in the
+ * order in which they were found.
  *
- * Returns: either the same uri given as parameter or a modified
- * uri that contains proper index number. In both cases free
- * this value using #g_free. Value can be %NULL, if error was
- * encountered.
+ * The model may be shared with views of the application, so every
+ * call has to be paired with _hildon_file_system_model_unset_sort().
  */
-gchar *hildon_file_system_model_autoname_uri(HildonFileSystemModel *model,
-  const gchar *uri, GError **error)
+void
+_hildon_file_system_model_set_sort(HildonFileSystemModel *model,
+                                   HildonFileSelectionSortKey key,
+                                   GtkSortType order)
 {
-  GtkFileSystem *backend;
-  GtkFilePath *folder = NULL;
-  GtkFilePath * uri_path = NULL;
-  gchar *file = NULL;
-  gboolean is_folder = FALSE;
-  gchar *result = NULL;
-  GtkTreeIter iter;
-
-  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), NULL);
-  g_return_val_if_fail(uri != NULL, NULL);
-
-  backend = model->priv->filesystem;
+  HildonFileSystemModelPrivate *priv;
 
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
 
-  if ( ((uri_path = gtk_file_system_uri_to_path(backend, uri)) != NULL) &&
-        gtk_file_system_get_parent(backend, uri_path, &folder, NULL)    &&
-        (folder != NULL)                                                &&
-        hildon_file_system_model_load_path(model, folder, &iter) )
-  {
+  priv = model->priv;
+  priv->sort_users++;
 
-      _hildon_file_system_model_load_children(model, &iter);
+  if (priv->sorted && priv->sort_key == key && priv->sort_order == order)
+    return;
 
-      GtkTreeIter ret_iter;
+  priv->sorted = TRUE;
+  priv->sort_key = key;
+  priv->sort_order = order;
 
-      if ( hildon_file_system_model_search_uri(model, uri, &ret_iter, &iter, FALSE) )
-      {
-         gtk_tree_model_get
-           (GTK_TREE_MODEL(model), &ret_iter,
-            HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME, &file,
-            HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER, &is_folder,
-            -1);
-      }
-  }
+  g_node_traverse(priv->roots, G_PRE_ORDER, G_TRAVERSE_NON_LEAVES, -1,
+                  sort_children, model);
 
-  gtk_file_path_free(uri_path);
+  /* Some records may now come before the last rows */
+  if (priv->windowed_folders > 0)
+    g_node_traverse(priv->roots, G_PRE_ORDER, G_TRAVERSE_NON_LEAVES, -1,
+                    rebalance_records, model);
+}
 
-  if( file == NULL )
-  {
-      gtk_file_path_free(folder);
-      return g_strdup(uri);
-  }
+static gboolean
+unsort_children(GNode *node, gpointer data)
+{
+  HildonFileSystemModelNode *model_node = node->data;
 
-  gchar *extension = NULL, *dot, *autonamed;
+  sort_children(node, data);
 
-  dot = _hildon_file_system_search_extension (file, FALSE, is_folder);
-  if (dot && dot != file) {
-     extension = g_strdup(dot);
-     *dot = '\0';
-  }
+  /* Not kept up to date while unsorted */
+  if (model_node && model_node->sorted_children)
+    {
+      g_ptr_array_free(model_node->sorted_children, TRUE);
+      model_node->sorted_children = NULL;
+    }
 
-  _hildon_file_system_remove_autonumber(file);
+  return FALSE;
+}
 
-  autonamed = hildon_file_system_model_new_item(model,
-                                &iter, file, extension);
-  g_free(file);
+/**
+ * _hildon_file_system_model_unset_sort:
+ * @model: a #HildonFileSystemModel.
+ *
+ * Undoes one _hildon_file_system_model_set_sort().  After the last one
+ * the children of every folder go back to the order in which they got
+ * their rows.
+ */
+void
+_hildon_file_system_model_unset_sort(HildonFileSystemModel *model)
+{
+  HildonFileSystemModelPrivate *priv;
 
-  if (autonamed)
-  {
-    GtkFilePath *result_path;
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
 
-    if (extension) {
-       /* Dot is part of the extension */
-        gchar *ext_name = g_strconcat(autonamed, extension, NULL);
-        g_free(extension);
-        g_free(autonamed);
-        autonamed = ext_name;
-    }
+  priv = model->priv;
 
-    result_path = gtk_file_system_make_path(backend, folder, autonamed, error);
+  g_return_if_fail(priv->sort_users > 0);
 
-    if (result_path) {
-       result = gtk_file_system_path_to_uri(backend, result_path);
-       gtk_file_path_free(result_path);
-    }
+  if (--priv->sort_users > 0)
+    return;
 
-    g_free(autonamed);
-  }
+  priv->sorted = FALSE;
 
-  gtk_file_path_free(folder);
+  g_node_traverse(priv->roots, G_PRE_ORDER, G_TRAVERSE_NON_LEAVES, -1,
+                  unsort_children, model);
 
-  return result;
+  if (priv->windowed_folders > 0)
+    g_node_traverse(priv->roots, G_PRE_ORDER, G_TRAVERSE_NON_LEAVES, -1,
+                    rebalance_records, model);
 }
 
 /**
- * hildon_file_system_model_iter_available:
+ * _hildon_file_system_model_window_children:
  * @model: a #HildonFileSystemModel.
- * @iter: a #GtkTreeIter to location to modify.
- * @available: new availability state.
+ * @parent: a folder of @model.
+ * @size: the number of rows.
  *
- * This function sets some paths available/not available. Locations
- * that are not available are usually shown dimmed in the gui. This
- * function can be used if program needs for some reason to disable some
- * locations. By default all paths are available.
+ * Once @parent has @size rows, the files found after that are only
+ * kept as records and get rows when
+ * _hildon_file_system_model_grow_children() asks for them, or when
+ * they are searched for, so that a huge folder costs about the same as
+ * a small one until it is scrolled through.  The rows are always the
+ * first ones in display order.  Folders always get rows.
+ *
+ * Other users of @model see only the rows made so far, so this is
+ * meant for a view that grows the folder as it is scrolled.  Every
+ * call has to be undone with
+ * _hildon_file_system_model_unwindow_children(), and the largest
+ * @size asked for is used meanwhile.
  */
-void hildon_file_system_model_iter_available (HildonFileSystemModel *model,
-					      GtkTreeIter *iter,
-					      gboolean available)
+void
+_hildon_file_system_model_window_children(HildonFileSystemModel *model,
+                                          GtkTreeIter *parent,
+                                          guint size)
 {
-  GNode *node;
   HildonFileSystemModelNode *model_node;
-  GtkTreeIter child;
 
   g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
-  g_return_if_fail(iter != NULL);
-  g_return_if_fail(model->priv->stamp == iter->stamp);
-
-  node = iter->user_data;
-  model_node = node->data;
+  g_return_if_fail(parent != NULL);
+  g_return_if_fail(parent->stamp == model->priv->stamp);
+  g_return_if_fail(size > 0);
 
-  if (model_node->available != available)
-    {
-      model_node->available = available;
-      emit_node_changed(node);
-    }
+  model_node = ((GNode *) parent->user_data)->data;
+  g_return_if_fail(model_node != NULL);
 
-  if (gtk_tree_model_iter_children (GTK_TREE_MODEL (model), &child, iter)) 
-    {
-      do {
-	hildon_file_system_model_iter_available (model, &child, FALSE);
-      } while (gtk_tree_model_iter_next (GTK_TREE_MODEL (model), &child));
-    }
+  if (model_node->window_users++ == 0)
+    model->priv->windowed_folders++;
+  model_node->window_size = MAX(model_node->window_size, size);
 }
 
-static gboolean
-reset_callback(GNode *node, gpointer data)
+/**
+ * _hildon_file_system_model_unwindow_children:
+ * @model: a #HildonFileSystemModel.
+ * @parent: a folder of @model.
+ *
+ * Undoes one _hildon_file_system_model_window_children().  After the
+ * last one, every file of @parent gets a row.
+ */
+void
+_hildon_file_system_model_unwindow_children(HildonFileSystemModel *model,
+                                            GtkTreeIter *parent)
 {
   HildonFileSystemModelNode *model_node;
 
-  g_assert(node != NULL);
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(parent != NULL);
+  g_return_if_fail(parent->stamp == model->priv->stamp);
 
-  model_node = node->data;
-  if (model_node && !model_node->available)
-  {
-    model_node->available = TRUE;
-    emit_node_changed(node);
-  }
+  model_node = ((GNode *) parent->user_data)->data;
+  g_return_if_fail(model_node != NULL && model_node->window_users > 0);
 
-  return FALSE;
+  if (--model_node->window_users > 0)
+    return;
+
+  model->priv->windowed_folders--;
+  model_node->window_size = 0;
+  child_records_grow(model, parent->user_data, G_MAXUINT);
 }
 
 /**
- * hildon_file_system_model_reset_available:
+ * _hildon_file_system_model_set_max_device_loads:
  * @model: a #HildonFileSystemModel.
+ * @n: the number of folders, or 0.
  *
- * Cancels all changes made by #hildon_file_system_model_iter_available.
- * Selection is back to it's default state.
+ * Sets how many folders of one device are enumerated at the same
+ * time.  Further folders wait until one of them has been loaded.  The
+ * current folder and the folders that are waited for are always
+ * loaded at once, but take a slot too.  0 removes the limit.
  */
-void hildon_file_system_model_reset_available(HildonFileSystemModel *model)
+void
+_hildon_file_system_model_set_max_device_loads(HildonFileSystemModel *model,
+                                               guint n)
 {
   g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
 
-  g_node_traverse(model->priv->roots, G_POST_ORDER,
-      G_TRAVERSE_ALL, -1, reset_callback, NULL);
+  model->priv->max_device_loads = n;
+  load_queue_schedule(model);
 }
 
+/**
+ * _hildon_file_system_model_grow_children:
+ * @model: a #HildonFileSystemModel.
+ * @parent: a folder of @model.
+ * @n: how many rows to add.
+ *
+ * Makes rows for the next @n files of @parent that are only kept as
+ * records, see _hildon_file_system_model_window_children().
+ *
+ * Returns: %TRUE if @parent still has files without a row.
+ */
+gboolean
+_hildon_file_system_model_grow_children(HildonFileSystemModel *model,
+                                        GtkTreeIter *parent,
+                                        guint n)
+{
+  g_return_val_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model), FALSE);
+  g_return_val_if_fail(parent != NULL, FALSE);
+  g_return_val_if_fail(parent->stamp == model->priv->stamp, FALSE);
+
+  return child_records_grow(model, parent->user_data, n);
+}
 
+/**
+ * _hildon_file_system_model_add_record_files:
+ * @model: a #HildonFileSystemModel.
+ * @parent: a folder of @model.
+ * @files: a #GPtrArray that unrefs its elements.
+ *
+ * Adds the #GFile of every file of @parent that has no row yet, see
+ * _hildon_file_system_model_window_children(), to @files in display
+ * order.  No rows are made for them.
+ */
 void
-_hildon_file_system_model_prioritize_folder(HildonFileSystemModel *model,
-                                            GtkTreeIter *folder_iter)
+_hildon_file_system_model_add_record_files(HildonFileSystemModel *model,
+                                           GtkTreeIter *parent,
+                                           GPtrArray *files)
 {
-  /* We don't have any influence any more over what is loaded first.
-   */
+  HildonFileSystemModelNode *model_node;
+  ChildRecords *records;
+  guint i, n;
+
+  g_return_if_fail(HILDON_IS_FILE_SYSTEM_MODEL(model));
+  g_return_if_fail(parent != NULL);
+  g_return_if_fail(parent->stamp == model->priv->stamp);
+  g_return_if_fail(files != NULL);
+
+  model_node = ((GNode *) parent->user_data)->data;
+  if (model_node == NULL || model_node->records == NULL)
+    return;
+
+  records = model_node->records;
+  n = records->list->len;
+
+  for (i = 0; i < n; i++)
+  {
+    ChildRecord *record =
+      g_ptr_array_index(records->list, records->sorted ? n - 1 - i : i);
+
+    g_ptr_array_add(files, g_object_ref(record->file));
+  }
 }
 
 void rescan_local_device_folders(HildonFileSystemModel *model)
@@ -179,6 +179,16 @@ void hildon_file_system_model_iter_available(HildonFileSystemModel *model,
 
 void hildon_file_system_model_reset_available(HildonFileSystemModel *model);
 
+/* Finds files by name without loading their folders */
+void hildon_file_system_model_search_async(HildonFileSystemModel *model,
+                                           const gchar *text,
+                                           GCancellable *cancellable,
+                                           GAsyncReadyCallback callback,
+                                           gpointer user_data);
+gchar **hildon_file_system_model_search_finish(HildonFileSystemModel *model,
+                                               GAsyncResult *result,
+                                               GError **error);
+
 /* Not for public use */
 
 void _hildon_file_system_model_queue_reload(HildonFileSystemModel *model,
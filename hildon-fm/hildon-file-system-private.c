@@ -36,7 +36,10 @@
 #include <libintl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <wchar.h>
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 #include "hildon-file-system-private.h"
 #include "hildon-file-system-settings.h"
 
@@ -602,6 +605,205 @@ _hildon_file_system_create_file_name (GFile *file,
   return rv;
 }
 
+#ifdef __STDC_ISO_10646__
+
+/* Most file names are plain ASCII (IMG_1234.JPG and friends).  For
+   those we build the very same key that
+   g_utf8_collate_key_for_filename (g_utf8_casefold (name)) would
+   build, but skip the Unicode case folding and normalization, which
+   are identities for ASCII.  The keys have to be byte for byte
+   identical, since ASCII and non-ASCII names are sorted against each
+   other with strcmp().
+
+   This mirrors the __STDC_ISO_10646__ code path of GLib's
+   gunicollate.c: the collatable parts go through wcsxfrm() and the
+   resulting weights are UTF-8 encoded, dots and digit runs are
+   encoded specially. */
+
+#define COLLATION_SENTINEL "\1\1\1"
+
+static gboolean
+is_ascii (const gchar *str, gsize len)
+{
+  const gchar *p = str, *end = str + len;
+
+  /* Test a word at a time, most names are longer than eight bytes */
+  while (p + sizeof (guint64) <= end)
+    {
+      guint64 word;
+
+      memcpy (&word, p, sizeof (word));
+      if (word & G_GUINT64_CONSTANT (0x8080808080808080))
+        return FALSE;
+      p += sizeof (word);
+    }
+
+  while (p < end)
+    if (*p++ & 0x80)
+      return FALSE;
+
+  return TRUE;
+}
+
+/* ASCII counterpart of appending g_utf8_collate_key (str, len), with
+   the case folding done inline */
+static void
+append_ascii_collate_key (GString *result, const gchar *str, gsize len)
+{
+  wchar_t buf[64], *wstr, *xfrm;
+  gsize i, xfrm_len;
+
+  wstr = len < G_N_ELEMENTS (buf) ? buf : g_new (wchar_t, len + 1);
+  for (i = 0; i < len; i++)
+    wstr[i] = g_ascii_tolower (str[i]);
+  wstr[len] = 0;
+
+  xfrm_len = wcsxfrm (NULL, wstr, 0);
+  xfrm = g_new (wchar_t, xfrm_len + 1);
+  wcsxfrm (xfrm, wstr, xfrm_len + 1);
+
+  for (i = 0; i < xfrm_len && xfrm[i] != 0; i++)
+    {
+      if (xfrm[i] < 0x80)
+        g_string_append_c (result, (gchar) xfrm[i]);
+      else
+        {
+          gchar utf8[6];
+
+          g_string_append_len (result, utf8,
+                               g_unichar_to_utf8 (xfrm[i], utf8));
+        }
+    }
+
+  g_free (xfrm);
+  if (wstr != buf)
+    g_free (wstr);
+}
+
+static gchar *
+create_ascii_sort_key (const gchar *str, gsize len)
+{
+  GString *result;
+  GString *append;
+  const gchar *p;
+  const gchar *prev;
+  const gchar *end;
+  gint digits;
+  gint leading_zeros;
+
+  result = g_string_sized_new (len * 2);
+  append = g_string_sized_new (0);
+
+  end = str + len;
+
+  for (prev = p = str; p < end; p++)
+    {
+      if (*p == '.')
+        {
+          if (prev != p)
+            append_ascii_collate_key (result, prev, p - prev);
+
+          g_string_append (result, COLLATION_SENTINEL "\1");
+
+          /* skip the dot */
+          prev = p + 1;
+        }
+      else if (g_ascii_isdigit (*p))
+        {
+          if (prev != p)
+            append_ascii_collate_key (result, prev, p - prev);
+
+          g_string_append (result, COLLATION_SENTINEL "\2");
+
+          prev = p;
+
+          /* Numbers are prefixed with d-1 colons, where d is the
+             number of digits without leading zeros */
+          if (*p == '0')
+            {
+              leading_zeros = 1;
+              digits = 0;
+            }
+          else
+            {
+              leading_zeros = 0;
+              digits = 1;
+            }
+
+          while (++p < end)
+            {
+              if (*p == '0' && !digits)
+                ++leading_zeros;
+              else if (g_ascii_isdigit (*p))
+                ++digits;
+              else
+                {
+                  /* count an all-zero sequence as one digit plus
+                     leading zeros */
+                  if (!digits)
+                    {
+                      ++digits;
+                      --leading_zeros;
+                    }
+                  break;
+                }
+            }
+
+          while (digits > 1)
+            {
+              g_string_append_c (result, ':');
+              --digits;
+            }
+
+          /* The amount of leading zeros is appended to the very end
+             of the key */
+          if (leading_zeros > 0)
+            {
+              g_string_append_c (append, (gchar) leading_zeros);
+              prev += leading_zeros;
+            }
+
+          g_string_append_len (result, prev, p - prev);
+
+          prev = p;
+          --p; /* the outer loop steps over the terminating character */
+        }
+    }
+
+  if (prev != p)
+    append_ascii_collate_key (result, prev, p - prev);
+
+  g_string_append (result, append->str);
+  g_string_free (append, TRUE);
+
+  return g_string_free (result, FALSE);
+}
+
+#endif /* __STDC_ISO_10646__ */
+
+/* Returns the collation key used for HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY.
+   Only depends on NAME, so it is safe to call from any thread. */
+gchar *
+_hildon_file_system_create_sort_key (const gchar *name)
+{
+  gchar *casefold, *key;
+
+#ifdef __STDC_ISO_10646__
+  gsize len = strlen (name);
+
+  if (is_ascii (name, len))
+    return create_ascii_sort_key (name, len);
+#endif
+
+  /* We cannot just use display_key from GtkFileInfo, because it is
+   * case sensitive */
+  casefold = g_utf8_casefold (name, -1);
+  key = g_utf8_collate_key_for_filename (casefold, -1);
+  g_free (casefold);
+
+  return key;
+}
+
 gchar *
 _hildon_file_system_create_display_name(GFile *file,
 					HildonFileSystemSpecialLocation *location,
@@ -709,63 +911,295 @@ GtkFileSystem *hildon_file_system_create_backend(const gchar *name, gboolean use
    * If given, then only matching mime-types are searched
 */
 
-/* known types are stored into list of these structs (with longest types first) */
+/* The known extensions are kept in a compiled table which is written
+   to $XDG_CACHE_HOME/hildon-fm/mime-extensions.cache the first time
+   any process needs it.  Other processes then just map the cache
+   read-only and look extensions up in place, instead of each parsing
+   the globs file again.  The cache is keyed by the mtime and size of
+   the globs file; if it is stale or unusable the table is compiled
+   in memory as before.
+
+   Layout: a MimeCacheHeader, n_entries MimeCacheEntry records sorted
+   with mime_entry_compare (longest extension first, then by
+   lowercased extension) and a pool of NUL terminated strings.
+*/
+
+#define MIME_GLOBS_FILE "/usr/share/mime/globs"
+#define MIME_CACHE_MAGIC "HFMEXT01"
+
+typedef struct
+{
+  gchar magic[8];
+  gint64 globs_mtime;
+  gint64 globs_size;
+  guint32 n_entries;
+  guint32 pool_size;
+} MimeCacheHeader;
+
+typedef struct
+{
+  guint32 extension;     /* offset into the string pool */
+  guint32 extension_len;
+  guint32 mime;          /* offset into the string pool */
+} MimeCacheEntry;
+
+typedef struct
+{
+  GMappedFile *mapped;   /* NULL if the table was compiled in memory */
+  gchar *data;           /* owned by us if mapped is NULL */
+  const MimeCacheEntry *entries;
+  guint n_entries;
+  const gchar *pool;
+} MimeTable;
+
 typedef struct
 {
   gchar *extension;
   gchar *mime;
 } MimeType;
 
-static gint mime_list_insert(gconstpointer a, gconstpointer b)
+static gint
+mime_entry_compare (const gchar *a, guint a_len,
+                    const gchar *b, guint b_len)
 {
-  return strlen(((MimeType *) b)->extension) -
-         strlen(((MimeType *) a)->extension);
+  if (a_len != b_len)
+    return a_len > b_len ? -1 : 1;
+
+  return g_ascii_strncasecmp (a, b, a_len);
 }
 
-static GSList *
-get_known_mime_types ()
+static gint
+mime_type_compare (gconstpointer a, gconstpointer b)
 {
-  static GSList *types = NULL;
-  MimeType *type;
-  gint len;
+  const MimeType *ta = a, *tb = b;
 
-  /* Initialize suffix hash table from /usr/share/mime/globs */
-  if (!types)
-  {
-    FILE *f;
-    gchar line[256];
-    gchar *sep;
+  return mime_entry_compare (ta->extension, strlen (ta->extension),
+                             tb->extension, strlen (tb->extension));
+}
+
+static gchar *
+get_mime_cache_filename (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "hildon-fm",
+                           "mime-extensions.cache", NULL);
+}
+
+static gboolean
+mime_table_set_data (MimeTable *table, const gchar *data, gsize len,
+                     const struct stat *globs_stat)
+{
+  const MimeCacheHeader *header = (const MimeCacheHeader *) data;
+  const MimeCacheEntry *entries;
+  const gchar *pool;
+  guint i;
+
+  if (len < sizeof (MimeCacheHeader)
+      || memcmp (header->magic, MIME_CACHE_MAGIC, sizeof (header->magic))
+      || header->globs_mtime != (gint64) globs_stat->st_mtime
+      || header->globs_size != (gint64) globs_stat->st_size
+      || len != sizeof (MimeCacheHeader)
+                + (gsize) header->n_entries * sizeof (MimeCacheEntry)
+                + header->pool_size
+      || header->pool_size == 0)
+    return FALSE;
+
+  entries = (const MimeCacheEntry *) (data + sizeof (MimeCacheHeader));
+  pool = (const gchar *) (entries + header->n_entries);
+
+  if (pool[header->pool_size - 1] != '\0')
+    return FALSE;
+
+  for (i = 0; i < header->n_entries; i++)
+    if (entries[i].extension >= header->pool_size
+        || entries[i].mime >= header->pool_size
+        || entries[i].extension_len
+             != strlen (pool + entries[i].extension))
+      return FALSE;
+
+  table->entries = entries;
+  table->n_entries = header->n_entries;
+  table->pool = pool;
+
+  return TRUE;
+}
 
-    f = fopen("/usr/share/mime/globs", "rt");
-    if (f)
+/* Parses the globs file the way we always did and serializes the
+   result into the cache layout. */
+static gchar *
+compile_mime_table (const struct stat *globs_stat, gsize *len)
+{
+  MimeCacheHeader header;
+  GArray *types;
+  GString *pool;
+  GString *blob;
+  FILE *f;
+  gchar line[256];
+  gchar *sep;
+  guint i, n;
+
+  types = g_array_new (FALSE, FALSE, sizeof (MimeType));
+
+  f = fopen(MIME_GLOBS_FILE, "rt");
+  if (f)
     {
       while (fgets(line, sizeof(line), f))
-      {
-        if (line[0] == 0 || line[0] == '#') continue;
-        /* fgets leaves newline into buffer */
-        len = strlen(line);
-        if (line[len - 1] == '\n') line[len - 1] = 0;
-        sep = strstr(line, ":*.");
-              if (sep == NULL) continue;
-        *sep = 0; /* Clear colon */
-
-        type = g_new(MimeType, 1);
-        type->extension = g_strdup(sep + 2);
-        type->mime = g_strdup(line);
-        types = g_slist_insert_sorted(types, type, mime_list_insert);
-      }
+        {
+          MimeType type;
+          gint line_len;
+
+          if (line[0] == 0 || line[0] == '#') continue;
+          /* fgets leaves newline into buffer */
+          line_len = strlen(line);
+          if (line[line_len - 1] == '\n') line[line_len - 1] = 0;
+          sep = strstr(line, ":*.");
+          if (sep == NULL) continue;
+          *sep = 0; /* Clear colon */
+
+          type.extension = g_ascii_strdown (sep + 2, -1);
+          type.mime = g_strdup (line);
+          g_array_append_val (types, type);
+        }
 
       fclose(f);
+    }
 
-/*      for (iter = types; iter; iter = iter->next)
-      {
-        type = iter->data;
-        fprintf(stderr, "%s: %s\n", type->extension, type->mime);
-      }*/
+  g_array_sort (types, mime_type_compare);
+
+  /* Several MIME types can claim the same extension; only the
+     extension matters for lookups, so keep the first one. */
+  pool = g_string_new ("");
+  blob = g_string_new ("");
+  g_string_set_size (blob, sizeof (MimeCacheHeader));
+
+  for (i = 0, n = 0; i < types->len; i++)
+    {
+      MimeType *type = &g_array_index (types, MimeType, i);
+      MimeCacheEntry entry;
+
+      if (i > 0 && mime_type_compare (type - 1, type) == 0)
+        continue;
+
+      entry.extension_len = strlen (type->extension);
+      entry.extension = pool->len;
+      g_string_append_len (pool, type->extension, entry.extension_len + 1);
+      entry.mime = pool->len;
+      g_string_append_len (pool, type->mime, strlen (type->mime) + 1);
+
+      g_string_append_len (blob, (const gchar *) &entry, sizeof (entry));
+      n++;
     }
-  }
 
-  return types;
+  for (i = 0; i < types->len; i++)
+    {
+      MimeType *type = &g_array_index (types, MimeType, i);
+
+      g_free (type->extension);
+      g_free (type->mime);
+    }
+  g_array_free (types, TRUE);
+
+  /* Keep the pool non-empty so that the header check stays simple */
+  if (pool->len == 0)
+    g_string_append_c (pool, '\0');
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, MIME_CACHE_MAGIC, sizeof (header.magic));
+  header.globs_mtime = globs_stat->st_mtime;
+  header.globs_size = globs_stat->st_size;
+  header.n_entries = n;
+  header.pool_size = pool->len;
+  memcpy (blob->str, &header, sizeof (header));
+
+  g_string_append_len (blob, pool->str, pool->len);
+  g_string_free (pool, TRUE);
+
+  *len = blob->len;
+  return g_string_free (blob, FALSE);
+}
+
+static void
+write_mime_cache (const gchar *filename, const gchar *data, gsize len)
+{
+  gchar *dir;
+
+  dir = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  /* g_file_set_contents() renames a temporary file into place, so
+     other processes never map a partially written cache.  Failing to
+     write it is harmless; we just compile the table again next time. */
+  g_file_set_contents (filename, data, len, NULL);
+}
+
+static const MimeTable *
+get_known_mime_types (void)
+{
+  static MimeTable *table = NULL;
+  struct stat globs_stat;
+  gchar *filename;
+  gsize len;
+
+  if (table)
+    return table;
+
+  table = g_new0 (MimeTable, 1);
+
+  if (g_stat (MIME_GLOBS_FILE, &globs_stat) != 0)
+    memset (&globs_stat, 0, sizeof (globs_stat));
+
+  filename = get_mime_cache_filename ();
+
+  table->mapped = g_mapped_file_new (filename, FALSE, NULL);
+  if (table->mapped
+      && !mime_table_set_data (table,
+                               g_mapped_file_get_contents (table->mapped),
+                               g_mapped_file_get_length (table->mapped),
+                               &globs_stat))
+    {
+      g_mapped_file_unref (table->mapped);
+      table->mapped = NULL;
+    }
+
+  if (!table->mapped)
+    {
+      table->data = compile_mime_table (&globs_stat, &len);
+      if (!mime_table_set_data (table, table->data, len, &globs_stat))
+        g_assert_not_reached ();
+
+      /* Only cache something that reflects an existing globs file */
+      if (globs_stat.st_mtime != 0)
+        write_mime_cache (filename, table->data, len);
+    }
+
+  g_free (filename);
+
+  return table;
+}
+
+static gboolean
+mime_table_contains (const MimeTable *table, const gchar *ext, guint len)
+{
+  guint lo = 0, hi = table->n_entries;
+
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+      const MimeCacheEntry *entry = &table->entries[mid];
+      gint cmp;
+
+      cmp = mime_entry_compare (ext, len,
+                                table->pool + entry->extension,
+                                entry->extension_len);
+      if (cmp == 0)
+        return TRUE;
+      else if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return FALSE;
 }
 
 gchar *
@@ -784,27 +1218,24 @@ _hildon_file_system_search_extension (gchar *name,
     }
   else
     {
-      GSList *types;
-      gint len;
-      MimeType *type;
-      GSList *iter;
-
-      /* We must search possible extensions from the list that match a
-         suffix of the given name.  The list is sorted from longest to
-         shortest extension so that we are guaranteed to find the
-         longest matching extension.
+      const MimeTable *types;
+      guint len, ext_len;
+
+      /* We must search possible extensions that match a suffix of
+         the given name.  The table is sorted from longest to
+         shortest extension, so trying suffix lengths from the
+         longest known extension downwards guarantees that we find
+         the longest matching extension.
       */
 
       types = get_known_mime_types ();
       len = strlen(name);
-      for (iter = types; iter; iter = iter->next)
+      ext_len = types->n_entries > 0 ? types->entries[0].extension_len : 0;
+      for (ext_len = MIN (ext_len, len); ext_len > 0; ext_len--)
         {
-          gchar *candidate;
-          type = iter->data;
+          gchar *candidate = name + len - ext_len;
 
-          candidate = name + len - strlen(type->extension);
-          if (name <= candidate
-              && g_ascii_strcasecmp (candidate, type->extension) == 0)
+          if (mime_table_contains (types, candidate, ext_len))
             return candidate;
         }
 
@@ -822,22 +1253,10 @@ _hildon_file_system_search_extension (gchar *name,
 gboolean
 _hildon_file_system_is_known_extension (const gchar *ext)
 {
-  GSList *types = get_known_mime_types ();
-  GSList *iter;
-  MimeType *type;
-
   if (ext == NULL)
     return FALSE;
 
-  for (iter = types; iter; iter = iter->next)
-    {
-      type = iter->data;
-
-      if (g_ascii_strcasecmp (ext, type->extension) == 0)
-        return TRUE;
-    }
-
-  return FALSE;
+  return mime_table_contains (get_known_mime_types (), ext, strlen (ext));
 }
 
 enum {
@@ -60,6 +60,8 @@ gchar *_hildon_file_system_create_file_name(GFile *path,
 gchar *_hildon_file_system_create_display_name(GFile *file,
   HildonFileSystemSpecialLocation *location, GFileInfo *info);
 
+gchar *_hildon_file_system_create_sort_key(const gchar *name);
+
 GFile *_hildon_file_system_path_for_location(HildonFileSystemSpecialLocation *location);
 
 GtkFileSystemVolume *
@@ -0,0 +1,356 @@
+/*
+ * This file is a part of hildon-fm tests
+ *
+ * Copyright (C) 2008 Nokia Corporation.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <hildon/hildon.h>
+
+#include "hildon-file-system-model.h"
+#include "hildon-file-folder-tree.h"
+#include "hildon-file-common-private.h"
+
+#define START_TEST(name) static void name (void)
+#define END_TEST
+#define fail_if(expr, ...) g_assert(!(expr))
+
+/* -------------------- Fixtures -------------------- */
+
+static HildonFileSystemModel *model = NULL;
+static HildonFileFolderTree *tree = NULL;
+static gchar *folder = NULL;
+
+static gchar *
+build_path (const gchar *name)
+{
+    return name ? g_build_filename (folder, name, NULL) : g_strdup (folder);
+}
+
+static void
+create_folder (const gchar *name)
+{
+    gchar *path = build_path (name);
+
+    g_mkdir_with_parents (path, 0700);
+    g_free (path);
+}
+
+static void
+create_file (const gchar *name)
+{
+    gchar *path = build_path (name);
+
+    g_file_set_contents (path, ".", -1, NULL);
+    g_free (path);
+}
+
+static void
+remove_path (const gchar *name)
+{
+    gchar *path = build_path (name);
+
+    g_remove (path);
+    g_free (path);
+}
+
+/* Loads the folder NAME of the test folder, or the test folder itself
+   for NULL, and runs the main loop until it is ready */
+static void
+load_folder (const gchar *name, GtkTreeIter *iter)
+{
+    gchar *path = build_path (name);
+    gboolean loaded = FALSE;
+    time_t max_time;
+
+    fail_if (!hildon_file_system_model_load_local_path (model, path, iter),
+             "Loading a test folder failed");
+    g_free (path);
+
+    max_time = time (NULL) + 5;
+    while (!loaded && time (NULL) < max_time)
+    {
+        gtk_tree_model_get (GTK_TREE_MODEL (model), iter,
+                            HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &loaded,
+                            -1);
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+}
+
+/* The names of the subfolders that the tree lists for the folder NAME
+   of the test folder, separated by commas.  Iters of the tree do not
+   survive changes, so the row is looked up again every time. */
+static gchar *
+get_folder_names (const gchar *name)
+{
+    GString *names = g_string_new (NULL);
+    GtkTreeIter model_iter, iter, child;
+    gchar *path = build_path (name);
+
+    if (hildon_file_system_model_search_local_path (model, path, &model_iter,
+                                                    NULL, TRUE)
+        && _hildon_file_folder_tree_convert_child_iter_to_iter (tree, &iter,
+                                                                &model_iter)
+        && gtk_tree_model_iter_children (GTK_TREE_MODEL (tree), &child, &iter))
+        do
+        {
+            gchar *child_name;
+
+            gtk_tree_model_get (GTK_TREE_MODEL (tree), &child,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME,
+                                &child_name, -1);
+            if (names->len > 0)
+                g_string_append_c (names, ',');
+            g_string_append (names, child_name);
+            g_free (child_name);
+        } while (gtk_tree_model_iter_next (GTK_TREE_MODEL (tree), &child));
+
+    g_free (path);
+
+    return g_string_free (names, FALSE);
+}
+
+/* Runs the main loop until the tree lists NAMES below the folder NAME,
+   or for 5 seconds */
+static void
+wait_for_folder_names (const gchar *name, const gchar *names)
+{
+    time_t max_time = time (NULL) + 5;
+    gchar *current = get_folder_names (name);
+
+    while (strcmp (current, names) != 0 && time (NULL) < max_time)
+    {
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+        g_free (current);
+        current = get_folder_names (name);
+    }
+
+    g_free (current);
+}
+
+/* Runs the main loop until the folder NAME has N rows in the model,
+   files included, or for 5 seconds */
+static void
+wait_for_model_rows (const gchar *name, gint n)
+{
+    time_t max_time = time (NULL) + 5;
+    gchar *path = build_path (name);
+    GtkTreeIter iter;
+
+    while ((!hildon_file_system_model_search_local_path (model, path, &iter,
+                                                         NULL, TRUE)
+            || gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model),
+                                               &iter) != n)
+           && time (NULL) < max_time)
+    {
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+
+    g_free (path);
+}
+
+static void
+count_signal (GtkTreeModel *tree_model, GtkTreePath *path, GtkTreeIter *iter,
+              guint *count)
+{
+    (*count)++;
+}
+
+static void
+fx_setup_default_hildonfm_file_folder_tree ()
+{
+    GtkTreeIter folder_iter;
+
+    folder = g_build_filename (g_getenv ("MYDOCSDIR"), "hildonfmfoldertree",
+                               NULL);
+    create_folder ("b");
+    create_folder ("d");
+    create_file ("f.txt");
+
+    model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                          "root-dir", g_getenv ("MYDOCSDIR"),
+                          NULL);
+    _hildon_file_system_model_set_sort (model, HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_ASCENDING);
+    load_folder (NULL, &folder_iter);
+
+    tree = _hildon_file_folder_tree_new (model);
+    wait_for_folder_names (NULL, "b,d");
+}
+
+static void
+fx_teardown_default_hildonfm_file_folder_tree ()
+{
+    g_object_unref (tree);
+    _hildon_file_system_model_unset_sort (model);
+    g_object_unref (model);
+
+    remove_path ("b/sub2");
+    remove_path ("b/sub");
+    remove_path ("b/x.txt");
+    remove_path ("b");
+    remove_path ("c");
+    remove_path ("d");
+    remove_path ("e.txt");
+    remove_path ("f.txt");
+    g_rmdir (folder);
+    g_free (folder);
+}
+
+/* -------------------- Test cases -------------------- */
+
+/**
+ * Purpose: Check that new folders are listed at their place and new
+ *          files are not
+ * Case 1: A folder in the middle
+ * Case 2: A file does not add a row
+ */
+START_TEST (test_file_folder_tree_insert)
+{
+    gchar *names;
+    guint inserted = 0;
+
+    names = get_folder_names (NULL);
+    g_assert_cmpstr (names, ==, "b,d");
+    g_free (names);
+
+    /* Test 1: c goes between b and d */
+    create_folder ("c");
+    wait_for_folder_names (NULL, "b,c,d");
+    names = get_folder_names (NULL);
+    g_assert_cmpstr (names, ==, "b,c,d");
+    g_free (names);
+
+    /* Test 2: A new file is turned away */
+    g_signal_connect (tree, "row-inserted", G_CALLBACK (count_signal),
+                      &inserted);
+    create_file ("e.txt");
+    wait_for_model_rows (NULL, 5);
+    names = get_folder_names (NULL);
+    g_assert_cmpstr (names, ==, "b,c,d");
+    g_free (names);
+    g_assert_cmpuint (inserted, ==, 0);
+}
+END_TEST
+
+/**
+ * Purpose: Check that the rows of removed folders go away
+ * Case 1: The last row
+ * Case 2: The only row left
+ */
+START_TEST (test_file_folder_tree_delete)
+{
+    gchar *names;
+
+    /* Test 1: The last row */
+    remove_path ("d");
+    wait_for_folder_names (NULL, "b");
+    names = get_folder_names (NULL);
+    g_assert_cmpstr (names, ==, "b");
+    g_free (names);
+
+    /* Test 2: The only row */
+    remove_path ("b");
+    wait_for_folder_names (NULL, "");
+    names = get_folder_names (NULL);
+    g_assert_cmpstr (names, ==, "");
+    g_free (names);
+}
+END_TEST
+
+/**
+ * Purpose: Check the levels below the top one
+ * Case 1: A loaded folder lists its subfolders
+ * Case 2: A folder made in an expanded level is listed
+ * Case 3: A file in an expanded level is not
+ */
+START_TEST (test_file_folder_tree_expand)
+{
+    GtkTreeIter b_iter;
+    gchar *names;
+
+    create_folder ("b/sub");
+    create_file ("b/x.txt");
+
+    /* Test 1: Loading b lists sub */
+    load_folder ("b", &b_iter);
+    wait_for_folder_names ("b", "sub");
+    names = get_folder_names ("b");
+    g_assert_cmpstr (names, ==, "sub");
+    g_free (names);
+
+    /* Test 2: sub2 is added below sub */
+    create_folder ("b/sub2");
+    wait_for_folder_names ("b", "sub,sub2");
+    names = get_folder_names ("b");
+    g_assert_cmpstr (names, ==, "sub,sub2");
+    g_free (names);
+
+    /* Test 3: The level of b still lists only folders, and the top
+       level has not changed */
+    wait_for_model_rows ("b", 3);
+    names = get_folder_names ("b");
+    g_assert_cmpstr (names, ==, "sub,sub2");
+    g_free (names);
+    names = get_folder_names (NULL);
+    g_assert_cmpstr (names, ==, "b,d");
+    g_free (names);
+}
+END_TEST
+
+/* ------------------ Suite creation ------------------ */
+
+typedef void (*fm_test_func) (void);
+
+static void
+fm_test_setup (gconstpointer func)
+{
+    fx_setup_default_hildonfm_file_folder_tree ();
+    ((fm_test_func) (func)) ();
+    fx_teardown_default_hildonfm_file_folder_tree ();
+}
+
+int
+main (int    argc,
+      char** argv)
+{
+#if !GLIB_CHECK_VERSION(2,32,0)
+#ifdef	G_THREADS_ENABLED
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+#endif
+    gtk_test_init (&argc, &argv, NULL);
+
+    g_test_add_data_func ("/HildonfmFileFolderTree/insert",
+        (fm_test_func)test_file_folder_tree_insert, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileFolderTree/delete",
+        (fm_test_func)test_file_folder_tree_delete, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileFolderTree/expand",
+        (fm_test_func)test_file_folder_tree_expand, fm_test_setup);
+
+    return g_test_run ();
+}
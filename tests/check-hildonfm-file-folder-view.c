@@ -0,0 +1,318 @@
+/*
+ * This file is a part of hildon-fm tests
+ *
+ * Copyright (C) 2008 Nokia Corporation.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <hildon/hildon.h>
+
+#include "hildon-file-system-model.h"
+#include "hildon-file-folder-view.h"
+#include "hildon-file-common-private.h"
+
+#define START_TEST(name) static void name (void)
+#define END_TEST
+#define fail_if(expr, ...) g_assert(!(expr))
+
+#define SORT_COLUMN_NAME 0
+
+/* -------------------- Fixtures -------------------- */
+
+static HildonFileSystemModel *model = NULL;
+static HildonFileFolderView *view = NULL;
+static GtkTreeModel *view_model = NULL;
+static gchar *folder = NULL;
+
+static void
+create_file (const gchar *name)
+{
+    gchar *file = g_build_filename (folder, name, NULL);
+
+    g_file_set_contents (file, ".", -1, NULL);
+    g_free (file);
+}
+
+static void
+remove_file (const gchar *name)
+{
+    gchar *file = g_build_filename (folder, name, NULL);
+
+    g_unlink (file);
+    g_free (file);
+}
+
+/* Runs the main loop until the view has N rows, or for 5 seconds */
+static void
+wait_for_rows (gint n)
+{
+    time_t max_time = time (NULL) + 5;
+
+    while (gtk_tree_model_iter_n_children (view_model, NULL) != n
+           && time (NULL) < max_time)
+    {
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+}
+
+/* The file names of the rows of the view, separated by commas */
+static gchar *
+get_row_names (void)
+{
+    GString *names = g_string_new (NULL);
+    GtkTreeIter iter;
+
+    if (gtk_tree_model_get_iter_first (view_model, &iter))
+        do
+        {
+            gchar *name;
+
+            gtk_tree_model_get (view_model, &iter,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME, &name,
+                                -1);
+            if (names->len > 0)
+                g_string_append_c (names, ',');
+            g_string_append (names, name);
+            g_free (name);
+        } while (gtk_tree_model_iter_next (view_model, &iter));
+
+    return g_string_free (names, FALSE);
+}
+
+static gint
+compare_names (GtkTreeModel *tree_model, GtkTreeIter *a, GtkTreeIter *b,
+               gpointer data)
+{
+    gchar *name_a, *name_b;
+    gint result;
+
+    gtk_tree_model_get (tree_model, a,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME, &name_a, -1);
+    gtk_tree_model_get (tree_model, b,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME, &name_b, -1);
+    result = strcmp (name_a, name_b);
+    g_free (name_a);
+    g_free (name_b);
+
+    return result;
+}
+
+static void
+count_signal (GtkTreeModel *tree_model, GtkTreePath *path, GtkTreeIter *iter,
+              gint *new_order, guint *count)
+{
+    (*count)++;
+}
+
+static void
+fx_setup_default_hildonfm_file_folder_view ()
+{
+    GtkTreeIter folder_iter;
+    gboolean loaded = FALSE;
+    time_t max_time;
+
+    folder = g_build_filename (g_getenv ("MYDOCSDIR"), "hildonfmfolderview",
+                               NULL);
+    g_mkdir_with_parents (folder, 0700);
+    create_file ("b.txt");
+    create_file ("d.txt");
+    create_file ("f.txt");
+
+    model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                          "root-dir", g_getenv ("MYDOCSDIR"),
+                          NULL);
+    fail_if (!hildon_file_system_model_load_local_path (model, folder,
+                                                        &folder_iter),
+             "Loading the test folder failed");
+
+    max_time = time (NULL) + 5;
+    while (!loaded && time (NULL) < max_time)
+    {
+        gtk_tree_model_get (GTK_TREE_MODEL (model), &folder_iter,
+                            HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &loaded,
+                            -1);
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+
+    view = _hildon_file_folder_view_new (model, &folder_iter);
+    view_model = GTK_TREE_MODEL (view);
+    gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (view),
+                                     SORT_COLUMN_NAME, compare_names,
+                                     NULL, NULL);
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (view),
+                                          SORT_COLUMN_NAME,
+                                          GTK_SORT_ASCENDING);
+    wait_for_rows (3);
+}
+
+static void
+fx_teardown_default_hildonfm_file_folder_view ()
+{
+    g_object_unref (view);
+    g_object_unref (model);
+
+    remove_file ("a.txt");
+    remove_file ("b.txt");
+    remove_file ("c.txt");
+    remove_file ("d.txt");
+    remove_file ("f.txt");
+    g_rmdir (folder);
+    g_free (folder);
+}
+
+/* -------------------- Test cases -------------------- */
+
+/**
+ * Purpose: Check that new files get rows at their sorted position
+ * Case 1: In the middle
+ * Case 2: At the start
+ */
+START_TEST (test_file_folder_view_insert)
+{
+    gchar *names;
+
+    names = get_row_names ();
+    g_assert_cmpstr (names, ==, "b.txt,d.txt,f.txt");
+    g_free (names);
+
+    /* Test 1: c.txt goes between b.txt and d.txt */
+    create_file ("c.txt");
+    wait_for_rows (4);
+    names = get_row_names ();
+    g_assert_cmpstr (names, ==, "b.txt,c.txt,d.txt,f.txt");
+    g_free (names);
+
+    /* Test 2: a.txt goes first */
+    create_file ("a.txt");
+    wait_for_rows (5);
+    names = get_row_names ();
+    g_assert_cmpstr (names, ==, "a.txt,b.txt,c.txt,d.txt,f.txt");
+    g_free (names);
+}
+END_TEST
+
+/**
+ * Purpose: Check that the rows of removed files go away
+ * Case 1: A row in the middle
+ * Case 2: The last row
+ * Case 3: Hidden rows are not listed and can be removed
+ */
+START_TEST (test_file_folder_view_delete)
+{
+    gchar *names;
+
+    /* Test 1: A row in the middle */
+    remove_file ("d.txt");
+    wait_for_rows (2);
+    names = get_row_names ();
+    g_assert_cmpstr (names, ==, "b.txt,f.txt");
+    g_free (names);
+
+    /* Test 2: The last row */
+    remove_file ("f.txt");
+    wait_for_rows (1);
+    names = get_row_names ();
+    g_assert_cmpstr (names, ==, "b.txt");
+    g_free (names);
+
+    /* Test 3: Removing the only file leaves an empty view */
+    remove_file ("b.txt");
+    wait_for_rows (0);
+    fail_if (gtk_tree_model_iter_n_children (view_model, NULL) != 0,
+             "The view still has rows of removed files");
+}
+END_TEST
+
+/**
+ * Purpose: Check that changing the sort order reorders the rows
+ * Case 1: Descending order reverses the rows with one rows-reordered
+ * Case 2: Setting the same order again does not reorder them
+ * Case 3: Files added to a descending view go to their place
+ */
+START_TEST (test_file_folder_view_reorder)
+{
+    guint reordered = 0;
+    gchar *names;
+
+    g_signal_connect (view_model, "rows-reordered",
+                      G_CALLBACK (count_signal), &reordered);
+
+    /* Test 1: Descending order */
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (view),
+                                          SORT_COLUMN_NAME,
+                                          GTK_SORT_DESCENDING);
+    names = get_row_names ();
+    g_assert_cmpstr (names, ==, "f.txt,d.txt,b.txt");
+    g_free (names);
+    g_assert_cmpuint (reordered, ==, 1);
+
+    /* Test 2: The same order again */
+    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (view),
+                                          SORT_COLUMN_NAME,
+                                          GTK_SORT_DESCENDING);
+    g_assert_cmpuint (reordered, ==, 1);
+
+    /* Test 3: A new file in a descending view */
+    create_file ("c.txt");
+    wait_for_rows (4);
+    names = get_row_names ();
+    g_assert_cmpstr (names, ==, "f.txt,d.txt,c.txt,b.txt");
+    g_free (names);
+}
+END_TEST
+
+/* ------------------ Suite creation ------------------ */
+
+typedef void (*fm_test_func) (void);
+
+static void
+fm_test_setup (gconstpointer func)
+{
+    fx_setup_default_hildonfm_file_folder_view ();
+    ((fm_test_func) (func)) ();
+    fx_teardown_default_hildonfm_file_folder_view ();
+}
+
+int
+main (int    argc,
+      char** argv)
+{
+#if !GLIB_CHECK_VERSION(2,32,0)
+#ifdef	G_THREADS_ENABLED
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+#endif
+#endif
+    gtk_test_init (&argc, &argv, NULL);
+
+    g_test_add_data_func ("/HildonfmFileFolderView/insert",
+        (fm_test_func)test_file_folder_view_insert, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileFolderView/delete",
+        (fm_test_func)test_file_folder_view_delete, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileFolderView/reorder",
+        (fm_test_func)test_file_folder_view_reorder, fm_test_setup);
+
+    return g_test_run ();
+}
@@ -30,8 +30,10 @@
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 #include <hildon/hildon.h>
 
 #include "hildon-file-selection.h"
@@ -40,6 +42,7 @@
 #include "hildon-file-system-private.h"
 #include "hildon-file-system-settings.h"
 #include "hildon-file-common-private.h"
+#include "hildon-file-grid-view.h"
 
 #define START_TEST(name) static void name (void)
 #define END_TEST 
@@ -88,6 +91,111 @@ fx_teardown_default_hildonfm_file_selection ()
     g_object_unref (model);
 }
 
+/* Makes PATH the current folder of _FS.  The navigation pane may not
+   list it yet, so this runs the main loop and tries again until the
+   selection has switched to it. */
+static void
+set_folder_and_wait (HildonFileSelection *_fs, const gchar *path)
+{
+    gchar *uri = g_filename_to_uri (path, NULL, NULL);
+    gchar *current = NULL;
+    time_t max_time = time (NULL) + 5;
+
+    do
+    {
+        g_free (current);
+        fail_if (!hildon_file_selection_set_current_folder_uri (_fs, uri,
+                                                                NULL),
+                 "Setting a test folder failed");
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+        current = hildon_file_selection_get_current_folder_uri (_fs);
+    } while ((current == NULL || strcmp (current, uri) != 0)
+             && time (NULL) < max_time);
+
+    g_assert_cmpstr (current, ==, uri);
+
+    g_free (current);
+    g_free (uri);
+}
+
+static void
+visit_cache_folder (const gchar *name)
+{
+    gchar *path = g_build_filename (g_getenv ("MYDOCSDIR"),
+                                    "hildonfmviewcache", name, NULL);
+
+    set_folder_and_wait (fs, path);
+    g_free (path);
+}
+
+/* Runs the main loop until the folder at PATH is loaded and has N rows
+   in the model, or for 5 seconds */
+static void
+wait_for_folder_rows (const gchar *path, gint n)
+{
+    time_t max_time = time (NULL) + 5;
+    gboolean loaded = FALSE;
+    GtkTreeIter iter;
+
+    while (time (NULL) < max_time)
+    {
+        if (hildon_file_system_model_search_local_path (model, path, &iter,
+                                                        NULL, TRUE))
+        {
+            gtk_tree_model_get (GTK_TREE_MODEL (model), &iter,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY,
+                                &loaded, -1);
+            if (loaded && gtk_tree_model_iter_n_children
+                            (GTK_TREE_MODEL (model), &iter) == n)
+                break;
+        }
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+}
+
+/* Runs the main loop until _FS reports N selected URIs, or for 5
+   seconds, and returns how many it reports */
+static guint
+wait_for_selected_uris (HildonFileSelection *_fs, guint n)
+{
+    time_t max_time = time (NULL) + 5;
+    GSList *list = hildon_file_selection_get_selected_uris (_fs);
+    guint count = g_slist_length (list);
+
+    while (count != n && time (NULL) < max_time)
+    {
+        g_slist_foreach (list, (GFunc) g_free, NULL);
+        g_slist_free (list);
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+        list = hildon_file_selection_get_selected_uris (_fs);
+        count = g_slist_length (list);
+    }
+
+    g_slist_foreach (list, (GFunc) g_free, NULL);
+    g_slist_free (list);
+
+    return count;
+}
+
+static gboolean
+cache_folder_is_cached (const gchar *name)
+{
+    gchar *path = g_build_filename (g_getenv ("MYDOCSDIR"),
+                                    "hildonfmviewcache", name, NULL);
+    GtkTreeIter iter;
+    gboolean cached = FALSE;
+
+    if (hildon_file_system_model_search_local_path (model, path, &iter,
+                                                    NULL, TRUE))
+        cached = _hildon_file_selection_view_cache_has_folder (fs, &iter);
+    g_free (path);
+
+    return cached;
+}
+
 /* -------------------- Test cases -------------------- */
 
 /**
@@ -1474,6 +1582,290 @@ START_TEST (test_file_selection_type)
 }
 END_TEST
 
+/* Returns how many files _hildon_file_selection_get_selected_file_array()
+   reports for _FS */
+static guint
+selected_file_count (HildonFileSelection *_fs)
+{
+    GPtrArray *files = _hildon_file_selection_get_selected_file_array (_fs);
+    guint count = files->len;
+
+    g_ptr_array_free (files, TRUE);
+
+    return count;
+}
+
+/**
+ * Purpose: Check the edit mode selection helpers of the content pane
+ * Case 1: Inverting an empty selection selects every row
+ * Case 2: A range selects the rows from one file to another
+ * Case 3: Inverting the range selects the other rows
+ * Case 4: Unselect all clears the selection
+ */
+START_TEST (test_file_selection_select_range_invert)
+{
+    const gchar *names[] = { "a.txt", "b.txt", "c.txt", "d.txt" };
+    gchar *folder = g_build_filename (g_getenv ("MYDOCSDIR"),
+                                      "hildonfmselectrange", NULL);
+    GtkTreeIter first, last;
+    gchar *path;
+    guint i;
+
+    g_mkdir_with_parents (folder, 0700);
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        path = g_build_filename (folder, names[i], NULL);
+        g_file_set_contents (path, ".", -1, NULL);
+        g_free (path);
+    }
+
+    set_folder_and_wait (fs_edit, folder);
+    wait_for_folder_rows (folder, G_N_ELEMENTS (names));
+    hildon_file_selection_unselect_all (fs_edit);
+
+    /* Test 1: All four files */
+    _hildon_file_selection_invert_selection (fs_edit);
+    g_assert_cmpuint (selected_file_count (fs_edit), ==, 4);
+    g_assert_cmpuint (wait_for_selected_uris (fs_edit, 4), ==, 4);
+
+    /* Test 2: a.txt and b.txt */
+    hildon_file_selection_unselect_all (fs_edit);
+    path = g_build_filename (folder, names[0], NULL);
+    fail_if (!hildon_file_system_model_search_local_path (model, path,
+                                                          &first, NULL,
+                                                          TRUE),
+             "Finding the first file of the range failed");
+    g_free (path);
+    path = g_build_filename (folder, names[1], NULL);
+    fail_if (!hildon_file_system_model_search_local_path (model, path,
+                                                          &last, NULL,
+                                                          TRUE),
+             "Finding the last file of the range failed");
+    g_free (path);
+    fail_if (!_hildon_file_selection_select_range (fs_edit, &last, &first),
+             "Selecting a range failed");
+    g_assert_cmpuint (selected_file_count (fs_edit), ==, 2);
+
+    /* Test 3: c.txt and d.txt */
+    _hildon_file_selection_invert_selection (fs_edit);
+    g_assert_cmpuint (selected_file_count (fs_edit), ==, 2);
+
+    /* Test 4: Nothing is left */
+    hildon_file_selection_unselect_all (fs_edit);
+    g_assert_cmpuint (selected_file_count (fs_edit), ==, 0);
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        path = g_build_filename (folder, names[i], NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+    g_rmdir (folder);
+    g_free (folder);
+}
+END_TEST
+
+/**
+ * Purpose: Check that select all in edit mode selects every row of the
+ *          content pane
+ * Case 1: All rows of a loaded folder
+ * Case 2: A file that appears afterwards is not selected
+ * Case 3: Unselect all clears the selection
+ */
+START_TEST (test_file_selection_select_all_edit)
+{
+    const gchar *names[] = { "a.txt", "b.txt", "c.txt", "d.txt" };
+    gchar *folder = g_build_filename (g_getenv ("MYDOCSDIR"),
+                                      "hildonfmselectall", NULL);
+    gchar *path;
+    guint i;
+
+    g_mkdir_with_parents (folder, 0700);
+    for (i = 0; i < 3; i++)
+    {
+        path = g_build_filename (folder, names[i], NULL);
+        g_file_set_contents (path, ".", -1, NULL);
+        g_free (path);
+    }
+
+    set_folder_and_wait (fs_edit, folder);
+    wait_for_folder_rows (folder, 3);
+
+    /* Test 1: The three files */
+    hildon_file_selection_unselect_all (fs_edit);
+    hildon_file_selection_select_all (fs_edit);
+    g_assert_cmpuint (wait_for_selected_uris (fs_edit, 3), ==, 3);
+
+    /* Test 2: d.txt is listed but not selected */
+    path = g_build_filename (folder, names[3], NULL);
+    g_file_set_contents (path, ".", -1, NULL);
+    g_free (path);
+    wait_for_folder_rows (folder, 4);
+    for (i = 0; i < 100 && g_main_context_iteration (NULL, FALSE); i++)
+        ;
+    g_assert_cmpuint (wait_for_selected_uris (fs_edit, 3), ==, 3);
+
+    /* Test 3: Nothing is left */
+    hildon_file_selection_unselect_all (fs_edit);
+    g_assert_cmpuint (wait_for_selected_uris (fs_edit, 0), ==, 0);
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        path = g_build_filename (folder, names[i], NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+    g_rmdir (folder);
+    g_free (folder);
+}
+END_TEST
+
+GtkWidget *
+_hildon_file_selection_get_scroll_thumb (HildonFileSelection *self);
+
+/**
+ * Purpose: Check that the thumbnail grid takes the place of the
+ *          thumbnail tree view and keeps the selection
+ * Case 1: The grid is shown with the rows of the folder
+ * Case 2: Select all in edit mode selects every cell
+ * Case 3: Turning the grid off keeps the selection
+ * Case 4: Unselect all clears the selection
+ */
+START_TEST (test_file_selection_grid)
+{
+    const gchar *names[] = { "a.jpg", "b.jpg", "c.jpg" };
+    gchar *folder = g_build_filename (g_getenv ("MYDOCSDIR"),
+                                      "hildonfmgrid", NULL);
+    GtkWidget *grid;
+    gchar *path;
+    guint i;
+
+    g_mkdir_with_parents (folder, 0700);
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        path = g_build_filename (folder, names[i], NULL);
+        g_file_set_contents (path, ".", -1, NULL);
+        g_free (path);
+    }
+
+    hildon_file_selection_show_content_pane (fs_edit);
+    hildon_file_selection_set_mode (fs_edit,
+                                    HILDON_FILE_SELECTION_MODE_THUMBNAILS);
+    set_folder_and_wait (fs_edit, folder);
+    wait_for_folder_rows (folder, G_N_ELEMENTS (names));
+    hildon_file_selection_unselect_all (fs_edit);
+
+    /* Test 1: The grid has the three files */
+    _hildon_file_selection_set_grid (fs_edit, TRUE);
+    grid = gtk_bin_get_child
+      (GTK_BIN (_hildon_file_selection_get_scroll_thumb (fs_edit)));
+    fail_if (!HILDON_IS_FILE_GRID_VIEW (grid),
+             "The thumbnails are not shown in the grid");
+    fail_if (_hildon_file_grid_view_get_model
+               (HILDON_FILE_GRID_VIEW (grid)) == NULL,
+             "The grid has no model");
+    g_assert_cmpint (gtk_tree_model_iter_n_children
+                       (_hildon_file_grid_view_get_model
+                          (HILDON_FILE_GRID_VIEW (grid)), NULL),
+                     ==, G_N_ELEMENTS (names));
+
+    /* Test 2: All three files */
+    hildon_file_selection_select_all (fs_edit);
+    g_assert_cmpuint (wait_for_selected_uris (fs_edit, 3), ==, 3);
+
+    /* Test 3: The tree view shows the same three */
+    _hildon_file_selection_set_grid (fs_edit, FALSE);
+    fail_if (HILDON_IS_FILE_GRID_VIEW
+               (gtk_bin_get_child
+                  (GTK_BIN (_hildon_file_selection_get_scroll_thumb
+                              (fs_edit)))),
+             "The grid is still shown");
+    fail_if (_hildon_file_grid_view_get_model
+               (HILDON_FILE_GRID_VIEW (grid)) != NULL,
+             "The grid kept its model");
+    g_assert_cmpuint (wait_for_selected_uris (fs_edit, 3), ==, 3);
+
+    /* Test 4: Nothing is left */
+    hildon_file_selection_unselect_all (fs_edit);
+    g_assert_cmpuint (wait_for_selected_uris (fs_edit, 0), ==, 0);
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        path = g_build_filename (folder, names[i], NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+    g_rmdir (folder);
+    g_free (folder);
+}
+END_TEST
+
+/**
+ * Purpose: Check that the view cache gives up the folder visited the
+ *          longest time ago first
+ * Case 1: The oldest of three folders goes when the cache holds two
+ * Case 2: A folder taken back out of the cache counts as visited again
+ * Case 3: Shrinking the cache drops the oldest entries, and 0 all
+ */
+START_TEST (test_file_selection_view_cache_eviction)
+{
+    const gchar *names[] = { "a", "b", "c", "d" };
+    gchar *folder = g_build_filename (g_getenv ("MYDOCSDIR"),
+                                      "hildonfmviewcache", NULL);
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        gchar *path = g_build_filename (folder, names[i], NULL);
+
+        g_mkdir_with_parents (path, 0700);
+        g_free (path);
+    }
+
+    _hildon_file_selection_set_view_cache_size (fs, 2);
+
+    /* Test 1: a, b, c leaves b and a cached, then d pushes a out */
+    visit_cache_folder ("a");
+    visit_cache_folder ("b");
+    visit_cache_folder ("c");
+    fail_if (!cache_folder_is_cached ("a") || !cache_folder_is_cached ("b"),
+             "The two previous folders are not cached");
+    fail_if (cache_folder_is_cached ("c"),
+             "The current folder is cached");
+
+    /* Test 2: Going back to a takes it out of the cache, so b is the
+       oldest one when d is visited */
+    visit_cache_folder ("a");
+    fail_if (cache_folder_is_cached ("a"),
+             "The current folder is still cached");
+    fail_if (!cache_folder_is_cached ("b") || !cache_folder_is_cached ("c"),
+             "The folders left for a are not cached");
+    visit_cache_folder ("d");
+    fail_if (cache_folder_is_cached ("b"),
+             "The least recently visited folder was not evicted");
+    fail_if (!cache_folder_is_cached ("c") || !cache_folder_is_cached ("a"),
+             "A recently visited folder was evicted");
+
+    /* Test 3: a is the newest entry and c the oldest */
+    _hildon_file_selection_set_view_cache_size (fs, 1);
+    fail_if (cache_folder_is_cached ("c") || !cache_folder_is_cached ("a"),
+             "Shrinking the cache did not keep only the newest entry");
+    _hildon_file_selection_set_view_cache_size (fs, 0);
+    fail_if (cache_folder_is_cached ("a"),
+             "A cache of size 0 still holds a folder");
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        gchar *path = g_build_filename (folder, names[i], NULL);
+
+        g_rmdir (path);
+        g_free (path);
+    }
+    g_rmdir (folder);
+    g_free (folder);
+}
+END_TEST
+
 /* ---------- Suite creation ---------- */
 
 typedef void (*fm_test_func) (void);
@@ -1583,5 +1975,21 @@ main (int    argc,
     g_test_add_data_func ("/HildonfmFileSelection/get_selected_files_edit",
         (fm_test_func)test_file_selection_get_selected_files_edit, fm_test_setup);
 
+    /* Create test case for the edit mode selection helpers */
+    g_test_add_data_func ("/HildonfmFileSelection/select_range_invert",
+        (fm_test_func)test_file_selection_select_range_invert, fm_test_setup);
+
+    /* Create test case for edit mode select all */
+    g_test_add_data_func ("/HildonfmFileSelection/select_all_edit",
+        (fm_test_func)test_file_selection_select_all_edit, fm_test_setup);
+
+    /* Create test case for the thumbnail grid */
+    g_test_add_data_func ("/HildonfmFileSelection/grid",
+        (fm_test_func)test_file_selection_grid, fm_test_setup);
+
+    /* Create test case for the view cache */
+    g_test_add_data_func ("/HildonfmFileSelection/view_cache_eviction",
+        (fm_test_func)test_file_selection_view_cache_eviction, fm_test_setup);
+
     return g_test_run ();
 }
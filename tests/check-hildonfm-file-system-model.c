@@ -28,8 +28,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 #include <hildon/hildon.h>
 
 #include "hildon-file-system-model.h"
@@ -900,6 +902,421 @@ START_TEST (test_file_system_smb)
 }
 END_TEST
 
+/* Creates MYDOCSDIR/hildonfmsort with the folders y and x and the
+   files a.txt, c.txt and b.txt, and loads it into a new model that
+   no HildonFileSelection uses. */
+static HildonFileSystemModel *
+create_sort_model (GtkTreeIter *folder_iter)
+{
+    HildonFileSystemModel *sort_model;
+    const gchar *names[] = { "a.txt", "c.txt", "b.txt", NULL };
+    gboolean loaded = FALSE;
+    time_t max_time;
+    gchar *folder, *file;
+    gint i;
+
+    folder = g_build_filename (g_getenv ("MYDOCSDIR"), "hildonfmsort", NULL);
+    file = g_build_filename (folder, "y", NULL);
+    g_mkdir_with_parents (file, 0700);
+    g_free (file);
+    file = g_build_filename (folder, "x", NULL);
+    g_mkdir_with_parents (file, 0700);
+    g_free (file);
+    for (i = 0; names[i]; i++)
+    {
+        file = g_build_filename (folder, names[i], NULL);
+        g_file_set_contents (file, ".", -1, NULL);
+        g_free (file);
+    }
+
+    sort_model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                               "root-dir", g_getenv ("MYDOCSDIR"),
+                               NULL);
+    fail_if (!hildon_file_system_model_load_local_path (sort_model, folder,
+                                                        folder_iter),
+             "Loading the sort test folder failed");
+    g_free (folder);
+
+    max_time = time (NULL) + 5;
+    while (!loaded && time (NULL) < max_time)
+    {
+        gtk_tree_model_get (GTK_TREE_MODEL (sort_model), folder_iter,
+                            HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &loaded,
+                            -1);
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+
+    return sort_model;
+}
+
+static void
+remove_sort_folder (void)
+{
+    const gchar *names[] = { "a.txt", "b.txt", "c.txt", "0.txt", "x", "y",
+                             NULL };
+    gchar *folder, *file;
+    gint i;
+
+    folder = g_build_filename (g_getenv ("MYDOCSDIR"), "hildonfmsort", NULL);
+    for (i = 0; names[i]; i++)
+    {
+        file = g_build_filename (folder, names[i], NULL);
+        g_remove (file);
+        g_free (file);
+    }
+    g_rmdir (folder);
+    g_free (folder);
+}
+
+/* The file names of the children of ITER, separated by commas */
+static gchar *
+get_child_names (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+    GString *names = g_string_new (NULL);
+    GtkTreeIter child;
+
+    if (gtk_tree_model_iter_children (tree_model, &child, iter))
+        do
+        {
+            gchar *name;
+
+            gtk_tree_model_get (tree_model, &child,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_FILE_NAME, &name,
+                                -1);
+            if (names->len > 0)
+                g_string_append_c (names, ',');
+            g_string_append (names, name);
+            g_free (name);
+        } while (gtk_tree_model_iter_next (tree_model, &child));
+
+    return g_string_free (names, FALSE);
+}
+
+/**
+ * Purpose: Check the order that the model keeps by itself
+ * Case 1: Ascending, folders first
+ * Case 2: Descending reverses the files but keeps the folders first
+ *         and in ascending order
+ */
+START_TEST (test_file_system_model_sort_order)
+{
+    HildonFileSystemModel *sort_model;
+    GtkTreeIter folder_iter;
+    gchar *names;
+
+    sort_model = create_sort_model (&folder_iter);
+
+    /* Test 1: Ascending */
+    _hildon_file_system_model_set_sort (sort_model,
+                                        HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_ASCENDING);
+    names = get_child_names (GTK_TREE_MODEL (sort_model), &folder_iter);
+    g_assert_cmpstr (names, ==, "x,y,a.txt,b.txt,c.txt");
+    g_free (names);
+    _hildon_file_system_model_unset_sort (sort_model);
+
+    /* Test 2: Descending */
+    _hildon_file_system_model_set_sort (sort_model,
+                                        HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_DESCENDING);
+    names = get_child_names (GTK_TREE_MODEL (sort_model), &folder_iter);
+    g_assert_cmpstr (names, ==, "x,y,c.txt,b.txt,a.txt");
+    g_free (names);
+    _hildon_file_system_model_unset_sort (sort_model);
+
+    g_object_unref (sort_model);
+    remove_sort_folder ();
+}
+END_TEST
+
+/**
+ * Purpose: Check that the model stops sorting when the last user of
+ *          the order unsets it
+ * Case 1: While one user is left, new files go to their sorted place
+ * Case 2: After the last one, new files are added at the end
+ */
+START_TEST (test_file_system_model_unset_sort)
+{
+    HildonFileSystemModel *sort_model;
+    GtkTreeIter folder_iter;
+    time_t max_time;
+    gchar *names, *file;
+
+    sort_model = create_sort_model (&folder_iter);
+
+    _hildon_file_system_model_set_sort (sort_model,
+                                        HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_ASCENDING);
+    _hildon_file_system_model_set_sort (sort_model,
+                                        HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_ASCENDING);
+
+    /* Test 1: One user is left */
+    _hildon_file_system_model_unset_sort (sort_model);
+    names = get_child_names (GTK_TREE_MODEL (sort_model), &folder_iter);
+    g_assert_cmpstr (names, ==, "x,y,a.txt,b.txt,c.txt");
+    g_free (names);
+
+    /* Test 2: No users are left */
+    _hildon_file_system_model_unset_sort (sort_model);
+
+    file = g_build_filename (g_getenv ("MYDOCSDIR"), "hildonfmsort", "0.txt",
+                             NULL);
+    g_file_set_contents (file, ".", -1, NULL);
+    g_free (file);
+
+    max_time = time (NULL) + 5;
+    while (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (sort_model),
+                                           &folder_iter) != 6
+           && time (NULL) < max_time)
+    {
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+
+    names = get_child_names (GTK_TREE_MODEL (sort_model), &folder_iter);
+    fail_if (!g_str_has_suffix (names, ",0.txt"),
+             "A new file was not added at the end of an unsorted folder");
+    g_free (names);
+
+    g_object_unref (sort_model);
+    remove_sort_folder ();
+}
+END_TEST
+
+static void
+count_row_changed (GtkTreeModel *tree_model, GtkTreePath *path,
+                   GtkTreeIter *iter, guint *count)
+{
+    (*count)++;
+}
+
+/**
+ * Purpose: Check that row-changed comes from the main loop, once per row
+ * Case 1: The new values can be read before any signal
+ * Case 2: Rows that changed twice get one signal each
+ */
+START_TEST (test_file_system_model_row_changed)
+{
+    HildonFileSystemModel *sort_model;
+    GtkTreeModel *tree_model;
+    GtkTreeIter folder_iter, iter;
+    guint i, signals = 0, rows = 0, emitted_before, emitted, flushes_before,
+          flushes;
+    gboolean available;
+    time_t max_time;
+
+    sort_model = create_sort_model (&folder_iter);
+    tree_model = GTK_TREE_MODEL (sort_model);
+    for (i = 0; i < 1000 && g_main_context_iteration (NULL, FALSE); i++)
+        ;
+
+    _hildon_file_system_model_get_change_counts (sort_model, NULL,
+                                                 &emitted_before,
+                                                 &flushes_before);
+    g_signal_connect (sort_model, "row-changed",
+                      G_CALLBACK (count_row_changed), &signals);
+
+    /* Test 1: Every row changes twice without a signal */
+    if (gtk_tree_model_iter_children (tree_model, &iter, &folder_iter))
+        do
+        {
+            hildon_file_system_model_iter_available (sort_model, &iter, FALSE);
+            gtk_tree_model_get (tree_model, &iter,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE,
+                                &available, -1);
+            fail_if (available, "The row does not show its new value");
+            hildon_file_system_model_iter_available (sort_model, &iter, TRUE);
+            rows++;
+        } while (gtk_tree_model_iter_next (tree_model, &iter));
+    g_assert_cmpuint (rows, ==, 5);
+    g_assert_cmpuint (signals, ==, 0);
+
+    /* Test 2: One signal per row, from one flush */
+    max_time = time (NULL) + 5;
+    while (signals < rows && time (NULL) < max_time)
+    {
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+    g_assert_cmpuint (signals, ==, rows);
+
+    _hildon_file_system_model_get_change_counts (sort_model, NULL, &emitted,
+                                                 &flushes);
+    g_assert_cmpuint (emitted - emitted_before, ==, rows);
+    g_assert_cmpuint (flushes - flushes_before, ==, 1);
+
+    g_object_unref (sort_model);
+    remove_sort_folder ();
+}
+END_TEST
+
+/**
+ * Purpose: Check that the rows of a loaded folder follow it when it is
+ *          renamed
+ * Case 1: The children are found under the new name
+ * Case 2: Nothing is left under the old one
+ */
+START_TEST (test_file_system_model_rename_folder)
+{
+    HildonFileSystemModel *rename_model;
+    GtkTreeIter iter;
+    gchar *folder, *old_path, *new_path, *old_child, *new_child, *local_path;
+    gboolean loaded = FALSE, found = FALSE;
+    time_t max_time;
+
+    folder = g_build_filename (g_getenv ("MYDOCSDIR"), "hildonfmrename",
+                               NULL);
+    old_path = g_build_filename (folder, "old", NULL);
+    new_path = g_build_filename (folder, "new", NULL);
+    old_child = g_build_filename (old_path, "child.txt", NULL);
+    new_child = g_build_filename (new_path, "child.txt", NULL);
+    g_mkdir_with_parents (old_path, 0700);
+    g_file_set_contents (old_child, ".", -1, NULL);
+
+    rename_model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                                 "root-dir", g_getenv ("MYDOCSDIR"),
+                                 NULL);
+    fail_if (!hildon_file_system_model_load_local_path (rename_model,
+                                                        old_path, &iter),
+             "Loading the rename test folder failed");
+
+    max_time = time (NULL) + 5;
+    while (!loaded && time (NULL) < max_time)
+    {
+        gtk_tree_model_get (GTK_TREE_MODEL (rename_model), &iter,
+                            HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &loaded,
+                            -1);
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+    fail_if (!hildon_file_system_model_search_local_path (rename_model,
+                                                          old_child, &iter,
+                                                          NULL, TRUE),
+             "The child of the rename test folder was not loaded");
+
+    g_rename (old_path, new_path);
+
+    /* Test 1: The child is listed again below the new name */
+    max_time = time (NULL) + 5;
+    while (!found && time (NULL) < max_time)
+    {
+        found = hildon_file_system_model_search_local_path (rename_model,
+                                                            new_child, &iter,
+                                                            NULL, TRUE);
+        if (!found && !g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+    fail_if (!found, "The child of a renamed folder was not found");
+    gtk_tree_model_get (GTK_TREE_MODEL (rename_model), &iter,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_LOCAL_PATH,
+                        &local_path, -1);
+    g_assert_cmpstr (local_path, ==, new_child);
+    g_free (local_path);
+
+    /* Test 2: The old path is gone */
+    fail_if (hildon_file_system_model_search_local_path (rename_model,
+                                                         old_child, &iter,
+                                                         NULL, TRUE),
+             "The child is still found below the old name");
+
+    g_object_unref (rename_model);
+    g_remove (new_child);
+    g_remove (old_child);
+    g_rmdir (new_path);
+    g_rmdir (old_path);
+    g_rmdir (folder);
+    g_free (new_child);
+    g_free (old_child);
+    g_free (new_path);
+    g_free (old_path);
+    g_free (folder);
+}
+END_TEST
+
+/**
+ * Purpose: Check that a windowed folder keeps files beyond its window
+ *          out of the rows until they are needed
+ * Case 1: Only the window gets rows
+ * Case 2: Searching for a file without a row gives it one
+ * Case 3: Undoing the window gives every file a row
+ */
+START_TEST (test_file_system_model_window_search)
+{
+    HildonFileSystemModel *window_model;
+    const gchar *names[] = { "a.txt", "b.txt", "c.txt", "d.txt", "e.txt",
+                             NULL };
+    GtkTreeIter folder_iter, iter;
+    gchar *folder, *file;
+    gboolean loaded = FALSE;
+    time_t max_time;
+    gint i;
+
+    folder = g_build_filename (g_getenv ("MYDOCSDIR"), "hildonfmwindow",
+                               NULL);
+    g_mkdir_with_parents (folder, 0700);
+    for (i = 0; names[i]; i++)
+    {
+        file = g_build_filename (folder, names[i], NULL);
+        g_file_set_contents (file, ".", -1, NULL);
+        g_free (file);
+    }
+
+    window_model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                                 "root-dir", g_getenv ("MYDOCSDIR"),
+                                 NULL);
+    _hildon_file_system_model_set_sort (window_model,
+                                        HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_ASCENDING);
+    fail_if (!hildon_file_system_model_load_local_path (window_model, folder,
+                                                        &folder_iter),
+             "Loading the window test folder failed");
+    _hildon_file_system_model_window_children (window_model, &folder_iter,
+                                               2);
+
+    max_time = time (NULL) + 5;
+    while (!loaded && time (NULL) < max_time)
+    {
+        gtk_tree_model_get (GTK_TREE_MODEL (window_model), &folder_iter,
+                            HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &loaded,
+                            -1);
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+    }
+
+    /* Test 1: Two rows */
+    g_assert_cmpint (gtk_tree_model_iter_n_children
+                     (GTK_TREE_MODEL (window_model), &folder_iter), ==, 2);
+
+    /* Test 2: The last file is found among the immediate children */
+    file = g_build_filename (folder, "e.txt", NULL);
+    fail_if (!hildon_file_system_model_search_local_path (window_model, file,
+                                                          &iter, &folder_iter,
+                                                          FALSE),
+             "A file beyond the window was not found");
+    g_free (file);
+    g_assert_cmpint (gtk_tree_model_iter_n_children
+                     (GTK_TREE_MODEL (window_model), &folder_iter), ==, 3);
+
+    /* Test 3: Every file */
+    _hildon_file_system_model_unwindow_children (window_model, &folder_iter);
+    g_assert_cmpint (gtk_tree_model_iter_n_children
+                     (GTK_TREE_MODEL (window_model), &folder_iter), ==, 5);
+
+    _hildon_file_system_model_unset_sort (window_model);
+    g_object_unref (window_model);
+    for (i = 0; names[i]; i++)
+    {
+        file = g_build_filename (folder, names[i], NULL);
+        g_remove (file);
+        g_free (file);
+    }
+    g_rmdir (folder);
+    g_free (folder);
+}
+END_TEST
+
 /**
  * Purpose: Check if getting the type of a upnp device works
  */
@@ -969,6 +1386,24 @@ main (int    argc,
     g_test_add_data_func ("/HildonfmFileSystemModel/autoname_uri_nonexistent_folder",
         (fm_test_func)test_file_system_model_autoname_uri_nonexistent_folder, fm_test_setup);
 
+    /* Create a test case for the order the model keeps by itself */
+    g_test_add_data_func ("/HildonfmFileSystemModel/sort_order",
+        (fm_test_func)test_file_system_model_sort_order, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileSystemModel/unset_sort",
+        (fm_test_func)test_file_system_model_unset_sort, fm_test_setup);
+
+    /* Create a test case for the delayed row-changed signals */
+    g_test_add_data_func ("/HildonfmFileSystemModel/row_changed",
+        (fm_test_func)test_file_system_model_row_changed, fm_test_setup);
+
+    /* Create a test case for renamed folders */
+    g_test_add_data_func ("/HildonfmFileSystemModel/rename_folder",
+        (fm_test_func)test_file_system_model_rename_folder, fm_test_setup);
+
+    /* Create a test case for windowed folders */
+    g_test_add_data_func ("/HildonfmFileSystemModel/window_search",
+        (fm_test_func)test_file_system_model_window_search, fm_test_setup);
+
     /* Create a test case for testing functions not ment for public use */
     g_test_add_data_func ("/HildonfmFileSystemModel/get_file_system",
         (fm_test_func)test_file_system_model_get_file_system, fm_test_setup);
@@ -641,6 +641,27 @@ START_TEST (test_file_system_search_extension)
 }
 END_TEST
 
+/**
+ * Purpose: Check that extension lookups from the compiled extension
+ * table are case insensitive and prefer the longest known extension
+ */
+START_TEST (test_file_system_search_extension_longest)
+{
+    gchar *name = "file:///tmp/archive.TAR.GZ";
+    gchar *res;
+
+    g_assert (_hildon_file_system_is_known_extension (".DEB"));
+
+    res = _hildon_file_system_search_extension (name, true, false);
+    fail_if (res == NULL || strcmp (res, ".TAR.GZ"),
+             "Searching for the longest known extension failed");
+
+    res = _hildon_file_system_search_extension (name + strlen (name) - 2,
+                                                true, false);
+    fail_if (res != NULL, "Extension matched beyond the start of the name");
+}
+END_TEST
+
 /**
  * Purpose: Check if searching a folder's name for an extension works
  * Case 1: It is known that the name being searched is a folder
@@ -667,6 +688,63 @@ START_TEST (test_file_system_search_extension_folder)
 }
 END_TEST
 
+/**
+ * Purpose: Check that sort keys of ASCII names are identical to the
+ * keys GLib generates, so that they sort consistently against
+ * non-ASCII names
+ */
+START_TEST (test_file_system_create_sort_key)
+{
+    const gchar *names[] = {
+        "", "a", "A", "IMG_1234.JPG", "img_0001.jpg", "DSC0001.jpg",
+        "file10", "file2", "file010", "file000", "file0", "00",
+        "a.b.c", ".hidden", "file.", "README", "x:10", "a-b_c d",
+        "a very long file name that does not fit into the stack buffer 1.txt",
+        "\xc3\x84ppel.txt", "Caf\xc3\xa9 2.jpg"
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        gchar *casefold, *expected, *key;
+
+        casefold = g_utf8_casefold (names[i], -1);
+        expected = g_utf8_collate_key_for_filename (casefold, -1);
+        key = _hildon_file_system_create_sort_key (names[i]);
+
+        fail_if (strcmp (key, expected),
+                 "Sort key differs from the GLib one");
+
+        g_free (key);
+        g_free (expected);
+        g_free (casefold);
+    }
+}
+END_TEST
+
+/**
+ * Purpose: Check that sort keys order numbers naturally and ignore case
+ */
+START_TEST (test_file_system_sort_key_order)
+{
+    const gchar *sorted[] = {
+        "file1.txt", "FILE2.txt", "file10.txt", "File100.txt"
+    };
+    guint i;
+
+    for (i = 1; i < G_N_ELEMENTS (sorted); i++)
+    {
+        gchar *a = _hildon_file_system_create_sort_key (sorted[i - 1]);
+        gchar *b = _hildon_file_system_create_sort_key (sorted[i]);
+
+        fail_if (strcmp (a, b) >= 0, "Sort keys are in wrong order");
+
+        g_free (a);
+        g_free (b);
+    }
+}
+END_TEST
+
 /**
  * Purpose: Check if parsing the autonumbers works
  * Case 1: A valid autonumber
@@ -847,8 +925,14 @@ main (int    argc,
         (fm_test_func)test_file_system_is_known_extension, fm_test_setup);
     g_test_add_data_func ("/HildonfmFileSystemPrivate/search_extension",
         (fm_test_func)test_file_system_search_extension, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileSystemPrivate/search_extension_longest",
+        (fm_test_func)test_file_system_search_extension_longest, fm_test_setup);
     g_test_add_data_func ("/HildonfmFileSystemPrivate/search_extension_folder",
         (fm_test_func)test_file_system_search_extension_folder, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileSystemPrivate/create_sort_key",
+        (fm_test_func)test_file_system_create_sort_key, fm_test_setup);
+    g_test_add_data_func ("/HildonfmFileSystemPrivate/sort_key_order",
+        (fm_test_func)test_file_system_sort_key_order, fm_test_setup);
     g_test_add_data_func ("/HildonfmFileSystemPrivate/parse_autonumber",
         (fm_test_func)test_file_system_parse_autonumber, fm_test_setup);
     g_test_add_data_func ("/HildonfmFileSystemPrivate/remove_autonumber",
@@ -10,12 +10,12 @@
 
 #include <string.h>
 #include <hildon/hildon.h>
-#include <libgnomevfs/gnome-vfs.h>
 #include <glib/gstdio.h>
 
 #include "hildon-file-system-model.h"
 #include "hildon-file-selection.h"
 #include "hildon-file-common-private.h"
+#include "hildon-file-system-private.h"
 
 static void
 recurse_folder (const gchar *parent,
@@ -109,7 +109,7 @@ performance_file_system_model (void)
 
     uri = hildon_file_selection_get_current_folder_uri (selection);
     g_assert_cmpstr (uri, ==, NULL);
-    start = (gchar *)_hildon_file_selection_get_current_folder_path (selection);
+    start = g_filename_to_uri (g_getenv ("MYDOCSDIR"), NULL, NULL);
 
     for (i = 0; i < G_N_ELEMENTS (folders); i++)
     {
@@ -130,6 +130,33 @@ performance_file_system_model (void)
 
 GtkWidget *
 _hildon_file_selection_get_scroll_thumb (HildonFileSelection *self);
+void
+_hildon_file_selection_set_grid (HildonFileSelection *self, gboolean grid);
+
+static void
+scroll_thumbnails (HildonFileSelection *selection, const gchar *what)
+{
+  GtkWidget *pannable;
+  GtkAdjustment *hadj;
+  GtkAdjustment *vadj;
+  guint i;
+  gdouble elapsed;
+
+  pannable = _hildon_file_selection_get_scroll_thumb (selection);
+  gtk_widget_show (pannable);
+  hadj = hildon_pannable_area_get_hadjustment (HILDON_PANNABLE_AREA (pannable));
+  vadj = hildon_pannable_area_get_vadjustment (HILDON_PANNABLE_AREA (pannable));
+  g_print ("\nlower: %f/%f, upper: %f/%f\n", hadj->lower, vadj->lower, hadj->upper, vadj->upper);
+  elapsed = 0;
+  for (i = 0; i < 1000; i++)
+    {
+      g_test_timer_start ();
+      hildon_pannable_area_scroll_to (HILDON_PANNABLE_AREA (pannable), hadj->lower, vadj->lower);
+      hildon_pannable_area_scroll_to (HILDON_PANNABLE_AREA (pannable), hadj->upper - 1, vadj->upper - 1);
+      elapsed += g_test_timer_elapsed ();
+    }
+  g_print ("%s: %f (%f)\n", what, elapsed / i, elapsed);
+}
 
 static void
 performance_file_selection (void)
@@ -138,10 +165,6 @@ performance_file_selection (void)
   GtkWidget *file_selection;
   GtkWidget *window;
   gchar *folder;
-  GtkWidget *pannable;
-  GtkAdjustment *hadj;
-  GtkAdjustment *vadj;
-  guint i;
   gdouble elapsed;
 
   g_test_timer_start ();
@@ -160,36 +183,606 @@ performance_file_selection (void)
   hildon_file_selection_set_current_folder_uri (HILDON_FILE_SELECTION (file_selection),
                                                 folder, NULL);
   g_free (folder);
-  pannable = _hildon_file_selection_get_scroll_thumb (HILDON_FILE_SELECTION (file_selection));
-  gtk_widget_show (pannable);
-  hadj = hildon_pannable_area_get_hadjustment (HILDON_PANNABLE_AREA (pannable));
-  vadj = hildon_pannable_area_get_vadjustment (HILDON_PANNABLE_AREA (pannable));
-  g_print ("\nlower: %f/%f, upper: %f/%f\n", hadj->lower, vadj->lower, hadj->upper, vadj->upper);
-  elapsed = 0;
-  for (i = 0; i < 1000; i++)
+  scroll_thumbnails (HILDON_FILE_SELECTION (file_selection), "scrolling");
+
+  hildon_file_selection_set_mode (HILDON_FILE_SELECTION (file_selection),
+                                  HILDON_FILE_SELECTION_MODE_THUMBNAILS);
+  _hildon_file_selection_set_grid (HILDON_FILE_SELECTION (file_selection), TRUE);
+  scroll_thumbnails (HILDON_FILE_SELECTION (file_selection), "scrolling the grid");
+  gtk_widget_destroy (window);
+}
+
+static void
+performance_sort_key (void)
+{
+    const gchar *names[] = {
+        "IMG_1234.JPG", "DSC0001.jpg", "holiday photos 2009", "README",
+        "track 07 - some artist.mp3", "Document (2).odt"
+    };
+    gdouble elapsed;
+    guint i;
+
+    g_test_timer_start ();
+    for (i = 0; i < 100000; i++)
     {
-      g_test_timer_start ();
-      hildon_pannable_area_scroll_to (HILDON_PANNABLE_AREA (pannable), hadj->lower, vadj->lower);
-      hildon_pannable_area_scroll_to (HILDON_PANNABLE_AREA (pannable), hadj->upper - 1, vadj->upper - 1);
-      elapsed += g_test_timer_elapsed ();
+        gchar *casefold = g_utf8_casefold (names[i % G_N_ELEMENTS (names)], -1);
+        g_free (g_utf8_collate_key_for_filename (casefold, -1));
+        g_free (casefold);
     }
-  g_print ("scrolling: %f (%f)\n", elapsed / i, elapsed);
-  gtk_widget_destroy (window);
+    elapsed = g_test_timer_elapsed ();
+    g_print ("\n%f keys per second with GLib\n", i / elapsed);
+
+    g_test_timer_start ();
+    for (i = 0; i < 100000; i++)
+        g_free (_hildon_file_system_create_sort_key (names[i % G_N_ELEMENTS (names)]));
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f keys per second with the ASCII fast path\n", i / elapsed);
+}
+
+static void
+performance_peek_row (void)
+{
+    HildonFileSystemModel *model;
+    GtkTreeModel *tree_model;
+    GtkTreeIter folder_iter, iter;
+    gdouble elapsed;
+    gchar *folder;
+    HildonFileSystemModelRow row;
+    gint weight, type;
+    gboolean is_folder, local, available;
+    gchar *sort_key, *mime_type;
+    guint i, rows;
+
+    folder = g_build_path (G_DIR_SEPARATOR_S, g_getenv ("MYDOCSDIR"), "hildonfmflat", NULL);
+    g_mkdir_with_parents (folder, 0700);
+    for (i = 0; i < 1000; i++)
+    {
+        gchar *file_name = g_strdup_printf ("file%04d.txt", i);
+        gchar *file = g_build_filename (folder, file_name, NULL);
+
+        g_file_set_contents (file, ".", -1, NULL);
+        g_free (file_name);
+        g_free (file);
+    }
+
+    model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                          "root-dir", g_getenv ("MYDOCSDIR"), NULL);
+    tree_model = GTK_TREE_MODEL (model);
+    g_assert (hildon_file_system_model_load_local_path (model, folder,
+                                                        &folder_iter));
+    while (gtk_events_pending ())
+        gtk_main_iteration ();
+    g_free (folder);
+
+    rows = 0;
+    g_test_timer_start ();
+    for (i = 0; i < 100; i++)
+    {
+        if (!gtk_tree_model_iter_children (tree_model, &iter, &folder_iter))
+            break;
+        do
+        {
+            gtk_tree_model_get (tree_model, &iter,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER, &is_folder,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH, &local,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE, &available,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_TYPE, &type,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT, &weight,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY, &sort_key,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_MIME_TYPE, &mime_type,
+                                -1);
+            g_free (sort_key);
+            g_free (mime_type);
+            rows++;
+        } while (gtk_tree_model_iter_next (tree_model, &iter));
+    }
+    elapsed = g_test_timer_elapsed ();
+    g_print ("\n%f rows per second through the columns\n", rows / elapsed);
+
+    rows = 0;
+    g_test_timer_start ();
+    for (i = 0; i < 100; i++)
+    {
+        if (!gtk_tree_model_iter_children (tree_model, &iter, &folder_iter))
+            break;
+        do
+        {
+            _hildon_file_system_model_peek_row (model, &iter, &row);
+            weight = ROW_FLAGS_SORT_WEIGHT (row.flags);
+            type = ROW_FLAGS_TYPE (row.flags);
+            rows++;
+        } while (gtk_tree_model_iter_next (tree_model, &iter));
+    }
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f rows per second through peek_row\n", rows / elapsed);
+
+    g_object_unref (model);
+}
+
+/* The model sorted by the comparison functions below */
+static HildonFileSystemModel *sort_model = NULL;
+
+/* What the content pane sort did before the row flags: every value
+   is read through the model columns */
+static gint
+compare_by_columns (gconstpointer a,
+                    gconstpointer b)
+{
+    GtkTreeIter *iter_a = (GtkTreeIter *) a, *iter_b = (GtkTreeIter *) b;
+    gint weight_a, weight_b, result;
+    gchar *key_a, *key_b;
+
+    gtk_tree_model_get (GTK_TREE_MODEL (sort_model), iter_a,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT, &weight_a,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY, &key_a,
+                        -1);
+    gtk_tree_model_get (GTK_TREE_MODEL (sort_model), iter_b,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_WEIGHT, &weight_b,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_SORT_KEY, &key_b,
+                        -1);
+    result = weight_a != weight_b ? weight_a - weight_b
+                                  : g_strcmp0 (key_a, key_b);
+    g_free (key_a);
+    g_free (key_b);
+
+    return result;
+}
+
+static gint
+compare_by_rows (gconstpointer a,
+                 gconstpointer b)
+{
+    HildonFileSystemModelRow row_a, row_b;
+
+    _hildon_file_system_model_peek_row (sort_model, (GtkTreeIter *) a, &row_a);
+    _hildon_file_system_model_peek_row (sort_model, (GtkTreeIter *) b, &row_b);
+
+    return _hildon_file_system_model_compare_rows (&row_a, &row_b,
+                                                   HILDON_FILE_SELECTION_SORT_NAME,
+                                                   GTK_SORT_ASCENDING);
+}
+
+static void
+performance_sort_filter (void)
+{
+    GtkTreeModel *tree_model;
+    GtkTreeIter folder_iter, iter;
+    GArray *iters;
+    gdouble elapsed;
+    gchar *folder;
+    gboolean loaded = FALSE;
+    guint i, j, visible;
+
+    folder = g_build_path (G_DIR_SEPARATOR_S, g_getenv ("MYDOCSDIR"), "hildonfmsortfilter", NULL);
+    g_mkdir_with_parents (folder, 0700);
+    for (i = 0; i < 5000; i++)
+    {
+        gchar *file_name = g_strdup_printf ("IMG_%04d.JPG", (i * 7919) % 5000);
+        gchar *file = g_build_filename (folder, file_name, NULL);
+
+        g_file_set_contents (file, ".", -1, NULL);
+        g_free (file_name);
+        g_free (file);
+    }
+
+    sort_model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                               "root-dir", g_getenv ("MYDOCSDIR"), NULL);
+    tree_model = GTK_TREE_MODEL (sort_model);
+    g_assert (hildon_file_system_model_load_local_path (sort_model, folder,
+                                                        &folder_iter));
+    while (!loaded)
+    {
+        if (!g_main_context_iteration (NULL, FALSE))
+            g_usleep (1000);
+        gtk_tree_model_get (tree_model, &folder_iter,
+                            HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &loaded,
+                            -1);
+    }
+    g_free (folder);
+
+    iters = g_array_new (FALSE, FALSE, sizeof (GtkTreeIter));
+    if (gtk_tree_model_iter_children (tree_model, &iter, &folder_iter))
+        do
+            g_array_append_val (iters, iter);
+        while (gtk_tree_model_iter_next (tree_model, &iter));
+    g_assert_cmpuint (iters->len, ==, 5000);
+
+    g_print ("\n");
+
+    /* Sort: every pass starts from the order of the folder */
+    g_test_timer_start ();
+    for (i = 0; i < 10; i++)
+    {
+        GArray *copy = g_array_sized_new (FALSE, FALSE, sizeof (GtkTreeIter),
+                                          iters->len);
+
+        g_array_append_vals (copy, iters->data, iters->len);
+        g_array_sort (copy, compare_by_columns);
+        g_array_free (copy, TRUE);
+    }
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f rows sorted per second through the columns\n",
+             i * iters->len / elapsed);
+
+    g_test_timer_start ();
+    for (i = 0; i < 10; i++)
+    {
+        GArray *copy = g_array_sized_new (FALSE, FALSE, sizeof (GtkTreeIter),
+                                          iters->len);
+
+        g_array_append_vals (copy, iters->data, iters->len);
+        g_array_sort (copy, compare_by_rows);
+        g_array_free (copy, TRUE);
+    }
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f rows sorted per second through the row flags\n",
+             i * iters->len / elapsed);
+
+    /* Filter: the checks of the content pane for files */
+    visible = 0;
+    g_test_timer_start ();
+    for (i = 0; i < 100; i++)
+        for (j = 0; j < iters->len; j++)
+        {
+            gboolean is_folder, local, available;
+
+            gtk_tree_model_get (tree_model,
+                                &g_array_index (iters, GtkTreeIter, j),
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_FOLDER, &is_folder,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_HAS_LOCAL_PATH, &local,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_IS_AVAILABLE, &available,
+                                -1);
+            if (!is_folder && local && available)
+                visible++;
+        }
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f rows filtered per second through the columns\n",
+             i * iters->len / elapsed);
+    g_assert_cmpuint (visible, ==, i * iters->len);
+
+    visible = 0;
+    g_test_timer_start ();
+    for (i = 0; i < 100; i++)
+        for (j = 0; j < iters->len; j++)
+        {
+            guint32 flags = _hildon_file_system_model_peek_row_flags
+              (sort_model, &g_array_index (iters, GtkTreeIter, j), NULL);
+
+            if ((flags & (ROW_FLAG_IS_FOLDER | ROW_FLAG_HAS_LOCAL_PATH
+                          | ROW_FLAG_IS_AVAILABLE))
+                == (ROW_FLAG_HAS_LOCAL_PATH | ROW_FLAG_IS_AVAILABLE))
+                visible++;
+        }
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f rows filtered per second through the row flags\n",
+             i * iters->len / elapsed);
+    g_assert_cmpuint (visible, ==, i * iters->len);
+
+    g_array_free (iters, TRUE);
+    g_object_unref (sort_model);
+    sort_model = NULL;
+}
+
+/* Loads FOLDER, keeping all but WINDOW_SIZE of its files as records
+   if WINDOW_SIZE is not 0 */
+static void
+load_huge_folder (HildonFileSystemModel *model,
+                  const gchar           *folder,
+                  GtkTreeIter           *folder_iter,
+                  guint                  window_size)
+{
+    g_assert (hildon_file_system_model_load_local_path (model, folder,
+                                                        folder_iter));
+    if (window_size > 0)
+        _hildon_file_system_model_window_children (model, folder_iter,
+                                                   window_size);
+    while (gtk_events_pending ())
+        gtk_main_iteration ();
+}
+
+static void
+performance_windowed_folder (void)
+{
+    HildonFileSystemModel *model;
+    GtkTreeModel *tree_model;
+    GtkTreeIter folder_iter;
+    gdouble elapsed;
+    gchar *folder;
+    guint i;
+
+    folder = g_build_path (G_DIR_SEPARATOR_S, g_getenv ("MYDOCSDIR"), "hildonfmhuge", NULL);
+    g_mkdir_with_parents (folder, 0700);
+    for (i = 0; i < 20000; i++)
+    {
+        gchar *file_name = g_strdup_printf ("file%05d.txt", (i * 7919) % 20000);
+        gchar *file = g_build_filename (folder, file_name, NULL);
+
+        g_file_set_contents (file, ".", -1, NULL);
+        g_free (file_name);
+        g_free (file);
+    }
+
+    model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                          "root-dir", g_getenv ("MYDOCSDIR"), NULL);
+    tree_model = GTK_TREE_MODEL (model);
+    _hildon_file_system_model_set_sort (model, HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_ASCENDING);
+    g_test_timer_start ();
+    load_huge_folder (model, folder, &folder_iter, 0);
+    elapsed = g_test_timer_elapsed ();
+    g_print ("\n%f seconds to load 20000 files with a row for each\n", elapsed);
+    g_assert_cmpint (gtk_tree_model_iter_n_children (tree_model, &folder_iter), ==, 20000);
+    g_object_unref (model);
+
+    model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                          "root-dir", g_getenv ("MYDOCSDIR"), NULL);
+    tree_model = GTK_TREE_MODEL (model);
+    _hildon_file_system_model_set_sort (model, HILDON_FILE_SELECTION_SORT_NAME,
+                                        GTK_SORT_ASCENDING);
+    g_test_timer_start ();
+    load_huge_folder (model, folder, &folder_iter, 200);
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f seconds to load 20000 files with 200 rows\n", elapsed);
+    g_assert_cmpint (gtk_tree_model_iter_n_children (tree_model, &folder_iter), ==, 200);
+
+    g_test_timer_start ();
+    while (_hildon_file_system_model_grow_children (model, &folder_iter, 100))
+        ;
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f seconds to grow it to every file\n", elapsed);
+    g_assert_cmpint (gtk_tree_model_iter_n_children (tree_model, &folder_iter), ==, 20000);
+
+    g_free (folder);
+    g_object_unref (model);
+}
+
+static gboolean
+row_is_loaded (GtkTreeModel *tree_model,
+               GtkTreeIter  *iter)
+{
+    gboolean loaded;
+
+    gtk_tree_model_get (tree_model, iter,
+                        HILDON_FILE_SYSTEM_MODEL_COLUMN_LOAD_READY, &loaded,
+                        -1);
+    return loaded;
+}
+
+static void
+performance_load_limit (void)
+{
+    static const guint limits[] = { 0, 1, 3, 8 };
+    gchar *folder;
+    guint i, j;
+
+    folder = g_build_path (G_DIR_SEPARATOR_S, g_getenv ("MYDOCSDIR"), "hildonfmwide", NULL);
+    for (i = 0; i < 200; i++)
+    {
+        gchar *subfolder_name = g_strdup_printf ("folder%03d", i);
+        gchar *subfolder = g_build_filename (folder, subfolder_name, NULL);
+
+        g_mkdir_with_parents (subfolder, 0700);
+        for (j = 0; j < 20; j++)
+        {
+            gchar *file_name = g_strdup_printf ("file%02d.txt", j);
+            gchar *file = g_build_filename (subfolder, file_name, NULL);
+
+            g_file_set_contents (file, ".", -1, NULL);
+            g_free (file_name);
+            g_free (file);
+        }
+        g_free (subfolder_name);
+        g_free (subfolder);
+    }
+
+    g_print ("\n");
+    for (i = 0; i < G_N_ELEMENTS (limits); i++)
+    {
+        HildonFileSystemModel *model;
+        GtkTreeModel *tree_model;
+        GtkTreeIter folder_iter, iter, last;
+        gdouble opened, total;
+
+        model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL,
+                              "root-dir", g_getenv ("MYDOCSDIR"), NULL);
+        tree_model = GTK_TREE_MODEL (model);
+        _hildon_file_system_model_set_max_device_loads (model, limits[i]);
+        load_huge_folder (model, folder, &folder_iter, 0);
+        g_assert_cmpint (gtk_tree_model_iter_n_children (tree_model, &folder_iter), ==, 200);
+
+        /* Showing the rows loads every subfolder, then the user opens
+           the last one */
+        g_test_timer_start ();
+        gtk_tree_model_iter_children (tree_model, &iter, &folder_iter);
+        do
+        {
+            gchar *name;
+
+            gtk_tree_model_get (tree_model, &iter,
+                                HILDON_FILE_SYSTEM_MODEL_COLUMN_DISPLAY_NAME, &name,
+                                -1);
+            g_free (name);
+            last = iter;
+        } while (gtk_tree_model_iter_next (tree_model, &iter));
+
+        _hildon_file_system_model_prioritize_folder (model, &last);
+        _hildon_file_system_model_queue_reload (model, &last, FALSE);
+        while (!row_is_loaded (tree_model, &last))
+            gtk_main_iteration ();
+        opened = g_test_timer_elapsed ();
+
+        gtk_tree_model_iter_children (tree_model, &iter, &folder_iter);
+        do
+        {
+            while (!row_is_loaded (tree_model, &iter))
+                gtk_main_iteration ();
+        } while (gtk_tree_model_iter_next (tree_model, &iter));
+        total = g_test_timer_elapsed ();
+
+        if (limits[i] == 0)
+            g_print ("no limit: ");
+        else
+            g_print ("%u per device: ", limits[i]);
+        g_print ("%f seconds to the opened folder, %f seconds to all 200\n",
+                 opened, total);
+
+        g_object_unref (model);
+    }
+
+    g_free (folder);
+}
+
+static guint
+brute_force_search (GFile       *folder,
+                    const gchar *needle)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    guint matches = 0;
+
+    enumerator = g_file_enumerate_children (folder,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                            G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            NULL, NULL);
+    if (!enumerator)
+        return 0;
+
+    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)))
+    {
+        const gchar *name = g_file_info_get_name (info);
+        gchar *display_name = g_filename_display_name (name);
+        gchar *normalized = hildon_helper_normalize_string (display_name);
+
+        if (hildon_helper_smart_match (normalized, needle))
+            matches++;
+        if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+        {
+            GFile *child = g_file_get_child (folder, name);
+            matches += brute_force_search (child, needle);
+            g_object_unref (child);
+        }
+
+        g_free (normalized);
+        g_free (display_name);
+        g_object_unref (info);
+    }
+    g_object_unref (enumerator);
+
+    return matches;
+}
+
+static void
+search_ready (GObject      *source,
+              GAsyncResult *result,
+              gpointer      data)
+{
+    gchar ***uris = data;
+
+    *uris = hildon_file_system_model_search_finish (HILDON_FILE_SYSTEM_MODEL (source),
+                                                    result, NULL);
+}
+
+static guint
+index_search (HildonFileSystemModel *model,
+              const gchar           *text)
+{
+    gchar **uris = NULL;
+    guint matches;
+
+    hildon_file_system_model_search_async (model, text, NULL, search_ready, &uris);
+    while (!uris)
+        gtk_main_iteration ();
+
+    matches = g_strv_length (uris);
+    g_strfreev (uris);
+
+    return matches;
+}
+
+static void
+performance_name_index (void)
+{
+    HildonFileSystemModel *model;
+    GFile *file;
+    gdouble elapsed;
+    gchar *root;
+    guint i, j, k, matches;
+
+    root = g_build_path (G_DIR_SEPARATOR_S, g_getenv ("MYDOCSDIR"), "hildonfmindex", NULL);
+    for (i = 0; i < 100; i++)
+        for (j = 0; j < 10; j++)
+        {
+            gchar *folder = g_strdup_printf ("%s/dir%02d/sub%d", root, i, j);
+
+            g_mkdir_with_parents (folder, 0700);
+            for (k = 0; k < 100; k++)
+            {
+                gchar *file_name = g_strdup_printf ("%s/photo %02d-%d-%03d.jpg",
+                                                    folder, i, j, k);
+                if (!g_file_test (file_name, G_FILE_TEST_EXISTS))
+                    g_file_set_contents (file_name, ".", -1, NULL);
+                g_free (file_name);
+            }
+            g_free (folder);
+        }
+
+    file = g_file_new_for_path (root);
+    g_test_timer_start ();
+    matches = brute_force_search (file, "042");
+    elapsed = g_test_timer_elapsed ();
+    g_print ("\n%f seconds for a recursive enumeration, %u matches\n", elapsed, matches);
+    g_object_unref (file);
+
+    model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL, "root-dir", root, NULL);
+    g_test_timer_start ();
+    matches = index_search (model, "042");
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f seconds for the first search, %u matches\n", elapsed, matches);
+
+    g_test_timer_start ();
+    matches = index_search (model, "043");
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f seconds for a search in the index, %u matches\n", elapsed, matches);
+    g_object_unref (model);
+
+    /* The index is read back from disk */
+    model = g_object_new (HILDON_TYPE_FILE_SYSTEM_MODEL, "root-dir", root, NULL);
+    g_test_timer_start ();
+    matches = index_search (model, "044");
+    elapsed = g_test_timer_elapsed ();
+    g_print ("%f seconds for a search in a saved index, %u matches\n", elapsed, matches);
+    g_object_unref (model);
+
+    g_free (root);
 }
 
 int
 main (int    argc,
       char** argv)
 {
+#if !GLIB_CHECK_VERSION(2,32,0)
     if (!g_thread_supported ())
         g_thread_init (NULL);
-    g_assert (gnome_vfs_init ());
+#endif
     gtk_test_init (&argc, &argv, NULL);
 
     g_test_add_func ("/performance/file-system-model",
                      performance_file_system_model);
     g_test_add_func ("/performance/file-selection",
                      performance_file_selection);
+    g_test_add_func ("/performance/sort-key",
+                     performance_sort_key);
+    g_test_add_func ("/performance/peek-row",
+                     performance_peek_row);
+    g_test_add_func ("/performance/sort-filter",
+                     performance_sort_filter);
+    g_test_add_func ("/performance/name-index",
+                     performance_name_index);
+    g_test_add_func ("/performance/windowed-folder",
+                     performance_windowed_folder);
+    g_test_add_func ("/performance/load-limit",
+                     performance_load_limit);
 
     return g_test_run ();
 }